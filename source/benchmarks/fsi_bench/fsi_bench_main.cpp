@@ -0,0 +1,548 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+// Throughput/latency benchmark for Reader::read, Writer::write, Reader::readRect and
+// proc::generateThumbnail. Run with --help for the options. Results are printed as JSON so they can
+// be stored and compared between releases.
+
+#include "../../modules/core/Depth.hpp"
+#include "../../modules/core/Exception.h"
+#include "../../modules/core/ImageBuffer.h"
+#include "../../modules/core/Reader.h"
+#include "../../modules/core/Writer.h"
+#include "../../modules/core/Timer.h"
+#include "../../modules/core/proc.h"
+#include "../../modules/version.hpp"
+#include "../../modules/global.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <filesystem>
+#include <limits>
+
+#if defined(__unix__) || defined(__APPLE__)
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+enum class CacheMode
+{
+	None, // The cache state doesn't apply (e.g. writes or in-memory work)
+	Warm,
+	Cold,
+};
+
+struct Config
+{
+	std::filesystem::path dir = "fsi_bench_data";
+	std::filesystem::path out;
+	std::vector<uint32_t> sizes = { 512, 2048 };
+	std::vector<uint32_t> channels = { 1, 3, 4 };
+	std::vector<fsi::Depth> depths = {
+		fsi::Depth::Int8, fsi::Depth::Int16, fsi::Depth::Int32, fsi::Depth::Int64,
+		fsi::Depth::Uint8, fsi::Depth::Uint16, fsi::Depth::Uint32, fsi::Depth::Uint64,
+		fsi::Depth::Float32, fsi::Depth::Float64 };
+	uint32_t iterations = 3;
+	uint32_t rectSamples = 32;
+	uint32_t tileSize = 256;
+	uint64_t maxImageBytes = 1024ull*1024ull*1024ull;
+	bool warm = true;
+	bool cold = true;
+};
+
+struct Result
+{
+	std::string op;
+	CacheMode cache = CacheMode::None;
+	fsi::Depth depth = fsi::Depth::Invalid;
+	uint32_t channels = 0;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	uint64_t bytes = 0; // Bytes moved by all the samples
+	std::vector<uint64_t> latenciesUs;
+};
+
+const char* cacheModeName(CacheMode mode)
+{
+	switch (mode)
+	{
+	case CacheMode::Warm: return "warm";
+	case CacheMode::Cold: return "cold";
+	case CacheMode::None:
+	default: return "none";
+	}
+}
+
+// Evicts the file from the page cache. Returns false if it isn't supported on this platform.
+bool dropFileCache(const std::filesystem::path& path)
+{
+#if (defined(__unix__) || defined(__APPLE__)) && defined(POSIX_FADV_DONTNEED)
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	// Dirty pages can't be dropped
+	::fdatasync(fd);
+	const bool dropped = ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+	::close(fd);
+	return dropped;
+#else
+	(void)path;
+	return false;
+#endif
+}
+
+bool coldCacheSupported()
+{
+#if (defined(__unix__) || defined(__APPLE__)) && defined(POSIX_FADV_DONTNEED)
+	return true;
+#else
+	return false;
+#endif
+}
+
+template <typename T>
+void fillSynthetic(uint8_t* data, uint32_t width, uint32_t height, uint32_t channels)
+{
+	// Gradients plus noise, so the thumbnail kernel and the disk don't see constant data
+	T* ptr = reinterpret_cast<T*>(data);
+	std::mt19937_64 rng(width * 31 + height * 17 + channels);
+
+	const double lowest = std::numeric_limits<T>::is_integer
+		? static_cast<double>(std::numeric_limits<T>::lowest()) : 0.0;
+	const double range = std::numeric_limits<T>::is_integer
+		? static_cast<double>(std::numeric_limits<T>::max()) - lowest : 1.0;
+
+	for (uint64_t y = 0; y < height; y++)
+	{
+		for (uint64_t x = 0; x < width; x++)
+		{
+			for (uint64_t c = 0; c < channels; c++)
+			{
+				const double gradient = (c % 2 == 0)
+					? static_cast<double>(x) / width
+					: static_cast<double>(y) / height;
+				const double noise = static_cast<double>(rng() % 1024) / 1024.0 * 0.1;
+				const double value = std::min(gradient * 0.9 + noise, 1.0);
+				ptr[(y*width + x)*channels + c] = static_cast<T>(lowest + value * range);
+			}
+		}
+	}
+}
+
+void fillSynthetic(fsi::ImageBuffer& image)
+{
+	uint8_t* data = image.data();
+	const uint32_t w = image.width();
+	const uint32_t h = image.height();
+	const uint32_t c = image.channels();
+
+	switch (image.depth())
+	{
+	case fsi::Depth::Int8: fillSynthetic<int8_t>(data, w, h, c); break;
+	case fsi::Depth::Int16: fillSynthetic<int16_t>(data, w, h, c); break;
+	case fsi::Depth::Int32: fillSynthetic<int32_t>(data, w, h, c); break;
+	case fsi::Depth::Int64: fillSynthetic<int64_t>(data, w, h, c); break;
+	case fsi::Depth::Uint8: fillSynthetic<uint8_t>(data, w, h, c); break;
+	case fsi::Depth::Uint16: fillSynthetic<uint16_t>(data, w, h, c); break;
+	case fsi::Depth::Uint32: fillSynthetic<uint32_t>(data, w, h, c); break;
+	case fsi::Depth::Uint64: fillSynthetic<uint64_t>(data, w, h, c); break;
+	case fsi::Depth::Float32: fillSynthetic<float>(data, w, h, c); break;
+	case fsi::Depth::Float64: fillSynthetic<double>(data, w, h, c); break;
+	default: break;
+	}
+}
+
+uint64_t percentile(std::vector<uint64_t> sorted, double p)
+{
+	if (sorted.empty())
+		return 0;
+
+	const size_t index = static_cast<size_t>(p * static_cast<double>(sorted.size() - 1) + 0.5);
+	return sorted[std::min(index, sorted.size() - 1)];
+}
+
+std::string toJson(const Result& result)
+{
+	std::vector<uint64_t> sorted = result.latenciesUs;
+	std::sort(sorted.begin(), sorted.end());
+
+	uint64_t totalUs = 0;
+	for (uint64_t latency : sorted)
+		totalUs += latency;
+
+	const double mbps = totalUs > 0
+		? (static_cast<double>(result.bytes) / (1024.0*1024.0)) / (static_cast<double>(totalUs) / 1e6)
+		: 0.0;
+
+	std::ostringstream json;
+	json << "{\"op\": \"" << result.op << "\""
+		<< ", \"cache\": \"" << cacheModeName(result.cache) << "\""
+		<< ", \"depth\": \"" << result.depth << "\""
+		<< ", \"channels\": " << result.channels
+		<< ", \"width\": " << result.width
+		<< ", \"height\": " << result.height
+		<< ", \"samples\": " << sorted.size()
+		<< ", \"bytes\": " << result.bytes
+		<< ", \"mb_per_s\": " << mbps
+		<< ", \"latency_us\": {"
+		<< "\"min\": " << (sorted.empty() ? 0 : sorted.front())
+		<< ", \"p50\": " << percentile(sorted, 0.50)
+		<< ", \"p90\": " << percentile(sorted, 0.90)
+		<< ", \"p99\": " << percentile(sorted, 0.99)
+		<< ", \"max\": " << (sorted.empty() ? 0 : sorted.back())
+		<< "}}";
+
+	return json.str();
+}
+
+struct Rect
+{
+	uint32_t x;
+	uint32_t y;
+	uint32_t width;
+	uint32_t height;
+};
+
+// Access patterns of readRect: square tiles, full-height columns and full-width row bands
+std::vector<Rect> makeRects(const std::string& pattern, const fsi::Header& header, const Config& config)
+{
+	std::mt19937 rng(1234);
+	std::vector<Rect> rects;
+
+	const uint32_t tile = std::min({ config.tileSize, header.width, header.height });
+
+	for (uint32_t i = 0; i < config.rectSamples; i++)
+	{
+		Rect rect;
+		if (pattern == "tiles")
+		{
+			rect.width = tile;
+			rect.height = tile;
+			rect.x = rng() % (header.width - tile + 1);
+			rect.y = rng() % (header.height - tile + 1);
+		}
+		else if (pattern == "columns")
+		{
+			rect.width = std::min(64u, header.width);
+			rect.height = header.height;
+			rect.x = rng() % (header.width - rect.width + 1);
+			rect.y = 0;
+		}
+		else // rows
+		{
+			rect.width = header.width;
+			rect.height = std::min(64u, header.height);
+			rect.x = 0;
+			rect.y = rng() % (header.height - rect.height + 1);
+		}
+		rects.push_back(rect);
+	}
+
+	return rects;
+}
+
+void benchmarkImage(const Config& config, uint32_t size, uint32_t channels, fsi::Depth depth,
+	std::vector<Result>& results)
+{
+	const std::filesystem::path path = config.dir / "bench.fsi";
+
+	fsi::ImageBuffer image(size, size, channels, depth);
+	fillSynthetic(image);
+
+	const fsi::Header header = image.header();
+	const uint64_t bytesPerPixel = static_cast<uint64_t>(channels) * fsi::sizeOfDepth(depth);
+
+	auto newResult = [&](const std::string& op, CacheMode cache)
+	{
+		Result result;
+		result.op = op;
+		result.cache = cache;
+		result.depth = depth;
+		result.channels = channels;
+		result.width = size;
+		result.height = size;
+		return result;
+	};
+
+	fsi::Timer timer;
+
+	// --- write ---
+	{
+		Result result = newResult("write", CacheMode::None);
+		for (uint32_t i = 0; i < config.iterations; i++)
+		{
+			fsi::Header writeHeader = header;
+			writeHeader.hasThumb = true;
+
+			timer.start();
+			fsi::Writer writer(fsi::FormatVersion::V2);
+			writer.open(path, writeHeader);
+			writer.write(image.data());
+			writer.close();
+			result.latenciesUs.push_back(timer.elapsedUs());
+			result.bytes += image.size();
+		}
+		results.push_back(result);
+	}
+
+	std::vector<CacheMode> cacheModes;
+	if (config.warm)
+		cacheModes.push_back(CacheMode::Warm);
+	if (config.cold)
+		cacheModes.push_back(CacheMode::Cold);
+
+	fsi::ImageBuffer readImage(header);
+
+	for (CacheMode cache : cacheModes)
+	{
+		// --- read ---
+		{
+			Result result = newResult("read", cache);
+
+			// Warm up the cache with a first read that isn't measured
+			if (cache == CacheMode::Warm)
+			{
+				fsi::Reader reader;
+				reader.open(path);
+				reader.read(readImage.data());
+			}
+
+			for (uint32_t i = 0; i < config.iterations; i++)
+			{
+				if (cache == CacheMode::Cold)
+					dropFileCache(path);
+
+				timer.start();
+				fsi::Reader reader;
+				reader.open(path);
+				reader.read(readImage.data());
+				result.latenciesUs.push_back(timer.elapsedUs());
+				result.bytes += readImage.size();
+			}
+			results.push_back(result);
+		}
+
+		// --- readRect ---
+		for (const std::string pattern : { "tiles", "columns", "rows" })
+		{
+			Result result = newResult("readRect_" + pattern, cache);
+			const std::vector<Rect> rects = makeRects(pattern, header, config);
+
+			fsi::Reader reader;
+			reader.open(path);
+
+			for (const Rect& rect : rects)
+			{
+				if (cache == CacheMode::Cold)
+					dropFileCache(path);
+
+				timer.start();
+				reader.readRect(readImage.data(), rect.x, rect.y, rect.width, rect.height);
+				result.latenciesUs.push_back(timer.elapsedUs());
+				result.bytes += static_cast<uint64_t>(rect.width) * rect.height * bytesPerPixel;
+			}
+			results.push_back(result);
+		}
+	}
+
+	// --- generateThumbnail (in memory) ---
+	{
+		fsi::Reader reader;
+		reader.open(path);
+		const fsi::Header thumbHeader = reader.header();
+		reader.close();
+
+		std::vector<uint8_t> thumb(fsi::thumbSizeInBytes);
+
+		Result result = newResult("generateThumbnail", CacheMode::None);
+		for (uint32_t i = 0; i < config.iterations; i++)
+		{
+			timer.start();
+			fsi::proc::generateThumbnail(image.data(), size, size, channels, depth,
+				static_cast<uint64_t>(size) * channels, thumb.data(), thumbHeader.thumbWidth * fsi::thumbChannels,
+				thumbHeader.thumbWidth, thumbHeader.thumbHeight);
+			result.latenciesUs.push_back(timer.elapsedUs());
+			result.bytes += image.size();
+		}
+		results.push_back(result);
+	}
+
+	std::filesystem::remove(path);
+}
+
+std::vector<uint32_t> parseList(const std::string& value)
+{
+	std::vector<uint32_t> list;
+	std::stringstream stream(value);
+	std::string item;
+	while (std::getline(stream, item, ','))
+		list.push_back(static_cast<uint32_t>(std::stoul(item)));
+	return list;
+}
+
+std::vector<fsi::Depth> parseDepths(const std::string& value)
+{
+	std::vector<fsi::Depth> depths;
+	std::stringstream stream(value);
+	std::string item;
+	while (std::getline(stream, item, ','))
+	{
+		for (uint8_t d = 1; d <= 10; d++)
+		{
+			std::ostringstream name;
+			name << static_cast<fsi::Depth>(d);
+			if (name.str() == item)
+				depths.push_back(static_cast<fsi::Depth>(d));
+		}
+	}
+	return depths;
+}
+
+void printUsage()
+{
+	std::cout <<
+		"Usage: fsi_bench [options]\n"
+		"  --dir <path>          Directory for the temporary files (default: fsi_bench_data)\n"
+		"  --out <file>          Write the JSON report to a file instead of stdout\n"
+		"  --sizes <list>        Image sizes in pixels, square (default: 512,2048)\n"
+		"  --channels <list>     Channel counts (default: 1,3,4)\n"
+		"  --depths <list>       Depths by name, e.g. Uint8,Float32 (default: all)\n"
+		"  --iterations <n>      Iterations of read/write/thumbnail (default: 3)\n"
+		"  --rect-samples <n>    Rects per readRect pattern (default: 32)\n"
+		"  --tile <n>            Tile size of the readRect tile pattern (default: 256)\n"
+		"  --max-bytes <n>       Skip images larger than this (default: 1 GiB)\n"
+		"  --cache <mode>        warm, cold or both (default: both)\n";
+}
+
+int main(int argc, char** argv)
+{
+	Config config;
+
+	for (int i = 1; i < argc; i++)
+	{
+		const std::string arg = argv[i];
+		const bool hasValue = i + 1 < argc;
+
+		if (arg == "--help" || arg == "-h")
+		{
+			printUsage();
+			return 0;
+		}
+		else if (!hasValue)
+		{
+			std::cerr << "Missing value for " << arg << "\n";
+			printUsage();
+			return 1;
+		}
+
+		const std::string value = argv[++i];
+
+		if (arg == "--dir")
+			config.dir = value;
+		else if (arg == "--out")
+			config.out = value;
+		else if (arg == "--sizes")
+			config.sizes = parseList(value);
+		else if (arg == "--channels")
+			config.channels = parseList(value);
+		else if (arg == "--depths")
+			config.depths = parseDepths(value);
+		else if (arg == "--iterations")
+			config.iterations = static_cast<uint32_t>(std::stoul(value));
+		else if (arg == "--rect-samples")
+			config.rectSamples = static_cast<uint32_t>(std::stoul(value));
+		else if (arg == "--tile")
+			config.tileSize = static_cast<uint32_t>(std::stoul(value));
+		else if (arg == "--max-bytes")
+			config.maxImageBytes = std::stoull(value);
+		else if (arg == "--cache")
+		{
+			config.warm = value == "warm" || value == "both";
+			config.cold = value == "cold" || value == "both";
+		}
+		else
+		{
+			std::cerr << "Unknown option " << arg << "\n";
+			printUsage();
+			return 1;
+		}
+	}
+
+	if (config.cold && !coldCacheSupported())
+	{
+		std::cerr << "Warning: cold-cache mode is not supported on this platform and will be skipped\n";
+		config.cold = false;
+	}
+
+	std::error_code createDirsError;
+	std::filesystem::create_directories(config.dir, createDirsError);
+	if (createDirsError)
+	{
+		std::cerr << "Could not create " << config.dir << "\n";
+		return 1;
+	}
+
+	std::vector<Result> results;
+
+	try
+	{
+		for (fsi::Depth depth : config.depths)
+		for (uint32_t channels : config.channels)
+		for (uint32_t size : config.sizes)
+		{
+			const uint64_t imageBytes = static_cast<uint64_t>(size) * size * channels * fsi::sizeOfDepth(depth);
+			if (imageBytes > config.maxImageBytes)
+			{
+				std::cerr << "Skipping " << size << "x" << size << "x" << channels << " " << depth
+					<< " (larger than --max-bytes)\n";
+				continue;
+			}
+
+			std::cerr << "Benchmarking " << size << "x" << size << "x" << channels << " " << depth << "\n";
+			benchmarkImage(config, size, channels, depth, results);
+		}
+	}
+	catch (const fsi::Exception& e)
+	{
+		std::cerr << e << "\n";
+		return 1;
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << "\n";
+		return 1;
+	}
+
+	std::ostringstream json;
+	json << "{\n  \"fsi_version\": \"" << fsi::Version() << "\",\n  \"results\": [\n";
+	for (size_t i = 0; i < results.size(); i++)
+		json << "    " << toJson(results[i]) << (i + 1 < results.size() ? ",\n" : "\n");
+	json << "  ]\n}\n";
+
+	if (config.out.empty())
+	{
+		std::cout << json.str();
+	}
+	else
+	{
+		std::ofstream file(config.out);
+		file << json.str();
+		if (!file)
+		{
+			std::cerr << "Could not write " << config.out << "\n";
+			return 1;
+		}
+	}
+
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,135 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include "fsi_core_exports.h"
+#include "../global.h"
+#include "BlockFormat.h"
+#include "Header.h"
+#include "ScaleFilter.h"
+#include <cstdint>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <vector>
+
+namespace fsi { struct AccessTraceEvent; struct AccessTrace; class AccessTraceRecorder; }
+
+/** @brief A single Reader::read(), readRect(), readRectScaled() or readCompressed() call.
+*/
+struct fsi::AccessTraceEvent
+{
+	enum class Op : uint8_t
+	{
+		Read = 0,
+		ReadRect = 1,
+		ReadRectScaled = 2,
+		ReadCompressed = 3,
+	};
+
+	Op op = Op::ReadRect;
+
+	/** @brief Whether the call returned true. Calls that threw are recorded as failed.
+	*/
+	bool success = false;
+
+	/** @brief Start of the call in microseconds since the recorder was created.
+	*/
+	uint64_t timestampUs = 0;
+
+	uint64_t latencyUs = 0;
+
+	/** @brief Image bytes copied to the caller. The size of the blocks for Op::ReadCompressed.
+	*/
+	uint64_t bytes = 0;
+
+	// The whole image for Op::Read, the source rect for Op::ReadRectScaled
+	uint32_t x = 0;
+	uint32_t y = 0;
+	uint32_t width = 0;
+	uint32_t height = 0;
+
+	/** @brief Downscale factor and filter of Op::ReadRectScaled.
+	*/
+	uint32_t factor = 0;
+
+	ScaleFilter filter = ScaleFilter::Box;
+
+	/** @brief Block format of Op::ReadCompressed.
+	*/
+	BlockFormat format = BlockFormat::BC1;
+};
+
+/** @brief Trace loaded from a file written by AccessTraceRecorder.
+*/
+struct fsi::AccessTrace
+{
+	/** @brief Header of the image the trace was recorded on. All zeros if nothing was recorded.
+	*/
+	Header header;
+
+	std::vector<AccessTraceEvent> events;
+
+	/** @brief Loads a trace file. Throws ExceptionFailedToOpenFile or ExceptionInvalidSignature.
+	*/
+	static AccessTrace load(const std::filesystem::path& path);
+};
+
+/** @brief Records the reads of one or more Readers to a compact binary trace.
+
+Attach it with Reader::setAccessTraceRecorder(). The events can be replayed offline against any file
+with the fsi_trace_replay tool, e.g. to evaluate caching or prefetch strategies with the tile access
+pattern of a real viewer. It's thread-safe, so several Readers can share one instance.
+
+File layout (native byte order, like the FSI files): signature "fsit", uint32 trace version, the
+image width, height and channels (uint32) and depth (uint8), followed by fixed-size events. Version 1
+traces, without the scaled reads, still load.
+*/
+class FSI_CORE_API fsi::AccessTraceRecorder
+{
+public:
+
+	/** @brief Creates or truncates the trace file. Throws ExceptionFailedToCreateFile.
+	*/
+	AccessTraceRecorder(const std::filesystem::path& path);
+
+	~AccessTraceRecorder();
+
+	FSI_DISABLE_COPY_MOVE(AccessTraceRecorder);
+
+public:
+
+	/** @brief Microseconds since the recorder was created. Used for AccessTraceEvent::timestampUs.
+	*/
+	uint64_t now() const;
+
+	/** @brief Appends an event. The header of the first event is stored in the trace file.
+	*/
+	void record(const Header& header, const AccessTraceEvent& event);
+
+	void flush();
+
+private:
+
+	void writeFileHeader(const Header& header);
+
+private:
+
+	std::mutex m_mutex;
+
+	std::ofstream m_file;
+
+	std::chrono::steady_clock::time_point m_start;
+
+	bool m_headerWritten;
+};
+
+#if FSI_HEADERONLY
+#include "AccessTrace.hpp"
+#endif
\ No newline at end of file
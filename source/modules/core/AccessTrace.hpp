@@ -0,0 +1,179 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include "AccessTrace.h"
+#include "exceptions.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <string>
+
+namespace fsi
+{
+	namespace detail
+	{
+		const uint8_t accessTraceSignature[] = { 'f', 's', 'i', 't' };
+
+		const uint32_t accessTraceVersion = 2;
+
+		template <typename T>
+		inline void writeTraceValue(std::ofstream& file, T value)
+		{
+			file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+		}
+
+		template <typename T>
+		inline bool readTraceValue(std::ifstream& file, T& value)
+		{
+			file.read(reinterpret_cast<char*>(&value), sizeof(T));
+			return static_cast<bool>(file);
+		}
+	}
+}
+
+FSI_INLINE_HPP
+fsi::AccessTrace fsi::AccessTrace::load(const std::filesystem::path& path)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (file.fail())
+		throw ExceptionFailedToOpenFile();
+
+	uint8_t signature[sizeof(detail::accessTraceSignature)] = {};
+	file.read(reinterpret_cast<char*>(signature), sizeof(signature));
+	for (size_t c = 0; c < sizeof(detail::accessTraceSignature); c++)
+	{
+		if (signature[c] != detail::accessTraceSignature[c])
+			throw ExceptionInvalidSignature("Not an FSI access trace");
+	}
+
+	uint32_t version = 0;
+	detail::readTraceValue(file, version);
+	if (version < 1 || version > detail::accessTraceVersion)
+		throw ExceptionInvalidFormatVersion("Access trace version " + std::to_string(version)
+			+ " is not supported");
+
+	AccessTrace trace;
+	uint8_t depth = 0;
+	detail::readTraceValue(file, trace.header.width);
+	detail::readTraceValue(file, trace.header.height);
+	detail::readTraceValue(file, trace.header.channels);
+	detail::readTraceValue(file, depth);
+	trace.header.depth = static_cast<Depth>(depth);
+
+	for (;;)
+	{
+		AccessTraceEvent event;
+		uint8_t op = 0;
+		uint8_t success = 0;
+		uint32_t latencyUs = 0;
+		uint8_t variant = 0;
+
+		if (!detail::readTraceValue(file, op))
+			break;
+
+		// A truncated last event (e.g. the recording process crashed) is dropped
+		if (!detail::readTraceValue(file, success)
+			|| !detail::readTraceValue(file, event.timestampUs)
+			|| !detail::readTraceValue(file, latencyUs)
+			|| !detail::readTraceValue(file, event.bytes)
+			|| !detail::readTraceValue(file, event.x)
+			|| !detail::readTraceValue(file, event.y)
+			|| !detail::readTraceValue(file, event.width)
+			|| !detail::readTraceValue(file, event.height))
+			break;
+
+		if (version >= 2
+			&& (!detail::readTraceValue(file, event.factor)
+			|| !detail::readTraceValue(file, variant)))
+			break;
+
+		event.op = static_cast<AccessTraceEvent::Op>(op);
+		event.success = success != 0;
+		event.latencyUs = latencyUs;
+		if (event.op == AccessTraceEvent::Op::ReadRectScaled)
+			event.filter = static_cast<ScaleFilter>(variant);
+		else if (event.op == AccessTraceEvent::Op::ReadCompressed)
+			event.format = static_cast<BlockFormat>(variant);
+		trace.events.push_back(event);
+	}
+
+	return trace;
+}
+
+FSI_INLINE_HPP
+fsi::AccessTraceRecorder::AccessTraceRecorder(const std::filesystem::path& path)
+	: m_file(path, std::ios::binary | std::ios::trunc)
+	, m_start(std::chrono::steady_clock::now())
+	, m_headerWritten(false)
+{
+	if (m_file.fail())
+		throw ExceptionFailedToCreateFile();
+}
+
+FSI_INLINE_HPP
+fsi::AccessTraceRecorder::~AccessTraceRecorder()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	// Keep the file loadable even if nothing was recorded
+	if (!m_headerWritten)
+		writeFileHeader(Header());
+}
+
+FSI_INLINE_HPP
+uint64_t fsi::AccessTraceRecorder::now() const
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now() - m_start).count();
+}
+
+FSI_INLINE_HPP
+void fsi::AccessTraceRecorder::record(const Header& header, const AccessTraceEvent& event)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (!m_headerWritten)
+		writeFileHeader(header);
+
+	// 43 bytes per event. Latencies over ~71 minutes are clamped.
+	const uint32_t latencyUs = static_cast<uint32_t>(std::min<uint64_t>(event.latencyUs, UINT32_MAX));
+
+	detail::writeTraceValue(m_file, static_cast<uint8_t>(event.op));
+	detail::writeTraceValue(m_file, static_cast<uint8_t>(event.success ? 1 : 0));
+	detail::writeTraceValue(m_file, event.timestampUs);
+	detail::writeTraceValue(m_file, latencyUs);
+	detail::writeTraceValue(m_file, event.bytes);
+	detail::writeTraceValue(m_file, event.x);
+	detail::writeTraceValue(m_file, event.y);
+	detail::writeTraceValue(m_file, event.width);
+	detail::writeTraceValue(m_file, event.height);
+	detail::writeTraceValue(m_file, event.factor);
+	detail::writeTraceValue(m_file, static_cast<uint8_t>(event.op == AccessTraceEvent::Op::ReadCompressed
+		? static_cast<uint32_t>(event.format) : static_cast<uint32_t>(event.filter)));
+}
+
+FSI_INLINE_HPP
+void fsi::AccessTraceRecorder::flush()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_file.flush();
+}
+
+FSI_INLINE_HPP
+void fsi::AccessTraceRecorder::writeFileHeader(const Header& header)
+{
+	m_file.write(reinterpret_cast<const char*>(detail::accessTraceSignature),
+		sizeof(detail::accessTraceSignature));
+	detail::writeTraceValue(m_file, detail::accessTraceVersion);
+	detail::writeTraceValue(m_file, header.width);
+	detail::writeTraceValue(m_file, header.height);
+	detail::writeTraceValue(m_file, header.channels);
+	detail::writeTraceValue(m_file, static_cast<uint8_t>(header.depth));
+
+	m_headerWritten = true;
+}
\ No newline at end of file
@@ -0,0 +1,48 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include <cstdint>
+
+namespace fsi
+{
+
+/** @brief Block-compressed texture formats of Reader::readCompressed(). Every 4x4 block of pixels is
+encoded on its own. Uint16 channels are rounded to 8 bits first.
+*/
+enum class BlockFormat : uint32_t
+{
+	// RGB, 8 bytes per block. Images with 1 or 2 channels are gray. Alpha is dropped.
+	BC1 = 0,
+
+	// The first channel, 8 bytes per block
+	BC4 = 1,
+
+	// The first two channels, 16 bytes per block. The second is 0 for images with one channel.
+	BC5 = 2,
+
+	// RGBA, 16 bytes per block (mode 6 only). Images with 1 or 2 channels are gray, with the second
+	// channel as alpha. Images without alpha are opaque.
+	BC7 = 3,
+};
+
+inline constexpr uint64_t blockSizeInBytes(BlockFormat format)
+{
+	return format == BlockFormat::BC1 || format == BlockFormat::BC4 ? 8 : 16;
+}
+
+/** @brief Bytes of a width x height rect in the format. Blocks at the right and bottom edges that
+* are only partly inside the rect count as whole blocks.
+*/
+inline constexpr uint64_t compressedSizeInBytes(uint32_t width, uint32_t height, BlockFormat format)
+{
+	return ((static_cast<uint64_t>(width) + 3) / 4) * ((static_cast<uint64_t>(height) + 3) / 4)
+		* blockSizeInBytes(format);
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,147 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include "fsi_core_exports.h"
+#include "../global.h"
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <vector>
+
+namespace fsi { class Executor; class ThreadPool; }
+
+/** @brief Interface used by the library to run work in parallel.
+
+All library parallelism (thumbnail generation, parallel I/O, conversions, etc.) goes through the
+executor returned by fsi::executor(). Applications with their own task scheduler can implement this
+interface and install it with fsi::setExecutor() so the library doesn't oversubscribe the cores.
+*/
+class FSI_CORE_API fsi::Executor
+{
+public:
+
+	typedef std::function<void()> Task;
+
+	typedef std::function<void(int64_t begin, int64_t end)> RangeTask;
+
+public:
+
+	Executor();
+
+	virtual ~Executor();
+
+	FSI_DISABLE_COPY_MOVE(Executor);
+
+public:
+
+	/** @brief Returns the number of tasks that can run simultaneously.
+	*/
+	virtual uint32_t concurrency() = 0;
+
+	/** @brief Schedules a task for asynchronous execution. It must not block the caller.
+	*/
+	virtual void submit(Task task) = 0;
+
+	/** @brief Runs body over [begin, end) split in chunks of at least grainSize elements and blocks
+	* until every chunk is done.
+	*
+	* The default implementation schedules helpers with submit() and lets the calling thread take
+	* chunks too, so nested calls from inside a task never deadlock. Exceptions thrown by body are
+	* rethrown in the calling thread. Executors wrapping a scheduler with its own parallel loop (e.g.
+	* tbb::parallel_for) can override it.
+	*/
+	virtual void parallelFor(int64_t begin, int64_t end, int64_t grainSize, const RangeTask& body);
+};
+
+/** @brief Default executor. A fixed set of worker threads with one task queue each. Idle workers
+steal from the queues of the others.
+*/
+class FSI_CORE_API fsi::ThreadPool : public Executor
+{
+public:
+
+	/** @brief Creates the pool.
+	*
+	* @param threadCount Number of worker threads. If 0 is passed, one less than the number of
+	* hardware threads is used, since callers of parallelFor() take chunks too.
+	*/
+	ThreadPool(uint32_t threadCount = 0);
+
+	~ThreadPool() override;
+
+	FSI_DISABLE_COPY_MOVE(ThreadPool);
+
+public:
+
+	uint32_t concurrency() override;
+
+	void submit(Task task) override;
+
+private:
+
+	struct Queue
+	{
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	struct WorkerSlot
+	{
+		const ThreadPool* pool = nullptr;
+		uint32_t index = 0;
+	};
+
+private:
+
+	void run(uint32_t index);
+
+	bool popTask(uint32_t index, Task& task);
+
+	// Pool and queue index of the worker running on the calling thread (if any)
+	static WorkerSlot& currentWorker();
+
+private:
+
+	std::vector<std::unique_ptr<Queue>> m_queues;
+
+	std::vector<std::thread> m_threads;
+
+	std::mutex m_sleepMutex;
+
+	std::condition_variable m_wakeUp;
+
+	std::atomic<uint64_t> m_pending;
+
+	std::atomic<uint32_t> m_nextQueue;
+
+	bool m_stop;
+};
+
+namespace fsi
+{
+	/** @brief Returns the executor used by the library. Unless another one was installed with
+	setExecutor(), it's a ThreadPool created on first use.
+	*/
+	FSI_CORE_API std::shared_ptr<Executor> executor();
+
+	/** @brief Installs the executor used by the library. Passing nullptr restores the default pool.
+	*
+	* Operations already running keep the executor they started with.
+	*/
+	FSI_CORE_API void setExecutor(std::shared_ptr<Executor> executor);
+}
+
+#if FSI_HEADERONLY
+#include "Executor.hpp"
+#endif
\ No newline at end of file
@@ -0,0 +1,275 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include "Executor.h"
+#include <algorithm>
+#include <exception>
+
+namespace fsi
+{
+	namespace detail
+	{
+		struct ExecutorRegistry
+		{
+			std::mutex mutex;
+			std::shared_ptr<Executor> executor;
+		};
+
+		inline ExecutorRegistry& executorRegistry()
+		{
+			static ExecutorRegistry registry;
+			return registry;
+		}
+	}
+}
+
+FSI_INLINE_HPP
+fsi::Executor::Executor()
+{
+}
+
+FSI_INLINE_HPP
+fsi::Executor::~Executor()
+{
+}
+
+FSI_INLINE_HPP
+void fsi::Executor::parallelFor(int64_t begin, int64_t end, int64_t grainSize, const RangeTask& body)
+{
+	if (end <= begin)
+		return;
+
+	const int64_t count = end - begin;
+	const int64_t workers = std::max<int64_t>(concurrency(), 1);
+
+	// A few chunks per worker so faster workers can balance the load, but never less than grainSize
+	// elements per chunk
+	const int64_t chunkSize = std::max<int64_t>(std::max<int64_t>(grainSize, 1),
+		(count + workers*4 - 1) / (workers*4));
+	const int64_t chunks = (count + chunkSize - 1) / chunkSize;
+
+	if (chunks == 1)
+	{
+		body(begin, end);
+		return;
+	}
+
+	struct State
+	{
+		std::atomic<int64_t> next = 0;
+		std::atomic<int64_t> done = 0;
+		std::atomic<bool> failed = false;
+		std::mutex mutex;
+		std::condition_variable finished;
+		std::exception_ptr exception;
+	};
+
+	std::shared_ptr<State> state = std::make_shared<State>();
+
+	// Takes chunks until none are left. The body is only accessed while there are chunks left, so a
+	// helper that starts after parallelFor() returned exits without touching it.
+	auto work = [state, &body, begin, end, chunkSize, chunks]()
+	{
+		for (;;)
+		{
+			const int64_t chunk = state->next.fetch_add(1);
+			if (chunk >= chunks)
+				return;
+
+			const int64_t chunkBegin = begin + chunk*chunkSize;
+			const int64_t chunkEnd = std::min(end, chunkBegin + chunkSize);
+
+			try
+			{
+				if (!state->failed)
+					body(chunkBegin, chunkEnd);
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(state->mutex);
+				if (!state->exception)
+					state->exception = std::current_exception();
+				state->failed = true;
+			}
+
+			if (state->done.fetch_add(1) + 1 == chunks)
+			{
+				std::lock_guard<std::mutex> lock(state->mutex);
+				state->finished.notify_all();
+			}
+		}
+	};
+
+	const int64_t helpers = std::min(workers, chunks - 1);
+	for (int64_t i = 0; i < helpers; i++)
+		submit(work);
+
+	// The calling thread takes chunks too
+	work();
+
+	std::unique_lock<std::mutex> lock(state->mutex);
+	state->finished.wait(lock, [&state, chunks]() { return state->done == chunks; });
+
+	if (state->exception)
+		std::rethrow_exception(state->exception);
+}
+
+FSI_INLINE_HPP
+fsi::ThreadPool::ThreadPool(uint32_t threadCount)
+	: m_pending(0)
+	, m_nextQueue(0)
+	, m_stop(false)
+{
+	if (threadCount == 0)
+	{
+		const uint32_t hardwareThreads = std::thread::hardware_concurrency();
+		threadCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+	}
+
+	for (uint32_t i = 0; i < threadCount; i++)
+		m_queues.push_back(std::make_unique<Queue>());
+
+	for (uint32_t i = 0; i < threadCount; i++)
+		m_threads.emplace_back(&ThreadPool::run, this, i);
+}
+
+FSI_INLINE_HPP
+fsi::ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+		m_stop = true;
+	}
+	m_wakeUp.notify_all();
+
+	for (std::thread& thread : m_threads)
+		thread.join();
+}
+
+FSI_INLINE_HPP
+uint32_t fsi::ThreadPool::concurrency()
+{
+	return static_cast<uint32_t>(m_threads.size());
+}
+
+FSI_INLINE_HPP
+void fsi::ThreadPool::submit(Task task)
+{
+	// Workers push to their own queue (better locality for nested work), other threads distribute
+	// the tasks round-robin
+	const WorkerSlot& slot = currentWorker();
+	const uint32_t index = slot.pool == this
+		? slot.index
+		: m_nextQueue.fetch_add(1, std::memory_order_relaxed) % static_cast<uint32_t>(m_queues.size());
+
+	{
+		std::lock_guard<std::mutex> lock(m_queues[index]->mutex);
+		m_queues[index]->tasks.push_back(std::move(task));
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+		m_pending++;
+	}
+	m_wakeUp.notify_one();
+}
+
+FSI_INLINE_HPP
+void fsi::ThreadPool::run(uint32_t index)
+{
+	WorkerSlot& slot = currentWorker();
+	slot.pool = this;
+	slot.index = index;
+
+	for (;;)
+	{
+		Task task;
+		if (popTask(index, task))
+		{
+			// Tasks report their errors by themselves (see parallelFor). Don't let a misbehaving one
+			// take down the worker.
+			try
+			{
+				task();
+			}
+			catch (...)
+			{
+			}
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(m_sleepMutex);
+		m_wakeUp.wait(lock, [this]() { return m_stop || m_pending > 0; });
+
+		// Pending tasks are still run before stopping
+		if (m_stop && m_pending == 0)
+			return;
+	}
+}
+
+FSI_INLINE_HPP
+bool fsi::ThreadPool::popTask(uint32_t index, Task& task)
+{
+	const size_t queueCount = m_queues.size();
+
+	for (size_t i = 0; i < queueCount; i++)
+	{
+		Queue& queue = *m_queues[(index + i) % queueCount];
+
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.tasks.empty())
+			continue;
+
+		if (i == 0)
+		{
+			// Own queue: newest first
+			task = std::move(queue.tasks.back());
+			queue.tasks.pop_back();
+		}
+		else
+		{
+			// Steal the oldest task of another worker
+			task = std::move(queue.tasks.front());
+			queue.tasks.pop_front();
+		}
+
+		m_pending--;
+		return true;
+	}
+
+	return false;
+}
+
+FSI_INLINE_HPP
+fsi::ThreadPool::WorkerSlot& fsi::ThreadPool::currentWorker()
+{
+	static thread_local WorkerSlot slot;
+	return slot;
+}
+
+FSI_INLINE_HPP
+std::shared_ptr<fsi::Executor> fsi::executor()
+{
+	detail::ExecutorRegistry& registry = detail::executorRegistry();
+
+	std::lock_guard<std::mutex> lock(registry.mutex);
+	if (!registry.executor)
+		registry.executor = std::make_shared<ThreadPool>();
+
+	return registry.executor;
+}
+
+FSI_INLINE_HPP
+void fsi::setExecutor(std::shared_ptr<Executor> executor)
+{
+	detail::ExecutorRegistry& registry = detail::executorRegistry();
+
+	std::lock_guard<std::mutex> lock(registry.mutex);
+	registry.executor = executor;
+}
\ No newline at end of file
@@ -0,0 +1,134 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include "fsi_core_exports.h"
+#include "../global.h"
+#include "Depth.hpp"
+#include "Header.h"
+#include <cstdint>
+
+namespace fsi { struct ImageBufferOptions; class ImageBuffer; }
+
+struct fsi::ImageBufferOptions
+{
+	enum class HugePages
+	{
+		// Regular pages
+		None,
+
+		// Transparent huge pages (madvise(MADV_HUGEPAGE) on Linux). Falls back silently to regular
+		// pages when not supported.
+		Transparent,
+
+		// Explicit huge pages (MAP_HUGETLB on Linux, MEM_LARGE_PAGES on Windows). They must be reserved
+		// by the system administrator. Falls back to Transparent when the allocation fails.
+		Explicit,
+	};
+
+	/** @brief Alignment of the first byte in bytes. Must be a power of two. 0 means page alignment.
+	*/
+	uint64_t alignment = 64;
+
+	HugePages hugePages = HugePages::None;
+
+	/** @brief Touches the pages in parallel on allocation (defaultBufferSize chunks on
+	* fsi::executor()), which moves the page faults out of the read.
+	*
+	* The chunks are scheduled dynamically and don't follow ReadOptions::chunkSize or threads, so on
+	* NUMA systems the pages are spread over the nodes but not guaranteed to be local to the threads
+	* that fill them later.
+	*/
+	bool parallelFirstTouch = false;
+};
+
+/** @brief Owning image buffer sized from a Header, suitable for Reader::read and Writer::write.
+
+The rows are tightly packed (step = width*channels*sizeOfDepth(depth)).
+*/
+class FSI_CORE_API fsi::ImageBuffer
+{
+public:
+
+	ImageBuffer();
+
+	ImageBuffer(const Header& header, const ImageBufferOptions& options = ImageBufferOptions());
+
+	ImageBuffer(uint32_t width, uint32_t height, uint32_t channels, Depth depth,
+		const ImageBufferOptions& options = ImageBufferOptions());
+
+	~ImageBuffer();
+
+	ImageBuffer(ImageBuffer&& other) noexcept;
+
+	ImageBuffer& operator=(ImageBuffer&& other) noexcept;
+
+	FSI_DISABLE_COPY(ImageBuffer);
+
+public:
+
+	uint8_t* data();
+
+	const uint8_t* data() const;
+
+	/** @brief Size of the image data in bytes.
+	*/
+	uint64_t size() const;
+
+	/** @brief Number of bytes between the start of two consecutive rows.
+	*/
+	uint64_t step() const;
+
+	uint32_t width() const;
+
+	uint32_t height() const;
+
+	uint32_t channels() const;
+
+	Depth depth() const;
+
+	bool empty() const;
+
+	/** @brief Returns a header with the dimensions, channels and depth of the buffer.
+	*/
+	Header header() const;
+
+	/** @brief Frees the memory. The buffer becomes empty.
+	*/
+	void reset();
+
+private:
+
+	void allocate(const ImageBufferOptions& options);
+
+	void touchPages();
+
+private:
+
+	uint8_t* m_data;
+
+	uint64_t m_size;
+
+	// Size of the mapping when the memory was mapped instead of allocated (0 otherwise)
+	uint64_t m_mappedSize;
+
+	// Start of the mapping, which can be before m_data when it was aligned by hand
+	void* m_mappedPtr;
+
+	uint32_t m_width;
+
+	uint32_t m_height;
+
+	uint32_t m_channels;
+
+	Depth m_depth;
+};
+
+#if FSI_HEADERONLY
+#include "ImageBuffer.hpp"
+#endif
\ No newline at end of file
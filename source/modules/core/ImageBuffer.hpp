@@ -0,0 +1,357 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include "ImageBuffer.h"
+#include "Executor.h"
+#include "consts.h"
+#include <new>
+#include <stdexcept>
+#include <utility>
+#include <algorithm>
+
+#if defined(_WIN32)
+	#ifndef NOMINMAX
+		#define NOMINMAX
+	#endif
+	#ifndef WIN32_LEAN_AND_MEAN
+		#define WIN32_LEAN_AND_MEAN
+	#endif
+	#include <windows.h>
+	#include <malloc.h>
+#else
+	#include <sys/mman.h>
+	#include <unistd.h>
+	#include <stdlib.h>
+#endif
+
+namespace fsi
+{
+	namespace detail
+	{
+		const uint64_t hugePageSize = 2*1024*1024;
+
+		inline uint64_t pageSize()
+		{
+#if defined(_WIN32)
+			SYSTEM_INFO info;
+			GetSystemInfo(&info);
+			return static_cast<uint64_t>(info.dwPageSize);
+#else
+			return static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+#endif
+		}
+
+		inline uint64_t roundUp(uint64_t value, uint64_t multiple)
+		{
+			return (value + multiple - 1) / multiple * multiple;
+		}
+	}
+}
+
+FSI_INLINE_HPP
+fsi::ImageBuffer::ImageBuffer()
+	: m_data(nullptr)
+	, m_size(0)
+	, m_mappedSize(0)
+	, m_mappedPtr(nullptr)
+	, m_width(0)
+	, m_height(0)
+	, m_channels(0)
+	, m_depth(Depth::Invalid)
+{
+}
+
+FSI_INLINE_HPP
+fsi::ImageBuffer::ImageBuffer(const Header& header, const ImageBufferOptions& options)
+	: ImageBuffer(header.width, header.height, header.channels, header.depth, options)
+{
+}
+
+FSI_INLINE_HPP
+fsi::ImageBuffer::ImageBuffer(uint32_t width, uint32_t height, uint32_t channels, Depth depth,
+	const ImageBufferOptions& options)
+	: ImageBuffer()
+{
+	m_width = width;
+	m_height = height;
+	m_channels = channels;
+	m_depth = depth;
+	m_size = static_cast<uint64_t>(width) * static_cast<uint64_t>(height)
+		* static_cast<uint64_t>(channels) * sizeOfDepth(depth);
+
+	allocate(options);
+
+	if (options.parallelFirstTouch)
+		touchPages();
+}
+
+FSI_INLINE_HPP
+fsi::ImageBuffer::~ImageBuffer()
+{
+	reset();
+}
+
+FSI_INLINE_HPP
+fsi::ImageBuffer::ImageBuffer(ImageBuffer&& other) noexcept
+	: ImageBuffer()
+{
+	*this = std::move(other);
+}
+
+FSI_INLINE_HPP
+fsi::ImageBuffer& fsi::ImageBuffer::operator=(ImageBuffer&& other) noexcept
+{
+	if (this != &other)
+	{
+		reset();
+		std::swap(m_data, other.m_data);
+		std::swap(m_size, other.m_size);
+		std::swap(m_mappedSize, other.m_mappedSize);
+		std::swap(m_mappedPtr, other.m_mappedPtr);
+		std::swap(m_width, other.m_width);
+		std::swap(m_height, other.m_height);
+		std::swap(m_channels, other.m_channels);
+		std::swap(m_depth, other.m_depth);
+	}
+
+	return *this;
+}
+
+FSI_INLINE_HPP
+uint8_t* fsi::ImageBuffer::data()
+{
+	return m_data;
+}
+
+FSI_INLINE_HPP
+const uint8_t* fsi::ImageBuffer::data() const
+{
+	return m_data;
+}
+
+FSI_INLINE_HPP
+uint64_t fsi::ImageBuffer::size() const
+{
+	return m_size;
+}
+
+FSI_INLINE_HPP
+uint64_t fsi::ImageBuffer::step() const
+{
+	return static_cast<uint64_t>(m_width) * static_cast<uint64_t>(m_channels) * sizeOfDepth(m_depth);
+}
+
+FSI_INLINE_HPP
+uint32_t fsi::ImageBuffer::width() const
+{
+	return m_width;
+}
+
+FSI_INLINE_HPP
+uint32_t fsi::ImageBuffer::height() const
+{
+	return m_height;
+}
+
+FSI_INLINE_HPP
+uint32_t fsi::ImageBuffer::channels() const
+{
+	return m_channels;
+}
+
+FSI_INLINE_HPP
+fsi::Depth fsi::ImageBuffer::depth() const
+{
+	return m_depth;
+}
+
+FSI_INLINE_HPP
+bool fsi::ImageBuffer::empty() const
+{
+	return m_data == nullptr;
+}
+
+FSI_INLINE_HPP
+fsi::Header fsi::ImageBuffer::header() const
+{
+	Header header;
+	header.width = m_width;
+	header.height = m_height;
+	header.channels = m_channels;
+	header.depth = m_depth;
+	return header;
+}
+
+FSI_INLINE_HPP
+void fsi::ImageBuffer::reset()
+{
+	if (m_mappedPtr)
+	{
+#if defined(_WIN32)
+		VirtualFree(m_mappedPtr, 0, MEM_RELEASE);
+#else
+		munmap(m_mappedPtr, m_mappedSize);
+#endif
+	}
+	else if (m_data)
+	{
+#if defined(_WIN32)
+		_aligned_free(m_data);
+#else
+		free(m_data);
+#endif
+	}
+
+	m_data = nullptr;
+	m_size = 0;
+	m_mappedSize = 0;
+	m_mappedPtr = nullptr;
+	m_width = 0;
+	m_height = 0;
+	m_channels = 0;
+	m_depth = Depth::Invalid;
+}
+
+FSI_INLINE_HPP
+void fsi::ImageBuffer::allocate(const ImageBufferOptions& options)
+{
+	using HugePages = ImageBufferOptions::HugePages;
+
+	if (m_size == 0)
+		return;
+
+	const uint64_t pageSize = detail::pageSize();
+	const uint64_t alignment = options.alignment == 0 ? pageSize : options.alignment;
+
+	if ((alignment & (alignment - 1)) != 0)
+		throw std::invalid_argument("ImageBuffer alignment must be a power of two");
+
+	// Small alignments without huge pages: regular aligned heap allocation
+	if (options.hugePages == HugePages::None && alignment < pageSize)
+	{
+		const size_t heapAlignment = static_cast<size_t>(std::max<uint64_t>(alignment, sizeof(void*)));
+#if defined(_WIN32)
+		m_data = static_cast<uint8_t*>(_aligned_malloc(static_cast<size_t>(m_size), heapAlignment));
+#else
+		void* ptr = nullptr;
+		if (posix_memalign(&ptr, heapAlignment, static_cast<size_t>(m_size)) != 0)
+			ptr = nullptr;
+		m_data = static_cast<uint8_t*>(ptr);
+#endif
+		if (!m_data)
+			throw std::bad_alloc();
+		return;
+	}
+
+	// Page-granular mapping. Transparent huge pages are only used for 2 MB aligned regions, so the
+	// start is aligned by hand in that case.
+	HugePages hugePages = options.hugePages;
+
+#if defined(_WIN32)
+	if (hugePages == HugePages::Explicit)
+	{
+		const uint64_t largePageSize = static_cast<uint64_t>(GetLargePageMinimum());
+		if (largePageSize > 0)
+		{
+			const uint64_t size = detail::roundUp(m_size, largePageSize);
+			m_mappedPtr = VirtualAlloc(nullptr, static_cast<SIZE_T>(size),
+				MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+			if (m_mappedPtr)
+			{
+				m_mappedSize = size;
+				m_data = static_cast<uint8_t*>(m_mappedPtr);
+				return;
+			}
+		}
+	}
+
+	// There are no transparent huge pages on Windows
+	const uint64_t mapAlignment = std::max(alignment, pageSize);
+#else
+	#if defined(MAP_HUGETLB)
+	if (hugePages == HugePages::Explicit)
+	{
+		const uint64_t size = detail::roundUp(m_size, detail::hugePageSize);
+		void* ptr = mmap(nullptr, static_cast<size_t>(size), PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (ptr != MAP_FAILED)
+		{
+			m_mappedPtr = ptr;
+			m_mappedSize = size;
+			m_data = static_cast<uint8_t*>(ptr);
+			return;
+		}
+	}
+	#endif
+
+	// No huge pages reserved (or not supported): fall back to transparent huge pages
+	if (hugePages == HugePages::Explicit)
+		hugePages = HugePages::Transparent;
+
+	const uint64_t mapAlignment = hugePages == HugePages::Transparent
+		? std::max(alignment, detail::hugePageSize)
+		: std::max(alignment, pageSize);
+#endif
+
+	const uint64_t usableSize = detail::roundUp(m_size, pageSize);
+	const uint64_t mapSize = usableSize + (mapAlignment > pageSize ? mapAlignment : 0);
+
+#if defined(_WIN32)
+	m_mappedPtr = VirtualAlloc(nullptr, static_cast<SIZE_T>(mapSize), MEM_RESERVE | MEM_COMMIT,
+		PAGE_READWRITE);
+	if (!m_mappedPtr)
+		throw std::bad_alloc();
+#else
+	void* ptr = mmap(nullptr, static_cast<size_t>(mapSize), PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (ptr == MAP_FAILED)
+		throw std::bad_alloc();
+	m_mappedPtr = ptr;
+#endif
+
+	m_mappedSize = mapSize;
+	m_data = reinterpret_cast<uint8_t*>(
+		detail::roundUp(reinterpret_cast<uintptr_t>(m_mappedPtr), mapAlignment));
+
+#if !defined(_WIN32) && defined(MADV_HUGEPAGE)
+	if (hugePages == HugePages::Transparent)
+		madvise(m_data, static_cast<size_t>(usableSize), MADV_HUGEPAGE);
+#endif
+}
+
+FSI_INLINE_HPP
+void fsi::ImageBuffer::touchPages()
+{
+	if (!m_data)
+		return;
+
+	const uint64_t pageSize = detail::pageSize();
+	const uint64_t chunkSize = defaultBufferSize;
+	const int64_t chunks = static_cast<int64_t>((m_size + chunkSize - 1) / chunkSize);
+
+	uint8_t* data = m_data;
+	const uint64_t size = m_size;
+
+	executor()->parallelFor(0, chunks, 1, [data, size, chunkSize, pageSize](int64_t begin, int64_t end)
+	{
+		for (int64_t chunk = begin; chunk < end; chunk++)
+		{
+			const uint64_t chunkBegin = static_cast<uint64_t>(chunk) * chunkSize;
+			const uint64_t chunkEnd = std::min(size, chunkBegin + chunkSize);
+
+			// First byte of the chunk and then the first byte of every page starting inside it
+			data[chunkBegin] = 0;
+
+			const uintptr_t first = reinterpret_cast<uintptr_t>(data + chunkBegin) + 1;
+			uint64_t offset = detail::roundUp(first, pageSize) - reinterpret_cast<uintptr_t>(data);
+			for (; offset < chunkEnd; offset += pageSize)
+				data[offset] = 0;
+		}
+	});
+}
\ No newline at end of file
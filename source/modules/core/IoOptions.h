@@ -0,0 +1,144 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include "Depth.hpp"
+#include "consts.h"
+#include <cstdint>
+
+namespace fsi
+{
+
+/** @brief How a Reader or a Writer accesses the image data.
+*/
+enum class IoBackend : uint32_t
+{
+	// A buffered std::fstream, one chunk at a time
+	Stream = 0,
+
+	// pread/pwrite on a file descriptor, several chunks at a time on fsi::executor(). Only on POSIX
+	// systems, elsewhere it behaves like Stream.
+	Positional = 1,
+};
+
+/** @brief What the page cache is told about the file (posix_fadvise).
+*/
+enum class CacheAdvice : uint32_t
+{
+	Normal = 0,
+
+	// Larger read-ahead. Positional backend only.
+	Sequential = 1,
+
+	// No read-ahead, e.g. for scattered readRect() calls. Positional backend only.
+	Random = 2,
+
+	// Drops the pages of the file from the cache on close, so a batch job doesn't evict the working
+	// set of other programs.
+	DontKeep = 3,
+};
+
+enum class SyncPolicy : uint32_t
+{
+	None = 0,
+
+	// fsync when the file is closed, so it's on disk when close() or the last write returns
+	OnClose = 1,
+};
+
+/** @brief Order of the pixels that read() and readRect() put in the destination. See layout.h.
+*/
+enum class PixelLayout : uint32_t
+{
+	// Row after row
+	Linear = 0,
+
+	// Square tiles of ReadOptions::layoutTileSize pixels, row after row, with the pixels of a tile row
+	// after row. Tiles at the right and bottom edges are padded with zeros to full size.
+	Tiled = 1,
+
+	// Like Tiled, with the pixels of a tile in Morton (Z) order: pixel (x, y) of a tile is at the
+	// index whose bits interleave the bits of x and y, x in the even ones. The tile size must be a
+	// power of two. A tile that covers the whole rect makes one Z-order curve.
+	Morton = 2,
+};
+
+struct ReadOptions
+{
+	/** @brief Bytes per read request for read() and full-width readRect() calls.
+	*/
+	uint64_t chunkSize = defaultBufferSize;
+
+	/** @brief Chunks read at the same time with IoBackend::Positional. 0 uses every worker of
+	* fsi::executor().
+	*/
+	uint32_t threads = 1;
+
+	IoBackend backend = IoBackend::Stream;
+
+	/** @brief Bypasses the page cache (O_DIRECT) with IoBackend::Positional, through aligned buffers.
+	* Ignored where the filesystem doesn't support it.
+	*/
+	bool directIo = false;
+
+	CacheAdvice cacheAdvice = CacheAdvice::Normal;
+
+	/** @brief Minimum time between two calls of the progress callback.
+	*/
+	uint64_t progressIntervalMs = progressCallbackInterval;
+
+	/** @brief Takes chunkSize, threads, backend and directIo from the storage profile found for the
+	* file (see findIoProfile()), if any, where they are left at their defaults. Set it to false to
+	* use the options as they are, e.g. to keep a default value the profile changes.
+	*/
+	bool useStorageProfile = true;
+
+	/** @brief Pixel order of the destination of read() and readRect(). Other layouts than Linear take
+	* layoutSizeInBytes() bytes and can't be combined with a destination stride.
+	*/
+	PixelLayout layout = PixelLayout::Linear;
+
+	/** @brief Tile width and height in pixels of PixelLayout::Tiled and PixelLayout::Morton.
+	*/
+	uint32_t layoutTileSize = 32;
+};
+
+struct WriteOptions
+{
+	/** @brief Bytes per write request for write().
+	*/
+	uint64_t chunkSize = defaultBufferSize;
+
+	/** @brief Chunks written at the same time with IoBackend::Positional. 0 uses every worker of
+	* fsi::executor().
+	*/
+	uint32_t threads = 1;
+
+	IoBackend backend = IoBackend::Stream;
+
+	/** @brief Bypasses the page cache (O_DIRECT) for the aligned part of the image data with
+	* IoBackend::Positional. Ignored where the filesystem doesn't support it.
+	*/
+	bool directIo = false;
+
+	CacheAdvice cacheAdvice = CacheAdvice::Normal;
+
+	SyncPolicy sync = SyncPolicy::None;
+
+	/** @brief Minimum time between two calls of the progress callback.
+	*/
+	uint64_t progressIntervalMs = progressCallbackInterval;
+
+	/** @brief Takes chunkSize, threads, backend and directIo from the storage profile found for the
+	* file (see findIoProfile()), if any, where they are left at their defaults. Set it to false to
+	* use the options as they are, e.g. to keep a default value the profile changes.
+	*/
+	bool useStorageProfile = true;
+};
+
+}
\ No newline at end of file
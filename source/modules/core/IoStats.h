@@ -0,0 +1,89 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include "fsi_core_exports.h"
+#include "../global.h"
+#include <cstdint>
+
+namespace fsi { struct IoStats; }
+
+/** @brief I/O counters of a Reader, a Writer or the whole process.
+
+They tell whether a slow operation is disk-bound (ioTimeUs dominates and bytesRead/ioTimeUs is
+close to the storage bandwidth), seek-bound (many seeks and small reads) or CPU-bound (computeTimeUs
+dominates).
+*/
+struct fsi::IoStats
+{
+	/** @brief Image and thumbnail bytes asked for by the caller of a Reader, or image bytes passed to
+	* a Writer.
+	*/
+	uint64_t bytesRequested = 0;
+
+	/** @brief Bytes read from the file, including headers and skipped data.
+	*/
+	uint64_t bytesRead = 0;
+
+	uint64_t bytesWritten = 0;
+
+	/** @brief Read and write requests issued to the file. With the buffered stream some small
+	* requests are served from the stream buffer and don't reach the system.
+	*/
+	uint64_t readCalls = 0;
+
+	uint64_t writeCalls = 0;
+
+	uint64_t seeks = 0;
+
+	/** @brief Time blocked in reads, writes and seeks.
+	*/
+	uint64_t ioTimeUs = 0;
+
+	/** @brief Time spent processing data, e.g. generating the thumbnail.
+	*/
+	uint64_t computeTimeUs = 0;
+
+	/** @brief Largest temporary buffer allocated by the library during the operations.
+	*/
+	uint64_t peakScratchBytes = 0;
+
+	/** @brief Requests served from or missed in a block cache, when one is used.
+	*/
+	uint64_t cacheHits = 0;
+
+	uint64_t cacheMisses = 0;
+
+public:
+
+	/** @brief Adds the counters of other. peakScratchBytes takes the largest of both.
+	*/
+	IoStats& operator+=(const IoStats& other);
+
+	/** @brief Counters gathered between a previous snapshot and this one. peakScratchBytes is kept.
+	*/
+	IoStats operator-(const IoStats& other) const;
+};
+
+namespace fsi
+{
+	/** @brief Returns the counters of every Reader and Writer of the process since it started or
+	since the last call to resetGlobalIoStats(). They are updated at the end of each operation.
+	*/
+	FSI_CORE_API IoStats globalIoStats();
+
+	FSI_CORE_API void resetGlobalIoStats();
+
+	/** @brief Adds counters to the process-wide stats.
+	*/
+	FSI_CORE_API void addGlobalIoStats(const IoStats& stats);
+}
+
+#if FSI_HEADERONLY
+#include "IoStats.hpp"
+#endif
\ No newline at end of file
@@ -0,0 +1,91 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include "IoStats.h"
+#include <algorithm>
+#include <mutex>
+
+namespace fsi
+{
+	namespace detail
+	{
+		struct GlobalIoStats
+		{
+			std::mutex mutex;
+			IoStats stats;
+		};
+
+		inline GlobalIoStats& globalIoStatsInstance()
+		{
+			static GlobalIoStats instance;
+			return instance;
+		}
+	}
+}
+
+FSI_INLINE_HPP
+fsi::IoStats& fsi::IoStats::operator+=(const IoStats& other)
+{
+	bytesRequested += other.bytesRequested;
+	bytesRead += other.bytesRead;
+	bytesWritten += other.bytesWritten;
+	readCalls += other.readCalls;
+	writeCalls += other.writeCalls;
+	seeks += other.seeks;
+	ioTimeUs += other.ioTimeUs;
+	computeTimeUs += other.computeTimeUs;
+	peakScratchBytes = std::max(peakScratchBytes, other.peakScratchBytes);
+	cacheHits += other.cacheHits;
+	cacheMisses += other.cacheMisses;
+	return *this;
+}
+
+FSI_INLINE_HPP
+fsi::IoStats fsi::IoStats::operator-(const IoStats& other) const
+{
+	IoStats result = *this;
+	result.bytesRequested -= other.bytesRequested;
+	result.bytesRead -= other.bytesRead;
+	result.bytesWritten -= other.bytesWritten;
+	result.readCalls -= other.readCalls;
+	result.writeCalls -= other.writeCalls;
+	result.seeks -= other.seeks;
+	result.ioTimeUs -= other.ioTimeUs;
+	result.computeTimeUs -= other.computeTimeUs;
+	result.cacheHits -= other.cacheHits;
+	result.cacheMisses -= other.cacheMisses;
+	return result;
+}
+
+FSI_INLINE_HPP
+fsi::IoStats fsi::globalIoStats()
+{
+	detail::GlobalIoStats& global = detail::globalIoStatsInstance();
+
+	std::lock_guard<std::mutex> lock(global.mutex);
+	return global.stats;
+}
+
+FSI_INLINE_HPP
+void fsi::resetGlobalIoStats()
+{
+	detail::GlobalIoStats& global = detail::globalIoStatsInstance();
+
+	std::lock_guard<std::mutex> lock(global.mutex);
+	global.stats = IoStats();
+}
+
+FSI_INLINE_HPP
+void fsi::addGlobalIoStats(const IoStats& stats)
+{
+	detail::GlobalIoStats& global = detail::globalIoStatsInstance();
+
+	std::lock_guard<std::mutex> lock(global.mutex);
+	global.stats += stats;
+}
\ No newline at end of file
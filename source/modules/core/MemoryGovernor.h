@@ -0,0 +1,147 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include "fsi_core_exports.h"
+#include "../global.h"
+#include <atomic>
+#include <cstdint>
+
+namespace fsi { class MemoryGovernor; class MemoryReservation; struct MemoryUsage; }
+
+/** @brief Memory accounted by a MemoryGovernor.
+*/
+struct fsi::MemoryUsage
+{
+	/** @brief 0 when there is no budget.
+	*/
+	uint64_t budget = 0;
+
+	uint64_t current = 0;
+
+	/** @brief Largest current since the start or the last MemoryGovernor::resetPeak().
+	*/
+	uint64_t peak = 0;
+
+	/** @brief Reservations that got less than they asked for, i.e. operations that ran with smaller
+	* buffers, fewer rows per band or fewer threads.
+	*/
+	uint64_t reductions = 0;
+
+	/** @brief Reservations whose minimum went over the budget.
+	*/
+	uint64_t overBudget = 0;
+};
+
+/** @brief Accounts the memory the library allocates for its own use: scratch buffers and bands,
+thumbnails, cache blocks and the buffers of parallel and direct I/O.
+
+Operations reserve their memory with a MemoryReservation before allocating it. Under a budget they
+get what is left, down to the minimum they need to make progress, and adapt to it: streaming
+operations process fewer rows per band, parallel direct I/O runs fewer chunks at once. The minimum
+is always granted, so the budget bounds the memory of the operations that can adapt but isn't a
+hard limit. Pixels passed in and out by the caller aren't counted.
+
+The process-wide governor is returned by memoryGovernor(). Its budget is read from the
+FSI_MEMORY_BUDGET environment variable at first use (bytes, or with a K, M or G suffix) and can be
+changed at any time.
+*/
+class FSI_CORE_API fsi::MemoryGovernor
+{
+public:
+
+	/** @brief Creates a governor. 0 means no budget.
+	*/
+	MemoryGovernor(uint64_t budget = 0);
+
+	FSI_DISABLE_COPY_MOVE(MemoryGovernor);
+
+public:
+
+	void setBudget(uint64_t budget);
+
+	uint64_t budget() const;
+
+	/** @brief Bytes left under the budget, or UINT64_MAX without a budget.
+	*/
+	uint64_t available() const;
+
+	MemoryUsage usage() const;
+
+	void resetPeak();
+
+	/** @brief Accounts between minimum and desired bytes, as much as the budget allows, and
+	* returns the amount to be passed back to release(). Prefer MemoryReservation.
+	*/
+	uint64_t reserve(uint64_t desired, uint64_t minimum);
+
+	void release(uint64_t size);
+
+private:
+
+	std::atomic<uint64_t> m_budget;
+
+	std::atomic<uint64_t> m_current;
+
+	std::atomic<uint64_t> m_peak;
+
+	std::atomic<uint64_t> m_reductions;
+
+	std::atomic<uint64_t> m_overBudget;
+};
+
+/** @brief Memory reserved from memoryGovernor() for the lifetime of the object.
+*/
+class FSI_CORE_API fsi::MemoryReservation
+{
+public:
+
+	/** @brief Reserves desired bytes, or less down to minimum when the budget is tight.
+	*
+	* @param minimum The least the operation can run with. Equal to desired if it's larger.
+	*/
+	MemoryReservation(uint64_t desired, uint64_t minimum);
+
+	/** @brief Reserves exactly size bytes, for buffers that can't shrink.
+	*/
+	explicit MemoryReservation(uint64_t size = 0);
+
+	~MemoryReservation();
+
+	FSI_DISABLE_COPY_MOVE(MemoryReservation);
+
+public:
+
+	/** @brief The bytes granted.
+	*/
+	uint64_t size() const;
+
+	/** @brief Releases the current reservation and makes a new one.
+	*/
+	void reset(uint64_t desired, uint64_t minimum);
+
+	/** @brief Resets the reservation for a band of rows and returns how many rows it holds,
+	* between minimumRows and desiredRows.
+	*/
+	uint64_t reserveRows(uint64_t desiredRows, uint64_t minimumRows, uint64_t rowBytes);
+
+private:
+
+	uint64_t m_size;
+};
+
+namespace fsi
+{
+	/** @brief Returns the governor of the library's allocations.
+	*/
+	FSI_CORE_API MemoryGovernor& memoryGovernor();
+}
+
+#if FSI_HEADERONLY
+#include "MemoryGovernor.hpp"
+#endif
\ No newline at end of file
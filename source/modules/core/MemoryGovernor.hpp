@@ -0,0 +1,181 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include "MemoryGovernor.h"
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+#include <string>
+
+namespace fsi
+{
+	namespace detail
+	{
+		// "512M", "2G", "1048576". 0 for no budget or a value that can't be read.
+		inline uint64_t parseMemorySize(const char* text)
+		{
+			if (!text || !*text)
+				return 0;
+
+			char* end = nullptr;
+			const unsigned long long value = std::strtoull(text, &end, 10);
+			switch (end && *end ? *end : '\0')
+			{
+			case '\0': return value;
+			case 'k': case 'K': return value * 1024;
+			case 'm': case 'M': return value * 1024 * 1024;
+			case 'g': case 'G': return value * 1024 * 1024 * 1024;
+			default: return 0;
+			}
+		}
+	}
+}
+
+FSI_INLINE_HPP
+fsi::MemoryGovernor::MemoryGovernor(uint64_t budget)
+	: m_budget(budget)
+	, m_current(0)
+	, m_peak(0)
+	, m_reductions(0)
+	, m_overBudget(0)
+{
+}
+
+FSI_INLINE_HPP
+void fsi::MemoryGovernor::setBudget(uint64_t budget)
+{
+	m_budget = budget;
+}
+
+FSI_INLINE_HPP
+uint64_t fsi::MemoryGovernor::budget() const
+{
+	return m_budget;
+}
+
+FSI_INLINE_HPP
+uint64_t fsi::MemoryGovernor::available() const
+{
+	const uint64_t budget = m_budget;
+	if (budget == 0)
+		return std::numeric_limits<uint64_t>::max();
+
+	const uint64_t current = m_current;
+	return budget > current ? budget - current : 0;
+}
+
+FSI_INLINE_HPP
+fsi::MemoryUsage fsi::MemoryGovernor::usage() const
+{
+	MemoryUsage usage;
+	usage.budget = m_budget;
+	usage.current = m_current;
+	usage.peak = m_peak;
+	usage.reductions = m_reductions;
+	usage.overBudget = m_overBudget;
+	return usage;
+}
+
+FSI_INLINE_HPP
+void fsi::MemoryGovernor::resetPeak()
+{
+	m_peak = m_current.load();
+}
+
+FSI_INLINE_HPP
+uint64_t fsi::MemoryGovernor::reserve(uint64_t desired, uint64_t minimum)
+{
+	minimum = std::min(minimum, desired);
+
+	uint64_t current = m_current.load(std::memory_order_relaxed);
+	uint64_t granted;
+	for (;;)
+	{
+		const uint64_t budget = m_budget.load(std::memory_order_relaxed);
+		const uint64_t available = budget == 0 ? desired : (budget > current ? budget - current : 0);
+		granted = std::max(minimum, std::min(desired, available));
+
+		if (m_current.compare_exchange_weak(current, current + granted, std::memory_order_relaxed))
+			break;
+	}
+
+	const uint64_t reached = current + granted;
+	uint64_t peak = m_peak.load(std::memory_order_relaxed);
+	while (reached > peak && !m_peak.compare_exchange_weak(peak, reached, std::memory_order_relaxed))
+	{
+	}
+
+	if (granted < desired)
+		m_reductions.fetch_add(1, std::memory_order_relaxed);
+
+	const uint64_t budget = m_budget.load(std::memory_order_relaxed);
+	if (budget > 0 && granted > 0 && reached > budget)
+		m_overBudget.fetch_add(1, std::memory_order_relaxed);
+
+	return granted;
+}
+
+FSI_INLINE_HPP
+void fsi::MemoryGovernor::release(uint64_t size)
+{
+	m_current.fetch_sub(size, std::memory_order_relaxed);
+}
+
+FSI_INLINE_HPP
+fsi::MemoryReservation::MemoryReservation(uint64_t desired, uint64_t minimum)
+	: m_size(memoryGovernor().reserve(desired, minimum))
+{
+}
+
+FSI_INLINE_HPP
+fsi::MemoryReservation::MemoryReservation(uint64_t size)
+	: m_size(memoryGovernor().reserve(size, size))
+{
+}
+
+FSI_INLINE_HPP
+fsi::MemoryReservation::~MemoryReservation()
+{
+	memoryGovernor().release(m_size);
+}
+
+FSI_INLINE_HPP
+uint64_t fsi::MemoryReservation::size() const
+{
+	return m_size;
+}
+
+FSI_INLINE_HPP
+void fsi::MemoryReservation::reset(uint64_t desired, uint64_t minimum)
+{
+	memoryGovernor().release(m_size);
+	m_size = 0;
+	m_size = memoryGovernor().reserve(desired, minimum);
+}
+
+FSI_INLINE_HPP
+uint64_t fsi::MemoryReservation::reserveRows(uint64_t desiredRows, uint64_t minimumRows, uint64_t rowBytes)
+{
+	minimumRows = std::min(minimumRows, desiredRows);
+	if (rowBytes == 0)
+	{
+		reset(0, 0);
+		return desiredRows;
+	}
+
+	reset(desiredRows * rowBytes, minimumRows * rowBytes);
+	return std::clamp<uint64_t>(m_size / rowBytes, minimumRows, desiredRows);
+}
+
+FSI_INLINE_HPP
+fsi::MemoryGovernor& fsi::memoryGovernor()
+{
+	static MemoryGovernor governor(detail::parseMemorySize(std::getenv("FSI_MEMORY_BUDGET")));
+	return governor;
+}
\ No newline at end of file
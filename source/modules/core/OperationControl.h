@@ -0,0 +1,72 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include "fsi_core_exports.h"
+#include "../global.h"
+#include <cstdint>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+namespace fsi { class OperationControl; }
+
+/** @brief Pauses, resumes or cancels a running Reader/Writer operation from any thread.
+
+Pass an instance to Reader::read() or Writer::write() and call its functions from another thread (e.g.
+a UI thread). Unlike the state requested through ReportProgressCB, which is only seen the next time
+the callback is polled, the worker is woken up immediately.
+*/
+class FSI_CORE_API fsi::OperationControl
+{
+public:
+
+	OperationControl();
+
+	~OperationControl();
+
+	FSI_DISABLE_COPY_MOVE(OperationControl);
+
+public:
+
+	void pause();
+
+	void resume();
+
+	/** @brief Cancels the operation. It also wakes it up if it was paused.
+	*/
+	void cancel();
+
+	bool isPaused() const;
+
+	bool isCanceled() const;
+
+	/** @brief Clears the paused and canceled states so the instance can be reused.
+	*/
+	void reset();
+
+	/** @brief Blocks the calling thread while paused, for up to timeoutMs milliseconds.
+	*
+	* @return false if the operation was canceled.
+	*/
+	bool waitWhilePaused(uint64_t timeoutMs);
+
+private:
+
+	std::mutex m_mutex;
+
+	std::condition_variable m_stateChanged;
+
+	std::atomic<bool> m_paused;
+
+	std::atomic<bool> m_canceled;
+};
+
+#if FSI_HEADERONLY
+#include "OperationControl.hpp"
+#endif
\ No newline at end of file
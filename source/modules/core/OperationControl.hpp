@@ -0,0 +1,81 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include "OperationControl.h"
+#include <chrono>
+
+FSI_INLINE_HPP
+fsi::OperationControl::OperationControl()
+	: m_paused(false)
+	, m_canceled(false)
+{
+}
+
+FSI_INLINE_HPP
+fsi::OperationControl::~OperationControl()
+{
+}
+
+FSI_INLINE_HPP
+void fsi::OperationControl::pause()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_paused = true;
+}
+
+FSI_INLINE_HPP
+void fsi::OperationControl::resume()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_paused = false;
+	}
+	m_stateChanged.notify_all();
+}
+
+FSI_INLINE_HPP
+void fsi::OperationControl::cancel()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_canceled = true;
+		m_paused = false;
+	}
+	m_stateChanged.notify_all();
+}
+
+FSI_INLINE_HPP
+bool fsi::OperationControl::isPaused() const
+{
+	return m_paused;
+}
+
+FSI_INLINE_HPP
+bool fsi::OperationControl::isCanceled() const
+{
+	return m_canceled;
+}
+
+FSI_INLINE_HPP
+void fsi::OperationControl::reset()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_paused = false;
+	m_canceled = false;
+}
+
+FSI_INLINE_HPP
+bool fsi::OperationControl::waitWhilePaused(uint64_t timeoutMs)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_stateChanged.wait_for(lock, std::chrono::milliseconds(timeoutMs),
+		[this]() { return !m_paused || m_canceled; });
+
+	return !m_canceled;
+}
\ No newline at end of file
@@ -8,13 +8,20 @@
 #pragma once
 
 #include "../global.h"
-#include <thread>
+#include "OperationControl.h"
 #include <functional>
 #include <memory>
 #include <atomic>
+#include <chrono>
 
 namespace fsi { class ProgressThread; }
 
+/** @brief Drives progress reporting and pause/resume/cancel requests of a Reader/Writer operation.
+
+Despite its name it doesn't own a thread: the worker calls update() between chunks and the callback is
+invoked inline, at most once per update interval. This keeps short operations free of any thread
+creation and lets OperationControl wake a paused operation immediately.
+*/
 class fsi::ProgressThread
 {
 public:
@@ -42,29 +49,15 @@ public:
 	 */
 	typedef std::function<StateRequest(void* opaquePointer, float progress)> ReportProgressCB;
 
-private:
-
-	// Function that is run when progress is required
-	typedef std::function<float()> CalcProgressCB;
-
-	// Function that is run when operation is canceled
-	typedef std::function<void()> CancelCB;
-
-	// Function that is run when operation is paused
-	typedef std::function<void()> PauseCB;
-
-	// Function that is run when operation is resumed
-	typedef std::function<void()> ResumeCB;
-
 public:
 
+	/** @param control Optional. If nullptr, pause/resume/cancel can only be requested through
+	reportProgressCB.
+	*/
 	ProgressThread(
 		void* reportProgressOpaquePtr,
 		ReportProgressCB reportProgressCB,
-		CalcProgressCB calcProgressCB,
-		CancelCB cancelCB,
-		PauseCB pauseCB,
-		ResumeCB resumeCB,
+		OperationControl* control,
 		uint64_t updateFrequency);
 
 	~ProgressThread();
@@ -73,29 +66,42 @@ public:
 
 public:
 
-	void join(bool completed = false);
+	/** @brief Called by the worker between chunks.
+	*
+	* Reports the progress if the update interval elapsed and applies the requested state. Blocks
+	* while the operation is paused.
+	*
+	* @return false if the operation was canceled and the worker must stop.
+	*/
+	bool update(float progress);
 
-private:
+	/** @brief Reports the final progress (1.0) if the operation completed.
+	*/
+	void finish(bool completed);
 
-	static void updateProgress(
-		void* reportProgressOpaquePtr,
-		ReportProgressCB reportProgressCB,
-		CalcProgressCB calcProgressCB,
-		CancelCB cancelCB,
-		PauseCB pauseCB,
-		ResumeCB resumeCB,
-		const std::atomic<bool>& finished,
-		uint64_t updateFrequency);
+	bool canceled() const;
 
 private:
 
-	std::thread m_thread;
+	// Calls the callback and applies the state it requests
+	void report(float progress);
 
-	std::atomic<bool> m_finish;
+private:
 
 	void* m_reportProgressOpaquePtr;
 
 	ReportProgressCB m_reportProgressCB;
+
+	// Used when the caller doesn't provide one
+	OperationControl m_ownControl;
+
+	OperationControl* m_control;
+
+	std::chrono::milliseconds m_updateFrequency;
+
+	std::chrono::steady_clock::time_point m_lastReport;
+
+	bool m_reported;
 };
 
 #if FSI_HEADERONLY
@@ -6,31 +6,21 @@
 // file, you can obtain one at https://opensource.org/license/mit.
 
 #include "ProgressThread.h"
+#include "Trace.h"
 #include <iostream>
 
 FSI_INLINE_HPP
 fsi::ProgressThread::ProgressThread(
 	void* reportProgressOpaquePtr,
 	ReportProgressCB reportProgressCB,
-	CalcProgressCB calcProgressCB,
-	CancelCB cancelCB,
-	PauseCB pauseCB,
-	ResumeCB resumeCB,
+	OperationControl* control,
 	uint64_t updateFrequency)
-	: m_finish(false)
-	, m_reportProgressOpaquePtr(reportProgressOpaquePtr)
+	: m_reportProgressOpaquePtr(reportProgressOpaquePtr)
 	, m_reportProgressCB(reportProgressCB)
+	, m_control(control ? control : &m_ownControl)
+	, m_updateFrequency(updateFrequency)
+	, m_reported(false)
 {
-	m_thread = std::thread(
-		&fsi::ProgressThread::updateProgress, 
-		reportProgressOpaquePtr,
-		reportProgressCB,
-		calcProgressCB,
-		cancelCB,
-		pauseCB,
-		resumeCB,
-		std::ref(m_finish),
-		updateFrequency);
 }
 
 FSI_INLINE_HPP
@@ -39,55 +29,66 @@ fsi::ProgressThread::~ProgressThread()
 }
 
 FSI_INLINE_HPP
-void fsi::ProgressThread::join(bool completed)
+bool fsi::ProgressThread::update(float progress)
 {
-	m_finish = true;
-	m_thread.join();
+	if (m_reportProgressCB)
+	{
+		const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		if (!m_reported || now - m_lastReport >= m_updateFrequency)
+			report(progress);
+	}
+
+	while (m_control->isPaused())
+	{
+		// Wakes up as soon as OperationControl resumes or cancels. The callback is polled once per
+		// interval in the meantime, since it can request a resume too.
+		if (!m_control->waitWhilePaused(m_updateFrequency.count()))
+			break;
 
+		if (m_control->isPaused() && m_reportProgressCB)
+			report(progress);
+	}
+
+	return !m_control->isCanceled();
+}
+
+FSI_INLINE_HPP
+void fsi::ProgressThread::finish(bool completed)
+{
 	if (completed && m_reportProgressCB)
 		m_reportProgressCB(m_reportProgressOpaquePtr, 1.0f);
 }
 
 FSI_INLINE_HPP
-void fsi::ProgressThread::updateProgress(
-	void* progressOpaquePtr,
-	ReportProgressCB reportProgressCB,
-	CalcProgressCB calcProgressCB,
-	CancelCB cancelCB,
-	PauseCB pauseCB,
-	ResumeCB resumeCB,
-	const std::atomic<bool>& finished,
-	uint64_t updateFrequency)
+bool fsi::ProgressThread::canceled() const
 {
-	if (!reportProgressCB)
-		return;
+	return m_control->isCanceled();
+}
 
-	while (!finished)
-	{
-		// Calculate progress
-		float progress = calcProgressCB();
+FSI_INLINE_HPP
+void fsi::ProgressThread::report(float progress)
+{
+	FSI_TRACE_ZONE("callback", "progress callback");
 
-		// Report progress and get state request
-		StateRequest stateRequest = reportProgressCB(progressOpaquePtr, progress);
+	m_reported = true;
+	m_lastReport = std::chrono::steady_clock::now();
 
-		switch (stateRequest)
-		{
-		case fsi::ProgressThread::StateRequest::Pause:
-			pauseCB();
-			break;
-		case fsi::ProgressThread::StateRequest::Resume:
-			resumeCB();
-			break;
-		case fsi::ProgressThread::StateRequest::Cancel:
-			resumeCB(); // in case it was paused
-			cancelCB();
-			return;
-			break;
-		case fsi::ProgressThread::StateRequest::NoAction:
-		default:
-			break;
-		}
+	// Report progress and get state request
+	StateRequest stateRequest = m_reportProgressCB(m_reportProgressOpaquePtr, progress);
 
-		std::this_thread::sleep_for(std::chrono::milliseconds(updateFrequency));
+	switch (stateRequest)
+	{
+	case fsi::ProgressThread::StateRequest::Pause:
+		m_control->pause();
+		break;
+	case fsi::ProgressThread::StateRequest::Resume:
+		m_control->resume();
+		break;
+	case fsi::ProgressThread::StateRequest::Cancel:
+		m_control->cancel();
+		break;
+	case fsi::ProgressThread::StateRequest::NoAction:
+	default:
+		break;
 	}
 }
\ No newline at end of file
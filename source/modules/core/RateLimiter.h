@@ -0,0 +1,120 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include "fsi_core_exports.h"
+#include "../global.h"
+#include <cstdint>
+#include <chrono>
+#include <mutex>
+
+namespace fsi { class RateLimiter; class RateLimitScope; }
+
+/** @brief Caps the bandwidth and the request rate of the I/O that goes through it (a token bucket).
+
+Attach one to a Reader or a Writer with setRateLimiter(), or to every operation of a thread with a
+RateLimitScope. Sharing an instance between several of them caps their combined traffic, e.g. all
+background conversions, so they don't starve interactive readRect() calls on the same disk.
+
+Requests are split into chunks of at most defaultBufferSize bytes, and each chunk waits until the
+bucket has enough tokens. A bucket holds up to one burst: after an idle period that much I/O goes
+through at full speed. It's thread-safe.
+*/
+class FSI_CORE_API fsi::RateLimiter
+{
+public:
+
+	/** @brief A rate of 0 is unlimited. A burst of 0 allows a tenth of a second of traffic, but never
+	* less than one chunk or one request.
+	*/
+	RateLimiter(uint64_t bytesPerSecond, uint64_t requestsPerSecond = 0, uint64_t burstBytes = 0,
+		uint64_t burstRequests = 0);
+
+	FSI_DISABLE_COPY_MOVE(RateLimiter);
+
+public:
+
+	/** @brief Changes the rates, e.g. to throttle harder while a viewer is active. Waiting requests
+	* keep the delay they were given.
+	*/
+	void setRates(uint64_t bytesPerSecond, uint64_t requestsPerSecond = 0);
+
+	uint64_t bytesPerSecond() const;
+
+	uint64_t requestsPerSecond() const;
+
+	/** @brief Blocks until bytes bytes and requests requests may go. Requests larger than the burst
+	* are let through after waiting for their full size.
+	*/
+	void acquire(uint64_t bytes, uint64_t requests = 1);
+
+	/** @brief Total time that callers were blocked in acquire().
+	*/
+	uint64_t throttledTimeUs() const;
+
+private:
+
+	void refill(std::chrono::steady_clock::time_point now);
+
+private:
+
+	mutable std::mutex m_mutex;
+
+	uint64_t m_bytesPerSecond = 0;
+
+	uint64_t m_requestsPerSecond = 0;
+
+	// 0 picks the burst from the rate
+	uint64_t m_burstBytesSetting = 0;
+
+	uint64_t m_burstRequestsSetting = 0;
+
+	double m_burstBytes = 0.0;
+
+	double m_burstRequests = 0.0;
+
+	// Negative while in debt, i.e. the next requests have to wait
+	double m_byteTokens = 0.0;
+
+	double m_requestTokens = 0.0;
+
+	std::chrono::steady_clock::time_point m_lastRefill;
+
+	uint64_t m_throttledTimeUs = 0;
+};
+
+/** @brief Routes the reads and writes of the calling thread through a limiter during its lifetime.
+Readers and Writers with their own limiter, and nested scopes, take precedence. Passing nullptr
+keeps the current limiter.
+*/
+class FSI_CORE_API fsi::RateLimitScope
+{
+public:
+
+	RateLimitScope(RateLimiter* limiter);
+
+	~RateLimitScope();
+
+	/** @brief Limiter of the calling thread, or nullptr.
+	*/
+	static RateLimiter* current();
+
+	FSI_DISABLE_COPY_MOVE(RateLimitScope);
+
+private:
+
+	static RateLimiter*& threadLimiter();
+
+private:
+
+	RateLimiter* m_previous;
+};
+
+#if FSI_HEADERONLY
+#include "RateLimiter.hpp"
+#endif
\ No newline at end of file
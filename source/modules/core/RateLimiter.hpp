@@ -0,0 +1,137 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include "RateLimiter.h"
+#include "Depth.hpp"
+#include "consts.h"
+#include <algorithm>
+#include <thread>
+
+FSI_INLINE_HPP
+fsi::RateLimiter::RateLimiter(uint64_t bytesPerSecond, uint64_t requestsPerSecond, uint64_t burstBytes,
+	uint64_t burstRequests)
+	: m_burstBytesSetting(burstBytes)
+	, m_burstRequestsSetting(burstRequests)
+	, m_lastRefill(std::chrono::steady_clock::now())
+{
+	setRates(bytesPerSecond, requestsPerSecond);
+
+	m_byteTokens = m_burstBytes;
+	m_requestTokens = m_burstRequests;
+}
+
+FSI_INLINE_HPP
+void fsi::RateLimiter::setRates(uint64_t bytesPerSecond, uint64_t requestsPerSecond)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	refill(std::chrono::steady_clock::now());
+
+	m_bytesPerSecond = bytesPerSecond;
+	m_requestsPerSecond = requestsPerSecond;
+	m_burstBytes = m_burstBytesSetting > 0
+		? static_cast<double>(m_burstBytesSetting)
+		: std::max(static_cast<double>(bytesPerSecond) / 10.0, static_cast<double>(defaultBufferSize));
+	m_burstRequests = m_burstRequestsSetting > 0
+		? static_cast<double>(m_burstRequestsSetting)
+		: std::max(static_cast<double>(requestsPerSecond) / 10.0, 1.0);
+	m_byteTokens = std::min(m_byteTokens, m_burstBytes);
+	m_requestTokens = std::min(m_requestTokens, m_burstRequests);
+}
+
+FSI_INLINE_HPP
+uint64_t fsi::RateLimiter::bytesPerSecond() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_bytesPerSecond;
+}
+
+FSI_INLINE_HPP
+uint64_t fsi::RateLimiter::requestsPerSecond() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_requestsPerSecond;
+}
+
+FSI_INLINE_HPP
+void fsi::RateLimiter::acquire(uint64_t bytes, uint64_t requests)
+{
+	double waitSeconds = 0.0;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		refill(std::chrono::steady_clock::now());
+
+		// The tokens are taken right away and may go negative, so concurrent callers queue up behind
+		// each other instead of all waking up at the same time
+		if (m_bytesPerSecond > 0)
+		{
+			m_byteTokens -= static_cast<double>(bytes);
+			if (m_byteTokens < 0.0)
+				waitSeconds = -m_byteTokens / static_cast<double>(m_bytesPerSecond);
+		}
+
+		if (m_requestsPerSecond > 0)
+		{
+			m_requestTokens -= static_cast<double>(requests);
+			if (m_requestTokens < 0.0)
+				waitSeconds = std::max(waitSeconds, -m_requestTokens / static_cast<double>(m_requestsPerSecond));
+		}
+
+		m_throttledTimeUs += static_cast<uint64_t>(waitSeconds * 1e6);
+	}
+
+	if (waitSeconds > 0.0)
+		std::this_thread::sleep_for(std::chrono::duration<double>(waitSeconds));
+}
+
+FSI_INLINE_HPP
+uint64_t fsi::RateLimiter::throttledTimeUs() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_throttledTimeUs;
+}
+
+FSI_INLINE_HPP
+void fsi::RateLimiter::refill(std::chrono::steady_clock::time_point now)
+{
+	const double elapsed = std::chrono::duration<double>(now - m_lastRefill).count();
+	m_lastRefill = now;
+
+	m_byteTokens = std::min(m_burstBytes, m_byteTokens + elapsed * static_cast<double>(m_bytesPerSecond));
+	m_requestTokens = std::min(m_burstRequests,
+		m_requestTokens + elapsed * static_cast<double>(m_requestsPerSecond));
+}
+
+FSI_INLINE_HPP
+fsi::RateLimitScope::RateLimitScope(RateLimiter* limiter)
+	: m_previous(threadLimiter())
+{
+	if (limiter)
+		threadLimiter() = limiter;
+}
+
+FSI_INLINE_HPP
+fsi::RateLimitScope::~RateLimitScope()
+{
+	threadLimiter() = m_previous;
+}
+
+FSI_INLINE_HPP
+fsi::RateLimiter* fsi::RateLimitScope::current()
+{
+	return threadLimiter();
+}
+
+FSI_INLINE_HPP
+fsi::RateLimiter*& fsi::RateLimitScope::threadLimiter()
+{
+	thread_local RateLimiter* limiter = nullptr;
+	return limiter;
+}
\ No newline at end of file
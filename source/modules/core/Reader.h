@@ -12,7 +12,14 @@
 #include "Depth.hpp"
 #include "FormatVersion.h"
 #include "Header.h"
+#include "IoStats.h"
+#include "IoOptions.h"
+#include "AccessTrace.h"
+#include "RateLimiter.h"
 #include "ProgressThread.h"
+#include "ScaleFilter.h"
+#include "BlockFormat.h"
+#include "SharedBlockCache.h"
 #include <filesystem>
 #include <fstream>
 #include <memory>
@@ -42,23 +49,37 @@ public:
 	*/
 	FormatVersion formatVersion();
 
+	/** @brief Returns the I/O counters of the file opened last. See IoStats.
+	*/
+	IoStats ioStats();
+
 public:
 	/** @brief Opens an FSI file and reads the header information.
 	*
 	* @param path The path to the image file.
+	* @param options How the following read() and readRect() calls access the file.
+	*/
+	void open(const std::filesystem::path& path, const ReadOptions& options = ReadOptions());
+
+	/** @brief Changes the options of an open file, e.g. to read a thumbnail-sized rect with other
+	* settings than the full image.
 	*/
-	void open(const std::filesystem::path& path);
+	void setOptions(const ReadOptions& options);
+
+	ReadOptions options();
 
 	/** @brief Reads image data from a FSI file.
 	*
 	* The function reads the image bytes and optionally a thumbnail from the file. If a thumbnail is
 	* present Header::hasThumb will be true.
 	*
-	* @param data The image data.
+	* @param data The image data, in the layout of ReadOptions::layout (see layoutSizeInBytes()).
 	* @param reportProgressCB The function is called when the progress of the operation is updated. It can
 	* additionally be used for pausing, resuming and canceling the operation.
 	* @param reportProgressOpaquePtr Opaque pointer passed to reportProgressCB in case access to a member
 	* of an instance of opaquePointer is required.
+	* @param control Optional. Pauses, resumes or cancels the operation from another thread with no
+	* polling delay.
 	* 
 	* @warning This function is a one-shot sequential read. It is intended to be called only once,
 	*          immediately after `open()`. Do not call it after `readRect()` or after another
@@ -66,14 +87,14 @@ public:
 	*/
 	bool read(uint8_t* data, uint8_t* thumbData = nullptr,
 		ProgressThread::ReportProgressCB reportProgressCB = nullptr,
-		void* reportProgressOpaquePtr = nullptr);
+		void* reportProgressOpaquePtr = nullptr, OperationControl* control = nullptr);
 
 	/** @brief Reads a specific portion of an FSI file.
 	*
 	* The function reads the image bytes and optionally a thumbnail from the file. If a thumbnail is
 	* present Header::hasThumb will be true.
 	*
-	* @param data The image data.
+	* @param data The image data, in the layout of ReadOptions::layout (see layoutSizeInBytes()).
 	* @param x The X coord of the rect origin (left to right).
 	* @param y The Y coord of the rect origin (top to bottom).
 	* @param width The width of the rect.
@@ -98,12 +119,97 @@ public:
 		uint64_t dstStrideBytes
 	);
 
+	/** @brief readRect() in the given layout instead of the one of the options. Functions that take a
+	* Reader configured by the caller, like computeStats(), read their bands with PixelLayout::Linear.
+	*/
+	bool readRect(
+		uint8_t* data,
+		uint32_t x,
+		uint32_t y,
+		uint32_t width,
+		uint32_t height,
+		uint64_t dstStrideBytes,
+		PixelLayout layout
+	);
+
+	/** @brief Reads a portion of an FSI file downscaled by an integer factor, for previews.
+	*
+	* Each factor x factor block of the rect becomes one pixel of data, which is
+	* scaledExtent(width, factor) x scaledExtent(height, factor) pixels. Partial blocks at the right and
+	* bottom edges still make a pixel. ScaleFilter::Nearest reads one row of every block, so the I/O
+	* shrinks with the factor. ScaleFilter::Box averages the blocks and reads the whole rect, but only
+	* a few rows at a time.
+	*
+	* @param dstStrideBytes Bytes between the rows of data. 0 for packed rows.
+	*
+	* @note ReadOptions::layout doesn't apply, data is always row after row.
+	*/
+	bool readRectScaled(
+		uint8_t* data,
+		uint32_t x,
+		uint32_t y,
+		uint32_t width,
+		uint32_t height,
+		uint32_t factor,
+		ScaleFilter filter = ScaleFilter::Box,
+		uint64_t dstStrideBytes = 0
+	);
+
+	/** @brief Reads a portion of a Uint8 or Uint16 FSI file as a block-compressed texture.
+	*
+	* The rect is read in bands of whole 4-row block rows, which are encoded on fsi::executor() as
+	* they arrive, so the uncompressed rect is never held in memory. See BlockFormat for the channels
+	* each format keeps.
+	*
+	* @param data The blocks, row after row: compressedSizeInBytes(width, height, format) bytes. Blocks
+	* at the right and bottom edges repeat the last column and row of the rect.
+	*/
+	bool readCompressed(
+		uint8_t* data,
+		uint32_t x,
+		uint32_t y,
+		uint32_t width,
+		uint32_t height,
+		BlockFormat format
+	);
+
 	void close();
 
+	/** @brief Records every read(), readRect(), readRectScaled() and readCompressed() call (timestamp,
+	* rect, bytes, latency) to a trace.
+	*
+	* The recorder can be shared with other Readers and outlives close(). Pass nullptr to stop
+	* recording.
+	*/
+	void setAccessTraceRecorder(std::shared_ptr<AccessTraceRecorder> recorder);
+
+	/** @brief Throttles the reads of this Reader. The limiter can be shared with other Readers and
+	* Writers to cap their combined traffic. Pass nullptr to use the limiter of the calling thread's
+	* RateLimitScope, if any.
+	*/
+	void setRateLimiter(std::shared_ptr<RateLimiter> limiter);
+
+	/** @brief Serves readRect() and readRectScaled() from a block cache shared with other Readers
+	* and processes. Pass nullptr to read from the file again. Only the blocks missing from the cache
+	* are read from the file, through the rate limiter.
+	*/
+	void setBlockCache(std::shared_ptr<SharedBlockCache> cache);
+
+private:
+
+	template <typename ReadFn>
+	bool traced(AccessTraceEvent event, ReadFn readFn);
+
 private:
 
 	std::unique_ptr<ReaderImpl> m_impl;
 
+	std::shared_ptr<AccessTraceRecorder> m_traceRecorder;
+
+	std::shared_ptr<RateLimiter> m_rateLimiter;
+
+	std::shared_ptr<SharedBlockCache> m_blockCache;
+
 	FSI_DISABLE_COPY_MOVE(Reader);
 };
 
@@ -80,8 +80,18 @@ fsi::FormatVersion fsi::Reader::formatVersion()
 }
 
 FSI_INLINE_HPP
-void fsi::Reader::open(const std::filesystem::path& path)
+fsi::IoStats fsi::Reader::ioStats()
 {
+	if (!m_impl)
+		return IoStats();
+	return m_impl->ioStats();
+}
+
+FSI_INLINE_HPP
+void fsi::Reader::open(const std::filesystem::path& path, const ReadOptions& options)
+{
+	RateLimitScope rateLimit(m_rateLimiter.get());
+
 	FormatVersion formatVersion = formatVersionFromFile(path);
 
 	switch (formatVersion)
@@ -98,16 +108,50 @@ void fsi::Reader::open(const std::filesystem::path& path)
 			+ " is not a valid FSI format version");
 	}
 
-	m_impl->open(path);
+	m_impl->setBlockCache(m_blockCache);
+	m_impl->open(path, options);
+}
+
+FSI_INLINE_HPP
+void fsi::Reader::setOptions(const ReadOptions& options)
+{
+	if (!m_impl)
+		throw ExceptionFileIsNotOpen("The file must be opened before setting the options");
+
+	m_impl->setOptions(options);
+}
+
+FSI_INLINE_HPP
+fsi::ReadOptions fsi::Reader::options()
+{
+	if (!m_impl)
+		return ReadOptions();
+	return m_impl->options();
 }
 
 FSI_INLINE_HPP
 bool fsi::Reader::read(uint8_t* data, uint8_t* thumbData,
-	ProgressThread::ReportProgressCB reportProgressCB, void* reportProgressOpaquePtr)
+	ProgressThread::ReportProgressCB reportProgressCB, void* reportProgressOpaquePtr,
+	OperationControl* control)
 {
 	if (!m_impl)
 		throw ExceptionFileIsNotOpen("The file must be opened before reading can be attempted");
-	return m_impl->read(data, thumbData, reportProgressCB, reportProgressOpaquePtr);
+
+	RateLimitScope rateLimit(m_rateLimiter.get());
+
+	if (!m_traceRecorder)
+		return m_impl->read(data, thumbData, reportProgressCB, reportProgressOpaquePtr, control);
+
+	const Header header = m_impl->header();
+
+	AccessTraceEvent event;
+	event.op = AccessTraceEvent::Op::Read;
+	event.width = header.width;
+	event.height = header.height;
+
+	return traced(event, [&]() {
+		return m_impl->read(data, thumbData, reportProgressCB, reportProgressOpaquePtr, control);
+	});
 }
 
 FSI_INLINE_HPP bool fsi::Reader::readRect(
@@ -121,7 +165,44 @@ FSI_INLINE_HPP bool fsi::Reader::readRect(
 	if (!m_impl)
 		throw ExceptionFileIsNotOpen("The file must be opened before reading can be attempted");
 
-	return m_impl->readRect(data, x, y, width, height);
+	RateLimitScope rateLimit(m_rateLimiter.get());
+
+	if (!m_traceRecorder)
+		return m_impl->readRect(data, x, y, width, height);
+
+	AccessTraceEvent event;
+	event.x = x;
+	event.y = y;
+	event.width = width;
+	event.height = height;
+
+	return traced(event, [&]() { return m_impl->readRect(data, x, y, width, height); });
+}
+
+FSI_INLINE_HPP bool fsi::Reader::readRect(
+	uint8_t* data,
+	uint32_t x,
+	uint32_t y,
+	uint32_t width,
+	uint32_t height,
+	uint64_t dstStrideBytes
+)
+{
+	if (!m_impl)
+		throw ExceptionFileIsNotOpen("The file must be opened before reading can be attempted");
+
+	RateLimitScope rateLimit(m_rateLimiter.get());
+
+	if (!m_traceRecorder)
+		return m_impl->readRect(data, x, y, width, height, dstStrideBytes);
+
+	AccessTraceEvent event;
+	event.x = x;
+	event.y = y;
+	event.width = width;
+	event.height = height;
+
+	return traced(event, [&]() { return m_impl->readRect(data, x, y, width, height, dstStrideBytes); });
 }
 
 FSI_INLINE_HPP bool fsi::Reader::readRect(
@@ -130,13 +211,86 @@ FSI_INLINE_HPP bool fsi::Reader::readRect(
 	uint32_t y,
 	uint32_t width,
 	uint32_t height,
+	uint64_t dstStrideBytes,
+	PixelLayout layout
+)
+{
+	if (!m_impl)
+		throw ExceptionFileIsNotOpen("The file must be opened before reading can be attempted");
+
+	RateLimitScope rateLimit(m_rateLimiter.get());
+
+	if (!m_traceRecorder)
+		return m_impl->readRect(data, x, y, width, height, dstStrideBytes, layout);
+
+	AccessTraceEvent event;
+	event.x = x;
+	event.y = y;
+	event.width = width;
+	event.height = height;
+
+	return traced(event, [&]() { return m_impl->readRect(data, x, y, width, height, dstStrideBytes, layout); });
+}
+
+FSI_INLINE_HPP bool fsi::Reader::readRectScaled(
+	uint8_t* data,
+	uint32_t x,
+	uint32_t y,
+	uint32_t width,
+	uint32_t height,
+	uint32_t factor,
+	ScaleFilter filter,
 	uint64_t dstStrideBytes
 )
 {
 	if (!m_impl)
 		throw ExceptionFileIsNotOpen("The file must be opened before reading can be attempted");
 
-	return m_impl->readRect(data, x, y, width, height, dstStrideBytes);
+	RateLimitScope rateLimit(m_rateLimiter.get());
+
+	if (!m_traceRecorder)
+		return m_impl->readRectScaled(data, x, y, width, height, factor, filter, dstStrideBytes);
+
+	AccessTraceEvent event;
+	event.op = AccessTraceEvent::Op::ReadRectScaled;
+	event.x = x;
+	event.y = y;
+	event.width = width;
+	event.height = height;
+	event.factor = factor;
+	event.filter = filter;
+
+	return traced(event, [&]() {
+		return m_impl->readRectScaled(data, x, y, width, height, factor, filter, dstStrideBytes);
+	});
+}
+
+FSI_INLINE_HPP bool fsi::Reader::readCompressed(
+	uint8_t* data,
+	uint32_t x,
+	uint32_t y,
+	uint32_t width,
+	uint32_t height,
+	BlockFormat format
+)
+{
+	if (!m_impl)
+		throw ExceptionFileIsNotOpen("The file must be opened before reading can be attempted");
+
+	RateLimitScope rateLimit(m_rateLimiter.get());
+
+	if (!m_traceRecorder)
+		return m_impl->readCompressed(data, x, y, width, height, format);
+
+	AccessTraceEvent event;
+	event.op = AccessTraceEvent::Op::ReadCompressed;
+	event.x = x;
+	event.y = y;
+	event.width = width;
+	event.height = height;
+	event.format = format;
+
+	return traced(event, [&]() { return m_impl->readCompressed(data, x, y, width, height, format); });
 }
 
 FSI_INLINE_HPP
@@ -145,4 +299,65 @@ void fsi::Reader::close()
 	if (!m_impl)
 		return;
 	return m_impl->close();
+}
+
+FSI_INLINE_HPP
+void fsi::Reader::setAccessTraceRecorder(std::shared_ptr<AccessTraceRecorder> recorder)
+{
+	m_traceRecorder = recorder;
+}
+
+FSI_INLINE_HPP
+void fsi::Reader::setRateLimiter(std::shared_ptr<RateLimiter> limiter)
+{
+	m_rateLimiter = limiter;
+}
+
+FSI_INLINE_HPP
+void fsi::Reader::setBlockCache(std::shared_ptr<SharedBlockCache> cache)
+{
+	m_blockCache = cache;
+	if (m_impl)
+		m_impl->setBlockCache(cache);
+}
+
+template <typename ReadFn>
+bool fsi::Reader::traced(AccessTraceEvent event, ReadFn readFn)
+{
+	const Header header = m_impl->header();
+
+	event.timestampUs = m_traceRecorder->now();
+
+	bool result = false;
+	try
+	{
+		result = readFn();
+	}
+	catch (...)
+	{
+		event.latencyUs = m_traceRecorder->now() - event.timestampUs;
+		m_traceRecorder->record(header, event);
+		throw;
+	}
+
+	event.latencyUs = m_traceRecorder->now() - event.timestampUs;
+
+	// read() returns true when it was canceled, the others when they succeeded
+	event.success = event.op == AccessTraceEvent::Op::Read ? !result : result;
+	if (event.success && event.op == AccessTraceEvent::Op::ReadCompressed)
+	{
+		event.bytes = compressedSizeInBytes(event.width, event.height, event.format);
+	}
+	else if (event.success)
+	{
+		uint64_t pixels = static_cast<uint64_t>(event.width) * event.height;
+		if (event.op == AccessTraceEvent::Op::ReadRectScaled)
+			pixels = static_cast<uint64_t>(scaledExtent(event.width, event.factor))
+				* scaledExtent(event.height, event.factor);
+
+		event.bytes = pixels * header.channels * sizeOfDepth(header.depth);
+	}
+
+	m_traceRecorder->record(header, event);
+	return result;
 }
\ No newline at end of file
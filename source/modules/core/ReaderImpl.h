@@ -11,7 +11,12 @@
 #include "Depth.hpp"
 #include "FormatVersion.h"
 #include "Header.h"
+#include "IoStats.h"
+#include "IoOptions.h"
 #include "ProgressThread.h"
+#include "ScaleFilter.h"
+#include "BlockFormat.h"
+#include "SharedBlockCache.h"
 #include "exceptions.hpp"
 #include <filesystem>
 #include <fstream>
@@ -33,13 +38,19 @@ public:
 
 	virtual FormatVersion formatVersion() = 0;
 
+	IoStats ioStats();
+
 public:
 
-	void open(const std::filesystem::path& path);
+	void open(const std::filesystem::path& path, const ReadOptions& options = ReadOptions());
+
+	void setOptions(const ReadOptions& options);
+
+	ReadOptions options();
 
 	bool read(uint8_t* data, uint8_t* thumbData = nullptr,
 		ProgressThread::ReportProgressCB reportProgressCB = nullptr,
-		void* reportProgressOpaquePtr = nullptr);
+		void* reportProgressOpaquePtr = nullptr, OperationControl* control = nullptr);
 
 	bool readRect(
 		uint8_t* data,
@@ -58,15 +69,55 @@ public:
 		uint64_t dstStrideBytes
 	);
 
+	bool readRect(
+		uint8_t* data,
+		uint32_t x,
+		uint32_t y,
+		uint32_t width,
+		uint32_t height,
+		uint64_t dstStrideBytes,
+		PixelLayout layout
+	);
+
+	bool readRectScaled(uint8_t* data, uint32_t x, uint32_t y, uint32_t width, uint32_t height,
+		uint32_t factor, ScaleFilter filter, uint64_t dstStrideBytes);
+
+	bool readCompressed(uint8_t* data, uint32_t x, uint32_t y, uint32_t width, uint32_t height,
+		BlockFormat format);
+
 	void close();
 
+	void setBlockCache(std::shared_ptr<SharedBlockCache> cache);
+
+protected:
+
+	/** @brief Reads the image data section, which starts at the current position of file, with the
+	* backend, chunk size and threads of the options.
+	*/
+	void readImageData(std::ifstream& file, uint8_t* data, uint64_t size, ProgressThread& progress,
+		IoStats& stats);
+
 private:
 
-	virtual void open(std::ifstream& file, Header& header) = 0;
+	// readImageData() in the layout of the options
+	void readImageDataSwizzled(std::ifstream& file, uint8_t* data, uint64_t size, ProgressThread& progress,
+		IoStats& stats);
+
+	virtual void open(std::ifstream& file, Header& header, IoStats& stats) = 0;
 
 	virtual void read(std::ifstream& file, const Header& header, uint8_t* data, uint8_t* thumbData,
-		const std::atomic<bool>& paused, const std::atomic<bool>& canceled,
-		std::atomic<float>& progress) = 0;
+		ProgressThread& progress, IoStats& stats) = 0;
+
+	// Opens or closes the file descriptor of IoBackend::Positional to match the options
+	void applyOptions();
+
+	// The rows of readRect() in PixelLayout::Linear, after the checks
+	void readRows(uint8_t* data, uint32_t x, uint32_t y, uint32_t width, uint32_t height,
+		uint64_t dstStrideBytes);
+
+	// readRect() through m_blockCache
+	void readRectCached(uint8_t* data, uint32_t x, uint32_t y, uint32_t width, uint32_t height,
+		uint64_t dstStrideBytes);
 
 private:
 
@@ -76,6 +127,17 @@ private:
 
 	std::filesystem::path m_path;
 
+	IoStats m_ioStats;
+
+	ReadOptions m_options;
+
+	// Only open with IoBackend::Positional
+	int m_fd = -1;
+
+	std::shared_ptr<SharedBlockCache> m_blockCache;
+
+	SharedBlockCache::FileKey m_blockCacheKey;
+
 	FSI_DISABLE_COPY_MOVE(ReaderImpl);
 };
 
@@ -11,11 +11,26 @@
 #include "ReaderImplV1.h"
 #include "ReaderImplV2.h"
 #include "consts.h"
+#include "io.h"
+#include "proc.h"
+#include "Trace.h"
+#include "tuning.h"
+#include "MemoryGovernor.h"
+#include "layout.h"
+#include "bcn.h"
+#include "Executor.h"
 
 #include <iostream>
 #include <atomic>
+#include <cstring>
 #include <string>
 #include <stdexcept>
+#include <vector>
+
+#if !defined(_WIN32)
+	#include <cerrno>
+	#include <unistd.h>
+#endif
 
 FSI_INLINE_HPP
 fsi::ReaderImpl::ReaderImpl()
@@ -37,8 +52,16 @@ fsi::Header fsi::ReaderImpl::header()
 }
 
 FSI_INLINE_HPP
-void fsi::ReaderImpl::open(const std::filesystem::path& path)
+fsi::IoStats fsi::ReaderImpl::ioStats()
 {
+	return m_ioStats;
+}
+
+FSI_INLINE_HPP
+void fsi::ReaderImpl::open(const std::filesystem::path& path, const ReadOptions& options)
+{
+	FSI_TRACE_ZONE("api", "Reader::open");
+
 	// Check file extension
 	if (path.extension() != expectedFileExtension)
 		throw ExceptionInvalidFileExtension();
@@ -46,15 +69,19 @@ void fsi::ReaderImpl::open(const std::filesystem::path& path)
 	// Store path
 	m_path = path;
 
+	// The stats cover the file opened last
+	m_ioStats = IoStats();
+	io::GlobalStatsScope globalStats(m_ioStats);
+
 	// Open file
 	m_file = std::ifstream(path, std::ios::binary);
 	if (m_file.fail())
 		throw ExceptionFailedToOpenFile();
 
 	// Read and check signature
-	const uint8_t formatSignature[sizeof(expectedFormatSignature)] = {};
+	uint8_t formatSignature[sizeof(expectedFormatSignature)] = {};
 	{
-		m_file.read((char*)formatSignature, sizeof(expectedFormatSignature));
+		io::read(m_file, formatSignature, sizeof(expectedFormatSignature), m_ioStats);
 
 		for (size_t c = 0; c < sizeof(expectedFormatSignature); c++)
 		{
@@ -68,7 +95,7 @@ void fsi::ReaderImpl::open(const std::filesystem::path& path)
 
 	// Read the version of the file specification
 	FormatVersion formatVersionFromFile;
-	m_file.read((char*)(&formatVersionFromFile), sizeof(uint32_t));
+	io::read(m_file, (uint8_t*)(&formatVersionFromFile), sizeof(uint32_t), m_ioStats);
 	
 	switch (formatVersionFromFile)
 	{
@@ -89,7 +116,14 @@ void fsi::ReaderImpl::open(const std::filesystem::path& path)
 	// Read the rest of the header specific to the file version
 	try
 	{
-		open(m_file, m_header);
+		FSI_TRACE_ZONE("io", "parse header");
+		open(m_file, m_header, m_ioStats);
+
+		m_options = applyIoProfile(m_path, options);
+		applyOptions();
+
+		if (m_blockCache)
+			m_blockCacheKey = SharedBlockCache::fileKey(m_path);
 	}
 	catch (...)
 	{
@@ -99,73 +133,183 @@ void fsi::ReaderImpl::open(const std::filesystem::path& path)
 	}
 }
 
-namespace
+FSI_INLINE_HPP
+void fsi::ReaderImpl::setOptions(const ReadOptions& options)
 {
-    inline uint64_t fsiImageDataOffset(const fsi::FormatVersion formatVersion)
-    {
-        switch (formatVersion)
-        {
-        case fsi::FormatVersion::V1:
-            return
-                sizeof(fsi::expectedFormatSignature) +
-                sizeof(uint32_t) + // version
-                sizeof(uint32_t) + // width
-                sizeof(uint32_t) + // height
-                sizeof(uint32_t) + // channels
-                sizeof(uint32_t);  // depth
-
-        case fsi::FormatVersion::V2:
-            return
-                sizeof(fsi::expectedFormatSignature) +
-                sizeof(uint32_t) + // version
-                sizeof(uint32_t) + // width
-                sizeof(uint32_t) + // height
-                sizeof(uint32_t) + // channels
-                sizeof(uint8_t)  + // depth
-                sizeof(uint8_t)  + // hasThumb
-                sizeof(uint16_t) + // thumbWidth
-                sizeof(uint16_t) + // thumbHeight
-                fsi::thumbSizeInBytes;
-
-        default:
-            throw fsi::ExceptionInvalidFormatVersion(
-                "Invalid FSI format version while reading rectangle."
-            );
-        }
-    }
+	m_options = applyIoProfile(m_path, options);
+	if (m_file.is_open())
+		applyOptions();
+}
+
+FSI_INLINE_HPP
+fsi::ReadOptions fsi::ReaderImpl::options()
+{
+	return m_options;
+}
+
+FSI_INLINE_HPP
+void fsi::ReaderImpl::applyOptions()
+{
+#if !defined(_WIN32)
+	if (m_fd >= 0)
+	{
+		::close(m_fd);
+		m_fd = -1;
+	}
+
+	if (m_options.backend == IoBackend::Positional)
+	{
+		bool direct = m_options.directIo;
+		m_fd = io::openFile(m_path, false, direct);
+		if (m_fd < 0)
+			throw ExceptionFailedToOpenFile(std::strerror(errno));
+
+		io::adviseCache(m_fd, m_options.cacheAdvice);
+	}
+#endif
+}
+
+FSI_INLINE_HPP
+void fsi::ReaderImpl::readImageData(std::ifstream& file, uint8_t* data, uint64_t size, ProgressThread& progress,
+	IoStats& stats)
+{
+	const uint64_t chunkSize = std::clamp<uint64_t>(m_options.chunkSize, 1, size);
+
+	if (m_options.layout != PixelLayout::Linear)
+	{
+		readImageDataSwizzled(file, data, size, progress, stats);
+		return;
+	}
+
+#if !defined(_WIN32)
+	if (m_fd >= 0)
+	{
+		const uint64_t offset = io::imageDataOffset(formatVersion());
+
+		io::forEachChunk((size + chunkSize - 1) / chunkSize, m_options.threads, &progress, stats,
+			[&](uint64_t chunk, IoStats& chunkStats)
+		{
+			FSI_TRACE_ZONE("io", "read chunk");
+
+			const uint64_t begin = chunk * chunkSize;
+			if (!io::readAt(m_fd, data + begin, std::min(chunkSize, size - begin), offset + begin, chunkStats))
+				throw std::runtime_error(std::string("Failed to read FSI image data: ") + std::strerror(errno));
+		}, m_options.directIo ? chunkSize : 0);
+		return;
+	}
+#endif
+
+	// Read data
+	size_t ptr_offset = 0;
+	const size_t total = size - chunkSize;
+	for (; ptr_offset < total; ptr_offset += chunkSize)
+	{
+		if (!progress.update(static_cast<float>(ptr_offset) / static_cast<float>(total)))
+			return;
+
+		FSI_TRACE_ZONE("io", "read chunk");
+		io::read(file, (uint8_t*)(data + ptr_offset), chunkSize, stats);
+	}
+
+	// Read remaining bytes (if any)
+	size_t remainder_size = size % chunkSize;
+	if (remainder_size == 0)
+		remainder_size = chunkSize;
+	size_t remainder_ptr_offset = size - remainder_size;
+	FSI_TRACE_ZONE("io", "read chunk");
+	io::read(file, (uint8_t*)(data + remainder_ptr_offset), remainder_size, stats);
+}
+
+FSI_INLINE_HPP
+void fsi::ReaderImpl::readImageDataSwizzled(std::ifstream& file, uint8_t* data, uint64_t size,
+	ProgressThread& progress, IoStats& stats)
+{
+	const uint64_t height = m_header.height;
+	const uint64_t rowSize = size / height;
+	const uint64_t pixelBytes = static_cast<uint64_t>(m_header.channels) * sizeOfDepth(m_header.depth);
+	const uint64_t tileSize = m_options.layoutTileSize;
+	const uint64_t chunkSize = std::max<uint64_t>(m_options.chunkSize, 1);
+
+	// Bands of whole tile rows, each read like the data section and swizzled into data. A band holds a
+	// chunk for every thread when the memory budget allows it.
+	MemoryReservation memory;
+	const uint64_t tileRows = memory.reserveRows(
+		std::max<uint64_t>(chunkSize * std::max<uint32_t>(m_options.threads, 1) / (tileSize * rowSize), 1), 1,
+		tileSize * rowSize);
+	const uint64_t bandHeight = tileRows * tileSize;
+	std::vector<uint8_t> band(std::min(bandHeight, height) * rowSize);
+
+	for (uint64_t y = 0; y < height; y += bandHeight)
+	{
+		if (!progress.update(static_cast<float>(y) / static_cast<float>(height)))
+			return;
+
+		const uint64_t rows = std::min(bandHeight, height - y);
+		const uint64_t bandSize = rows * rowSize;
+
+#if !defined(_WIN32)
+		if (m_fd >= 0)
+		{
+			const uint64_t offset = io::imageDataOffset(formatVersion()) + y * rowSize;
+			const uint64_t bandChunk = std::min(chunkSize, bandSize);
+
+			io::forEachChunk((bandSize + bandChunk - 1) / bandChunk, m_options.threads, nullptr, stats,
+				[&](uint64_t chunk, IoStats& chunkStats)
+			{
+				FSI_TRACE_ZONE("io", "read chunk");
+
+				const uint64_t begin = chunk * bandChunk;
+				if (!io::readAt(m_fd, band.data() + begin, std::min(bandChunk, bandSize - begin), offset + begin,
+					chunkStats))
+				{
+					throw std::runtime_error(std::string("Failed to read FSI image data: ") + std::strerror(errno));
+				}
+			}, m_options.directIo ? bandChunk : 0);
+		}
+		else
+#endif
+		{
+			FSI_TRACE_ZONE("io", "read chunk");
+			io::read(file, band.data(), bandSize, stats);
+		}
+
+		FSI_TRACE_ZONE("compute", "swizzle rows");
+		swizzleRows(band.data(), rowSize, m_header.width, static_cast<uint32_t>(y), static_cast<uint32_t>(rows),
+			pixelBytes, m_options.layout, m_options.layoutTileSize, data);
+	}
 }
 
 FSI_INLINE_HPP
 bool fsi::ReaderImpl::read(uint8_t* data, uint8_t* thumbData,
-	ProgressThread::ReportProgressCB reportProgressCB, void* reportProgressOpaquePtr)
+	ProgressThread::ReportProgressCB reportProgressCB, void* reportProgressOpaquePtr,
+	OperationControl* control)
 {
 	if (!m_file.is_open())
 		throw ExceptionFileIsNotOpen("The file must be opened before reading can be attempted");
 
-	std::atomic<bool> canceled = false;
-	std::atomic<bool> paused = false;
-	std::atomic<float> progress = 0.0f;
-	ProgressThread progressThread(reportProgressOpaquePtr, reportProgressCB,
-		[&progress]() { return progress.load(std::memory_order_relaxed); },
-		[&canceled]() { canceled = true; },
-		[&paused]() { paused = true; },
-		[&paused]() { paused = false; },
-		progressCallbackInterval);
+	if (!isValidLayout(m_options.layout, m_options.layoutTileSize))
+		throw std::runtime_error("Invalid pixel layout or layout tile size.");
+
+	FSI_TRACE_ZONE("api", "Reader::read");
+	io::GlobalStatsScope globalStats(m_ioStats);
+
+	ProgressThread progressThread(reportProgressOpaquePtr, reportProgressCB, control,
+		m_options.progressIntervalMs);
 
 	// Read the data specific to the file version
 	try
 	{
-		read(m_file, m_header, data, thumbData, paused, canceled, progress);
+		read(m_file, m_header, data, thumbData, progressThread, m_ioStats);
 	}
 	catch (...)
 	{
-		// Join the progress thread, close file and rethrow the exception
-		progressThread.join(false);
+		// Close file and rethrow the exception
 		close();
 		throw;
 	}
 
-	progressThread.join(!canceled);
+	const bool canceled = progressThread.canceled();
+	progressThread.finish(!canceled);
 	close();
 	return canceled;
 }
@@ -204,6 +348,20 @@ bool fsi::ReaderImpl::readRect(
     uint32_t height,
     uint64_t dstStrideBytes
 )
+{
+    return readRect(data, x, y, width, height, dstStrideBytes, m_options.layout);
+}
+
+FSI_INLINE_HPP
+bool fsi::ReaderImpl::readRect(
+    uint8_t* data,
+    uint32_t x,
+    uint32_t y,
+    uint32_t width,
+    uint32_t height,
+    uint64_t dstStrideBytes,
+    PixelLayout layout
+)
 {
     if (!m_file.is_open())
         throw ExceptionFileIsNotOpen("The file must be opened before reading can be attempted");
@@ -240,17 +398,117 @@ bool fsi::ReaderImpl::readRect(
     const uint64_t bytesPerPixel =
         static_cast<uint64_t>(m_header.channels) * bytesPerChannel;
 
-    const uint64_t sourceRowSize =
-        static_cast<uint64_t>(m_header.width) * bytesPerPixel;
-
     const uint64_t targetRowSize =
         static_cast<uint64_t>(width) * bytesPerPixel;
 
     if (dstStrideBytes < targetRowSize)
         throw std::runtime_error("Destination stride is smaller than the rectangle row size.");
 
+    if (layout != PixelLayout::Linear && dstStrideBytes != targetRowSize)
+        throw std::runtime_error("A destination stride can't be used with a swizzled layout.");
+
+    if (!isValidLayout(layout, m_options.layoutTileSize))
+        throw std::runtime_error("Invalid pixel layout or layout tile size.");
+
+    FSI_TRACE_ZONE("api", "Reader::readRect");
+    io::GlobalStatsScope globalStats(m_ioStats);
+
+    m_ioStats.bytesRequested += targetRowSize * height;
+
+    if (layout == PixelLayout::Linear)
+    {
+        readRows(data, x, y, width, height, dstStrideBytes);
+        return true;
+    }
+
+    // Bands of whole tile rows, swizzled into data as they arrive
+    const uint64_t tileSize = m_options.layoutTileSize;
+    MemoryReservation memory;
+    const uint64_t tileRows = memory.reserveRows(std::max<uint64_t>(m_options.chunkSize / (tileSize * targetRowSize), 1),
+        1, tileSize * targetRowSize);
+    const uint64_t bandHeight = tileRows * tileSize;
+    std::vector<uint8_t> band(std::min<uint64_t>(bandHeight, height) * targetRowSize);
+
+    for (uint64_t bandY = 0; bandY < height; bandY += bandHeight)
+    {
+        const uint32_t rows = static_cast<uint32_t>(std::min<uint64_t>(bandHeight, height - bandY));
+        readRows(band.data(), x, static_cast<uint32_t>(y + bandY), width, rows, targetRowSize);
+
+        FSI_TRACE_ZONE("compute", "swizzle rows");
+        swizzleRows(band.data(), targetRowSize, width, static_cast<uint32_t>(bandY), rows, bytesPerPixel,
+            layout, m_options.layoutTileSize, data);
+    }
+
+    return true;
+}
+
+FSI_INLINE_HPP
+void fsi::ReaderImpl::readRows(uint8_t* data, uint32_t x, uint32_t y, uint32_t width, uint32_t height,
+    uint64_t dstStrideBytes)
+{
+    const uint64_t bytesPerPixel =
+        static_cast<uint64_t>(m_header.channels) * sizeOfDepth(m_header.depth);
+
+    const uint64_t sourceRowSize =
+        static_cast<uint64_t>(m_header.width) * bytesPerPixel;
+
+    const uint64_t targetRowSize =
+        static_cast<uint64_t>(width) * bytesPerPixel;
+
     const uint64_t imageDataOffset =
-        fsiImageDataOffset(formatVersion());
+        io::imageDataOffset(formatVersion());
+
+#if !defined(_WIN32)
+    if (m_blockCache)
+    {
+        readRectCached(data, x, y, width, height, dstStrideBytes);
+        return;
+    }
+
+    if (m_fd >= 0)
+    {
+        // Full-width rows packed in the destination are one range, read in chunks. Otherwise every
+        // row is a range.
+        const bool contiguous = targetRowSize == sourceRowSize && dstStrideBytes == targetRowSize;
+        const uint64_t size = contiguous ? targetRowSize * height : targetRowSize;
+        const uint64_t chunkSize = contiguous ? std::clamp<uint64_t>(m_options.chunkSize, 1, size) : size;
+        const uint64_t chunksPerRange = (size + chunkSize - 1) / chunkSize;
+
+        io::forEachChunk(contiguous ? chunksPerRange : height, m_options.threads, nullptr, m_ioStats,
+            [&](uint64_t chunk, IoStats& chunkStats)
+        {
+            const uint64_t begin = contiguous ? chunk * chunkSize : 0;
+            const uint64_t row = contiguous ? 0 : chunk;
+            const uint64_t sourceOffset = imageDataOffset + (y + row) * sourceRowSize + x * bytesPerPixel + begin;
+
+            if (!io::readAt(m_fd, data + row * dstStrideBytes + begin, std::min(chunkSize, size - begin),
+                sourceOffset, chunkStats))
+            {
+                throw std::runtime_error(std::string("Failed to read FSI rectangle: ") + std::strerror(errno));
+            }
+        }, m_options.directIo ? chunkSize : 0);
+
+        return;
+    }
+#endif
+
+    // Full-width rows packed in the destination are contiguous in the file too: one seek and one read
+    if (targetRowSize == sourceRowSize && dstStrideBytes == targetRowSize)
+    {
+        m_file.clear();
+
+        io::seek(m_file, imageDataOffset + static_cast<uint64_t>(y) * sourceRowSize, m_ioStats);
+
+        if (!m_file)
+            throw std::runtime_error("Failed to seek while reading FSI rectangle.");
+
+        io::read(m_file, data, targetRowSize * height, m_ioStats);
+
+        if (!m_file)
+            throw std::runtime_error("Failed to read row while reading FSI rectangle.");
+
+        return;
+    }
 
     for (uint32_t row = 0; row < height; ++row)
     {
@@ -264,29 +522,288 @@ bool fsi::ReaderImpl::readRect(
 
         m_file.clear();
 
-        m_file.seekg(
-            static_cast<std::streamoff>(sourceOffset),
-            std::ios::beg
-        );
+        io::seek(m_file, sourceOffset, m_ioStats);
 
         if (!m_file)
             throw std::runtime_error("Failed to seek while reading FSI rectangle.");
 
-        m_file.read(
-            reinterpret_cast<char*>(targetRow),
-            static_cast<std::streamsize>(targetRowSize)
-        );
+        io::read(m_file, targetRow, targetRowSize, m_ioStats);
 
         if (!m_file)
             throw std::runtime_error("Failed to read row while reading FSI rectangle.");
     }
+}
 
-    return true;
+FSI_INLINE_HPP
+bool fsi::ReaderImpl::readRectScaled(uint8_t* data, uint32_t x, uint32_t y, uint32_t width, uint32_t height,
+	uint32_t factor, ScaleFilter filter, uint64_t dstStrideBytes)
+{
+	if (!m_file.is_open())
+		throw ExceptionFileIsNotOpen("The file must be opened before reading can be attempted");
+
+	if (!data)
+		throw std::runtime_error("Cannot read rectangle into a null data pointer.");
+
+	if (width == 0 || height == 0)
+		throw std::runtime_error("Rectangle width and height must be greater than zero.");
+
+	if (factor == 0)
+		throw std::runtime_error("Scale factor must be greater than zero.");
+
+	if (static_cast<uint64_t>(x) + width > m_header.width || static_cast<uint64_t>(y) + height > m_header.height)
+		throw std::runtime_error("Requested rectangle is outside the image bounds.");
+
+	const uint64_t channels = m_header.channels;
+	const uint64_t bytesPerPixel = channels * sizeOfDepth(m_header.depth);
+	const uint32_t dstWidth = scaledExtent(width, factor);
+	const uint32_t dstHeight = scaledExtent(height, factor);
+	const uint64_t dstRowSize = dstWidth * bytesPerPixel;
+
+	if (dstStrideBytes == 0)
+		dstStrideBytes = dstRowSize;
+
+	if (dstStrideBytes < dstRowSize)
+		throw std::runtime_error("Destination stride is smaller than the rectangle row size.");
+
+	if (factor == 1)
+		return readRect(data, x, y, width, height, dstStrideBytes, PixelLayout::Linear);
+
+	FSI_TRACE_ZONE("api", "Reader::readRectScaled");
+
+	if (filter == ScaleFilter::Nearest)
+	{
+		// The center of the block, or the last pixel of a partial block that doesn't reach it
+		auto sample = [factor](uint32_t block, uint32_t extent)
+		{
+			const uint32_t start = block * factor;
+			return start + std::min(factor / 2, extent - 1 - start);
+		};
+
+		// Only the sampled rows are read, and only the columns between the first and the last sample
+		const uint32_t firstX = sample(0, width);
+		const uint32_t spanWidth = sample(dstWidth - 1, width) - firstX + 1;
+		MemoryReservation memory(spanWidth * bytesPerPixel);
+		std::vector<uint8_t> row(spanWidth * bytesPerPixel);
+
+		for (uint32_t dy = 0; dy < dstHeight; dy++)
+		{
+			readRect(row.data(), x + firstX, y + sample(dy, height), spanWidth, 1, spanWidth * bytesPerPixel,
+				PixelLayout::Linear);
+
+			uint8_t* target = data + dy * dstStrideBytes;
+			for (uint32_t dx = 0; dx < dstWidth; dx++)
+				std::memcpy(target + dx * bytesPerPixel, row.data() + (sample(dx, width) - firstX) * bytesPerPixel,
+					bytesPerPixel);
+		}
+
+		return true;
+	}
+
+	// Box: every row is needed. Rows are read in batches of about defaultBufferSize bytes and summed
+	// into one row of block sums, which is stored whenever a block of rows is complete.
+	const uint64_t srcRowSize = width * bytesPerPixel;
+	const uint64_t sumsSize = dstWidth * channels * sizeof(double);
+	MemoryReservation memory(std::clamp<uint64_t>(defaultBufferSize / srcRowSize, 1, height) * srcRowSize + sumsSize,
+		srcRowSize + sumsSize);
+	const uint32_t batchRows = static_cast<uint32_t>((memory.size() - sumsSize) / srcRowSize);
+
+	std::vector<uint8_t> rows(batchRows * srcRowSize);
+	std::vector<double> sums(dstWidth * channels, 0.0);
+
+	for (uint32_t row0 = 0; row0 < height; row0 += batchRows)
+	{
+		const uint32_t rowCount = std::min(batchRows, height - row0);
+		readRect(rows.data(), x, y + row0, width, rowCount, srcRowSize, PixelLayout::Linear);
+
+		for (uint32_t i = 0; i < rowCount; i++)
+		{
+			const uint32_t row = row0 + i;
+			proc::boxAccumulateRow(rows.data() + i * srcRowSize, width, channels, m_header.depth, factor, sums.data());
+
+			if ((row + 1) % factor == 0 || row + 1 == height)
+				proc::boxStoreRow(sums.data(), width, channels, m_header.depth, factor, row % factor + 1,
+					data + (row / factor) * dstStrideBytes);
+		}
+	}
+
+	return true;
+}
+
+FSI_INLINE_HPP
+bool fsi::ReaderImpl::readCompressed(uint8_t* data, uint32_t x, uint32_t y, uint32_t width, uint32_t height,
+	BlockFormat format)
+{
+	if (!m_file.is_open())
+		throw ExceptionFileIsNotOpen("The file must be opened before reading can be attempted");
+
+	if (!data)
+		throw std::runtime_error("Cannot read rectangle into a null data pointer.");
+
+	if (width == 0 || height == 0)
+		throw std::runtime_error("Rectangle width and height must be greater than zero.");
+
+	if (static_cast<uint64_t>(x) + width > m_header.width || static_cast<uint64_t>(y) + height > m_header.height)
+		throw std::runtime_error("Requested rectangle is outside the image bounds.");
+
+	if (m_header.depth != Depth::Uint8 && m_header.depth != Depth::Uint16)
+		throw ExceptionInvalidImageDepth("Block compression needs Uint8 or Uint16 channels");
+
+	if (m_header.channels > 4)
+		throw ExceptionInvalidImageChannels("Block compression needs 1 to 4 channels");
+
+	FSI_TRACE_ZONE("api", "Reader::readCompressed");
+	io::GlobalStatsScope globalStats(m_ioStats);
+
+	const uint64_t rowSize = static_cast<uint64_t>(width) * m_header.channels * sizeOfDepth(m_header.depth);
+	const uint64_t blockRowBytes = compressedSizeInBytes(width, 4, format);
+
+	m_ioStats.bytesRequested += rowSize * height;
+
+	// Bands of whole block rows, a chunk of rows when the memory budget allows it
+	MemoryReservation memory;
+	const uint64_t bandHeight = 4 * memory.reserveRows(std::max<uint64_t>(m_options.chunkSize / (4 * rowSize), 1), 1,
+		4 * rowSize);
+	std::vector<uint8_t> band(std::min<uint64_t>(bandHeight, height) * rowSize);
+
+	for (uint64_t bandY = 0; bandY < height; bandY += bandHeight)
+	{
+		const uint64_t rows = std::min<uint64_t>(bandHeight, height - bandY);
+		readRows(band.data(), x, static_cast<uint32_t>(y + bandY), width, static_cast<uint32_t>(rows), rowSize);
+
+		FSI_TRACE_ZONE("compute", "compress blocks");
+
+		// Block rows are independent
+		executor()->parallelFor(0, static_cast<int64_t>((rows + 3) / 4), 1, [&](int64_t begin, int64_t end)
+		{
+			for (int64_t blockRow = begin; blockRow < end; blockRow++)
+			{
+				const uint64_t row = static_cast<uint64_t>(blockRow) * 4;
+				const uint32_t blockRows = static_cast<uint32_t>(std::min<uint64_t>(4, rows - row));
+				compressBlocks(band.data() + row * rowSize, rowSize, width, blockRows, m_header.channels,
+					m_header.depth, format, data + (bandY + row) / 4 * blockRowBytes);
+			}
+		});
+	}
+
+	return true;
 }
 
 FSI_INLINE_HPP
 void fsi::ReaderImpl::close()
 {
+#if !defined(_WIN32)
+	if (m_fd >= 0)
+	{
+		::close(m_fd);
+		m_fd = -1;
+	}
+#endif
+
 	if (m_file.is_open())
+	{
 		m_file.close();
+
+#if !defined(_WIN32)
+		io::finishFile(m_path, false, m_options.cacheAdvice == CacheAdvice::DontKeep);
+#endif
+	}
+}
+
+FSI_INLINE_HPP
+void fsi::ReaderImpl::setBlockCache(std::shared_ptr<SharedBlockCache> cache)
+{
+	m_blockCache = std::move(cache);
+	if (m_blockCache && m_file.is_open())
+		m_blockCacheKey = SharedBlockCache::fileKey(m_path);
+}
+
+FSI_INLINE_HPP
+void fsi::ReaderImpl::readRectCached(uint8_t* data, uint32_t x, uint32_t y, uint32_t width, uint32_t height,
+	uint64_t dstStrideBytes)
+{
+#if !defined(_WIN32)
+	const uint64_t bytesPerPixel = static_cast<uint64_t>(m_header.channels) * sizeOfDepth(m_header.depth);
+	const uint64_t sourceRowSize = static_cast<uint64_t>(m_header.width) * bytesPerPixel;
+	const uint64_t targetRowSize = static_cast<uint64_t>(width) * bytesPerPixel;
+	const uint64_t imageSize = sourceRowSize * m_header.height;
+	const uint64_t imageDataOffset = io::imageDataOffset(formatVersion());
+	const uint64_t blockSize = m_blockCache->blockSize();
+
+	// Copies the parts of every row of the rect that lie in a block, given its bytes
+	auto copyRows = [&](uint64_t block, const uint8_t* src, uint64_t size)
+	{
+		const uint64_t blockBegin = block * blockSize;
+		const uint64_t blockEnd = blockBegin + size;
+		const uint64_t firstRow = std::max<uint64_t>(y, blockBegin / sourceRowSize);
+		const uint64_t lastRow = std::min<uint64_t>(y + height - 1, (blockEnd - 1) / sourceRowSize);
+
+		for (uint64_t row = firstRow; row <= lastRow; row++)
+		{
+			const uint64_t begin = row * sourceRowSize + x * bytesPerPixel;
+			const uint64_t from = std::max(begin, blockBegin);
+			const uint64_t to = std::min(begin + targetRowSize, blockEnd);
+			if (from < to)
+				std::memcpy(data + (row - y) * dstStrideBytes + (from - begin), src + (from - blockBegin), to - from);
+		}
+	};
+
+	std::vector<uint8_t> buffer;
+	MemoryReservation memory;
+	std::unique_ptr<io::FileDescriptor> fd;
+
+	// The blocks of the rows only grow, so each block is visited once and copied to all its rows
+	uint64_t nextBlock = 0;
+	for (uint64_t row = y; row < static_cast<uint64_t>(y) + height; row++)
+	{
+		const uint64_t begin = row * sourceRowSize + x * bytesPerPixel;
+		const uint64_t lastBlock = (begin + targetRowSize - 1) / blockSize;
+
+		for (uint64_t block = std::max(begin / blockSize, nextBlock); block <= lastBlock; block++)
+		{
+			nextBlock = block + 1;
+
+			if (m_blockCache->lookup(m_blockCacheKey, block,
+				[&](const uint8_t* src, uint64_t size) { copyRows(block, src, size); }))
+			{
+				m_ioStats.cacheHits++;
+				continue;
+			}
+
+			m_ioStats.cacheMisses++;
+
+			if (buffer.empty())
+			{
+				memory.reset(blockSize, blockSize);
+				buffer.resize(blockSize);
+				m_ioStats.peakScratchBytes = std::max(m_ioStats.peakScratchBytes, blockSize);
+			}
+
+			// The positional descriptor if there is one, otherwise one only for the misses
+			if (m_fd < 0 && !fd)
+			{
+				bool direct = false;
+				fd = std::make_unique<io::FileDescriptor>(io::openFile(m_path, false, direct));
+				if (fd->get() < 0)
+					throw ExceptionFailedToOpenFile(std::strerror(errno));
+			}
+
+			const uint64_t size = std::min(blockSize, imageSize - block * blockSize);
+			if (!io::readAt(m_fd >= 0 ? m_fd : fd->get(), buffer.data(), size, imageDataOffset + block * blockSize,
+				m_ioStats))
+			{
+				throw std::runtime_error(std::string("Failed to read FSI rectangle: ") + std::strerror(errno));
+			}
+
+			m_blockCache->insert(m_blockCacheKey, block, buffer.data(), size);
+			copyRows(block, buffer.data(), size);
+		}
+	}
+#else
+	(void)data;
+	(void)x;
+	(void)y;
+	(void)width;
+	(void)height;
+	(void)dstStrideBytes;
+#endif
 }
\ No newline at end of file
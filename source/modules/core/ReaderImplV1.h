@@ -30,11 +30,10 @@ public:
 
 private:
 
-	void open(std::ifstream& file, Header& header) override;
+	void open(std::ifstream& file, Header& header, IoStats& stats) override;
 
 	void read(std::ifstream& file, const Header& header, uint8_t* data, uint8_t* thumbData,
-		const std::atomic<bool>& paused, const std::atomic<bool>& canceled,
-		std::atomic<float>& progress) override;
+		ProgressThread& progress, IoStats& stats) override;
 
 private:
 
@@ -10,6 +10,8 @@
 #include "ReaderImplV1.h"
 #include "Depth.hpp"
 #include "consts.h"
+#include "io.h"
+#include "Trace.h"
 #include <iostream>
 
 FSI_INLINE_HPP
@@ -25,17 +27,17 @@ fsi::FormatVersion fsi::ReaderImplV1::formatVersion()
 }
 
 FSI_INLINE_HPP
-void fsi::ReaderImplV1::open(std::ifstream& file, Header& header)
+void fsi::ReaderImplV1::open(std::ifstream& file, Header& header, IoStats& stats)
 {
 	uint32_t width;
 	uint32_t height;
 	uint32_t channels;
 	uint32_t depth;
 
-	file.read((char*)(&width), sizeof(uint32_t));
-	file.read((char*)(&height), sizeof(uint32_t));
-	file.read((char*)(&channels), sizeof(uint32_t));
-	file.read((char*)(&depth), sizeof(uint32_t));
+	io::read(file, (uint8_t*)(&width), sizeof(uint32_t), stats);
+	io::read(file, (uint8_t*)(&height), sizeof(uint32_t), stats);
+	io::read(file, (uint8_t*)(&channels), sizeof(uint32_t), stats);
+	io::read(file, (uint8_t*)(&depth), sizeof(uint32_t), stats);
 
 	if (!(channels >= 1 && channels <= 1048575))
 	{
@@ -65,8 +67,7 @@ void fsi::ReaderImplV1::open(std::ifstream& file, Header& header)
 
 FSI_INLINE_HPP
 void fsi::ReaderImplV1::read(std::ifstream& file, const Header& header, uint8_t* data,
-	uint8_t* thumbData, const std::atomic<bool>& paused, const std::atomic<bool>& canceled,
-	std::atomic<float>& progress)
+	uint8_t* thumbData, ProgressThread& progress, IoStats& stats)
 {
 	if (thumbData)
 		std::cout << "Warning: The thumbnail data will be ignored because the FSI version is 1.\n";
@@ -79,32 +80,10 @@ void fsi::ReaderImplV1::read(std::ifstream& file, const Header& header, uint8_t*
 		  * static_cast<uint64_t>(header.channels)
 		  * sizeOfDepth(header.depth);
 
-		// TODO: Check if the remaining size of the file equals to "imageSize"
-
-		// If buffer is larger than the total data, adjust the buffer size
-		const uint64_t bufferSize = defaultBufferSize > imageSize ? imageSize : defaultBufferSize;
-
-		// Read data
-		size_t ptr_offset = 0;
-		const size_t total = imageSize - bufferSize;
-		for (; ptr_offset < total; ptr_offset += bufferSize)
-		{
-			while (paused)
-				std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		stats.bytesRequested += imageSize;
 
-			if (canceled)
-				return;
-
-			file.read((char*)(data + ptr_offset), bufferSize);
-
-			progress = static_cast<float>(ptr_offset) / static_cast<float>(total);
-		}
+		// TODO: Check if the remaining size of the file equals to "imageSize"
 
-		// Read remaining bytes (if any)
-		size_t remainder_size = imageSize % bufferSize;
-		if (remainder_size == 0)
-			remainder_size = bufferSize;
-		size_t remainder_ptr_offset = imageSize - remainder_size;
-		file.read((char*)(data + remainder_ptr_offset), remainder_size);
+		readImageData(file, data, imageSize, progress, stats);
 	}
 }
\ No newline at end of file
@@ -10,6 +10,8 @@
 #include "ReaderImplV2.h"
 #include "Depth.hpp"
 #include "consts.h"
+#include "io.h"
+#include "Trace.h"
 #include <iostream>
 
 FSI_INLINE_HPP
@@ -25,17 +27,17 @@ fsi::FormatVersion fsi::ReaderImplV2::formatVersion()
 }
 
 FSI_INLINE_HPP
-void fsi::ReaderImplV2::open(std::ifstream& file, Header& header)
+void fsi::ReaderImplV2::open(std::ifstream& file, Header& header, IoStats& stats)
 {
 	uint32_t width;
 	uint32_t height;
 	uint32_t channels;
 	uint8_t depth;
 
-	file.read((char*)(&width), sizeof(uint32_t));
-	file.read((char*)(&height), sizeof(uint32_t));
-	file.read((char*)(&channels), sizeof(uint32_t));
-	file.read((char*)(&depth), sizeof(uint8_t));
+	io::read(file, (uint8_t*)(&width), sizeof(uint32_t), stats);
+	io::read(file, (uint8_t*)(&height), sizeof(uint32_t), stats);
+	io::read(file, (uint8_t*)(&channels), sizeof(uint32_t), stats);
+	io::read(file, (uint8_t*)(&depth), sizeof(uint8_t), stats);
 
 	if (!(channels >= 1 && channels <= 1048575))
 	{
@@ -63,14 +65,14 @@ void fsi::ReaderImplV2::open(std::ifstream& file, Header& header)
 	header.depth = static_cast<Depth>(depth);
 
 	uint8_t hasThumb;
-	file.read((char*)(&hasThumb), sizeof(uint8_t));
+	io::read(file, (uint8_t*)(&hasThumb), sizeof(uint8_t), stats);
 
 	header.hasThumb = hasThumb > 0;
 
 	if (header.hasThumb)
 	{
-		file.read((char*)(&header.thumbWidth), sizeof(uint16_t));
-		file.read((char*)(&header.thumbHeight), sizeof(uint16_t));
+		io::read(file, (uint8_t*)(&header.thumbWidth), sizeof(uint16_t), stats);
+		io::read(file, (uint8_t*)(&header.thumbHeight), sizeof(uint16_t), stats);
 
 		if (header.thumbWidth == 0 || header.thumbWidth > thumbMaxDimension)
 			throw ExceptionInvalidThumbnailWidth("Must be an integer between 1 and "
@@ -82,14 +84,13 @@ void fsi::ReaderImplV2::open(std::ifstream& file, Header& header)
 	}
 	else
 	{
-		file.ignore(sizeof(uint16_t)*2);
+		io::ignore(file, sizeof(uint16_t)*2, stats);
 	}
 }
 
 FSI_INLINE_HPP
 void fsi::ReaderImplV2::read(std::ifstream& file, const Header& header, uint8_t* data,
-	uint8_t* thumbData, const std::atomic<bool>& paused, const std::atomic<bool>& canceled,
-	std::atomic<float>& progress)
+	uint8_t* thumbData, ProgressThread& progress, IoStats& stats)
 {
 	// TODO: Check if the remaining size of the file equals to "thumbSize + imageSize"
 	
@@ -99,16 +100,17 @@ void fsi::ReaderImplV2::read(std::ifstream& file, const Header& header, uint8_t*
 		{
 			uint64_t usedThumbSizeInBytes = header.thumbWidth * header.thumbHeight * thumbChannels
 				* thumbSizeOfDepth;
-			file.read((char*)(thumbData), usedThumbSizeInBytes);
+			stats.bytesRequested += usedThumbSizeInBytes;
+			io::read(file, (uint8_t*)(thumbData), usedThumbSizeInBytes, stats);
 
 			// Skip remaining non-read data
 			uint64_t remainingBytes = thumbSizeInBytes - usedThumbSizeInBytes;
 			if (remainingBytes > 0)
-				file.ignore(remainingBytes);
+				io::ignore(file, remainingBytes, stats);
 		}
 		else
 		{
-			file.ignore(thumbSizeInBytes);
+			io::ignore(file, thumbSizeInBytes, stats);
 		}
 
 		if (!header.hasThumb && thumbData)
@@ -129,32 +131,10 @@ void fsi::ReaderImplV2::read(std::ifstream& file, const Header& header, uint8_t*
 		  * static_cast<uint64_t>(header.channels)
 		  * sizeOfDepth(header.depth);
 
-		// TODO: Check if the remaining size of the file equals to "imageSize"
-
-		// If buffer is larger than the total data, adjust the buffer size
-		const uint64_t bufferSize = defaultBufferSize > imageSize ? imageSize : defaultBufferSize;
-
-		// Read data
-		size_t ptr_offset = 0;
-		const size_t total = imageSize - bufferSize;
-		for (; ptr_offset < total; ptr_offset += bufferSize)
-		{
-			while (paused)
-				std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		stats.bytesRequested += imageSize;
 
-			if (canceled)
-				return;
-
-			file.read((char*)(data + ptr_offset), bufferSize);
-
-			progress = static_cast<float>(ptr_offset) / static_cast<float>(total);
-		}
+		// TODO: Check if the remaining size of the file equals to "imageSize"
 
-		// Read remaining bytes (if any)
-		size_t remainder_size = imageSize % bufferSize;
-		if (remainder_size == 0)
-			remainder_size = bufferSize;
-		size_t remainder_ptr_offset = imageSize - remainder_size;
-		file.read((char*)(data + remainder_ptr_offset), remainder_size);
+		readImageData(file, data, imageSize, progress, stats);
 	}
 }
\ No newline at end of file
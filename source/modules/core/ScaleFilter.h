@@ -0,0 +1,33 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include <cstdint>
+
+namespace fsi
+{
+
+/** @brief How Reader::readRectScaled() reduces each factor x factor block to one pixel.
+*/
+enum class ScaleFilter : uint32_t
+{
+	// The center pixel of the block. Only one row of every block is read.
+	Nearest = 0,
+
+	// The average of the block. Every row is read.
+	Box = 1,
+};
+
+/** @brief Size of an extent downscaled by factor. A partial block at the end still makes a pixel.
+*/
+inline constexpr uint32_t scaledExtent(uint32_t extent, uint32_t factor)
+{
+	return factor > 0 ? static_cast<uint32_t>((static_cast<uint64_t>(extent) + factor - 1) / factor) : 0;
+}
+
+}
\ No newline at end of file
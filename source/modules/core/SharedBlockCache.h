@@ -0,0 +1,136 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include "fsi_core_exports.h"
+#include "../global.h"
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+
+namespace fsi { class SharedBlockCache; namespace detail { struct SharedBlockSegment; struct SharedBlockSlot; } }
+
+namespace fsi
+{
+	struct SharedBlockCacheOptions
+	{
+		/** @brief Bytes of image data the cache holds. Only used by the process that creates the
+		* segment.
+		*/
+		uint64_t capacity = 1024ull * 1024 * 1024;
+
+		/** @brief Bytes of image data per block, rounded up to a multiple of 4 KB. Only used by the
+		* process that creates the segment.
+		*/
+		uint32_t blockSize = 64 * 1024;
+	};
+
+	/** @brief Counters of a SharedBlockCache, shared by every process using it.
+	*/
+	struct SharedBlockCacheStats
+	{
+		uint64_t insertions = 0;
+
+		uint64_t evictions = 0;
+	};
+}
+
+/** @brief A cache of image data blocks in a named shared memory segment, shared by every process of
+the host that opens the same name.
+
+Readers with a cache (see Reader::setBlockCache()) serve readRect() from it: the image data of a file
+is split into blockSize byte blocks, blocks found in the cache are copied from it, the missing ones are
+read from the file and inserted. Only those reads count against the RateLimiter of the Reader. A
+file is identified by its device, inode, size and modification time, so a file that changes on disk
+doesn't get the blocks of its old contents.
+
+Lookups don't take locks: each slot has a sequence number that is odd while a process writes it, and a
+copy is discarded if the number changed meanwhile. Slots are grouped in sets of 8 picked by the hash of
+the block. A full set evicts with the CLOCK (second chance) policy: blocks read again since they were
+inserted survive one more pass.
+
+The segment stays until remove() is called or the host restarts. A process that dies while writing a
+block leaves that slot unused. Not available on Windows.
+*/
+class FSI_CORE_API fsi::SharedBlockCache
+{
+public:
+
+	/** @brief Identifies a version of a file.
+	*/
+	struct FileKey
+	{
+		uint64_t file = 0;
+
+		uint64_t version = 0;
+	};
+
+	/** @brief Called by lookup() with the data of a block.
+	*/
+	typedef std::function<void(const uint8_t* data, uint64_t size)> BlockVisitor;
+
+public:
+
+	/** @brief Opens the segment called name, or creates it with the given options if it doesn't
+	* exist. An existing segment keeps its capacity and block size.
+	*/
+	SharedBlockCache(const std::string& name, const SharedBlockCacheOptions& options = SharedBlockCacheOptions());
+
+	~SharedBlockCache();
+
+	FSI_DISABLE_COPY_MOVE(SharedBlockCache);
+
+public:
+
+	/** @brief Deletes the segment called name. Processes that have it open keep using it.
+	*
+	* @return false if there was none.
+	*/
+	static bool remove(const std::string& name);
+
+	/** @brief The key of the file at path.
+	*/
+	static FileKey fileKey(const std::filesystem::path& path);
+
+	uint64_t blockSize() const;
+
+	uint64_t capacity() const;
+
+	SharedBlockCacheStats stats() const;
+
+	/** @brief Calls visitor with the data of a cached block.
+	*
+	* @return false on a miss. Also when the block was replaced while visitor ran, in which case
+	* whatever visitor copied is torn and must be discarded.
+	*/
+	bool lookup(const FileKey& key, uint64_t block, const BlockVisitor& visitor);
+
+	/** @brief Adds a block of size bytes (at most blockSize()), evicting another if needed. Does
+	* nothing if the block is already cached or its set is being written by other processes.
+	*/
+	void insert(const FileKey& key, uint64_t block, const uint8_t* data, uint64_t size);
+
+private:
+
+	detail::SharedBlockSlot* slots() const;
+
+	uint8_t* blockData(uint64_t slot) const;
+
+	uint64_t firstSlot(const FileKey& key, uint64_t block) const;
+
+private:
+
+	detail::SharedBlockSegment* m_segment;
+
+	uint64_t m_mappedSize;
+};
+
+#if FSI_HEADERONLY
+#include "SharedBlockCache.hpp"
+#endif
\ No newline at end of file
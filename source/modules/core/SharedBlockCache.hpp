@@ -0,0 +1,384 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include "SharedBlockCache.h"
+#include "exceptions.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+#if !defined(_WIN32)
+	#include <cerrno>
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+namespace fsi
+{
+	namespace detail
+	{
+		const uint64_t sharedBlockMagic = 0x4B434F4C42495346; // "FSIBLOCK"
+
+		const uint64_t sharedBlockWays = 8;
+
+		const uint64_t sharedBlockPage = 4096;
+
+		/** @brief Start of the segment. Written once by the creating process, which sets ready last.
+		*/
+		struct SharedBlockSegment
+		{
+			uint64_t magic;
+			std::atomic<uint32_t> ready;
+			uint32_t reserved;
+			uint64_t blockSize;
+			uint64_t slotCount;
+			uint64_t slotsOffset;
+			uint64_t dataOffset;
+			uint64_t size;
+
+			// Start of the CLOCK scans, spread over the sets
+			std::atomic<uint64_t> clock;
+
+			std::atomic<uint64_t> insertions;
+			std::atomic<uint64_t> evictions;
+		};
+
+		/** @brief A block slot. sequence is odd while a process writes the slot. block is 0 for an
+		* empty slot, otherwise the block index + 1.
+		*/
+		struct alignas(64) SharedBlockSlot
+		{
+			std::atomic<uint64_t> sequence;
+			std::atomic<uint64_t> file;
+			std::atomic<uint64_t> version;
+			std::atomic<uint64_t> block;
+			std::atomic<uint64_t> size;
+			std::atomic<uint32_t> referenced;
+		};
+
+		static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+			"The shared block cache needs address-free atomics");
+
+		inline uint64_t mixBits(uint64_t value)
+		{
+			// splitmix64 finalizer
+			value ^= value >> 30;
+			value *= 0xbf58476d1ce4e5b9ull;
+			value ^= value >> 27;
+			value *= 0x94d049bb133111ebull;
+			value ^= value >> 31;
+			return value;
+		}
+
+		inline uint64_t alignUp(uint64_t value, uint64_t alignment)
+		{
+			return (value + alignment - 1) / alignment * alignment;
+		}
+
+		inline std::string sharedMemoryName(const std::string& name)
+		{
+			return name.empty() || name[0] != '/' ? "/" + name : name;
+		}
+	}
+}
+
+FSI_INLINE_HPP
+fsi::SharedBlockCache::SharedBlockCache(const std::string& name, const SharedBlockCacheOptions& options)
+	: m_segment(nullptr)
+	, m_mappedSize(0)
+{
+#if defined(_WIN32)
+	(void)name;
+	(void)options;
+	throw std::runtime_error("The shared block cache is not available on Windows");
+#else
+	const std::string shmName = detail::sharedMemoryName(name);
+
+	bool creator = true;
+	int fd = ::shm_open(shmName.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd < 0 && errno == EEXIST)
+	{
+		creator = false;
+		fd = ::shm_open(shmName.c_str(), O_RDWR, 0600);
+	}
+	if (fd < 0)
+		throw ExceptionFailedToOpenFile("Failed to open the shared block cache " + name + ": " + std::strerror(errno));
+
+	try
+	{
+		if (creator)
+		{
+			// Slots and data start on their own pages. New shared memory is zeros, i.e. empty slots.
+			const uint64_t blockSize = detail::alignUp(std::max<uint64_t>(options.blockSize, 1), detail::sharedBlockPage);
+			const uint64_t slotCount = std::max<uint64_t>(options.capacity / blockSize / detail::sharedBlockWays, 1)
+				* detail::sharedBlockWays;
+			const uint64_t slotsOffset = detail::alignUp(sizeof(detail::SharedBlockSegment), detail::sharedBlockPage);
+			const uint64_t dataOffset = detail::alignUp(slotsOffset + slotCount * sizeof(detail::SharedBlockSlot),
+				detail::sharedBlockPage);
+			const uint64_t size = dataOffset + slotCount * blockSize;
+
+			if (::ftruncate(fd, static_cast<off_t>(size)) != 0)
+				throw ExceptionFailedToCreateFile("Failed to size the shared block cache: " + std::string(std::strerror(errno)));
+
+			void* mapped = ::mmap(nullptr, static_cast<size_t>(size), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			if (mapped == MAP_FAILED)
+				throw ExceptionFailedToCreateFile("Failed to map the shared block cache: " + std::string(std::strerror(errno)));
+
+			m_segment = static_cast<detail::SharedBlockSegment*>(mapped);
+			m_mappedSize = size;
+
+			m_segment->magic = detail::sharedBlockMagic;
+			m_segment->blockSize = blockSize;
+			m_segment->slotCount = slotCount;
+			m_segment->slotsOffset = slotsOffset;
+			m_segment->dataOffset = dataOffset;
+			m_segment->size = size;
+			m_segment->ready.store(1, std::memory_order_release);
+		}
+		else
+		{
+			// The creator may still be sizing and filling in the segment
+			const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+			for (;;)
+			{
+				struct stat status;
+				if (::fstat(fd, &status) == 0 && static_cast<uint64_t>(status.st_size) >= sizeof(detail::SharedBlockSegment))
+				{
+					void* mapped = ::mmap(nullptr, sizeof(detail::SharedBlockSegment), PROT_READ | PROT_WRITE,
+						MAP_SHARED, fd, 0);
+					if (mapped == MAP_FAILED)
+						throw ExceptionFailedToOpenFile("Failed to map the shared block cache: " + std::string(std::strerror(errno)));
+
+					auto* segment = static_cast<detail::SharedBlockSegment*>(mapped);
+					const bool ready = segment->ready.load(std::memory_order_acquire) != 0;
+					const uint64_t magic = segment->magic;
+					const uint64_t size = segment->size;
+					::munmap(mapped, sizeof(detail::SharedBlockSegment));
+
+					if (ready)
+					{
+						if (magic != detail::sharedBlockMagic || static_cast<uint64_t>(status.st_size) < size)
+							throw ExceptionFailedToOpenFile(name + " is not a shared block cache");
+
+						mapped = ::mmap(nullptr, static_cast<size_t>(size), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+						if (mapped == MAP_FAILED)
+							throw ExceptionFailedToOpenFile("Failed to map the shared block cache: " + std::string(std::strerror(errno)));
+
+						m_segment = static_cast<detail::SharedBlockSegment*>(mapped);
+						m_mappedSize = size;
+						break;
+					}
+				}
+
+				if (std::chrono::steady_clock::now() > deadline)
+					throw ExceptionFailedToOpenFile("The shared block cache " + name + " was never initialized");
+
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+		}
+	}
+	catch (...)
+	{
+		::close(fd);
+		throw;
+	}
+
+	// The mapping keeps the memory
+	::close(fd);
+#endif
+}
+
+FSI_INLINE_HPP
+fsi::SharedBlockCache::~SharedBlockCache()
+{
+#if !defined(_WIN32)
+	if (m_segment)
+		::munmap(m_segment, static_cast<size_t>(m_mappedSize));
+#endif
+}
+
+FSI_INLINE_HPP
+bool fsi::SharedBlockCache::remove(const std::string& name)
+{
+#if !defined(_WIN32)
+	return ::shm_unlink(detail::sharedMemoryName(name).c_str()) == 0;
+#else
+	(void)name;
+	return false;
+#endif
+}
+
+FSI_INLINE_HPP
+fsi::SharedBlockCache::FileKey fsi::SharedBlockCache::fileKey(const std::filesystem::path& path)
+{
+	FileKey key;
+
+#if !defined(_WIN32)
+	struct stat status;
+	if (::stat(path.c_str(), &status) != 0)
+		throw ExceptionFailedToOpenFile(std::strerror(errno));
+
+#if defined(__APPLE__)
+	const uint64_t modified = static_cast<uint64_t>(status.st_mtimespec.tv_sec) * 1000000000ull
+		+ static_cast<uint64_t>(status.st_mtimespec.tv_nsec);
+#else
+	const uint64_t modified = static_cast<uint64_t>(status.st_mtim.tv_sec) * 1000000000ull
+		+ static_cast<uint64_t>(status.st_mtim.tv_nsec);
+#endif
+
+	key.file = detail::mixBits(static_cast<uint64_t>(status.st_dev) * 0x9e3779b97f4a7c15ull
+		^ static_cast<uint64_t>(status.st_ino));
+	key.version = detail::mixBits(modified ^ detail::mixBits(static_cast<uint64_t>(status.st_size)));
+#else
+	(void)path;
+#endif
+
+	return key;
+}
+
+FSI_INLINE_HPP
+uint64_t fsi::SharedBlockCache::blockSize() const
+{
+	return m_segment->blockSize;
+}
+
+FSI_INLINE_HPP
+uint64_t fsi::SharedBlockCache::capacity() const
+{
+	return m_segment->slotCount * m_segment->blockSize;
+}
+
+FSI_INLINE_HPP
+fsi::SharedBlockCacheStats fsi::SharedBlockCache::stats() const
+{
+	SharedBlockCacheStats stats;
+	stats.insertions = m_segment->insertions.load(std::memory_order_relaxed);
+	stats.evictions = m_segment->evictions.load(std::memory_order_relaxed);
+	return stats;
+}
+
+FSI_INLINE_HPP
+bool fsi::SharedBlockCache::lookup(const FileKey& key, uint64_t block, const BlockVisitor& visitor)
+{
+	const uint64_t first = firstSlot(key, block);
+	detail::SharedBlockSlot* set = slots() + first;
+
+	for (uint64_t way = 0; way < detail::sharedBlockWays; way++)
+	{
+		detail::SharedBlockSlot& slot = set[way];
+
+		const uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+		if ((sequence & 1) != 0
+			|| slot.block.load(std::memory_order_relaxed) != block + 1
+			|| slot.file.load(std::memory_order_relaxed) != key.file
+			|| slot.version.load(std::memory_order_relaxed) != key.version)
+		{
+			continue;
+		}
+
+		const uint64_t size = std::min(slot.size.load(std::memory_order_relaxed), m_segment->blockSize);
+		visitor(blockData(first + way), size);
+
+		// The copy only counts if no writer took the slot meanwhile
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (slot.sequence.load(std::memory_order_relaxed) != sequence)
+			return false;
+
+		if (slot.referenced.load(std::memory_order_relaxed) == 0)
+			slot.referenced.store(1, std::memory_order_relaxed);
+		return true;
+	}
+
+	return false;
+}
+
+FSI_INLINE_HPP
+void fsi::SharedBlockCache::insert(const FileKey& key, uint64_t block, const uint8_t* data, uint64_t size)
+{
+	size = std::min(size, m_segment->blockSize);
+
+	const uint64_t first = firstSlot(key, block);
+	detail::SharedBlockSlot* set = slots() + first;
+
+	// Another process may have read it too
+	for (uint64_t way = 0; way < detail::sharedBlockWays; way++)
+	{
+		if (set[way].block.load(std::memory_order_relaxed) == block + 1
+			&& set[way].file.load(std::memory_order_relaxed) == key.file
+			&& set[way].version.load(std::memory_order_relaxed) == key.version)
+		{
+			return;
+		}
+	}
+
+	// An empty slot if the set has one, so nothing is evicted before the set is full
+	bool hasEmpty = false;
+	for (uint64_t way = 0; way < detail::sharedBlockWays && !hasEmpty; way++)
+		hasEmpty = set[way].block.load(std::memory_order_relaxed) == 0;
+
+	// Otherwise CLOCK: the first slot not referenced since the last pass. Referenced slots lose their
+	// mark as the hand passes.
+	const uint64_t start = m_segment->clock.fetch_add(1, std::memory_order_relaxed);
+	for (uint64_t step = 0; step < 2 * detail::sharedBlockWays; step++)
+	{
+		const uint64_t way = (start + step) % detail::sharedBlockWays;
+		detail::SharedBlockSlot& slot = set[way];
+
+		const bool empty = slot.block.load(std::memory_order_relaxed) == 0;
+		if (hasEmpty ? !empty : slot.referenced.exchange(0, std::memory_order_relaxed) != 0)
+			continue;
+
+		uint64_t sequence = slot.sequence.load(std::memory_order_relaxed);
+		if ((sequence & 1) != 0
+			|| !slot.sequence.compare_exchange_strong(sequence, sequence + 1, std::memory_order_acquire))
+		{
+			continue;
+		}
+		std::atomic_thread_fence(std::memory_order_release);
+
+		if (slot.block.load(std::memory_order_relaxed) != 0)
+			m_segment->evictions.fetch_add(1, std::memory_order_relaxed);
+
+		slot.file.store(key.file, std::memory_order_relaxed);
+		slot.version.store(key.version, std::memory_order_relaxed);
+		slot.block.store(block + 1, std::memory_order_relaxed);
+		slot.size.store(size, std::memory_order_relaxed);
+		slot.referenced.store(0, std::memory_order_relaxed);
+		std::memcpy(blockData(first + way), data, static_cast<size_t>(size));
+
+		slot.sequence.store(sequence + 2, std::memory_order_release);
+		m_segment->insertions.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+}
+
+FSI_INLINE_HPP
+fsi::detail::SharedBlockSlot* fsi::SharedBlockCache::slots() const
+{
+	return reinterpret_cast<detail::SharedBlockSlot*>(reinterpret_cast<uint8_t*>(m_segment) + m_segment->slotsOffset);
+}
+
+FSI_INLINE_HPP
+uint8_t* fsi::SharedBlockCache::blockData(uint64_t slot) const
+{
+	return reinterpret_cast<uint8_t*>(m_segment) + m_segment->dataOffset + slot * m_segment->blockSize;
+}
+
+FSI_INLINE_HPP
+uint64_t fsi::SharedBlockCache::firstSlot(const FileKey& key, uint64_t block) const
+{
+	const uint64_t sets = m_segment->slotCount / detail::sharedBlockWays;
+	const uint64_t hash = detail::mixBits(key.file ^ detail::mixBits(key.version ^ detail::mixBits(block)));
+	return hash % sets * detail::sharedBlockWays;
+}
\ No newline at end of file
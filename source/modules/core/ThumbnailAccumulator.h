@@ -0,0 +1,90 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include "fsi_core_exports.h"
+#include "../global.h"
+#include "Header.h"
+#include "MemoryGovernor.h"
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+namespace fsi { class ThumbnailAccumulator; }
+
+/** @brief Builds the thumbnail of an image whose rows arrive in order, for writers that never hold
+the whole image.
+
+The result is identical to proc::generateThumbnail(): each thumbnail row sums the same source
+pixels in the same order. Only the sums of the thumbnail rows whose kernel is still open are kept,
+which is one or two rows of thumbWidth pixels.
+*/
+class FSI_CORE_API fsi::ThumbnailAccumulator
+{
+public:
+
+	/** @brief header.thumbWidth and header.thumbHeight must already be set.
+	*/
+	ThumbnailAccumulator(const Header& header);
+
+public:
+
+	/** @brief Adds the next rowCount packed rows of the image.
+	*/
+	void addRows(const uint8_t* rows, uint64_t rowCount);
+
+	/** @brief True after the last row was added.
+	*/
+	bool complete() const;
+
+	/** @brief thumbWidth*thumbHeight RGBA8 pixels, thumbWidth*thumbChannels bytes per row, like the
+	* start of the thumbnail section of a V2 file. The rest of the section is zeros.
+	*/
+	const std::vector<uint8_t>& thumbnail() const;
+
+private:
+
+	template <typename T>
+	void addRow(const uint8_t* row);
+
+	template <typename T>
+	void finishRow();
+
+	// First source row of the kernel of a thumbnail row
+	int64_t sourceRow(int64_t thumbRow) const;
+
+private:
+
+	Header m_header;
+
+	int64_t m_channels = 0; // Channels that make it into the thumbnail
+
+	int64_t m_kernelWidth = 0;
+
+	int64_t m_kernelHeight = 0;
+
+	double m_kernelSize = 0.0;
+
+	float m_heightFactor = 0.0f;
+
+	std::vector<int64_t> m_sourceColumns; // First source column of the kernel of each thumbnail column
+
+	std::deque<std::vector<double>> m_sums; // Open rows, starting at m_firstOpenRow
+
+	int64_t m_firstOpenRow = 0;
+
+	int64_t m_nextSourceRow = 0;
+
+	std::vector<uint8_t> m_thumbnail;
+
+	MemoryReservation m_memory;
+};
+
+#if FSI_HEADERONLY
+#include "ThumbnailAccumulator.hpp"
+#endif
\ No newline at end of file
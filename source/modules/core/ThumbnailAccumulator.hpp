@@ -0,0 +1,176 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include "ThumbnailAccumulator.h"
+#include "consts.h"
+#include "proc.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// The factors, kernel sizes and float rounding below follow proc::generateThumbnail() exactly, so
+// both produce the same bytes
+
+FSI_INLINE_HPP
+fsi::ThumbnailAccumulator::ThumbnailAccumulator(const Header& header)
+	: m_header(header)
+	, m_thumbnail(static_cast<uint64_t>(header.thumbWidth) * header.thumbHeight * thumbChannels * thumbSizeOfDepth, 0)
+	, m_memory(m_thumbnail.size())
+{
+	const int64_t srcWidth = header.width;
+	const int64_t thumbWidth = header.thumbWidth;
+
+	const float widthFactor = static_cast<float>(header.width) / static_cast<float>(header.thumbWidth);
+	m_heightFactor = static_cast<float>(header.height) / static_cast<float>(header.thumbHeight);
+
+	m_channels = std::min<int64_t>(header.channels, 4);
+	m_kernelWidth = static_cast<int64_t>(std::round(widthFactor));
+	m_kernelHeight = static_cast<int64_t>(std::round(m_heightFactor));
+	m_kernelSize = static_cast<double>(m_kernelWidth * m_kernelHeight);
+
+	m_sourceColumns.resize(thumbWidth);
+	for (int64_t x = 0; x < thumbWidth; x++)
+	{
+		const int64_t srcX = static_cast<int64_t>(std::floor(static_cast<float>(x) * widthFactor));
+		m_sourceColumns[x] = std::min(srcX, srcWidth - 1);
+	}
+}
+
+FSI_INLINE_HPP
+void fsi::ThumbnailAccumulator::addRows(const uint8_t* rows, uint64_t rowCount)
+{
+	const uint64_t rowSize =
+		static_cast<uint64_t>(m_header.width) * m_header.channels * sizeOfDepth(m_header.depth);
+
+	for (uint64_t i = 0; i < rowCount && !complete(); i++)
+	{
+		const uint8_t* row = rows + i * rowSize;
+
+		switch (m_header.depth)
+		{
+		case Depth::Int8: addRow<int8_t>(row); break;
+		case Depth::Int16: addRow<int16_t>(row); break;
+		case Depth::Int32: addRow<int32_t>(row); break;
+		case Depth::Int64: addRow<int64_t>(row); break;
+		case Depth::Uint8: addRow<uint8_t>(row); break;
+		case Depth::Uint16: addRow<uint16_t>(row); break;
+		case Depth::Uint32: addRow<uint32_t>(row); break;
+		case Depth::Uint64: addRow<uint64_t>(row); break;
+		case Depth::Float32: addRow<float>(row); break;
+		case Depth::Float64: addRow<double>(row); break;
+		default:
+			assert(false && "Invalid depth");
+			break;
+		}
+	}
+}
+
+FSI_INLINE_HPP
+bool fsi::ThumbnailAccumulator::complete() const
+{
+	return m_nextSourceRow >= static_cast<int64_t>(m_header.height);
+}
+
+FSI_INLINE_HPP
+const std::vector<uint8_t>& fsi::ThumbnailAccumulator::thumbnail() const
+{
+	return m_thumbnail;
+}
+
+FSI_INLINE_HPP
+int64_t fsi::ThumbnailAccumulator::sourceRow(int64_t thumbRow) const
+{
+	const int64_t srcY = static_cast<int64_t>(std::floor(static_cast<float>(thumbRow) * m_heightFactor));
+	return std::min<int64_t>(srcY, static_cast<int64_t>(m_header.height) - 1);
+}
+
+template <typename T>
+inline
+void fsi::ThumbnailAccumulator::addRow(const uint8_t* row)
+{
+	const int64_t srcWidth = m_header.width;
+	const int64_t srcHeight = m_header.height;
+	const int64_t srcChannels = m_header.channels;
+	const int64_t thumbWidth = m_header.thumbWidth;
+	const int64_t thumbHeight = m_header.thumbHeight;
+	const int64_t y = m_nextSourceRow++;
+
+	const T* values = reinterpret_cast<const T*>(row);
+
+	for (int64_t thumbRow = m_firstOpenRow; thumbRow < thumbHeight; thumbRow++)
+	{
+		const int64_t srcY = sourceRow(thumbRow);
+		if (srcY > y)
+			break;
+		if (y >= srcY + m_kernelHeight)
+			continue;
+
+		const size_t open = static_cast<size_t>(thumbRow - m_firstOpenRow);
+		if (open == m_sums.size())
+			m_sums.emplace_back(thumbWidth * m_channels, 0.0);
+		double* sums = m_sums[open].data();
+
+		// Kernel rows past the bottom edge are clamped to the last row, so it's added once for each
+		const int64_t repeat = y == srcHeight - 1 ? std::max<int64_t>(1, srcY + m_kernelHeight - y) : 1;
+
+		for (int64_t r = 0; r < repeat; r++)
+		for (int64_t x = 0; x < thumbWidth; x++)
+		for (int64_t c = 0; c < m_channels; c++)
+		{
+			double& sum = sums[x*m_channels + c];
+			for (int64_t kx = 0; kx < m_kernelWidth; kx++)
+			{
+				const int64_t srcX = std::min(m_sourceColumns[x] + kx, srcWidth - 1);
+				sum += static_cast<double>(values[srcX*srcChannels + c]);
+			}
+		}
+	}
+
+	// Close the rows whose kernel ends at this row
+	while (m_firstOpenRow < thumbHeight
+		&& y >= std::min(sourceRow(m_firstOpenRow) + m_kernelHeight, srcHeight) - 1)
+	{
+		if (m_sums.empty())
+			m_sums.emplace_back(thumbWidth * m_channels, 0.0);
+		finishRow<T>();
+	}
+}
+
+template <typename T>
+inline
+void fsi::ThumbnailAccumulator::finishRow()
+{
+	const double srcMin = static_cast<double>(std::numeric_limits<T>::lowest());
+	const double srcMax = static_cast<double>(std::numeric_limits<T>::max());
+	const double dstMin = static_cast<double>(std::numeric_limits<uint8_t>::lowest());
+	const double dstMax = static_cast<double>(std::numeric_limits<uint8_t>::max());
+
+	const std::vector<double>& sums = m_sums.front();
+	uint8_t* dst = m_thumbnail.data() + m_firstOpenRow * m_header.thumbWidth * thumbChannels;
+
+	for (int64_t x = 0; x < m_header.thumbWidth; x++)
+	{
+		double rgba[4] = { dstMin, dstMin, dstMin, dstMax };
+		for (int64_t c = 0; c < m_channels; c++)
+		{
+			const double average = sums[x*m_channels + c] / m_kernelSize;
+			rgba[c] = std::clamp(proc::remap(average, srcMin, srcMax, dstMin, dstMax), dstMin, dstMax);
+		}
+
+		// Gray is replicated to RGB
+		if (m_channels == 1)
+			rgba[1] = rgba[2] = rgba[0];
+
+		for (int64_t c = 0; c < 4; c++)
+			dst[x*thumbChannels + c] = static_cast<uint8_t>(rgba[c]);
+	}
+
+	m_sums.pop_front();
+	m_firstOpenRow++;
+}
\ No newline at end of file
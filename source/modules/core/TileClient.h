@@ -0,0 +1,98 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include "fsi_core_exports.h"
+#include "../global.h"
+#include "Depth.hpp"
+#include "FormatVersion.h"
+#include "Header.h"
+#include "TileServer.h"
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+
+namespace fsi { class TileClient; }
+
+/** @brief Reads FSI files through a TileServer instead of opening them.
+
+The pixels are written by the server into shared memory owned by the client, which grows to the
+largest request made. A TileClient can be shared by threads, but sends one request at a time; use one
+client per thread for parallel requests. Server-side failures are thrown as std::runtime_error with
+the message of the server. Not available on Windows.
+*/
+class FSI_CORE_API fsi::TileClient
+{
+public:
+
+	TileClient();
+
+	~TileClient();
+
+	FSI_DISABLE_COPY_MOVE(TileClient);
+
+public:
+
+	/** @brief Connects to the socket of a running TileServer.
+	*/
+	void connect(const std::filesystem::path& socketPath);
+
+	bool isConnected();
+
+	void close();
+
+	/** @brief Returns the header of an FSI file. The format version is returned in formatVersion if
+	* it isn't nullptr.
+	*/
+	Header header(const std::filesystem::path& path, FormatVersion* formatVersion = nullptr);
+
+	/** @brief Reads a portion of an FSI file, like Reader::readRect().
+	*
+	* @param dstStrideBytes Bytes between the rows of data. 0 for packed rows.
+	*/
+	void readRect(
+		const std::filesystem::path& path,
+		uint8_t* data,
+		uint32_t x,
+		uint32_t y,
+		uint32_t width,
+		uint32_t height,
+		TilePriority priority = TilePriority::Interactive,
+		uint64_t dstStrideBytes = 0
+	);
+
+	/** @brief Reads the thumbnail of an FSI file, thumbWidth*thumbHeight RGBA8 pixels of its header.
+	* Throws if the file has none.
+	*/
+	void readThumbnail(const std::filesystem::path& path, uint8_t* data,
+		TilePriority priority = TilePriority::Interactive);
+
+private:
+
+	detail::TileResponse request(detail::TileRequest& request, const std::filesystem::path& path, bool shared);
+
+	void reserve(uint64_t size);
+
+private:
+
+	std::mutex m_mutex;
+
+	int m_fd;
+
+	int m_bufferFd;
+
+	uint8_t* m_buffer;
+
+	uint64_t m_bufferSize;
+
+	uint64_t m_nextId;
+};
+
+#if FSI_HEADERONLY
+#include "TileClient.hpp"
+#endif
\ No newline at end of file
@@ -0,0 +1,292 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include "TileClient.h"
+#include "consts.h"
+#include "io.h"
+#include "exceptions.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#if !defined(_WIN32)
+	#include <cerrno>
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/socket.h>
+	#include <sys/un.h>
+	#include <unistd.h>
+#endif
+
+FSI_INLINE_HPP
+fsi::TileClient::TileClient()
+	: m_fd(-1)
+	, m_bufferFd(-1)
+	, m_buffer(nullptr)
+	, m_bufferSize(0)
+	, m_nextId(0)
+{
+}
+
+FSI_INLINE_HPP
+fsi::TileClient::~TileClient()
+{
+	close();
+
+#if !defined(_WIN32)
+	if (m_buffer)
+		::munmap(m_buffer, static_cast<size_t>(m_bufferSize));
+	if (m_bufferFd >= 0)
+		::close(m_bufferFd);
+#endif
+}
+
+FSI_INLINE_HPP
+void fsi::TileClient::connect(const std::filesystem::path& socketPath)
+{
+#if defined(_WIN32)
+	(void)socketPath;
+	throw std::runtime_error("The tile server is not available on Windows");
+#else
+	close();
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	sockaddr_un address{};
+	address.sun_family = AF_UNIX;
+	const std::string path = socketPath.string();
+	if (path.size() >= sizeof(address.sun_path))
+		throw ExceptionFailedToOpenFile("The socket path is too long: " + path);
+	std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+	const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		throw ExceptionFailedToOpenFile(std::strerror(errno));
+	::fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+	if (::connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0)
+	{
+		const std::string error = std::strerror(errno);
+		::close(fd);
+		throw ExceptionFailedToOpenFile("Failed to connect to " + path + ": " + error);
+	}
+
+	m_fd = fd;
+#endif
+}
+
+FSI_INLINE_HPP
+bool fsi::TileClient::isConnected()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_fd >= 0;
+}
+
+FSI_INLINE_HPP
+void fsi::TileClient::close()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+#if !defined(_WIN32)
+	if (m_fd >= 0)
+		::close(m_fd);
+#endif
+	m_fd = -1;
+}
+
+FSI_INLINE_HPP
+fsi::Header fsi::TileClient::header(const std::filesystem::path& path, FormatVersion* formatVersion)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	detail::TileRequest tileRequest;
+	tileRequest.type = detail::TileRequestType::Header;
+	const detail::TileResponse response = request(tileRequest, path, false);
+
+	Header header;
+	header.width = response.width;
+	header.height = response.height;
+	header.channels = response.channels;
+	header.depth = static_cast<Depth>(response.depth);
+	header.hasThumb = response.hasThumb != 0;
+	header.thumbWidth = static_cast<uint16_t>(response.thumbWidth);
+	header.thumbHeight = static_cast<uint16_t>(response.thumbHeight);
+
+	if (formatVersion)
+		*formatVersion = static_cast<FormatVersion>(response.formatVersion);
+
+	return header;
+}
+
+FSI_INLINE_HPP
+void fsi::TileClient::readRect(const std::filesystem::path& path, uint8_t* data, uint32_t x, uint32_t y,
+	uint32_t width, uint32_t height, TilePriority priority, uint64_t dstStrideBytes)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (width == 0 || height == 0)
+		return;
+
+	// The pixel size isn't known before the answer. RGBA8 is a guess, the server asks for more if
+	// needed. The rows are packed in the shared memory so that the padding of data stays untouched.
+	reserve(static_cast<uint64_t>(width) * height * 4);
+
+	detail::TileRequest tileRequest;
+	tileRequest.type = detail::TileRequestType::Rect;
+	tileRequest.priority = priority;
+	tileRequest.x = x;
+	tileRequest.y = y;
+	tileRequest.width = width;
+	tileRequest.height = height;
+	const detail::TileResponse response = request(tileRequest, path, true);
+
+	const uint64_t rowSize = static_cast<uint64_t>(width) * response.channels
+		* sizeOfDepth(static_cast<Depth>(response.depth));
+	const uint64_t stride = dstStrideBytes > 0 ? dstStrideBytes : rowSize;
+
+	if (stride == rowSize)
+	{
+		std::memcpy(data, m_buffer, rowSize * height);
+		return;
+	}
+
+	for (uint32_t row = 0; row < height; row++)
+		std::memcpy(data + row * stride, m_buffer + row * rowSize, rowSize);
+}
+
+FSI_INLINE_HPP
+void fsi::TileClient::readThumbnail(const std::filesystem::path& path, uint8_t* data, TilePriority priority)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	reserve(thumbSizeInBytes);
+
+	detail::TileRequest tileRequest;
+	tileRequest.type = detail::TileRequestType::Thumbnail;
+	tileRequest.priority = priority;
+	const detail::TileResponse response = request(tileRequest, path, true);
+
+	std::memcpy(data, m_buffer, static_cast<uint64_t>(response.thumbWidth) * response.thumbHeight
+		* thumbChannels * thumbSizeOfDepth);
+}
+
+FSI_INLINE_HPP
+fsi::detail::TileResponse fsi::TileClient::request(detail::TileRequest& request,
+	const std::filesystem::path& path, bool shared)
+{
+#if defined(_WIN32)
+	(void)request;
+	(void)path;
+	(void)shared;
+	throw std::runtime_error("The tile server is not available on Windows");
+#else
+	if (m_fd < 0)
+		throw ExceptionFileIsNotOpen("The client must be connected before sending requests");
+
+	// Relative paths are resolved by the client, the server has its own working directory
+	std::error_code error;
+	const std::string absolute = std::filesystem::absolute(path, error).string();
+	const std::string& sentPath = error ? path.string() : absolute;
+
+	request.pathSize = static_cast<uint32_t>(sentPath.size());
+
+	for (;;)
+	{
+		request.id = m_nextId++;
+		request.bufferSize = shared ? m_bufferSize : 0;
+
+		detail::TileResponse response;
+		int unexpectedFd = -1;
+		if (!io::sendMessage(m_fd, &request, sizeof(request), shared ? m_bufferFd : -1)
+			|| !io::sendMessage(m_fd, sentPath.data(), sentPath.size())
+			|| !io::receiveMessage(m_fd, &response, sizeof(response), unexpectedFd)
+			|| response.id != request.id)
+		{
+			if (unexpectedFd >= 0)
+				::close(unexpectedFd);
+
+			// The stream can't be trusted anymore
+			::close(m_fd);
+			m_fd = -1;
+			throw std::runtime_error("Lost the connection to the tile server");
+		}
+
+		if (!response.ok)
+		{
+			std::string message(response.messageSize, '\0');
+			if (!message.empty() && !io::receiveMessage(m_fd, message.data(), message.size(), unexpectedFd))
+			{
+				::close(m_fd);
+				m_fd = -1;
+			}
+			if (unexpectedFd >= 0)
+				::close(unexpectedFd);
+
+			// Once more with enough shared memory
+			if (shared && m_fd >= 0 && response.requiredSize > m_bufferSize)
+			{
+				reserve(response.requiredSize);
+				continue;
+			}
+
+			throw std::runtime_error(message);
+		}
+
+		return response;
+	}
+#endif
+}
+
+FSI_INLINE_HPP
+void fsi::TileClient::reserve(uint64_t size)
+{
+#if !defined(_WIN32)
+	if (size <= m_bufferSize)
+		return;
+
+	if (m_bufferFd < 0)
+	{
+#if defined(__linux__)
+		m_bufferFd = ::memfd_create("fsi-tile", MFD_CLOEXEC);
+#else
+		// Anonymous shared memory: the name is gone as soon as the memory is created
+		const std::string name = "/fsi-tile-" + std::to_string(::getpid()) + "-"
+			+ std::to_string(reinterpret_cast<uintptr_t>(this));
+		m_bufferFd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+		if (m_bufferFd >= 0)
+			::shm_unlink(name.c_str());
+#endif
+		if (m_bufferFd < 0)
+			throw std::runtime_error(std::string("Failed to create shared memory: ") + std::strerror(errno));
+	}
+
+	// Grows geometrically so that a series of growing requests doesn't remap every time
+	const uint64_t newSize = std::max(size, m_bufferSize * 2);
+
+	if (m_buffer)
+	{
+		::munmap(m_buffer, static_cast<size_t>(m_bufferSize));
+		m_buffer = nullptr;
+		m_bufferSize = 0;
+	}
+
+	if (::ftruncate(m_bufferFd, static_cast<off_t>(newSize)) != 0)
+		throw std::runtime_error(std::string("Failed to allocate shared memory: ") + std::strerror(errno));
+
+	void* buffer = ::mmap(nullptr, static_cast<size_t>(newSize), PROT_READ | PROT_WRITE, MAP_SHARED, m_bufferFd, 0);
+	if (buffer == MAP_FAILED)
+		throw std::runtime_error(std::string("Failed to map shared memory: ") + std::strerror(errno));
+
+	m_buffer = static_cast<uint8_t*>(buffer);
+	m_bufferSize = newSize;
+#else
+	(void)size;
+#endif
+}
\ No newline at end of file
@@ -0,0 +1,235 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include "fsi_core_exports.h"
+#include "../global.h"
+#include "Depth.hpp"
+#include "FormatVersion.h"
+#include "Header.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fsi { class TileServer; class Reader; }
+
+namespace fsi
+{
+	/** @brief Requests of the same priority are served in arrival order. Interactive requests are
+	* served before any queued Batch request.
+	*/
+	enum class TilePriority : uint32_t
+	{
+		Interactive = 0,
+		Batch = 1
+	};
+
+	struct TileServerOptions
+	{
+		/** @brief Number of requests served at the same time. 0 for the number of hardware threads.
+		*/
+		uint32_t workers = 0;
+
+		/** @brief Files kept open. The least recently used one is closed beyond it.
+		*/
+		uint32_t maxOpenFiles = 64;
+
+		/** @brief Readers kept open per file, i.e. how many requests on the same file can read at the
+		* same time without opening it again.
+		*/
+		uint32_t readersPerFile = 4;
+	};
+
+	namespace detail
+	{
+		const uint32_t tileProtocolMagic = 0x31545346; // "FST1"
+
+		enum class TileRequestType : uint32_t
+		{
+			Header = 0,
+			Rect = 1,
+			Thumbnail = 2
+		};
+
+		/** @brief Sent by TileClient, followed by pathSize bytes of path. Rect and Thumbnail requests pass
+		* the shared memory the data is written to as a file descriptor along with it.
+		*/
+		struct TileRequest
+		{
+			uint32_t magic = tileProtocolMagic;
+			TileRequestType type = TileRequestType::Header;
+			TilePriority priority = TilePriority::Interactive;
+			uint32_t x = 0;
+			uint32_t y = 0;
+			uint32_t width = 0;
+			uint32_t height = 0;
+			uint32_t pathSize = 0;
+			uint64_t id = 0;
+			uint64_t dstStrideBytes = 0;
+			uint64_t bufferSize = 0;
+		};
+
+		/** @brief Sent by TileServer, followed by messageSize bytes of error message when ok is 0.
+		* requiredSize is set when the shared memory was too small for the data.
+		*/
+		struct TileResponse
+		{
+			uint64_t id = 0;
+			uint64_t requiredSize = 0;
+			uint32_t ok = 0;
+			uint32_t formatVersion = 0;
+			uint32_t width = 0;
+			uint32_t height = 0;
+			uint32_t channels = 0;
+			uint32_t depth = 0;
+			uint32_t hasThumb = 0;
+			uint32_t thumbWidth = 0;
+			uint32_t thumbHeight = 0;
+			uint32_t messageSize = 0;
+		};
+	}
+}
+
+/** @brief Serves headers, rects and thumbnails of FSI files to local processes over a Unix domain
+socket, so that tools working on the same files share the open files and their I/O instead of each
+opening them with its own Reader.
+
+Clients connect with TileClient. Pixels are written by the server straight into shared memory that
+the client passes along with each request as a file descriptor. Files stay open between requests and
+are reopened when they change on disk. Requests are queued by TilePriority and served by a fixed set
+of workers.
+
+Clients can read any FSI file the server process can read. Restrict the socket with file permissions
+where that matters. Not available on Windows.
+*/
+class FSI_CORE_API fsi::TileServer
+{
+public:
+
+	TileServer(const std::filesystem::path& socketPath, const TileServerOptions& options = TileServerOptions());
+
+	~TileServer();
+
+	FSI_DISABLE_COPY_MOVE(TileServer);
+
+public:
+
+	/** @brief Creates the socket and serves requests until stop() is called. An existing file at the
+	* socket path is replaced.
+	*/
+	void run();
+
+	/** @brief Makes run() return after the requests being served. Can be called from any thread and
+	* from a signal handler.
+	*/
+	void stop();
+
+private:
+
+	struct Connection
+	{
+		~Connection();
+
+		int fd = -1;
+		std::mutex sendMutex;
+		std::thread thread;
+		std::atomic<bool> finished{ false };
+	};
+
+	struct CachedFile
+	{
+		std::filesystem::path path;
+		std::filesystem::file_time_type modified;
+		uint64_t size = 0;
+		Header header;
+		FormatVersion formatVersion = FormatVersion::Invalid;
+
+		std::mutex mutex;
+		std::vector<std::unique_ptr<Reader>> readers;
+		std::vector<uint8_t> thumbnail;
+		bool thumbnailLoaded = false;
+	};
+
+	struct Job
+	{
+		detail::TileRequest request;
+		std::string path;
+		int bufferFd = -1;
+		uint64_t sequence = 0;
+		std::shared_ptr<Connection> connection;
+	};
+
+	struct JobOrder
+	{
+		bool operator()(const std::shared_ptr<Job>& a, const std::shared_ptr<Job>& b) const;
+	};
+
+private:
+
+	void receive(std::shared_ptr<Connection> connection);
+
+	void work();
+
+	void serve(Job& job);
+
+	std::shared_ptr<CachedFile> file(const std::string& path);
+
+	std::unique_ptr<Reader> acquireReader(CachedFile& file);
+
+	void releaseReader(CachedFile& file, std::unique_ptr<Reader> reader);
+
+	const std::vector<uint8_t>& thumbnail(CachedFile& file);
+
+private:
+
+	std::filesystem::path m_socketPath;
+
+	TileServerOptions m_options;
+
+	int m_listenFd;
+
+	int m_wakeFds[2];
+
+	std::atomic<bool> m_stop;
+
+	std::vector<std::thread> m_workers;
+
+	std::mutex m_connectionsMutex;
+
+	std::vector<std::shared_ptr<Connection>> m_connections;
+
+	std::mutex m_jobsMutex;
+
+	std::condition_variable m_jobsChanged;
+
+	std::priority_queue<std::shared_ptr<Job>, std::vector<std::shared_ptr<Job>>, JobOrder> m_jobs;
+
+	uint64_t m_nextSequence;
+
+	bool m_stopWorkers;
+
+	std::mutex m_filesMutex;
+
+	// Most recently used first
+	std::list<std::shared_ptr<CachedFile>> m_files;
+
+	std::map<std::string, std::list<std::shared_ptr<CachedFile>>::iterator> m_fileIndex;
+};
+
+#if FSI_HEADERONLY
+#include "TileServer.hpp"
+#endif
\ No newline at end of file
@@ -0,0 +1,572 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include "TileServer.h"
+#include "Reader.h"
+#include "Trace.h"
+#include "consts.h"
+#include "io.h"
+#include "exceptions.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#if !defined(_WIN32)
+	#include <cerrno>
+	#include <fcntl.h>
+	#include <poll.h>
+	#include <sys/mman.h>
+	#include <sys/socket.h>
+	#include <sys/stat.h>
+	#include <sys/un.h>
+	#include <unistd.h>
+#endif
+
+namespace fsi
+{
+	namespace detail
+	{
+#if !defined(_WIN32)
+		/** @brief Maps the shared memory passed with a request for the time of the request.
+		*/
+		class SharedBuffer
+		{
+		public:
+
+			SharedBuffer(int fd, uint64_t size)
+				: m_data(nullptr), m_size(size)
+			{
+				// A mapping past the end of the memory would fault on access instead of failing here
+				struct stat status;
+				if (fd < 0 || ::fstat(fd, &status) != 0 || static_cast<uint64_t>(status.st_size) < size)
+					throw std::runtime_error("The shared memory of the request is too small");
+
+				void* data = ::mmap(nullptr, static_cast<size_t>(size), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+				if (data == MAP_FAILED)
+					throw std::runtime_error(std::string("Failed to map the shared memory: ") + std::strerror(errno));
+
+				m_data = static_cast<uint8_t*>(data);
+			}
+
+			~SharedBuffer()
+			{
+				::munmap(m_data, static_cast<size_t>(m_size));
+			}
+
+			uint8_t* data() const { return m_data; }
+
+			FSI_DISABLE_COPY_MOVE(SharedBuffer);
+
+		private:
+
+			uint8_t* m_data;
+
+			uint64_t m_size;
+		};
+#endif
+	}
+}
+
+FSI_INLINE_HPP
+fsi::TileServer::Connection::~Connection()
+{
+#if !defined(_WIN32)
+	if (fd >= 0)
+		::close(fd);
+#endif
+}
+
+FSI_INLINE_HPP
+bool fsi::TileServer::JobOrder::operator()(const std::shared_ptr<Job>& a, const std::shared_ptr<Job>& b) const
+{
+	// The queue serves its largest element first
+	if (a->request.priority != b->request.priority)
+		return static_cast<uint32_t>(a->request.priority) > static_cast<uint32_t>(b->request.priority);
+	return a->sequence > b->sequence;
+}
+
+FSI_INLINE_HPP
+fsi::TileServer::TileServer(const std::filesystem::path& socketPath, const TileServerOptions& options)
+	: m_socketPath(socketPath)
+	, m_options(options)
+	, m_listenFd(-1)
+	, m_wakeFds{ -1, -1 }
+	, m_stop(false)
+	, m_nextSequence(0)
+	, m_stopWorkers(false)
+{
+#if !defined(_WIN32)
+	// stop() writes to the pipe to wake up run()
+	if (::pipe(m_wakeFds) != 0)
+		throw std::runtime_error(std::string("Failed to create the tile server: ") + std::strerror(errno));
+
+	for (int fd : m_wakeFds)
+	{
+		::fcntl(fd, F_SETFD, FD_CLOEXEC);
+		::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+	}
+#endif
+}
+
+FSI_INLINE_HPP
+fsi::TileServer::~TileServer()
+{
+#if !defined(_WIN32)
+	for (int fd : m_wakeFds)
+	{
+		if (fd >= 0)
+			::close(fd);
+	}
+#endif
+}
+
+FSI_INLINE_HPP
+void fsi::TileServer::run()
+{
+#if defined(_WIN32)
+	throw std::runtime_error("The tile server is not available on Windows");
+#else
+	FSI_TRACE_ZONE("api", "TileServer::run");
+
+	sockaddr_un address{};
+	address.sun_family = AF_UNIX;
+	const std::string socketPath = m_socketPath.string();
+	if (socketPath.size() >= sizeof(address.sun_path))
+		throw ExceptionFailedToCreateFile("The socket path is too long: " + socketPath);
+	std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+
+	m_listenFd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+	if (m_listenFd < 0)
+		throw ExceptionFailedToCreateFile(std::strerror(errno));
+	::fcntl(m_listenFd, F_SETFD, FD_CLOEXEC);
+
+	::unlink(socketPath.c_str());
+	if (::bind(m_listenFd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0
+		|| ::listen(m_listenFd, SOMAXCONN) != 0)
+	{
+		const std::string error = std::strerror(errno);
+		::close(m_listenFd);
+		m_listenFd = -1;
+		throw ExceptionFailedToCreateFile(error);
+	}
+
+	m_stopWorkers = false;
+	const uint32_t workers = m_options.workers > 0 ? m_options.workers
+		: std::max(std::thread::hardware_concurrency(), 1u);
+	for (uint32_t i = 0; i < workers; i++)
+		m_workers.emplace_back(&TileServer::work, this);
+
+	// --- Accept connections until stop() ---
+	while (!m_stop)
+	{
+		pollfd fds[2] = { { m_listenFd, POLLIN, 0 }, { m_wakeFds[0], POLLIN, 0 } };
+		if (::poll(fds, 2, -1) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		if (fds[1].revents != 0)
+			continue;
+
+		if ((fds[0].revents & POLLIN) == 0)
+			continue;
+
+		const int fd = ::accept(m_listenFd, nullptr, nullptr);
+		if (fd < 0)
+			continue;
+		::fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+		auto connection = std::make_shared<Connection>();
+		connection->fd = fd;
+
+		std::lock_guard<std::mutex> lock(m_connectionsMutex);
+
+		// Forget the clients that left
+		for (auto it = m_connections.begin(); it != m_connections.end();)
+		{
+			if ((*it)->finished)
+			{
+				(*it)->thread.join();
+				it = m_connections.erase(it);
+			}
+			else
+				it++;
+		}
+
+		m_connections.push_back(connection);
+		connection->thread = std::thread(&TileServer::receive, this, connection);
+	}
+
+	// --- Shut down ---
+	::close(m_listenFd);
+	m_listenFd = -1;
+	::unlink(socketPath.c_str());
+
+	// No more requests. The connections stay open for the responses being sent.
+	std::vector<std::shared_ptr<Connection>> connections;
+	{
+		std::lock_guard<std::mutex> lock(m_connectionsMutex);
+		connections.swap(m_connections);
+	}
+	for (const std::shared_ptr<Connection>& connection : connections)
+		::shutdown(connection->fd, SHUT_RD);
+	for (const std::shared_ptr<Connection>& connection : connections)
+		connection->thread.join();
+
+	// Queued requests are dropped, which closes their connections
+	{
+		std::lock_guard<std::mutex> lock(m_jobsMutex);
+		m_stopWorkers = true;
+		while (!m_jobs.empty())
+		{
+			if (m_jobs.top()->bufferFd >= 0)
+				::close(m_jobs.top()->bufferFd);
+			m_jobs.pop();
+		}
+	}
+	m_jobsChanged.notify_all();
+	for (std::thread& worker : m_workers)
+		worker.join();
+	m_workers.clear();
+
+	{
+		std::lock_guard<std::mutex> lock(m_filesMutex);
+		m_fileIndex.clear();
+		m_files.clear();
+	}
+
+	// Ready for another run()
+	char wake[64];
+	while (::read(m_wakeFds[0], wake, sizeof(wake)) > 0)
+	{
+	}
+	m_stop = false;
+#endif
+}
+
+FSI_INLINE_HPP
+void fsi::TileServer::stop()
+{
+	m_stop = true;
+
+#if !defined(_WIN32)
+	// Only async-signal-safe calls here
+	const char wake = 1;
+	const ssize_t written = ::write(m_wakeFds[1], &wake, 1);
+	(void)written;
+#endif
+}
+
+FSI_INLINE_HPP
+void fsi::TileServer::receive(std::shared_ptr<Connection> connection)
+{
+#if !defined(_WIN32)
+	for (;;)
+	{
+		auto job = std::make_shared<Job>();
+		job->connection = connection;
+
+		if (!io::receiveMessage(connection->fd, &job->request, sizeof(job->request), job->bufferFd))
+			break;
+
+		// Not a client of this version. Closing the connection is all that can be done.
+		if (job->request.magic != detail::tileProtocolMagic || job->request.pathSize > 65536)
+		{
+			if (job->bufferFd >= 0)
+				::close(job->bufferFd);
+			::shutdown(connection->fd, SHUT_RDWR);
+			break;
+		}
+
+		job->path.resize(job->request.pathSize);
+		int unexpectedFd = -1;
+		const bool received = io::receiveMessage(connection->fd, job->path.data(), job->path.size(), unexpectedFd);
+		if (unexpectedFd >= 0)
+			::close(unexpectedFd);
+		if (!received)
+		{
+			if (job->bufferFd >= 0)
+				::close(job->bufferFd);
+			break;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_jobsMutex);
+			job->sequence = m_nextSequence++;
+			m_jobs.push(job);
+		}
+		m_jobsChanged.notify_one();
+	}
+
+	connection->finished = true;
+#else
+	(void)connection;
+#endif
+}
+
+FSI_INLINE_HPP
+void fsi::TileServer::work()
+{
+	for (;;)
+	{
+		std::shared_ptr<Job> job;
+		{
+			std::unique_lock<std::mutex> lock(m_jobsMutex);
+			m_jobsChanged.wait(lock, [&] { return m_stopWorkers || !m_jobs.empty(); });
+			if (m_stopWorkers)
+				return;
+
+			job = m_jobs.top();
+			m_jobs.pop();
+		}
+
+		serve(*job);
+	}
+}
+
+FSI_INLINE_HPP
+void fsi::TileServer::serve(Job& job)
+{
+#if !defined(_WIN32)
+	FSI_TRACE_ZONE("api", "TileServer::serve");
+
+	io::FileDescriptor bufferFd(job.bufferFd);
+	job.bufferFd = -1;
+
+	const detail::TileRequest& request = job.request;
+
+	detail::TileResponse response;
+	response.id = request.id;
+	std::string message;
+
+	try
+	{
+		const std::shared_ptr<CachedFile> cached = file(job.path);
+		const Header& header = cached->header;
+
+		response.formatVersion = static_cast<uint32_t>(cached->formatVersion);
+		response.width = header.width;
+		response.height = header.height;
+		response.channels = header.channels;
+		response.depth = static_cast<uint32_t>(header.depth);
+		response.hasThumb = header.hasThumb ? 1 : 0;
+		response.thumbWidth = header.thumbWidth;
+		response.thumbHeight = header.thumbHeight;
+
+		switch (request.type)
+		{
+		case detail::TileRequestType::Header:
+			break;
+
+		case detail::TileRequestType::Rect:
+		{
+			if (request.width == 0 || request.height == 0
+				|| static_cast<uint64_t>(request.x) + request.width > header.width
+				|| static_cast<uint64_t>(request.y) + request.height > header.height)
+			{
+				throw std::runtime_error("The rect is outside of the image");
+			}
+
+			const uint64_t pixelSize = static_cast<uint64_t>(header.channels) * sizeOfDepth(header.depth);
+			const uint64_t rowSize = request.width * pixelSize;
+			const uint64_t stride = request.dstStrideBytes > 0 ? request.dstStrideBytes : rowSize;
+			if (stride < rowSize)
+				throw std::runtime_error("The stride is smaller than a row of the rect");
+
+			// The stride comes from the client. The size is only computed once it's known not to overflow.
+			if (stride > header.width * pixelSize)
+				throw std::runtime_error("The stride is larger than a row of the image");
+
+			const uint64_t rows = request.height - 1;
+			if (request.bufferSize < rowSize || (rows > 0 && stride > (request.bufferSize - rowSize) / rows))
+			{
+				if (rows == 0 || stride <= (UINT64_MAX - rowSize) / rows)
+					response.requiredSize = stride * rows + rowSize;
+				throw std::runtime_error("The shared memory of the request is too small");
+			}
+
+			const uint64_t size = stride * rows + rowSize;
+
+			detail::SharedBuffer buffer(bufferFd.get(), size);
+
+			// A Reader that throws is dropped, its state is unknown
+			std::unique_ptr<Reader> reader = acquireReader(*cached);
+			reader->readRect(buffer.data(), request.x, request.y, request.width, request.height, stride);
+			releaseReader(*cached, std::move(reader));
+			break;
+		}
+
+		case detail::TileRequestType::Thumbnail:
+		{
+			const std::vector<uint8_t>& thumb = thumbnail(*cached);
+			if (thumb.empty())
+				throw std::runtime_error("The file has no thumbnail");
+			if (request.bufferSize < thumb.size())
+			{
+				response.requiredSize = thumb.size();
+				throw std::runtime_error("The shared memory of the request is too small");
+			}
+
+			detail::SharedBuffer buffer(bufferFd.get(), thumb.size());
+			std::memcpy(buffer.data(), thumb.data(), thumb.size());
+			break;
+		}
+
+		default:
+			throw std::runtime_error("Unknown request");
+		}
+
+		response.ok = 1;
+	}
+	catch (const Exception& e)
+	{
+		message = e.what();
+		if (!e.whatDetails().empty())
+			message += ": " + e.whatDetails();
+	}
+	catch (const std::exception& e)
+	{
+		message = e.what();
+	}
+
+	response.messageSize = static_cast<uint32_t>(message.size());
+
+	// A client that left doesn't need an answer
+	std::lock_guard<std::mutex> lock(job.connection->sendMutex);
+	if (io::sendMessage(job.connection->fd, &response, sizeof(response)) && !message.empty())
+		io::sendMessage(job.connection->fd, message.data(), message.size());
+#else
+	(void)job;
+#endif
+}
+
+FSI_INLINE_HPP
+std::shared_ptr<fsi::TileServer::CachedFile> fsi::TileServer::file(const std::string& path)
+{
+	std::error_code error;
+	std::string key = std::filesystem::weakly_canonical(path, error).string();
+	if (error)
+		key = path;
+
+	// A file that changed on disk is opened again
+	const std::filesystem::file_time_type modified = std::filesystem::last_write_time(key, error);
+	const uint64_t size = error ? 0 : static_cast<uint64_t>(std::filesystem::file_size(key, error));
+
+	{
+		std::lock_guard<std::mutex> lock(m_filesMutex);
+
+		auto found = m_fileIndex.find(key);
+		if (found != m_fileIndex.end())
+		{
+			if ((*found->second)->modified == modified && (*found->second)->size == size)
+			{
+				m_files.splice(m_files.begin(), m_files, found->second);
+				return m_files.front();
+			}
+
+			m_files.erase(found->second);
+			m_fileIndex.erase(found);
+		}
+	}
+
+	// Opened without the lock, so other files are served meanwhile
+	auto cached = std::make_shared<CachedFile>();
+	cached->path = key;
+	cached->modified = modified;
+	cached->size = size;
+
+	auto reader = std::make_unique<Reader>();
+	reader->open(key);
+	cached->header = reader->header();
+	cached->formatVersion = reader->formatVersion();
+	cached->readers.push_back(std::move(reader));
+
+	std::lock_guard<std::mutex> lock(m_filesMutex);
+
+	// Another worker may have opened it too
+	auto found = m_fileIndex.find(key);
+	if (found != m_fileIndex.end())
+	{
+		m_files.erase(found->second);
+		m_fileIndex.erase(found);
+	}
+
+	m_files.push_front(cached);
+	m_fileIndex[key] = m_files.begin();
+
+	// Files in use stay open until their requests finish
+	while (m_files.size() > std::max(m_options.maxOpenFiles, 1u))
+	{
+		m_fileIndex.erase(m_files.back()->path.string());
+		m_files.pop_back();
+	}
+
+	return cached;
+}
+
+FSI_INLINE_HPP
+std::unique_ptr<fsi::Reader> fsi::TileServer::acquireReader(CachedFile& file)
+{
+	{
+		std::lock_guard<std::mutex> lock(file.mutex);
+		if (!file.readers.empty())
+		{
+			std::unique_ptr<Reader> reader = std::move(file.readers.back());
+			file.readers.pop_back();
+			return reader;
+		}
+	}
+
+	auto reader = std::make_unique<Reader>();
+	reader->open(file.path);
+	return reader;
+}
+
+FSI_INLINE_HPP
+void fsi::TileServer::releaseReader(CachedFile& file, std::unique_ptr<Reader> reader)
+{
+	std::lock_guard<std::mutex> lock(file.mutex);
+	if (file.readers.size() < std::max(m_options.readersPerFile, 1u))
+		file.readers.push_back(std::move(reader));
+}
+
+FSI_INLINE_HPP
+const std::vector<uint8_t>& fsi::TileServer::thumbnail(CachedFile& file)
+{
+	std::lock_guard<std::mutex> lock(file.mutex);
+	if (file.thumbnailLoaded)
+		return file.thumbnail;
+
+#if !defined(_WIN32)
+	if (file.formatVersion == FormatVersion::V2 && file.header.hasThumb)
+	{
+		// The thumbnail sits in a fixed size section right before the image data
+		const uint64_t size = static_cast<uint64_t>(file.header.thumbWidth) * file.header.thumbHeight
+			* thumbChannels * thumbSizeOfDepth;
+		const uint64_t offset = io::imageDataOffset(FormatVersion::V2) - thumbSizeInBytes;
+
+		bool direct = false;
+		io::FileDescriptor fd(io::openFile(file.path, false, direct));
+		if (fd.get() < 0)
+			throw ExceptionFailedToOpenFile(std::strerror(errno));
+
+		std::vector<uint8_t> thumb(size);
+		IoStats stats;
+		if (!io::readAt(fd.get(), thumb.data(), size, offset, stats))
+			throw std::runtime_error(std::string("Failed to read the thumbnail: ") + std::strerror(errno));
+
+		file.thumbnail = std::move(thumb);
+	}
+#endif
+
+	file.thumbnailLoaded = true;
+	return file.thumbnail;
+}
\ No newline at end of file
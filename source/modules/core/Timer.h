@@ -26,6 +26,14 @@ public:
 	void start();
 
 	uint64_t elapsedMs();
+
+	uint64_t elapsedUs();
+
+	uint64_t elapsedNs();
+
+	/** @brief Returns the time of the last start() in nanoseconds of std::chrono::steady_clock.
+	*/
+	uint64_t startNs();
 	
 	float elapsedS();
 
@@ -33,6 +33,28 @@ uint64_t fsi::Timer::elapsedMs()
 	return elapsed;
 }
 
+FSI_INLINE_HPP
+uint64_t fsi::Timer::elapsedUs()
+{
+	std::chrono::steady_clock::time_point currentTime = std::chrono::steady_clock::now();
+	uint64_t elapsed = std::chrono::duration_cast<std::chrono::microseconds> (currentTime - m_time).count();
+	return elapsed;
+}
+
+FSI_INLINE_HPP
+uint64_t fsi::Timer::elapsedNs()
+{
+	std::chrono::steady_clock::time_point currentTime = std::chrono::steady_clock::now();
+	uint64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds> (currentTime - m_time).count();
+	return elapsed;
+}
+
+FSI_INLINE_HPP
+uint64_t fsi::Timer::startNs()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(m_time.time_since_epoch()).count();
+}
+
 FSI_INLINE_HPP
 float fsi::Timer::elapsedS()
 {
@@ -0,0 +1,117 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include "fsi_core_exports.h"
+#include "../global.h"
+#include "Timer.h"
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+namespace fsi { class TraceSession; class TraceZone; }
+
+/** @brief Collects the timing zones of the library and writes them as a timeline.
+
+The library marks open, header parsing, thumbnail generation, every I/O chunk, readRect calls and
+progress callbacks with FSI_TRACE_ZONE. The zones are only compiled in when the library is configured
+with FSI_ENABLE_TRACING=ON (FSI_TRACING is 1); otherwise the macro expands to nothing and a session
+records only the zones the application adds itself.
+
+Timestamps come from the monotonic clock and the events carry the real process and thread ids, so the
+file can be loaded next to the traces of the application (chrome://tracing, ui.perfetto.dev).
+*/
+class FSI_CORE_API fsi::TraceSession
+{
+public:
+
+	enum class Format
+	{
+		// Chrome trace event JSON
+		ChromeJson,
+
+		// Perfetto protobuf trace
+		Perfetto,
+	};
+
+	struct Event
+	{
+		const char* category;
+		const char* name;
+		uint64_t startNs;
+		uint64_t durationNs;
+		uint64_t threadId;
+	};
+
+public:
+
+	/** @brief Starts recording zones from every thread. A session already running is discarded.
+	*
+	* @param path The file written by stop().
+	* @param format The format of the file.
+	*/
+	static void start(const std::filesystem::path& path, Format format = Format::ChromeJson);
+
+	/** @brief Stops recording and writes the file. Throws ExceptionFailedToCreateFile.
+	*/
+	static void stop();
+
+	static bool active();
+
+	/** @brief Adds a zone to the running session. Category and name must be string literals (or
+	* outlive the session).
+	*/
+	static void record(const char* category, const char* name, uint64_t startNs, uint64_t durationNs);
+
+private:
+
+	static void writeChromeJson(const std::filesystem::path& path, const std::vector<Event>& events);
+
+	static void writePerfetto(const std::filesystem::path& path, const std::vector<Event>& events);
+
+	static uint64_t currentThreadId();
+
+	static uint64_t processId();
+};
+
+/** @brief Records the lifetime of a scope as a zone of the running TraceSession.
+*/
+class FSI_CORE_API fsi::TraceZone
+{
+public:
+
+	TraceZone(const char* category, const char* name);
+
+	~TraceZone();
+
+	FSI_DISABLE_COPY_MOVE(TraceZone);
+
+private:
+
+	const char* m_category;
+
+	const char* m_name;
+
+	bool m_active;
+
+	Timer m_timer;
+};
+
+#define FSI_TRACE_CONCAT_IMPL(a, b) a##b
+#define FSI_TRACE_CONCAT(a, b) FSI_TRACE_CONCAT_IMPL(a, b)
+
+#if FSI_TRACING
+	#define FSI_TRACE_ZONE(category, name) \
+		fsi::TraceZone FSI_TRACE_CONCAT(fsiTraceZone, __LINE__)(category, name)
+#else
+	#define FSI_TRACE_ZONE(category, name)
+#endif
+
+#if FSI_HEADERONLY
+#include "Trace.hpp"
+#endif
\ No newline at end of file
@@ -0,0 +1,339 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include "Trace.h"
+#include "exceptions.hpp"
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <set>
+#include <thread>
+#include <functional>
+
+#if defined(_WIN32)
+	#ifndef NOMINMAX
+		#define NOMINMAX
+	#endif
+	#include <windows.h>
+#elif defined(__linux__)
+	#include <sys/syscall.h>
+	#include <unistd.h>
+#else
+	#include <unistd.h>
+#endif
+
+namespace fsi
+{
+	namespace detail
+	{
+		struct TraceState
+		{
+			std::atomic<bool> active = false;
+			std::mutex mutex;
+			std::vector<TraceSession::Event> events;
+			std::filesystem::path path;
+			TraceSession::Format format = TraceSession::Format::ChromeJson;
+		};
+
+		inline TraceState& traceState()
+		{
+			static TraceState state;
+			return state;
+		}
+
+		// Minimal protobuf encoding for the Perfetto writer
+		inline void protoVarint(std::string& out, uint64_t value)
+		{
+			while (value >= 0x80)
+			{
+				out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+				value >>= 7;
+			}
+			out.push_back(static_cast<char>(value));
+		}
+
+		inline void protoVarintField(std::string& out, uint32_t field, uint64_t value)
+		{
+			protoVarint(out, (static_cast<uint64_t>(field) << 3) | 0);
+			protoVarint(out, value);
+		}
+
+		inline void protoBytesField(std::string& out, uint32_t field, const std::string& bytes)
+		{
+			protoVarint(out, (static_cast<uint64_t>(field) << 3) | 2);
+			protoVarint(out, bytes.size());
+			out += bytes;
+		}
+
+		inline std::string jsonEscape(const char* text)
+		{
+			std::string escaped;
+			for (const char* c = text; *c; c++)
+			{
+				if (*c == '"' || *c == '\\')
+					escaped.push_back('\\');
+				escaped.push_back(*c);
+			}
+			return escaped;
+		}
+	}
+}
+
+FSI_INLINE_HPP
+void fsi::TraceSession::start(const std::filesystem::path& path, Format format)
+{
+	detail::TraceState& state = detail::traceState();
+
+	std::lock_guard<std::mutex> lock(state.mutex);
+	state.events.clear();
+	state.path = path;
+	state.format = format;
+	state.active = true;
+}
+
+FSI_INLINE_HPP
+void fsi::TraceSession::stop()
+{
+	detail::TraceState& state = detail::traceState();
+
+	std::vector<Event> events;
+	std::filesystem::path path;
+	Format format;
+	{
+		std::lock_guard<std::mutex> lock(state.mutex);
+		if (!state.active)
+			return;
+
+		state.active = false;
+		events.swap(state.events);
+		path = state.path;
+		format = state.format;
+	}
+
+	// Zones are recorded when they end, so inner zones come first
+	std::sort(events.begin(), events.end(), [](const Event& a, const Event& b)
+	{
+		if (a.startNs != b.startNs)
+			return a.startNs < b.startNs;
+		return a.durationNs > b.durationNs;
+	});
+
+	switch (format)
+	{
+	case Format::Perfetto:
+		writePerfetto(path, events);
+		break;
+	case Format::ChromeJson:
+	default:
+		writeChromeJson(path, events);
+		break;
+	}
+}
+
+FSI_INLINE_HPP
+bool fsi::TraceSession::active()
+{
+	return detail::traceState().active.load(std::memory_order_relaxed);
+}
+
+FSI_INLINE_HPP
+void fsi::TraceSession::record(const char* category, const char* name, uint64_t startNs,
+	uint64_t durationNs)
+{
+	detail::TraceState& state = detail::traceState();
+
+	const Event event = { category, name, startNs, durationNs, currentThreadId() };
+
+	std::lock_guard<std::mutex> lock(state.mutex);
+	if (state.active)
+		state.events.push_back(event);
+}
+
+FSI_INLINE_HPP
+void fsi::TraceSession::writeChromeJson(const std::filesystem::path& path,
+	const std::vector<Event>& events)
+{
+	std::ofstream file(path, std::ios::trunc);
+	if (file.fail())
+		throw ExceptionFailedToCreateFile();
+
+	const uint64_t pid = processId();
+
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":0,"
+		"\"args\":{\"name\":\"fsi\"}}";
+
+	// Complete events with microsecond timestamps. The fractional part keeps the nanoseconds.
+	for (const Event& event : events)
+	{
+		file << ",\n{\"name\":\"" << detail::jsonEscape(event.name)
+			<< "\",\"cat\":\"" << detail::jsonEscape(event.category)
+			<< "\",\"ph\":\"X\",\"pid\":" << pid
+			<< ",\"tid\":" << event.threadId
+			<< ",\"ts\":" << event.startNs / 1000 << "." << std::to_string(1000 + event.startNs % 1000).substr(1)
+			<< ",\"dur\":" << event.durationNs / 1000 << "." << std::to_string(1000 + event.durationNs % 1000).substr(1)
+			<< "}";
+	}
+
+	file << "\n]}\n";
+
+	if (file.fail())
+		throw ExceptionFailedToCreateFile("Could not write the trace file");
+}
+
+FSI_INLINE_HPP
+void fsi::TraceSession::writePerfetto(const std::filesystem::path& path,
+	const std::vector<Event>& events)
+{
+	// Field numbers from perfetto/protos/perfetto/trace/trace_packet.proto and track_event/*.proto
+	const uint32_t tracePacket = 1;
+	const uint32_t packetTimestamp = 8;
+	const uint32_t packetSequenceId = 10;
+	const uint32_t packetTrackEvent = 11;
+	const uint32_t packetTrackDescriptor = 60;
+	const uint32_t descriptorUuid = 1;
+	const uint32_t descriptorThread = 4;
+	const uint32_t threadPid = 1;
+	const uint32_t threadTid = 2;
+	const uint32_t eventType = 9;
+	const uint32_t eventTrackUuid = 11;
+	const uint32_t eventCategories = 22;
+	const uint32_t eventName = 23;
+	const uint64_t sliceBegin = 1;
+	const uint64_t sliceEnd = 2;
+	const uint64_t sequenceId = 0x46534901; // Arbitrary, constant for the whole trace
+
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (file.fail())
+		throw ExceptionFailedToCreateFile();
+
+	const uint64_t pid = processId();
+
+	auto writePacket = [&file](const std::string& packet)
+	{
+		std::string framed;
+		detail::protoBytesField(framed, tracePacket, packet);
+		file.write(framed.data(), static_cast<std::streamsize>(framed.size()));
+	};
+
+	auto trackUuid = [pid](uint64_t threadId) { return (pid << 32) ^ threadId; };
+
+	// One track per thread
+	std::set<uint64_t> threads;
+	for (const Event& event : events)
+		threads.insert(event.threadId);
+
+	for (uint64_t threadId : threads)
+	{
+		std::string thread;
+		detail::protoVarintField(thread, threadPid, pid);
+		detail::protoVarintField(thread, threadTid, threadId);
+
+		std::string descriptor;
+		detail::protoVarintField(descriptor, descriptorUuid, trackUuid(threadId));
+		detail::protoBytesField(descriptor, descriptorThread, thread);
+
+		std::string packet;
+		detail::protoVarintField(packet, packetSequenceId, sequenceId);
+		detail::protoBytesField(packet, packetTrackDescriptor, descriptor);
+		writePacket(packet);
+	}
+
+	auto writeSlice = [&](uint64_t threadId, uint64_t type, uint64_t timestampNs, const Event* event)
+	{
+		std::string trackEvent;
+		detail::protoVarintField(trackEvent, eventType, type);
+		detail::protoVarintField(trackEvent, eventTrackUuid, trackUuid(threadId));
+		if (event)
+		{
+			detail::protoBytesField(trackEvent, eventCategories, event->category);
+			detail::protoBytesField(trackEvent, eventName, event->name);
+		}
+
+		std::string packet;
+		detail::protoVarintField(packet, packetTimestamp, timestampNs);
+		detail::protoVarintField(packet, packetSequenceId, sequenceId);
+		detail::protoBytesField(packet, packetTrackEvent, trackEvent);
+		writePacket(packet);
+	};
+
+	// Zones of a thread are properly nested, so the slices of each track are emitted with a stack
+	for (uint64_t threadId : threads)
+	{
+		std::vector<uint64_t> openEnds;
+
+		for (const Event& event : events)
+		{
+			if (event.threadId != threadId)
+				continue;
+
+			while (!openEnds.empty() && openEnds.back() <= event.startNs)
+			{
+				writeSlice(threadId, sliceEnd, openEnds.back(), nullptr);
+				openEnds.pop_back();
+			}
+
+			writeSlice(threadId, sliceBegin, event.startNs, &event);
+			openEnds.push_back(event.startNs + event.durationNs);
+		}
+
+		while (!openEnds.empty())
+		{
+			writeSlice(threadId, sliceEnd, openEnds.back(), nullptr);
+			openEnds.pop_back();
+		}
+	}
+
+	if (file.fail())
+		throw ExceptionFailedToCreateFile("Could not write the trace file");
+}
+
+FSI_INLINE_HPP
+uint64_t fsi::TraceSession::currentThreadId()
+{
+#if defined(_WIN32)
+	return static_cast<uint64_t>(::GetCurrentThreadId());
+#elif defined(__linux__)
+	static thread_local uint64_t threadId = static_cast<uint64_t>(::syscall(SYS_gettid));
+	return threadId;
+#else
+	static thread_local uint64_t threadId = std::hash<std::thread::id>()(std::this_thread::get_id())
+		& 0xFFFFFFFF;
+	return threadId;
+#endif
+}
+
+FSI_INLINE_HPP
+uint64_t fsi::TraceSession::processId()
+{
+#if defined(_WIN32)
+	return static_cast<uint64_t>(::GetCurrentProcessId());
+#else
+	return static_cast<uint64_t>(::getpid());
+#endif
+}
+
+FSI_INLINE_HPP
+fsi::TraceZone::TraceZone(const char* category, const char* name)
+	: m_category(category)
+	, m_name(name)
+	, m_active(TraceSession::active())
+{
+	if (m_active)
+		m_timer.start();
+}
+
+FSI_INLINE_HPP
+fsi::TraceZone::~TraceZone()
+{
+	if (m_active)
+		TraceSession::record(m_category, m_name, m_timer.startNs(), m_timer.elapsedNs());
+}
\ No newline at end of file
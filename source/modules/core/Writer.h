@@ -12,7 +12,10 @@
 #include "Depth.hpp"
 #include "FormatVersion.h"
 #include "Header.h"
+#include "IoStats.h"
+#include "IoOptions.h"
 #include "ProgressThread.h"
+#include "RateLimiter.h"
 #include <filesystem>
 #include <fstream>
 #include <memory>
@@ -38,6 +41,10 @@ public:
 	*/
 	FormatVersion formatVersion();
 
+	/** @brief Returns the I/O counters of the file opened last. See IoStats.
+	*/
+	IoStats ioStats();
+
 public:
 
 	/** @brief Creates an empty FSI file and writes the header information.
@@ -45,9 +52,15 @@ public:
 	* @param path The path to the image file.
 	* @param header The header containing the image properties like dimensions, number of channels and
 	* bit-depth.
-	* @return false if the operation was completed or true if it was canceled.
+	* @param options How the following write() call accesses the file.
 	*/
-	void open(const std::filesystem::path& path, const Header& header);
+	void open(const std::filesystem::path& path, const Header& header, const WriteOptions& options = WriteOptions());
+
+	/** @brief Changes the options for the following calls.
+	*/
+	void setOptions(const WriteOptions& options);
+
+	WriteOptions options();
 
 	/** @brief Writes image data to a FSI file.
 	*
@@ -75,17 +88,37 @@ public:
 	* additionally be used for pausing, resuming and canceling the operation.
 	* @param reportProgressOpaquePtr Opaque pointer passed to reportProgressCB in case access to a member
 	* of an instance of opaquePointer is required.
+	* @param control Optional. Pauses, resumes or cancels the operation from another thread with no
+	* polling delay.
 	* @return false if the operation was completed or true if it was canceled.
 	*/
 	bool write(const uint8_t* data, ProgressThread::ReportProgressCB reportProgressCB = nullptr,
-		void* reportProgressOpaquePtr = nullptr);
+		void* reportProgressOpaquePtr = nullptr, OperationControl* control = nullptr);
+
+	/** @brief Appends the next rowCount packed rows of the image, for images that don't fit in memory.
+	*
+	* Call it after open() instead of write(), until header().height rows have been written. The
+	* thumbnail (if any) is built from the rows as they pass and written after the last one, when the
+	* file is closed.
+	*
+	* @param data rowCount rows of width*channels values without padding.
+	*/
+	void writeRows(const uint8_t* data, uint32_t rowCount);
 
 	void close();
 
+	/** @brief Throttles the writes of this Writer. The limiter can be shared with other Readers and
+	* Writers to cap their combined traffic. Pass nullptr to use the limiter of the calling thread's
+	* RateLimitScope, if any.
+	*/
+	void setRateLimiter(std::shared_ptr<RateLimiter> limiter);
+
 private:
 
 	std::unique_ptr<WriterImpl> m_impl;
 
+	std::shared_ptr<RateLimiter> m_rateLimiter;
+
 	FSI_DISABLE_COPY_MOVE(Writer);
 };
 
@@ -53,20 +53,58 @@ fsi::FormatVersion fsi::Writer::formatVersion()
 }
 
 FSI_INLINE_HPP
-void fsi::Writer::open(const std::filesystem::path& path, const Header& header)
+fsi::IoStats fsi::Writer::ioStats()
 {
-	m_impl->open(path, header);
+	return m_impl->ioStats();
+}
+
+FSI_INLINE_HPP
+void fsi::Writer::open(const std::filesystem::path& path, const Header& header, const WriteOptions& options)
+{
+	RateLimitScope rateLimit(m_rateLimiter.get());
+
+	m_impl->open(path, header, options);
+}
+
+FSI_INLINE_HPP
+void fsi::Writer::setOptions(const WriteOptions& options)
+{
+	m_impl->setOptions(options);
+}
+
+FSI_INLINE_HPP
+fsi::WriteOptions fsi::Writer::options()
+{
+	return m_impl->options();
 }
 
 FSI_INLINE_HPP
 bool fsi::Writer::write(const uint8_t* data, ProgressThread::ReportProgressCB reportProgressCB,
-	void* reportProgressOpaquePtr)
+	void* reportProgressOpaquePtr, OperationControl* control)
+{
+	RateLimitScope rateLimit(m_rateLimiter.get());
+
+	return m_impl->write(data, reportProgressCB, reportProgressOpaquePtr, control);
+}
+
+FSI_INLINE_HPP
+void fsi::Writer::writeRows(const uint8_t* data, uint32_t rowCount)
 {
-	return m_impl->write(data, reportProgressCB, reportProgressOpaquePtr);
+	RateLimitScope rateLimit(m_rateLimiter.get());
+
+	m_impl->writeRows(data, rowCount);
 }
 
 FSI_INLINE_HPP
 void fsi::Writer::close()
 {
+	RateLimitScope rateLimit(m_rateLimiter.get());
+
 	m_impl->close();
+}
+
+FSI_INLINE_HPP
+void fsi::Writer::setRateLimiter(std::shared_ptr<RateLimiter> limiter)
+{
+	m_rateLimiter = limiter;
 }
\ No newline at end of file
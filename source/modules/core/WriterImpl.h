@@ -12,6 +12,8 @@
 #include "Depth.hpp"
 #include "FormatVersion.h"
 #include "Header.h"
+#include "IoStats.h"
+#include "IoOptions.h"
 #include "ProgressThread.h"
 #include <filesystem>
 #include <fstream>
@@ -32,22 +34,48 @@ public:
 
 	virtual FormatVersion formatVersion() = 0;
 
+	IoStats ioStats();
+
 public:
 
-	void open(const std::filesystem::path& path, const Header& header);
+	void open(const std::filesystem::path& path, const Header& header, const WriteOptions& options = WriteOptions());
+
+	void setOptions(const WriteOptions& options);
+
+	WriteOptions options();
 
 	bool write(const uint8_t* data, ProgressThread::ReportProgressCB reportProgressCB = nullptr,
-		void* reportProgressOpaquePtr = nullptr);
+		void* reportProgressOpaquePtr = nullptr, OperationControl* control = nullptr);
+
+	void writeRows(const uint8_t* data, uint32_t rowCount);
 
 	void close();
 
 protected:
 
-	virtual void open(std::ofstream& file, Header& header) = 0;
+	virtual void open(std::ofstream& file, Header& header, IoStats& stats) = 0;
 
 	virtual void write(std::ofstream& file, const Header& header, const uint8_t* data,
-		const std::atomic<bool>& paused, const std::atomic<bool>& canceled,
-		std::atomic<float>& progress) = 0;
+		ProgressThread& progress, IoStats& stats) = 0;
+
+	// Version specific parts of writeRows(): before the first row, after each call and after the last
+	// row. They do nothing by default.
+	virtual void beginRows(std::ofstream& file, const Header& header, IoStats& stats);
+
+	virtual void rowsWritten(const Header& header, const uint8_t* data, uint32_t rowCount, IoStats& stats);
+
+	virtual void finishRows(std::ofstream& file, const Header& header, IoStats& stats);
+
+	/** @brief Writes the image data section, which starts at the current position of file, with the
+	* backend, chunk size and threads of the options.
+	*/
+	void writeImageData(std::ofstream& file, const uint8_t* data, uint64_t size, ProgressThread& progress,
+		IoStats& stats);
+
+private:
+
+	// Closes the file and applies the sync and cache options. Failures only throw if report is true.
+	void closeFile(bool report);
 
 private:
 
@@ -57,6 +85,12 @@ private:
 
 	std::filesystem::path m_path;
 
+	IoStats m_ioStats;
+
+	uint32_t m_rowsWritten = 0;
+
+	WriteOptions m_options;
+
 	FSI_DISABLE_COPY_MOVE(WriterImpl);
 };
 
@@ -9,12 +9,22 @@
 
 #include "WriterImpl.h"
 #include "consts.h"
+#include "io.h"
+#include "Trace.h"
 #include "proc.h"
+#include "tuning.h"
 #include "exceptions.hpp"
 #include <iostream>
 #include <atomic>
 #include <algorithm>
 #include <exception>
+#include <stdexcept>
+
+#if !defined(_WIN32)
+	#include <cerrno>
+	#include <cstring>
+	#include <unistd.h>
+#endif
 
 FSI_INLINE_HPP
 fsi::WriterImpl::WriterImpl()
@@ -24,7 +34,7 @@ fsi::WriterImpl::WriterImpl()
 FSI_INLINE_HPP
 fsi::WriterImpl::~WriterImpl()
 {
-	close();
+	closeFile(false);
 }
 
 FSI_INLINE_HPP
@@ -34,8 +44,16 @@ fsi::Header fsi::WriterImpl::header()
 }
 
 FSI_INLINE_HPP
-void fsi::WriterImpl::open(const std::filesystem::path& path, const Header& header)
+fsi::IoStats fsi::WriterImpl::ioStats()
+{
+	return m_ioStats;
+}
+
+FSI_INLINE_HPP
+void fsi::WriterImpl::open(const std::filesystem::path& path, const Header& header, const WriteOptions& options)
 {
+	FSI_TRACE_ZONE("api", "Writer::open");
+
 	// Check file extension
 	if (path.extension() != expectedFileExtension)
 		throw ExceptionInvalidFileExtension();
@@ -46,22 +64,30 @@ void fsi::WriterImpl::open(const std::filesystem::path& path, const Header& head
 	// Set path
 	m_path = path;
 
+	m_options = applyIoProfile(m_path, options);
+
+	// The stats cover the file opened last
+	m_ioStats = IoStats();
+	m_rowsWritten = 0;
+	io::GlobalStatsScope globalStats(m_ioStats);
+
 	// Open file
 	m_file = std::ofstream(m_path, std::ios::binary);
 	if (m_file.fail())
 		throw ExceptionFailedToCreateFile();
 
 	// Write signature
-	m_file.write((char*)(expectedFormatSignature), sizeof(expectedFormatSignature));
+	io::write(m_file, expectedFormatSignature, sizeof(expectedFormatSignature), m_ioStats);
 
 	// Write version
 	uint32_t version = static_cast<uint32_t>(formatVersion());
-	m_file.write((char*)(&version), sizeof(uint32_t));
+	io::write(m_file, (const uint8_t*)(&version), sizeof(uint32_t), m_ioStats);
 
 	// Write the rest of the header specific to the file version
 	try
 	{
-		open(m_file, m_header);
+		FSI_TRACE_ZONE("io", "write header");
+		open(m_file, m_header, m_ioStats);
 	}
 	catch (...)
 	{
@@ -73,42 +99,205 @@ void fsi::WriterImpl::open(const std::filesystem::path& path, const Header& head
 
 FSI_INLINE_HPP
 bool fsi::WriterImpl::write(const uint8_t* data, ProgressThread::ReportProgressCB reportProgressCB,
-	void* reportProgressOpaquePtr)
+	void* reportProgressOpaquePtr, OperationControl* control)
 {
 	if (!m_file.is_open())
 		throw ExceptionFileIsNotOpen("The file must be opened before writing can be attempted");
 
-	std::atomic<bool> canceled = false;
-	std::atomic<bool> paused = false;
-	std::atomic<float> progress = 0.0f;
-	ProgressThread progressThread(reportProgressOpaquePtr, reportProgressCB,
-		[&progress]() { return progress.load(std::memory_order_relaxed); },
-		[&canceled]() { canceled = true; },
-		[&paused]() { paused = true; },
-		[&paused]() { paused = false; },
-		progressCallbackInterval);
+	FSI_TRACE_ZONE("api", "Writer::write");
+	io::GlobalStatsScope globalStats(m_ioStats);
+
+	ProgressThread progressThread(reportProgressOpaquePtr, reportProgressCB, control,
+		m_options.progressIntervalMs);
 
 	// Write the data specific to the file version
 	try
 	{
-		write(m_file, m_header, data, paused, canceled, progress);
+		write(m_file, m_header, data, progressThread, m_ioStats);
 	}
 	catch (...)
 	{
-		// Join the progress thread, close file and rethrow the exception
-		progressThread.join(false);
+		// Close file and rethrow the exception
 		close();
 		throw;
 	}
 
-	progressThread.join(!canceled);
+	const bool canceled = progressThread.canceled();
+	progressThread.finish(!canceled);
 	close();
 	return canceled;
 }
 
+FSI_INLINE_HPP
+void fsi::WriterImpl::writeRows(const uint8_t* data, uint32_t rowCount)
+{
+	if (!m_file.is_open())
+		throw ExceptionFileIsNotOpen("The file must be opened before writing can be attempted");
+
+	if (static_cast<uint64_t>(m_rowsWritten) + rowCount > m_header.height)
+		throw std::runtime_error("More rows than the image height were written.");
+
+	FSI_TRACE_ZONE("api", "Writer::writeRows");
+	io::GlobalStatsScope globalStats(m_ioStats);
+
+	const uint64_t size = static_cast<uint64_t>(rowCount) * m_header.width * m_header.channels
+		* sizeOfDepth(m_header.depth);
+
+	try
+	{
+		if (m_rowsWritten == 0)
+			beginRows(m_file, m_header, m_ioStats);
+
+		m_ioStats.bytesRequested += size;
+		io::write(m_file, data, size, m_ioStats);
+		rowsWritten(m_header, data, rowCount, m_ioStats);
+
+		m_rowsWritten += rowCount;
+		if (m_rowsWritten == m_header.height)
+			finishRows(m_file, m_header, m_ioStats);
+	}
+	catch (...)
+	{
+		// Close file and rethrow the exception
+		close();
+		throw;
+	}
+
+	if (m_rowsWritten == m_header.height)
+		close();
+}
+
+FSI_INLINE_HPP
+void fsi::WriterImpl::setOptions(const WriteOptions& options)
+{
+	m_options = applyIoProfile(m_path, options);
+}
+
+FSI_INLINE_HPP
+fsi::WriteOptions fsi::WriterImpl::options()
+{
+	return m_options;
+}
+
+FSI_INLINE_HPP
+void fsi::WriterImpl::writeImageData(std::ofstream& file, const uint8_t* data, uint64_t size,
+	ProgressThread& progress, IoStats& stats)
+{
+	uint64_t chunkSize = std::clamp<uint64_t>(m_options.chunkSize, 1, size);
+
+#if !defined(_WIN32)
+	if (m_options.backend == IoBackend::Positional)
+	{
+		// Everything before the data goes through the stream
+		{
+			io::ScopedTime time(stats.ioTimeUs);
+			file.flush();
+		}
+		const uint64_t offset = static_cast<uint64_t>(file.tellp());
+
+		bool plain = false;
+		io::FileDescriptor fd(io::openFile(m_path, true, plain));
+		if (fd.get() < 0)
+			throw ExceptionFailedToCreateFile(std::strerror(errno));
+
+		// O_DIRECT only takes aligned ranges: the unaligned head and tail are written buffered
+		bool direct = m_options.directIo;
+		io::FileDescriptor directFd(direct ? io::openFile(m_path, true, direct) : -1);
+
+		uint64_t head = 0;
+		uint64_t tail = size;
+		if (direct)
+		{
+			const uint64_t alignment = io::directIoAlignment;
+			head = std::min(size, (alignment - offset % alignment) % alignment);
+			tail = head + (size - head) / alignment * alignment;
+			chunkSize = (chunkSize + alignment - 1) / alignment * alignment;
+		}
+
+		const int middleFd = direct ? directFd.get() : fd.get();
+		const uint64_t middle = tail - head;
+
+		if ((head > 0 && !io::writeAt(fd.get(), data, head, offset, stats))
+			|| (tail < size && !io::writeAt(fd.get(), data + tail, size - tail, offset + tail, stats)))
+		{
+			throw std::runtime_error(std::string("Failed to write FSI image data: ") + std::strerror(errno));
+		}
+
+		io::forEachChunk((middle + chunkSize - 1) / chunkSize, m_options.threads, &progress, stats,
+			[&](uint64_t chunk, IoStats& chunkStats)
+		{
+			FSI_TRACE_ZONE("io", "write chunk");
+
+			const uint64_t begin = head + chunk * chunkSize;
+			if (!io::writeAt(middleFd, data + begin, std::min(chunkSize, tail - begin), offset + begin, chunkStats))
+				throw std::runtime_error(std::string("Failed to write FSI image data: ") + std::strerror(errno));
+		}, direct ? chunkSize : 0);
+
+		io::seek(file, offset + size, stats);
+		return;
+	}
+#endif
+
+	// Write chunks of bytes
+	size_t ptr_offset = 0;
+	const size_t total = size - chunkSize;
+	for (; ptr_offset < total; ptr_offset += chunkSize)
+	{
+		if (!progress.update(static_cast<float>(ptr_offset) / static_cast<float>(total)))
+			return;
+
+		FSI_TRACE_ZONE("io", "write chunk");
+		io::write(file, (const uint8_t*)(data + ptr_offset), chunkSize, stats);
+	}
+
+	// Write remaining bytes (if any)
+	size_t remainder_size = size % chunkSize;
+	if (remainder_size == 0)
+		remainder_size = chunkSize;
+	size_t remainder_ptr_offset = size - remainder_size;
+	FSI_TRACE_ZONE("io", "write chunk");
+	io::write(file, (const uint8_t*)(data + remainder_ptr_offset), remainder_size, stats);
+}
+
+FSI_INLINE_HPP
+void fsi::WriterImpl::beginRows(std::ofstream&, const Header&, IoStats&)
+{
+}
+
+FSI_INLINE_HPP
+void fsi::WriterImpl::rowsWritten(const Header&, const uint8_t*, uint32_t, IoStats&)
+{
+}
+
+FSI_INLINE_HPP
+void fsi::WriterImpl::finishRows(std::ofstream&, const Header&, IoStats&)
+{
+}
+
 FSI_INLINE_HPP
 void fsi::WriterImpl::close()
+{
+	closeFile(true);
+}
+
+FSI_INLINE_HPP
+void fsi::WriterImpl::closeFile(bool report)
 {
 	if (m_file.is_open())
-		m_file.close();
+	{
+		{
+			// Flushes the stream buffer
+			io::ScopedTime time(m_ioStats.ioTimeUs);
+			m_file.close();
+		}
+
+#if !defined(_WIN32)
+		io::ScopedTime time(m_ioStats.ioTimeUs);
+		if (!io::finishFile(m_path, m_options.sync == SyncPolicy::OnClose,
+			m_options.cacheAdvice == CacheAdvice::DontKeep) && report)
+		{
+			throw ExceptionFailedToCreateFile(std::string("Failed to flush the file: ") + std::strerror(errno));
+		}
+#endif
+	}
 }
\ No newline at end of file
@@ -27,11 +27,10 @@ public:
 
 private:
 
-	void open(std::ofstream& file, Header& header) override;
+	void open(std::ofstream& file, Header& header, IoStats& stats) override;
 
 	void write(std::ofstream& file, const Header& header, const uint8_t* data,
-		const std::atomic<bool>& paused, const std::atomic<bool>& canceled,
-		std::atomic<float>& progress) override;
+		ProgressThread& progress, IoStats& stats) override;
 };
 
 #if FSI_HEADERONLY
@@ -9,6 +9,8 @@
 
 #include "WriterImplV1.h"
 #include "consts.h"
+#include "io.h"
+#include "Trace.h"
 #include "proc.h"
 #include "exceptions.hpp"
 #include <iostream>
@@ -22,7 +24,7 @@ fsi::FormatVersion fsi::WriterImplV1::formatVersion()
 }
 
 FSI_INLINE_HPP
-void fsi::WriterImplV1::open(std::ofstream& file, Header& header)
+void fsi::WriterImplV1::open(std::ofstream& file, Header& header, IoStats& stats)
 {
 	uint32_t depth = static_cast<uint32_t>(header.depth);
 
@@ -46,15 +48,15 @@ void fsi::WriterImplV1::open(std::ofstream& file, Header& header)
 		throw ExceptionInvalidImageDepth("Must be an integer between 1 and 10");
 	}
 
-	file.write((char*)(&header.width), sizeof(uint32_t));
-	file.write((char*)(&header.height), sizeof(uint32_t));
-	file.write((char*)(&header.channels), sizeof(uint32_t));
-	file.write((char*)(&depth), sizeof(uint32_t));
+	io::write(file, (const uint8_t*)(&header.width), sizeof(uint32_t), stats);
+	io::write(file, (const uint8_t*)(&header.height), sizeof(uint32_t), stats);
+	io::write(file, (const uint8_t*)(&header.channels), sizeof(uint32_t), stats);
+	io::write(file, (const uint8_t*)(&depth), sizeof(uint32_t), stats);
 }
 
 FSI_INLINE_HPP
 void fsi::WriterImplV1::write(std::ofstream& file, const Header& header, const uint8_t* data,
-	const std::atomic<bool>& paused, const std::atomic<bool>& canceled, std::atomic<float>& progress)
+	ProgressThread& progress, IoStats& stats)
 {
 	const uint64_t imageSize =
 		static_cast<uint64_t>(header.width)
@@ -62,29 +64,7 @@ void fsi::WriterImplV1::write(std::ofstream& file, const Header& header, const u
 	  * static_cast<uint64_t>(header.channels)
 	  * sizeOfDepth(header.depth);
 
-	// If buffer is larger than the total data, adjust the buffer size
-	const uint64_t bufferSize = defaultBufferSize > imageSize ? imageSize : defaultBufferSize;
+	stats.bytesRequested += imageSize;
 
-	// Write chunks of bytes
-	size_t ptr_offset = 0;
-	const size_t total = imageSize - bufferSize;
-	for (; ptr_offset < total; ptr_offset += bufferSize)
-	{
-		while (paused)
-			std::this_thread::sleep_for(std::chrono::milliseconds(100));
-
-		if (canceled)
-			return;
-
-		file.write((char*)(data + ptr_offset), bufferSize);
-
-		progress = static_cast<float>(ptr_offset) / static_cast<float>(total);
-	}
-
-	// Write remaining bytes (if any)
-	size_t remainder_size = imageSize % bufferSize;
-	if (remainder_size == 0)
-		remainder_size = bufferSize;
-	size_t remainder_ptr_offset = imageSize - remainder_size;
-	file.write((char*)(data + remainder_ptr_offset), remainder_size);
+	writeImageData(file, data, imageSize, progress, stats);
 }
\ No newline at end of file
@@ -14,8 +14,10 @@
 #include "FormatVersion.h"
 #include "Header.h"
 #include "ProgressThread.h"
+#include "ThumbnailAccumulator.h"
 #include <filesystem>
 #include <fstream>
+#include <memory>
 
 namespace fsi { class WriterImplV2; }
 
@@ -27,16 +29,28 @@ public:
 
 private:
 
-	void open(std::ofstream& file, Header& header) override;
+	void open(std::ofstream& file, Header& header, IoStats& stats) override;
 
 	void write(std::ofstream& file, const Header& header, const uint8_t* data,
-		const std::atomic<bool>& paused, const std::atomic<bool>& canceled,
-		std::atomic<float>& progress) override;
+		ProgressThread& progress, IoStats& stats) override;
+
+	void beginRows(std::ofstream& file, const Header& header, IoStats& stats) override;
+
+	void rowsWritten(const Header& header, const uint8_t* data, uint32_t rowCount, IoStats& stats) override;
+
+	void finishRows(std::ofstream& file, const Header& header, IoStats& stats) override;
 
 private:
 
 	void calcThumbDimensions(uint32_t imageWidth, uint32_t imageHeight, uint16_t& thumbWidth,
 		uint16_t& thumbHeight);
+
+private:
+
+	// Streaming writes only
+	std::unique_ptr<ThumbnailAccumulator> m_thumbnail;
+
+	uint64_t m_thumbOffset = 0;
 };
 
 #if FSI_HEADERONLY
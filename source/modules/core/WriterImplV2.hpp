@@ -9,7 +9,10 @@
 
 #include "WriterImplV2.h"
 #include "consts.h"
+#include "io.h"
+#include "Trace.h"
 #include "proc.h"
+#include "MemoryGovernor.h"
 #include "exceptions.hpp"
 #include <iostream>
 #include <atomic>
@@ -23,7 +26,7 @@ fsi::FormatVersion fsi::WriterImplV2::formatVersion()
 }
 
 FSI_INLINE_HPP
-void fsi::WriterImplV2::open(std::ofstream& file, Header& header)
+void fsi::WriterImplV2::open(std::ofstream& file, Header& header, IoStats& stats)
 {
 	// --- Write image header ---
 	{
@@ -49,17 +52,17 @@ void fsi::WriterImplV2::open(std::ofstream& file, Header& header)
 			throw ExceptionInvalidImageDepth("Must be an integer between 1 and 10");
 		}
 
-		file.write((char*)(&header.width), sizeof(uint32_t));
-		file.write((char*)(&header.height), sizeof(uint32_t));
-		file.write((char*)(&header.channels), sizeof(uint32_t));
-		file.write((char*)(&depth), sizeof(uint8_t));
+		io::write(file, (const uint8_t*)(&header.width), sizeof(uint32_t), stats);
+		io::write(file, (const uint8_t*)(&header.height), sizeof(uint32_t), stats);
+		io::write(file, (const uint8_t*)(&header.channels), sizeof(uint32_t), stats);
+		io::write(file, (const uint8_t*)(&depth), sizeof(uint8_t), stats);
 	}
 
 	// --- Write thumbnail header ---
 	{
 		// Write "has thumbnail"
 		uint8_t hasThumb = header.hasThumb ? 1 : 0;
-		file.write((char*)(&hasThumb), sizeof(uint8_t));
+		io::write(file, (const uint8_t*)(&hasThumb), sizeof(uint8_t), stats);
 
 		// Write thumbnail dimensions
 		if (header.hasThumb)
@@ -72,20 +75,29 @@ void fsi::WriterImplV2::open(std::ofstream& file, Header& header)
 			header.thumbWidth = 0;
 			header.thumbHeight = 0;
 		}
-		file.write((char*)(&header.thumbWidth), sizeof(uint16_t));
-		file.write((char*)(&header.thumbHeight), sizeof(uint16_t));
+		io::write(file, (const uint8_t*)(&header.thumbWidth), sizeof(uint16_t), stats);
+		io::write(file, (const uint8_t*)(&header.thumbHeight), sizeof(uint16_t), stats);
 	}
 }
 
 FSI_INLINE_HPP
 void fsi::WriterImplV2::write(std::ofstream& file, const Header& header, const uint8_t* data,
-	const std::atomic<bool>& paused, const std::atomic<bool>& canceled, std::atomic<float>& progress)
+	ProgressThread& progress, IoStats& stats)
 {
 	// --- Write thumbnail data ---
 	{
-		std::vector<uint8_t> thumb(thumbSizeInBytes);
+		// Only the used part of the section is allocated, the rest is left as a hole of zeros
+		const uint64_t usedThumbSize = header.hasThumb
+			? static_cast<uint64_t>(header.thumbWidth) * header.thumbHeight * thumbChannels * thumbSizeOfDepth : 0;
+		MemoryReservation memory(usedThumbSize);
+		std::vector<uint8_t> thumb(usedThumbSize);
+		stats.peakScratchBytes = std::max(stats.peakScratchBytes, usedThumbSize);
+
 		if (header.hasThumb)
 		{
+			FSI_TRACE_ZONE("compute", "generate thumbnail");
+			io::ScopedTime computeTime(stats.computeTimeUs);
+
 			// const uint64_t thumbSize = header.thumbWidth * header.thumbHeight * thumbChannels * sizeOfDepth(thumbDepth);
 
 			const uint64_t step = header.width * header.channels;
@@ -97,7 +109,9 @@ void fsi::WriterImplV2::write(std::ofstream& file, const Header& header, const u
 			// std::cout << "Thumbnail generated in " << timer.elapsedMs() << " ms\n";
 		}
 
-		file.write((char*)(thumb.data()), thumbSizeInBytes);
+		const uint64_t thumbOffset = static_cast<uint64_t>(file.tellp());
+		io::write(file, (const uint8_t*)(thumb.data()), usedThumbSize, stats);
+		io::seek(file, thumbOffset + thumbSizeInBytes, stats);
 	}
 	
 	// --- Write image data ---
@@ -108,32 +122,50 @@ void fsi::WriterImplV2::write(std::ofstream& file, const Header& header, const u
 		  * static_cast<uint64_t>(header.channels)
 		  * sizeOfDepth(header.depth);
 
-		// If buffer is larger than the total data, adjust the buffer size
-		const uint64_t bufferSize = defaultBufferSize > imageSize ? imageSize : defaultBufferSize;
+		stats.bytesRequested += imageSize;
 
-		// Write chunks of bytes
-		size_t ptr_offset = 0;
-		const size_t total = imageSize - bufferSize;
-		for (; ptr_offset < total; ptr_offset += bufferSize)
-		{
-			while (paused)
-				std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		writeImageData(file, data, imageSize, progress, stats);
+	}
+}
 
-			if (canceled)
-				return;
+FSI_INLINE_HPP
+void fsi::WriterImplV2::beginRows(std::ofstream& file, const Header& header, IoStats& stats)
+{
+	// The thumbnail is only known after the last row. Reserve its section and fill it in later.
+	m_thumbOffset = static_cast<uint64_t>(file.tellp());
+	m_thumbnail.reset();
 
-			file.write((char*)(data + ptr_offset), bufferSize);
+	if (header.hasThumb)
+	{
+		m_thumbnail = std::make_unique<ThumbnailAccumulator>(header);
+		stats.peakScratchBytes = std::max<uint64_t>(stats.peakScratchBytes, m_thumbnail->thumbnail().size());
+	}
 
-			progress = static_cast<float>(ptr_offset) / static_cast<float>(total);
-		}
+	// A hole of zeros until then
+	io::seek(file, m_thumbOffset + thumbSizeInBytes, stats);
+}
 
-		// Write remaining bytes (if any)
-		size_t remainder_size = imageSize % bufferSize;
-		if (remainder_size == 0)
-			remainder_size = bufferSize;
-		size_t remainder_ptr_offset = imageSize - remainder_size;
-		file.write((char*)(data + remainder_ptr_offset), remainder_size);
-	}
+FSI_INLINE_HPP
+void fsi::WriterImplV2::rowsWritten(const Header&, const uint8_t* data, uint32_t rowCount, IoStats& stats)
+{
+	if (!m_thumbnail)
+		return;
+
+	FSI_TRACE_ZONE("compute", "accumulate thumbnail");
+	io::ScopedTime computeTime(stats.computeTimeUs);
+	m_thumbnail->addRows(data, rowCount);
+}
+
+FSI_INLINE_HPP
+void fsi::WriterImplV2::finishRows(std::ofstream& file, const Header&, IoStats& stats)
+{
+	if (!m_thumbnail)
+		return;
+
+	io::seek(file, m_thumbOffset, stats);
+	const std::vector<uint8_t>& thumb = m_thumbnail->thumbnail();
+	io::write(file, thumb.data(), thumb.size(), stats);
+	m_thumbnail.reset();
 }
 
 FSI_INLINE_HPP
@@ -168,4 +200,4 @@ void fsi::WriterImplV2::calcThumbDimensions(uint32_t imageWidth, uint32_t imageH
 
 	assert(thumbWidth <= thumbMaxDimension && "Thumbnail max width is 256. Should not reach here.");
 	assert(thumbHeight <= thumbMaxDimension && "Thumbnail max height is 256. Should not reach here.");
-}
+}
\ No newline at end of file
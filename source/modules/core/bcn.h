@@ -0,0 +1,32 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include "fsi_core_exports.h"
+#include "../global.h"
+#include "BlockFormat.h"
+#include "Depth.hpp"
+#include <cstdint>
+
+namespace fsi
+{
+	/** @brief Encodes one row of 4x4 blocks.
+	*
+	* @param src Up to 4 rows of width pixels, srcStrideBytes apart. Uint8 or Uint16 with 1 to 4
+	* channels.
+	* @param rows Rows in src. Missing rows and the columns of the last block past width repeat the
+	* last row and column.
+	* @param dst (width + 3) / 4 blocks of blockSizeInBytes(format).
+	*/
+	FSI_CORE_API void compressBlocks(const uint8_t* src, uint64_t srcStrideBytes, uint32_t width,
+		uint32_t rows, uint32_t channels, Depth depth, BlockFormat format, uint8_t* dst);
+}
+
+#if FSI_HEADERONLY
+#include "bcn.hpp"
+#endif
\ No newline at end of file
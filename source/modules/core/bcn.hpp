@@ -0,0 +1,563 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include "bcn.h"
+#include "bcn.tcc"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace fsi
+{
+	namespace detail
+	{
+		// --- Shared ---
+
+		// Direction of largest spread of the points around their mean: a few power iterations on the
+		// covariance, starting from the extent of the bounding box. Zero for a flat block.
+		template <int N>
+		inline void principalAxis(const float (&points)[16][N], float (&mean)[N], float (&axis)[N])
+		{
+			float lo[N];
+			float hi[N];
+			for (int c = 0; c < N; c++)
+			{
+				mean[c] = 0.0f;
+				lo[c] = std::numeric_limits<float>::max();
+				hi[c] = std::numeric_limits<float>::lowest();
+			}
+
+			for (int i = 0; i < 16; i++)
+			{
+				for (int c = 0; c < N; c++)
+				{
+					mean[c] += points[i][c] / 16.0f;
+					lo[c] = std::min(lo[c], points[i][c]);
+					hi[c] = std::max(hi[c], points[i][c]);
+				}
+			}
+
+			float covariance[N][N] = {};
+			for (int i = 0; i < 16; i++)
+			{
+				for (int a = 0; a < N; a++)
+				{
+					for (int b = 0; b < N; b++)
+						covariance[a][b] += (points[i][a] - mean[a]) * (points[i][b] - mean[b]);
+				}
+			}
+
+			for (int c = 0; c < N; c++)
+				axis[c] = hi[c] - lo[c];
+
+			for (int iteration = 0; iteration < 4; iteration++)
+			{
+				float next[N] = {};
+				float largest = 0.0f;
+				for (int a = 0; a < N; a++)
+				{
+					for (int b = 0; b < N; b++)
+						next[a] += covariance[a][b] * axis[b];
+					largest = std::max(largest, std::fabs(next[a]));
+				}
+
+				if (largest == 0.0f)
+					break;
+
+				for (int c = 0; c < N; c++)
+					axis[c] = next[c] / largest;
+			}
+		}
+
+		// Endpoints e0 and e1 that minimize the squared error of the points for the given weights of
+		// e0 (e1 gets 1 - weight). False when the weights can't separate them.
+		template <int N>
+		inline bool leastSquaresEndpoints(const float (&points)[16][N], const float (&weights)[16],
+			float (&e0)[N], float (&e1)[N])
+		{
+			float aa = 0.0f;
+			float ab = 0.0f;
+			float bb = 0.0f;
+			float ap[N] = {};
+			float bp[N] = {};
+
+			for (int i = 0; i < 16; i++)
+			{
+				const float a = weights[i];
+				const float b = 1.0f - a;
+				aa += a * a;
+				ab += a * b;
+				bb += b * b;
+				for (int c = 0; c < N; c++)
+				{
+					ap[c] += a * points[i][c];
+					bp[c] += b * points[i][c];
+				}
+			}
+
+			const float determinant = aa * bb - ab * ab;
+			if (std::fabs(determinant) < 1e-6f)
+				return false;
+
+			for (int c = 0; c < N; c++)
+			{
+				e0[c] = std::clamp((bb * ap[c] - ab * bp[c]) / determinant, 0.0f, 255.0f);
+				e1[c] = std::clamp((aa * bp[c] - ab * ap[c]) / determinant, 0.0f, 255.0f);
+			}
+
+			return true;
+		}
+
+		// --- BC1 ---
+
+		inline uint16_t packRgb565(const float (&color)[3])
+		{
+			const uint32_t r = static_cast<uint32_t>(std::lround(std::clamp(color[0], 0.0f, 255.0f) * 31.0f / 255.0f));
+			const uint32_t g = static_cast<uint32_t>(std::lround(std::clamp(color[1], 0.0f, 255.0f) * 63.0f / 255.0f));
+			const uint32_t b = static_cast<uint32_t>(std::lround(std::clamp(color[2], 0.0f, 255.0f) * 31.0f / 255.0f));
+			return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+		}
+
+		inline void unpackRgb565(uint16_t packed, int (&color)[3])
+		{
+			const int r = (packed >> 11) & 31;
+			const int g = (packed >> 5) & 63;
+			const int b = packed & 31;
+			color[0] = (r << 3) | (r >> 2);
+			color[1] = (g << 2) | (g >> 4);
+			color[2] = (b << 3) | (b >> 2);
+		}
+
+		// Nearest of the four colors of c0 and c1 for every pixel. Returns the squared error.
+		inline int64_t assignBC1(const uint8_t (&rgba)[16][4], uint16_t c0, uint16_t c1, uint8_t (&indices)[16])
+		{
+			int palette[4][3];
+			unpackRgb565(c0, palette[0]);
+			unpackRgb565(c1, palette[1]);
+			for (int c = 0; c < 3; c++)
+			{
+				palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+				palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+			}
+
+			int64_t total = 0;
+			for (int i = 0; i < 16; i++)
+			{
+				int best = 0;
+				int bestError = std::numeric_limits<int>::max();
+				for (int p = 0; p < 4; p++)
+				{
+					int error = 0;
+					for (int c = 0; c < 3; c++)
+					{
+						const int d = palette[p][c] - rgba[i][c];
+						error += d * d;
+					}
+					if (error < bestError)
+					{
+						best = p;
+						bestError = error;
+					}
+				}
+				indices[i] = static_cast<uint8_t>(best);
+				total += bestError;
+			}
+
+			return total;
+		}
+
+		/** @brief Encodes the RGB of a block in the four-color mode of BC1: endpoints at the ends of the
+		* principal axis, refined by least squares for the chosen indices.
+		*/
+		inline void encodeBC1(const uint8_t (&rgba)[16][4], uint8_t* dst)
+		{
+			float points[16][3];
+			for (int i = 0; i < 16; i++)
+			{
+				for (int c = 0; c < 3; c++)
+					points[i][c] = rgba[i][c];
+			}
+
+			float mean[3];
+			float axis[3];
+			principalAxis(points, mean, axis);
+
+			float e0[3] = { mean[0], mean[1], mean[2] };
+			float e1[3] = { mean[0], mean[1], mean[2] };
+			float lo = std::numeric_limits<float>::max();
+			float hi = std::numeric_limits<float>::lowest();
+			for (int i = 0; i < 16; i++)
+			{
+				const float t = (points[i][0] - mean[0]) * axis[0] + (points[i][1] - mean[1]) * axis[1]
+					+ (points[i][2] - mean[2]) * axis[2];
+				if (t > hi)
+				{
+					hi = t;
+					std::copy(points[i], points[i] + 3, e0);
+				}
+				if (t < lo)
+				{
+					lo = t;
+					std::copy(points[i], points[i] + 3, e1);
+				}
+			}
+
+			uint16_t bestC0 = 0;
+			uint16_t bestC1 = 0;
+			uint8_t bestIndices[16] = {};
+			int64_t bestError = std::numeric_limits<int64_t>::max();
+
+			for (int iteration = 0; iteration < 3; iteration++)
+			{
+				const uint16_t c0 = packRgb565(e0);
+				const uint16_t c1 = packRgb565(e1);
+
+				uint8_t indices[16];
+				const int64_t error = assignBC1(rgba, c0, c1, indices);
+				if (error < bestError)
+				{
+					bestC0 = c0;
+					bestC1 = c1;
+					std::copy(indices, indices + 16, bestIndices);
+					bestError = error;
+				}
+
+				if (error == 0)
+					break;
+
+				const float weightOfC0[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+				float weights[16];
+				for (int i = 0; i < 16; i++)
+					weights[i] = weightOfC0[indices[i]];
+
+				if (!leastSquaresEndpoints(points, weights, e0, e1))
+					break;
+			}
+
+			// The four-color mode needs c0 > c1. Swapping the endpoints swaps 0 with 1 and 2 with 3. Equal
+			// endpoints would select the three-color mode, where only index 0 is safe.
+			if (bestC0 < bestC1)
+			{
+				std::swap(bestC0, bestC1);
+				for (uint8_t& index : bestIndices)
+					index ^= 1;
+			}
+			else if (bestC0 == bestC1)
+			{
+				std::fill(bestIndices, bestIndices + 16, 0);
+			}
+
+			uint32_t bits = 0;
+			for (int i = 0; i < 16; i++)
+				bits |= static_cast<uint32_t>(bestIndices[i]) << (2 * i);
+
+			dst[0] = static_cast<uint8_t>(bestC0);
+			dst[1] = static_cast<uint8_t>(bestC0 >> 8);
+			dst[2] = static_cast<uint8_t>(bestC1);
+			dst[3] = static_cast<uint8_t>(bestC1 >> 8);
+			for (int b = 0; b < 4; b++)
+				dst[4 + b] = static_cast<uint8_t>(bits >> (8 * b));
+		}
+
+		// --- BC4 ---
+
+		/** @brief Encodes one channel of a block in the eight-value mode of BC4, between its minimum and
+		* maximum.
+		*/
+		inline void encodeBC4(const uint8_t (&values)[16], uint8_t* dst)
+		{
+			const int hi = *std::max_element(values, values + 16);
+			const int lo = *std::min_element(values, values + 16);
+
+			dst[0] = static_cast<uint8_t>(hi);
+			dst[1] = static_cast<uint8_t>(lo);
+
+			uint64_t bits = 0;
+			if (hi > lo)
+			{
+				int palette[8];
+				palette[0] = hi;
+				palette[1] = lo;
+				for (int k = 2; k < 8; k++)
+					palette[k] = ((8 - k) * hi + (k - 1) * lo + 3) / 7;
+
+				for (int i = 0; i < 16; i++)
+				{
+					int best = 0;
+					for (int p = 1; p < 8; p++)
+					{
+						if (std::abs(palette[p] - values[i]) < std::abs(palette[best] - values[i]))
+							best = p;
+					}
+					bits |= static_cast<uint64_t>(best) << (3 * i);
+				}
+			}
+
+			for (int b = 0; b < 6; b++)
+				dst[2 + b] = static_cast<uint8_t>(bits >> (8 * b));
+		}
+
+		// --- BC7 ---
+
+		const int bc7Weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+		// 7 bits per channel and a shared lowest bit (the p-bit), whichever of the two is closer
+		inline void quantizeBC7Endpoint(const float (&color)[4], int (&quantized)[4], int& pBit)
+		{
+			float bestError = std::numeric_limits<float>::max();
+			for (int p = 0; p < 2; p++)
+			{
+				int candidate[4];
+				float error = 0.0f;
+				for (int c = 0; c < 4; c++)
+				{
+					candidate[c] = std::clamp(static_cast<int>(std::lround((color[c] - p) / 2.0f)), 0, 127);
+					const float d = static_cast<float>((candidate[c] << 1) | p) - color[c];
+					error += d * d;
+				}
+
+				if (error < bestError)
+				{
+					bestError = error;
+					pBit = p;
+					std::copy(candidate, candidate + 4, quantized);
+				}
+			}
+		}
+
+		inline int64_t assignBC7(const uint8_t (&rgba)[16][4], const int (&q0)[4], int p0, const int (&q1)[4],
+			int p1, uint8_t (&indices)[16])
+		{
+			int palette[16][4];
+			for (int c = 0; c < 4; c++)
+			{
+				const int e0 = (q0[c] << 1) | p0;
+				const int e1 = (q1[c] << 1) | p1;
+				for (int k = 0; k < 16; k++)
+					palette[k][c] = ((64 - bc7Weights4[k]) * e0 + bc7Weights4[k] * e1 + 32) >> 6;
+			}
+
+			int64_t total = 0;
+			for (int i = 0; i < 16; i++)
+			{
+				int best = 0;
+				int bestError = std::numeric_limits<int>::max();
+				for (int k = 0; k < 16; k++)
+				{
+					int error = 0;
+					for (int c = 0; c < 4; c++)
+					{
+						const int d = palette[k][c] - rgba[i][c];
+						error += d * d;
+					}
+					if (error < bestError)
+					{
+						best = k;
+						bestError = error;
+					}
+				}
+				indices[i] = static_cast<uint8_t>(best);
+				total += bestError;
+			}
+
+			return total;
+		}
+
+		// Appends bits to a zeroed block, lowest bit first
+		struct BlockBitWriter
+		{
+			uint8_t* dst;
+			uint32_t position = 0;
+
+			void write(uint32_t value, uint32_t count)
+			{
+				for (uint32_t b = 0; b < count; b++, position++)
+				{
+					if ((value >> b) & 1)
+						dst[position / 8] |= static_cast<uint8_t>(1 << (position % 8));
+				}
+			}
+		};
+
+		/** @brief Encodes the RGBA of a block in mode 6 of BC7: one subset, 7.7.7.7 endpoints with a
+		* p-bit each and 4-bit indices. The endpoints start at the extent of the principal axis and are
+		* refined by least squares for the chosen indices.
+		*/
+		inline void encodeBC7(const uint8_t (&rgba)[16][4], uint8_t* dst)
+		{
+			float points[16][4];
+			for (int i = 0; i < 16; i++)
+			{
+				for (int c = 0; c < 4; c++)
+					points[i][c] = rgba[i][c];
+			}
+
+			float mean[4];
+			float axis[4];
+			principalAxis(points, mean, axis);
+
+			float lo = 0.0f;
+			float hi = 0.0f;
+			const float length = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2] + axis[3] * axis[3];
+			for (int i = 0; i < 16 && length > 0.0f; i++)
+			{
+				float t = 0.0f;
+				for (int c = 0; c < 4; c++)
+					t += (points[i][c] - mean[c]) * axis[c];
+				lo = std::min(lo, t / length);
+				hi = std::max(hi, t / length);
+			}
+
+			float e0[4];
+			float e1[4];
+			for (int c = 0; c < 4; c++)
+			{
+				e0[c] = std::clamp(mean[c] + lo * axis[c], 0.0f, 255.0f);
+				e1[c] = std::clamp(mean[c] + hi * axis[c], 0.0f, 255.0f);
+			}
+
+			int bestQ0[4] = {};
+			int bestQ1[4] = {};
+			int bestP0 = 0;
+			int bestP1 = 0;
+			uint8_t bestIndices[16] = {};
+			int64_t bestError = std::numeric_limits<int64_t>::max();
+
+			for (int iteration = 0; iteration < 3; iteration++)
+			{
+				int q0[4];
+				int q1[4];
+				int p0 = 0;
+				int p1 = 0;
+				quantizeBC7Endpoint(e0, q0, p0);
+				quantizeBC7Endpoint(e1, q1, p1);
+
+				uint8_t indices[16];
+				const int64_t error = assignBC7(rgba, q0, p0, q1, p1, indices);
+				if (error < bestError)
+				{
+					std::copy(q0, q0 + 4, bestQ0);
+					std::copy(q1, q1 + 4, bestQ1);
+					bestP0 = p0;
+					bestP1 = p1;
+					std::copy(indices, indices + 16, bestIndices);
+					bestError = error;
+				}
+
+				if (error == 0)
+					break;
+
+				float weights[16];
+				for (int i = 0; i < 16; i++)
+					weights[i] = static_cast<float>(64 - bc7Weights4[indices[i]]) / 64.0f;
+
+				if (!leastSquaresEndpoints(points, weights, e0, e1))
+					break;
+			}
+
+			// The highest bit of the first index is implied to be 0. Swapping the endpoints reverses the
+			// indices.
+			if (bestIndices[0] >= 8)
+			{
+				std::swap(bestQ0, bestQ1);
+				std::swap(bestP0, bestP1);
+				for (uint8_t& index : bestIndices)
+					index = static_cast<uint8_t>(15 - index);
+			}
+
+			std::memset(dst, 0, 16);
+			BlockBitWriter writer{ dst };
+			writer.write(1 << 6, 7);
+			for (int c = 0; c < 4; c++)
+			{
+				writer.write(static_cast<uint32_t>(bestQ0[c]), 7);
+				writer.write(static_cast<uint32_t>(bestQ1[c]), 7);
+			}
+			writer.write(static_cast<uint32_t>(bestP0), 1);
+			writer.write(static_cast<uint32_t>(bestP1), 1);
+			writer.write(bestIndices[0], 3);
+			for (int i = 1; i < 16; i++)
+				writer.write(bestIndices[i], 4);
+		}
+
+		// RGBA of the channels: gray for 1 or 2 channels, the second one being alpha, opaque without
+		// alpha
+		inline void blockToRgba(uint8_t (&block)[16][4], uint64_t channels)
+		{
+			for (uint8_t* pixel : block)
+			{
+				if (channels <= 2)
+				{
+					pixel[3] = channels == 2 ? pixel[1] : 255;
+					pixel[1] = pixel[0];
+					pixel[2] = pixel[0];
+				}
+				else if (channels == 3)
+				{
+					pixel[3] = 255;
+				}
+			}
+		}
+	}
+}
+
+FSI_INLINE_HPP
+void fsi::compressBlocks(const uint8_t* src, uint64_t srcStrideBytes, uint32_t width, uint32_t rows,
+	uint32_t channels, Depth depth, BlockFormat format, uint8_t* dst)
+{
+	if (depth != Depth::Uint8 && depth != Depth::Uint16)
+		throw std::invalid_argument("Block compression needs Uint8 or Uint16 channels");
+
+	if (channels < 1 || channels > 4)
+		throw std::invalid_argument("Block compression needs 1 to 4 channels");
+
+	if (width == 0 || rows == 0 || rows > 4)
+		throw std::invalid_argument("Block compression needs 1 to 4 rows of at least one pixel");
+
+	const uint64_t blockBytes = blockSizeInBytes(format);
+	const uint64_t blocksX = (static_cast<uint64_t>(width) + 3) / 4;
+
+	for (uint64_t bx = 0; bx < blocksX; bx++)
+	{
+		uint8_t block[16][4];
+		if (depth == Depth::Uint8)
+			detail::loadBlock<uint8_t>(src, srcStrideBytes, width, rows, channels, bx * 4, block);
+		else
+			detail::loadBlock<uint16_t>(src, srcStrideBytes, width, rows, channels, bx * 4, block);
+
+		uint8_t* out = dst + bx * blockBytes;
+
+		switch (format)
+		{
+		case BlockFormat::BC1:
+			detail::blockToRgba(block, channels);
+			detail::encodeBC1(block, out);
+			break;
+		case BlockFormat::BC4:
+		case BlockFormat::BC5:
+			for (uint64_t c = 0; c < (format == BlockFormat::BC5 ? 2u : 1u); c++)
+			{
+				uint8_t values[16];
+				for (int i = 0; i < 16; i++)
+					values[i] = block[i][c];
+				detail::encodeBC4(values, out + 8 * c);
+			}
+			break;
+		case BlockFormat::BC7:
+			detail::blockToRgba(block, channels);
+			detail::encodeBC7(block, out);
+			break;
+		default:
+			throw std::invalid_argument("Unknown block format");
+		}
+	}
+}
\ No newline at end of file
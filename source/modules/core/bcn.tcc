@@ -0,0 +1,51 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include "bcn.h"
+#include <algorithm>
+
+namespace fsi
+{
+	namespace detail
+	{
+		/** @brief Gathers the 4x4 block at column x0 of up to 4 rows as 8-bit channels, 0 for the
+		* channels the image doesn't have. Rows and columns outside the image repeat the last ones.
+		*/
+		template <typename T>
+		void loadBlock(const uint8_t* src, uint64_t srcStride, uint64_t width, uint64_t rows,
+			uint64_t channels, uint64_t x0, uint8_t (&block)[16][4]);
+	}
+}
+
+template <typename T>
+inline
+void fsi::detail::loadBlock(const uint8_t* src, uint64_t srcStride, uint64_t width, uint64_t rows,
+	uint64_t channels, uint64_t x0, uint8_t (&block)[16][4])
+{
+	for (uint64_t py = 0; py < 4; py++)
+	{
+		const T* row = reinterpret_cast<const T*>(src + std::min(py, rows - 1) * srcStride);
+
+		for (uint64_t px = 0; px < 4; px++)
+		{
+			const T* pixel = row + std::min(x0 + px, width - 1) * channels;
+			uint8_t* out = block[py * 4 + px];
+
+			for (uint64_t c = 0; c < 4; c++)
+			{
+				if (c >= channels)
+					out[c] = 0;
+				else if (sizeof(T) == 1)
+					out[c] = static_cast<uint8_t>(pixel[c]);
+				else
+					out[c] = static_cast<uint8_t>((static_cast<uint32_t>(pixel[c]) + 128) / 257);
+			}
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,60 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include "fsi_core_exports.h"
+#include "../global.h"
+#include "FormatVersion.h"
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+namespace fsi
+{
+	struct ChannelOptions
+	{
+		/** @brief Version of the output files.
+		*/
+		FormatVersion formatVersion = FormatVersion::Latest;
+
+		/** @brief Generates the thumbnails of the outputs (V2 only).
+		*/
+		bool thumbnail = true;
+
+		/** @brief Rows per band. 0 picks about 16 * defaultBufferSize bytes of input and output rows per
+		* band.
+		*/
+		uint32_t bandHeight = 0;
+	};
+
+	/** @brief Writes the given channels of src, in that order, to dst. Extracts when channels is a
+	* subset and reorders when it's a permutation. A channel can be repeated.
+	*/
+	FSI_CORE_API void selectChannels(const std::filesystem::path& srcPath, const std::filesystem::path& dstPath,
+		const std::vector<uint32_t>& channels, const ChannelOptions& options = ChannelOptions());
+
+	/** @brief Splits src into several files in one pass: dstPaths[i] gets channels[i].
+	*/
+	FSI_CORE_API void splitChannels(const std::filesystem::path& srcPath,
+		const std::vector<std::filesystem::path>& dstPaths, const std::vector<std::vector<uint32_t>>& channels,
+		const ChannelOptions& options = ChannelOptions());
+
+	/** @brief Interleaves the channels of files of the same size and depth into one file, in the order
+	* of srcPaths.
+	*
+	* All the channel operations stream the images in row bands: the inputs are read in parallel with
+	* readRect(), the channels are copied between the interleaved bands in runs of consecutive
+	* channels, and the outputs are appended with Writer::writeRows() while the next band is read.
+	*/
+	FSI_CORE_API void mergeChannels(const std::vector<std::filesystem::path>& srcPaths,
+		const std::filesystem::path& dstPath, const ChannelOptions& options = ChannelOptions());
+}
+
+#if FSI_HEADERONLY
+#include "channels.hpp"
+#endif
\ No newline at end of file
@@ -0,0 +1,289 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include "channels.h"
+#include "channels.tcc"
+#include "Reader.h"
+#include "Writer.h"
+#include "Executor.h"
+#include "MemoryGovernor.h"
+#include "Trace.h"
+#include "consts.h"
+#include "exceptions.hpp"
+#include <future>
+#include <memory>
+
+namespace fsi
+{
+	namespace detail
+	{
+		struct ChannelSource
+		{
+			size_t input = 0;
+			uint32_t channel = 0;
+		};
+
+		struct ChannelOutput
+		{
+			std::filesystem::path path;
+			std::vector<ChannelSource> channels;
+		};
+
+		typedef void (*CopyChannelRunsKernel)(const uint8_t* src, uint64_t srcChannels, uint8_t* dst,
+			uint64_t dstChannels, uint64_t pixelCount, const ChannelRun* runs, size_t runCount);
+
+		inline CopyChannelRunsKernel copyChannelRunsKernel(Depth depth)
+		{
+			switch (sizeOfDepth(depth))
+			{
+			case 1: return &copyChannelRuns<uint8_t>;
+			case 2: return &copyChannelRuns<uint16_t>;
+			case 4: return &copyChannelRuns<uint32_t>;
+			case 8: return &copyChannelRuns<uint64_t>;
+			default:
+				throw ExceptionInvalidImageDepth("Must be an integer between 1 and 10");
+			}
+		}
+
+		/** @brief Runs of consecutive channels of input that go to consecutive channels of output.
+		*/
+		inline std::vector<ChannelRun> channelRuns(const ChannelOutput& output, size_t input)
+		{
+			std::vector<ChannelRun> runs;
+
+			for (uint64_t c = 0; c < output.channels.size(); c++)
+			{
+				const ChannelSource& source = output.channels[c];
+				if (source.input != input)
+					continue;
+
+				if (!runs.empty()
+					&& runs.back().dstOffset + runs.back().count == c
+					&& runs.back().srcOffset + runs.back().count == source.channel)
+				{
+					runs.back().count++;
+				}
+				else
+				{
+					ChannelRun run;
+					run.srcOffset = source.channel;
+					run.dstOffset = c;
+					run.count = 1;
+					runs.push_back(run);
+				}
+			}
+
+			return runs;
+		}
+
+		/** @brief Streams the inputs into the outputs, band by band. Each output channel comes from a
+		* channel of one of the inputs, which must all have the same size and depth.
+		*/
+		inline void remapChannels(const std::vector<std::filesystem::path>& inputs,
+			const std::vector<ChannelOutput>& outputs, const ChannelOptions& options)
+		{
+			if (inputs.empty() || outputs.empty())
+				throw std::runtime_error("Channel operations need at least one input and one output.");
+
+			// --- Inputs ---
+
+			std::vector<std::unique_ptr<Reader>> readers;
+			std::vector<Header> inputHeaders;
+			for (const std::filesystem::path& path : inputs)
+			{
+				readers.push_back(std::make_unique<Reader>());
+				readers.back()->open(path);
+				inputHeaders.push_back(readers.back()->header());
+
+				const Header& first = inputHeaders.front();
+				const Header& header = inputHeaders.back();
+				if (header.width != first.width)
+					throw ExceptionInvalidImageWidth("All the inputs must have the same width");
+				if (header.height != first.height)
+					throw ExceptionInvalidImageHeight("All the inputs must have the same height");
+				if (header.depth != first.depth)
+					throw ExceptionInvalidImageDepth("All the inputs must have the same depth");
+			}
+
+			const Header& inputHeader = inputHeaders.front();
+			const uint64_t width = inputHeader.width;
+			const uint64_t height = inputHeader.height;
+			const uint64_t channelBytes = sizeOfDepth(inputHeader.depth);
+			const CopyChannelRunsKernel kernel = copyChannelRunsKernel(inputHeader.depth);
+
+			// --- Outputs ---
+
+			std::vector<std::unique_ptr<Writer>> writers;
+			std::vector<std::vector<std::vector<ChannelRun>>> runs(outputs.size());
+			uint64_t rowBytes = 0;
+
+			for (const Header& header : inputHeaders)
+				rowBytes += width * header.channels * channelBytes;
+
+			for (size_t o = 0; o < outputs.size(); o++)
+			{
+				for (const ChannelSource& source : outputs[o].channels)
+				{
+					if (source.input >= inputs.size() || source.channel >= inputHeaders[source.input].channels)
+						throw ExceptionInvalidImageChannels("A selected channel doesn't exist in the input");
+				}
+
+				Header header;
+				header.width = inputHeader.width;
+				header.height = inputHeader.height;
+				header.channels = static_cast<uint32_t>(outputs[o].channels.size());
+				header.depth = inputHeader.depth;
+				header.hasThumb = options.thumbnail;
+
+				writers.push_back(std::make_unique<Writer>(options.formatVersion));
+				writers.back()->open(outputs[o].path, header);
+
+				for (size_t i = 0; i < inputs.size(); i++)
+					runs[o].push_back(channelRuns(outputs[o], i));
+
+				// Outputs are double buffered
+				rowBytes += 2 * width * header.channels * channelBytes;
+			}
+
+			// --- Bands ---
+
+			const uint64_t desiredBandHeight = options.bandHeight > 0
+				? std::min<uint64_t>(options.bandHeight, height)
+				: std::clamp<uint64_t>(16 * defaultBufferSize / rowBytes, 1, height);
+
+			// Fewer rows per band under a tight memory budget, unless the band height was given
+			MemoryReservation memory;
+			const uint64_t bandHeight = memory.reserveRows(desiredBandHeight,
+				options.bandHeight > 0 ? desiredBandHeight : 1, rowBytes);
+
+			std::vector<std::vector<uint8_t>> inputBands(inputs.size());
+			std::vector<std::vector<uint8_t>> outputBands[2];
+			std::future<void> writing;
+
+			for (uint64_t bandY = 0; bandY < height; bandY += bandHeight)
+			{
+				const uint64_t bandRows = std::min(bandHeight, height - bandY);
+				std::vector<std::vector<uint8_t>>& bands = outputBands[(bandY / bandHeight) % 2];
+				bands.resize(outputs.size());
+
+				try
+				{
+					// Every reader is only used by the task of its input
+					executor()->parallelFor(0, static_cast<int64_t>(inputs.size()), 1, [&](int64_t begin, int64_t end)
+					{
+						for (int64_t i = begin; i < end; i++)
+						{
+							inputBands[i].resize(bandRows * width * inputHeaders[i].channels * channelBytes);
+							readers[i]->readRect(inputBands[i].data(), 0, static_cast<uint32_t>(bandY),
+								static_cast<uint32_t>(width), static_cast<uint32_t>(bandRows));
+						}
+					});
+
+					for (size_t o = 0; o < outputs.size(); o++)
+						bands[o].resize(bandRows * width * outputs[o].channels.size() * channelBytes);
+
+					// Row chunks of a band are contiguous pixel ranges in every input and output
+					executor()->parallelFor(0, static_cast<int64_t>(bandRows), 1, [&](int64_t rowBegin, int64_t rowEnd)
+					{
+						FSI_TRACE_ZONE("compute", "copy channels");
+
+						const uint64_t firstPixel = rowBegin * width;
+						const uint64_t pixelCount = (rowEnd - rowBegin) * width;
+
+						for (size_t o = 0; o < outputs.size(); o++)
+						{
+							const uint64_t dstChannels = outputs[o].channels.size();
+
+							for (size_t i = 0; i < inputs.size(); i++)
+							{
+								const std::vector<ChannelRun>& inputRuns = runs[o][i];
+								if (inputRuns.empty())
+									continue;
+
+								const uint64_t srcChannels = inputHeaders[i].channels;
+								kernel(inputBands[i].data() + firstPixel * srcChannels * channelBytes, srcChannels,
+									bands[o].data() + firstPixel * dstChannels * channelBytes, dstChannels,
+									pixelCount, inputRuns.data(), inputRuns.size());
+							}
+						}
+					});
+				}
+				catch (...)
+				{
+					// The write task uses the other bands
+					if (writing.valid())
+						writing.wait();
+					throw;
+				}
+
+				if (writing.valid())
+					writing.get();
+
+				auto task = std::make_shared<std::packaged_task<void()>>([&writers, &bands, bandRows]()
+				{
+					for (size_t o = 0; o < writers.size(); o++)
+						writers[o]->writeRows(bands[o].data(), static_cast<uint32_t>(bandRows));
+				});
+				writing = task->get_future();
+				executor()->submit([task]() { (*task)(); });
+			}
+
+			if (writing.valid())
+				writing.get();
+		}
+	}
+}
+
+FSI_INLINE_HPP
+void fsi::selectChannels(const std::filesystem::path& srcPath, const std::filesystem::path& dstPath,
+	const std::vector<uint32_t>& channels, const ChannelOptions& options)
+{
+	splitChannels(srcPath, { dstPath }, { channels }, options);
+}
+
+FSI_INLINE_HPP
+void fsi::splitChannels(const std::filesystem::path& srcPath, const std::vector<std::filesystem::path>& dstPaths,
+	const std::vector<std::vector<uint32_t>>& channels, const ChannelOptions& options)
+{
+	FSI_TRACE_ZONE("api", "splitChannels");
+
+	if (dstPaths.size() != channels.size())
+		throw std::runtime_error("splitChannels needs one list of channels per output.");
+
+	std::vector<detail::ChannelOutput> outputs(dstPaths.size());
+	for (size_t o = 0; o < outputs.size(); o++)
+	{
+		outputs[o].path = dstPaths[o];
+		for (uint32_t channel : channels[o])
+			outputs[o].channels.push_back({ 0, channel });
+	}
+
+	detail::remapChannels({ srcPath }, outputs, options);
+}
+
+FSI_INLINE_HPP
+void fsi::mergeChannels(const std::vector<std::filesystem::path>& srcPaths, const std::filesystem::path& dstPath,
+	const ChannelOptions& options)
+{
+	FSI_TRACE_ZONE("api", "mergeChannels");
+
+	detail::ChannelOutput output;
+	output.path = dstPath;
+
+	for (size_t i = 0; i < srcPaths.size(); i++)
+	{
+		Reader reader;
+		reader.open(srcPaths[i]);
+
+		for (uint32_t c = 0; c < reader.header().channels; c++)
+			output.channels.push_back({ i, c });
+	}
+
+	detail::remapChannels(srcPaths, { output }, options);
+}
\ No newline at end of file
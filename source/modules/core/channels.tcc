@@ -0,0 +1,74 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include "channels.h"
+#include <algorithm>
+#include <cstring>
+
+namespace fsi
+{
+	namespace detail
+	{
+		/** @brief Consecutive channels copied from one interleaved image to another. Offsets and count
+		* are in channels.
+		*/
+		struct ChannelRun
+		{
+			uint64_t srcOffset = 0;
+			uint64_t dstOffset = 0;
+			uint64_t count = 0;
+		};
+
+		/** @brief Copies the runs of every pixel from src (srcChannels per pixel) to dst (dstChannels
+		* per pixel).
+		*
+		* Pixels are processed in blocks that fit in L1, one run at a time, so single channel runs
+		* become strided loops the compiler can vectorize (de-interleave/interleave), while long runs of
+		* a multispectral image become one memcpy per pixel. T is an unsigned integer of the size of a
+		* channel.
+		*/
+		template <typename T>
+		void copyChannelRuns(const uint8_t* src, uint64_t srcChannels, uint8_t* dst, uint64_t dstChannels,
+			uint64_t pixelCount, const ChannelRun* runs, size_t runCount);
+	}
+}
+
+template <typename T>
+inline
+void fsi::detail::copyChannelRuns(const uint8_t* src, uint64_t srcChannels, uint8_t* dst,
+	uint64_t dstChannels, uint64_t pixelCount, const ChannelRun* runs, size_t runCount)
+{
+	const T* in = reinterpret_cast<const T*>(src);
+	T* out = reinterpret_cast<T*>(dst);
+
+	const uint64_t blockPixels = std::max<uint64_t>(1, 16384 / ((srcChannels + dstChannels) * sizeof(T)));
+
+	for (uint64_t p0 = 0; p0 < pixelCount; p0 += blockPixels)
+	{
+		const uint64_t p1 = std::min(p0 + blockPixels, pixelCount);
+
+		for (size_t r = 0; r < runCount; r++)
+		{
+			const ChannelRun& run = runs[r];
+			const T* s = in + run.srcOffset;
+			T* d = out + run.dstOffset;
+
+			if (run.count == 1)
+			{
+				for (uint64_t p = p0; p < p1; p++)
+					d[p * dstChannels] = s[p * srcChannels];
+			}
+			else
+			{
+				for (uint64_t p = p0; p < p1; p++)
+					std::memcpy(d + p * dstChannels, s + p * srcChannels, run.count * sizeof(T));
+			}
+		}
+	}
+}
\ No newline at end of file
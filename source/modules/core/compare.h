@@ -0,0 +1,97 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include "fsi_core_exports.h"
+#include "../global.h"
+#include "Header.h"
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+namespace fsi { struct CompareOptions; struct CompareResult; }
+
+struct fsi::CompareOptions
+{
+	/** @brief Only answers whether the images are identical. Stops at the first difference and skips
+	* the metrics.
+	*/
+	bool exactOnly = false;
+
+	/** @brief Absolute difference up to which two values still count as equal for differingPixels and
+	* the tile map. The metrics always use the exact values.
+	*/
+	double tolerance = 0.0;
+
+	/** @brief Size in pixels of the cells of CompareResult::differingTiles. 0 disables the map.
+	*/
+	uint32_t tileSize = 0;
+
+	/** @brief Rows per band read from each file. 0 picks about defaultBufferSize bytes per band.
+	*/
+	uint32_t bandHeight = 0;
+};
+
+struct fsi::CompareResult
+{
+	struct Channel
+	{
+		double maxAbsDiff = 0.0;
+
+		double rmse = 0.0;
+
+		/** @brief Peak signal-to-noise ratio in dB. The peak is the value range of the depth for
+		* integers and 1.0 for floating-point. Infinite when the channel is identical.
+		*/
+		double psnr = 0.0;
+	};
+
+	/** @brief Whether width, height, channels and depth match. Nothing else is compared otherwise.
+	*/
+	bool headersMatch = false;
+
+	/** @brief Whether the data sections are bitwise identical. The thumbnails are not compared.
+	*/
+	bool identical = false;
+
+	/** @brief Pixels with at least one channel differing by more than CompareOptions::tolerance.
+	*/
+	uint64_t differingPixels = 0;
+
+	std::vector<Channel> channels;
+
+	uint32_t tileSize = 0;
+
+	uint32_t tilesX = 0;
+
+	uint32_t tilesY = 0;
+
+	/** @brief tilesX*tilesY flags, row-major. 1 when the tile has a differing pixel.
+	*/
+	std::vector<uint8_t> differingTiles;
+};
+
+namespace fsi
+{
+	/** @brief Compares the image data of two FSI files.
+	*
+	* Both data sections are streamed in row bands on fsi::executor(). Each band reads the same rows of
+	* both files, so memory stays bounded by two bands per thread whatever the image size. Identical
+	* rows are skipped with a plain memory compare; rows that differ go through per-depth kernels.
+	* Differences are taken in the precision of the depth, so Float32 values more than FLT_MAX apart
+	* differ by Inf.
+	*
+	* @param pathA, pathB The files to compare. They can have different format versions.
+	*/
+	FSI_CORE_API CompareResult compare(const std::filesystem::path& pathA, const std::filesystem::path& pathB,
+		const CompareOptions& options = CompareOptions());
+}
+
+#if FSI_HEADERONLY
+#include "compare.hpp"
+#endif
\ No newline at end of file
@@ -0,0 +1,243 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include "compare.h"
+#include "compare.tcc"
+#include "Reader.h"
+#include "Executor.h"
+#include "MemoryGovernor.h"
+#include "Trace.h"
+#include "consts.h"
+#include "exceptions.hpp"
+#include <atomic>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <mutex>
+
+namespace fsi
+{
+	namespace detail
+	{
+		typedef uint64_t (*CompareRowKernel)(const uint8_t* rowA, const uint8_t* rowB, uint64_t width,
+			uint64_t runtimeChannels, double tolerance, double* maxAbsDiff, double* sumSquares,
+			uint8_t* tileRow, uint32_t tileSize, uint8_t* flags);
+
+		template <typename T>
+		inline CompareRowKernel compareRowKernel(uint64_t channels, double& peak)
+		{
+			peak = comparePeak<T>();
+
+			switch (channels)
+			{
+			case 1: return &compareRow<T, 1>;
+			case 2: return &compareRow<T, 2>;
+			case 3: return &compareRow<T, 3>;
+			case 4: return &compareRow<T, 4>;
+			default: return &compareRow<T, 0>;
+			}
+		}
+
+		inline CompareRowKernel compareRowKernel(Depth depth, uint64_t channels, double& peak)
+		{
+			switch (depth)
+			{
+			case Depth::Int8: return compareRowKernel<int8_t>(channels, peak);
+			case Depth::Int16: return compareRowKernel<int16_t>(channels, peak);
+			case Depth::Int32: return compareRowKernel<int32_t>(channels, peak);
+			case Depth::Int64: return compareRowKernel<int64_t>(channels, peak);
+			case Depth::Uint8: return compareRowKernel<uint8_t>(channels, peak);
+			case Depth::Uint16: return compareRowKernel<uint16_t>(channels, peak);
+			case Depth::Uint32: return compareRowKernel<uint32_t>(channels, peak);
+			case Depth::Uint64: return compareRowKernel<uint64_t>(channels, peak);
+			case Depth::Float32: return compareRowKernel<float>(channels, peak);
+			case Depth::Float64: return compareRowKernel<double>(channels, peak);
+			default:
+				throw ExceptionInvalidImageDepth("Must be an integer between 1 and 10");
+			}
+		}
+	}
+}
+
+FSI_INLINE_HPP
+fsi::CompareResult fsi::compare(const std::filesystem::path& pathA, const std::filesystem::path& pathB,
+	const CompareOptions& options)
+{
+	FSI_TRACE_ZONE("api", "compare");
+
+	CompareResult result;
+
+	Header header;
+	{
+		Reader readerA;
+		readerA.open(pathA);
+		header = readerA.header();
+
+		Reader readerB;
+		readerB.open(pathB);
+		const Header headerB = readerB.header();
+
+		result.headersMatch = header.width == headerB.width
+			&& header.height == headerB.height
+			&& header.channels == headerB.channels
+			&& header.depth == headerB.depth;
+	}
+
+	if (!result.headersMatch)
+		return result;
+
+	double peak = 0.0;
+	const detail::CompareRowKernel kernel = detail::compareRowKernel(header.depth, header.channels, peak);
+
+	const uint64_t width = header.width;
+	const uint64_t height = header.height;
+	const uint64_t channels = header.channels;
+	const uint64_t rowSize = width * channels * sizeOfDepth(header.depth);
+
+	const uint64_t desiredBandHeight = options.bandHeight > 0
+		? std::min<uint64_t>(options.bandHeight, height)
+		: std::clamp<uint64_t>(defaultBufferSize / rowSize, 1, height);
+
+	// Every worker holds a band of each file. Fewer rows per band under a tight memory budget,
+	// unless the band height was given.
+	const uint64_t workers = static_cast<uint64_t>(executor()->concurrency()) + 1;
+	MemoryReservation memory;
+	const uint64_t bandHeight = memory.reserveRows(desiredBandHeight,
+		options.bandHeight > 0 ? desiredBandHeight : 1, 2 * rowSize * workers);
+	const uint64_t bands = (height + bandHeight - 1) / bandHeight;
+
+	if (options.tileSize > 0 && !options.exactOnly)
+	{
+		result.tileSize = options.tileSize;
+		result.tilesX = static_cast<uint32_t>((width + options.tileSize - 1) / options.tileSize);
+		result.tilesY = static_cast<uint32_t>((height + options.tileSize - 1) / options.tileSize);
+		result.differingTiles.assign(static_cast<uint64_t>(result.tilesX) * result.tilesY, 0);
+	}
+
+	std::vector<double> maxAbsDiff(channels, 0.0);
+	std::vector<double> sumSquares(channels, 0.0);
+	std::atomic<bool> differs = false;
+	std::atomic<uint64_t> nextBand = 0;
+	std::mutex mutex;
+
+	// One task per worker, which keeps its readers and buffers for all the bands it takes. Tasks that
+	// start after the bands ran out return without opening anything.
+	executor()->parallelFor(0, static_cast<int64_t>(workers), 1, [&](int64_t, int64_t)
+	{
+		std::unique_ptr<Reader> readerA;
+		std::unique_ptr<Reader> readerB;
+		std::vector<uint8_t> bandA;
+		std::vector<uint8_t> bandB;
+		std::vector<uint8_t> flags;
+
+		std::vector<double> localMaxAbsDiff(channels, 0.0);
+		std::vector<double> localSumSquares(channels, 0.0);
+		uint64_t localDifferingPixels = 0;
+
+		// The tile rows the worker touched, merged at the end
+		std::vector<uint8_t> localTiles;
+		uint64_t firstTileY = std::numeric_limits<uint64_t>::max();
+		uint64_t lastTileY = 0;
+
+		for (;;)
+		{
+			if (options.exactOnly && differs)
+				break;
+
+			const uint64_t band = nextBand.fetch_add(1);
+			if (band >= bands)
+				break;
+
+			if (!readerA)
+			{
+				// Readers can't be shared between threads
+				readerA = std::make_unique<Reader>();
+				readerA->open(pathA);
+				readerB = std::make_unique<Reader>();
+				readerB->open(pathB);
+
+				bandA.resize(bandHeight * rowSize);
+				bandB.resize(bandHeight * rowSize);
+			}
+
+			const uint64_t y0 = band * bandHeight;
+			const uint64_t rows = std::min(bandHeight, height - y0);
+
+			readerA->readRect(bandA.data(), 0, static_cast<uint32_t>(y0), static_cast<uint32_t>(width),
+				static_cast<uint32_t>(rows));
+			readerB->readRect(bandB.data(), 0, static_cast<uint32_t>(y0), static_cast<uint32_t>(width),
+				static_cast<uint32_t>(rows));
+
+			FSI_TRACE_ZONE("compute", "compare band");
+
+			for (uint64_t row = 0; row < rows; row++)
+			{
+				const uint8_t* rowA = bandA.data() + row * rowSize;
+				const uint8_t* rowB = bandB.data() + row * rowSize;
+
+				// Identical rows are the common case of a regression run
+				if (std::memcmp(rowA, rowB, rowSize) == 0)
+					continue;
+
+				differs = true;
+				if (options.exactOnly)
+					break;
+
+				uint8_t* tileRow = nullptr;
+				if (!result.differingTiles.empty())
+				{
+					if (localTiles.empty())
+						localTiles.assign(result.differingTiles.size(), 0);
+
+					const uint64_t tileY = (y0 + row) / options.tileSize;
+					firstTileY = std::min(firstTileY, tileY);
+					lastTileY = std::max(lastTileY, tileY);
+					tileRow = localTiles.data() + tileY * result.tilesX;
+				}
+
+				flags.resize(width * (channels + 1));
+				localDifferingPixels += kernel(rowA, rowB, width, channels, options.tolerance,
+					localMaxAbsDiff.data(), localSumSquares.data(), tileRow, options.tileSize, flags.data());
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		for (uint64_t c = 0; c < channels; c++)
+		{
+			maxAbsDiff[c] = std::max(maxAbsDiff[c], localMaxAbsDiff[c]);
+			sumSquares[c] += localSumSquares[c];
+		}
+		for (uint64_t tileY = firstTileY; !localTiles.empty() && tileY <= lastTileY; tileY++)
+		{
+			for (uint64_t i = tileY * result.tilesX; i < (tileY + 1) * result.tilesX; i++)
+				result.differingTiles[i] |= localTiles[i];
+		}
+		result.differingPixels += localDifferingPixels;
+	});
+
+	result.identical = !differs;
+
+	if (!options.exactOnly)
+	{
+		const double pixelCount = static_cast<double>(width) * static_cast<double>(height);
+
+		result.channels.resize(channels);
+		for (uint64_t c = 0; c < channels; c++)
+		{
+			CompareResult::Channel& channel = result.channels[c];
+			channel.maxAbsDiff = maxAbsDiff[c];
+			channel.rmse = std::sqrt(sumSquares[c] / pixelCount);
+			channel.psnr = channel.rmse > 0.0
+				? 20.0 * std::log10(peak / channel.rmse)
+				: std::numeric_limits<double>::infinity();
+		}
+	}
+
+	return result;
+}
\ No newline at end of file
@@ -0,0 +1,282 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include "compare.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+namespace fsi
+{
+	namespace detail
+	{
+		/** @brief Types of the compare kernels for values of type T. Diff holds the absolute
+		* difference of two values: the unsigned type of the same size for integers, so it can't
+		* overflow, and T itself for floating-point. Square accumulates the squared differences: exactly
+		* in uint64_t for 8 and 16-bit integers, in double otherwise.
+		*/
+		template <typename T>
+		struct CompareTraits
+		{
+			typedef typename std::conditional_t<std::is_floating_point_v<T>,
+				std::common_type<T>, std::make_unsigned<T>>::type Diff;
+
+			typedef std::conditional_t<std::is_integral_v<T> && sizeof(T) <= 2, uint64_t, double> Square;
+
+			static Square square(Diff diff)
+			{
+				if constexpr (std::is_integral_v<T> && sizeof(T) == 8)
+				{
+					// From its 32-bit halves: only 32-bit integers convert to double in vector registers
+					const double value = static_cast<double>(static_cast<uint32_t>(diff >> 32)) * 4294967296.0
+						+ static_cast<double>(static_cast<uint32_t>(diff));
+					return value * value;
+				}
+				else
+				{
+					return static_cast<Square>(diff) * static_cast<Square>(diff);
+				}
+			}
+		};
+
+		/** @brief Absolute difference of two values, in the precision of T. For floating-point NaN
+		* only equals NaN and Inf only equals the same Inf, every other pair with a non-finite value is
+		* infinitely apart, and so are finite values more than the largest finite value apart. The cases
+		* are selected with masks rather than branches so the loops around it vectorize.
+		*/
+		template <typename T>
+		typename CompareTraits<T>::Diff compareDiff(T a, T b);
+
+		/** @brief The largest Diff d such that differences above d are above tolerance. Negative
+		* tolerances give 0, the caller flags every value then.
+		*/
+		template <typename T>
+		typename CompareTraits<T>::Diff compareThreshold(double tolerance);
+
+		/** @brief Accumulates the maximum and the sum of the squares of the differences of count values
+		* into the lanes, and flags the values differing by more than threshold. Lane j gets the values
+		* at j, j + lanes, j + 2*lanes and so on, so lanes spanning whole pixels keep the channels apart.
+		*
+		* Lanes is 0 when the count is only known at runtime.
+		*/
+		template <typename T, uint64_t Lanes>
+		void compareLanes(const T* a, const T* b, uint64_t count, uint64_t runtimeLanes,
+			typename CompareTraits<T>::Diff threshold, typename CompareTraits<T>::Diff* laneMax,
+			typename CompareTraits<T>::Square* laneSquares, uint8_t* valueFlags);
+
+		/** @brief Accumulates the differences of one row of pixels.
+		*
+		* Channels is 0 when the count is only known at runtime. The row goes through loops without
+		* branches: the per-channel maximum and sum of squares over the values along with a flag per
+		* value above the tolerance, a flag per pixel with a flagged value, and the count of the pixel
+		* flags per tile. With -O3 they vectorize for every depth on targets with 64-bit integer
+		* comparisons (SSE4.2 on x86-64); on plain SSE2 the 64-bit depths stay scalar.
+		*
+		* @param flags Scratch of width * (channels + 1) bytes.
+		* @return The number of pixels with a channel differing by more than tolerance.
+		*/
+		template <typename T, uint64_t Channels>
+		uint64_t compareRow(const uint8_t* rowA, const uint8_t* rowB, uint64_t width, uint64_t runtimeChannels,
+			double tolerance, double* maxAbsDiff, double* sumSquares, uint8_t* tileRow, uint32_t tileSize,
+			uint8_t* flags);
+
+		/** @brief Value range of T used as the PSNR peak. 1.0 for floating-point.
+		*/
+		template <typename T>
+		double comparePeak();
+	}
+}
+
+template <typename T>
+inline
+typename fsi::detail::CompareTraits<T>::Diff fsi::detail::compareDiff(T a, T b)
+{
+	typedef typename CompareTraits<T>::Diff Diff;
+
+	if constexpr (std::is_floating_point_v<T>)
+	{
+		// The cases come from the bit patterns and select the result with masks of all ones. Selects
+		// on comparisons, even integer ones joined with | or &, stay branches in the compiler and keep
+		// the loops from vectorizing.
+		typedef std::conditional_t<sizeof(T) == 4, uint32_t, uint64_t> Bits;
+		constexpr Bits sign = Bits(1) << (sizeof(T) * 8 - 1);
+		constexpr Bits infinity = sizeof(T) == 4 ? Bits(0x7f800000) : Bits(0x7ff0000000000000);
+
+		Bits ua, ub;
+		std::memcpy(&ua, &a, sizeof(T));
+		std::memcpy(&ub, &b, sizeof(T));
+		const Bits absA = ua & ~sign;
+		const Bits absB = ub & ~sign;
+
+		const Bits same = -static_cast<Bits>(ua == ub)
+			| -static_cast<Bits>((absA | absB) == 0)
+			| (-static_cast<Bits>(absA > infinity) & -static_cast<Bits>(absB > infinity));
+		const Bits nonFinite = -static_cast<Bits>(absA >= infinity) | -static_cast<Bits>(absB >= infinity);
+
+		const T diff = std::abs(a - b);
+		Bits bits;
+		std::memcpy(&bits, &diff, sizeof(T));
+		bits = ((bits & ~nonFinite) | (infinity & nonFinite)) & ~same;
+
+		T result;
+		std::memcpy(&result, &bits, sizeof(T));
+		return result;
+	}
+	else
+	{
+		const Diff ua = static_cast<Diff>(a);
+		const Diff ub = static_cast<Diff>(b);
+		return a > b ? static_cast<Diff>(ua - ub) : static_cast<Diff>(ub - ua);
+	}
+}
+
+template <typename T>
+inline
+typename fsi::detail::CompareTraits<T>::Diff fsi::detail::compareThreshold(double tolerance)
+{
+	typedef typename CompareTraits<T>::Diff Diff;
+
+	if (tolerance < 0.0)
+		return 0;
+
+	if constexpr (std::is_floating_point_v<T>)
+	{
+		// Rounded down, so the comparison in T gives the same answer as in double
+		Diff threshold = static_cast<Diff>(tolerance);
+		if (static_cast<double>(threshold) > tolerance)
+			threshold = std::nextafter(threshold, Diff(0));
+		return threshold;
+	}
+	else
+	{
+		// Integer differences above the integer part of the tolerance are above the tolerance
+		return tolerance >= static_cast<double>(std::numeric_limits<Diff>::max())
+			? std::numeric_limits<Diff>::max()
+			: static_cast<Diff>(tolerance);
+	}
+}
+
+template <typename T, uint64_t Lanes>
+inline
+void fsi::detail::compareLanes(const T* a, const T* b, uint64_t count, uint64_t runtimeLanes,
+	typename CompareTraits<T>::Diff threshold, typename CompareTraits<T>::Diff* laneMax,
+	typename CompareTraits<T>::Square* laneSquares, uint8_t* valueFlags)
+{
+	typedef typename CompareTraits<T>::Diff Diff;
+
+	const uint64_t lanes = Lanes > 0 ? Lanes : runtimeLanes;
+
+	auto accumulate = [&](uint64_t i, uint64_t j)
+	{
+		const Diff diff = compareDiff(a[i + j], b[i + j]);
+		laneMax[j] = diff > laneMax[j] ? diff : laneMax[j];
+		laneSquares[j] += CompareTraits<T>::square(diff);
+		valueFlags[i + j] = diff > threshold;
+	};
+
+	uint64_t i = 0;
+	for (; i + lanes <= count; i += lanes)
+	{
+		for (uint64_t j = 0; j < lanes; j++)
+			accumulate(i, j);
+	}
+
+	for (uint64_t j = 0; i + j < count; j++)
+		accumulate(i, j);
+}
+
+template <typename T, uint64_t Channels>
+inline
+uint64_t fsi::detail::compareRow(const uint8_t* rowA, const uint8_t* rowB, uint64_t width,
+	uint64_t runtimeChannels, double tolerance, double* maxAbsDiff, double* sumSquares, uint8_t* tileRow,
+	uint32_t tileSize, uint8_t* flags)
+{
+	typedef typename CompareTraits<T>::Diff Diff;
+	typedef typename CompareTraits<T>::Square Square;
+
+	const uint64_t channels = Channels > 0 ? Channels : runtimeChannels;
+
+	const T* a = reinterpret_cast<const T*>(rowA);
+	const T* b = reinterpret_cast<const T*>(rowB);
+
+	const Diff threshold = compareThreshold<T>(tolerance);
+	uint8_t* valueFlags = flags;
+	uint8_t* pixelFlags = flags + width * channels;
+
+	// --- Pass 1: maximum and sum of squares per channel, flags per value ---
+	// With a fixed channel count 16 pixels of lanes live on the stack, otherwise one pixel
+	if constexpr (Channels > 0)
+	{
+		constexpr uint64_t Lanes = Channels * 16;
+		Diff laneMax[Lanes] = {};
+		Square laneSquares[Lanes] = {};
+		compareLanes<T, Lanes>(a, b, width * channels, Lanes, threshold, laneMax, laneSquares, valueFlags);
+
+		for (uint64_t j = 0; j < Lanes; j++)
+		{
+			maxAbsDiff[j % Channels] = std::max(maxAbsDiff[j % Channels], static_cast<double>(laneMax[j]));
+			sumSquares[j % Channels] += static_cast<double>(laneSquares[j]);
+		}
+	}
+	else
+	{
+		std::vector<Diff> laneMax(channels, 0);
+		std::vector<Square> laneSquares(channels, 0);
+		compareLanes<T, 0>(a, b, width * channels, channels, threshold, laneMax.data(), laneSquares.data(),
+			valueFlags);
+
+		for (uint64_t c = 0; c < channels; c++)
+		{
+			maxAbsDiff[c] = std::max(maxAbsDiff[c], static_cast<double>(laneMax[c]));
+			sumSquares[c] += static_cast<double>(laneSquares[c]);
+		}
+	}
+
+	// --- Pass 2: pixels with a flagged value. A negative tolerance flags every pixel. ---
+	const uint8_t everyPixel = tolerance < 0.0;
+	for (uint64_t x = 0; x < width; x++)
+	{
+		uint8_t differs = everyPixel;
+		for (uint64_t c = 0; c < channels; c++)
+			differs |= valueFlags[x*channels + c];
+		pixelFlags[x] = differs;
+	}
+
+	// --- Pass 3: count of the pixel flags, per tile for the map ---
+	const uint64_t span = tileRow ? tileSize : width;
+	uint64_t differingPixels = 0;
+	for (uint64_t x0 = 0; x0 < width; x0 += span)
+	{
+		const uint64_t x1 = std::min(width, x0 + span);
+
+		uint64_t count = 0;
+		for (uint64_t x = x0; x < x1; x++)
+			count += pixelFlags[x];
+
+		differingPixels += count;
+		if (tileRow && count > 0)
+			tileRow[x0 / tileSize] = 1;
+	}
+
+	return differingPixels;
+}
+
+template <typename T>
+inline
+double fsi::detail::comparePeak()
+{
+	if constexpr (std::is_floating_point_v<T>)
+		return 1.0;
+	else
+		return static_cast<double>(std::numeric_limits<T>::max())
+			- static_cast<double>(std::numeric_limits<T>::lowest());
+}
\ No newline at end of file
@@ -0,0 +1,41 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include "fsi_core_exports.h"
+#include "../global.h"
+#include "FormatVersion.h"
+#include <filesystem>
+
+namespace fsi
+{
+	struct ConvertOptions
+	{
+		/** @brief Generates a thumbnail when converting to V2 from a file that has none. A V2 source
+		* keeps its thumbnail.
+		*/
+		bool thumbnail = true;
+	};
+
+	/** @brief Writes an FSI file in another format version without holding the image in memory.
+	*
+	* The data section is the same in every version, so it's copied file to file with
+	* io::copyRange() (copy_file_range on Linux) while the thumbnail, when one has to be generated,
+	* is built from a streamed readRect() pass running at the same time. When nothing changes (same
+	* version and thumbnail) the file is reflinked where the filesystem supports it, or copied. On
+	* Windows the image is streamed in row bands through readRect() and Writer::writeRows().
+	*
+	* The limiter of a RateLimitScope around the call also throttles the copy.
+	*/
+	FSI_CORE_API void convert(const std::filesystem::path& srcPath, const std::filesystem::path& dstPath,
+		FormatVersion targetVersion, const ConvertOptions& options = ConvertOptions());
+}
+
+#if FSI_HEADERONLY
+#include "convert.hpp"
+#endif
\ No newline at end of file
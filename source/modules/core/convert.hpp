@@ -0,0 +1,192 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include "convert.h"
+#include "Reader.h"
+#include "Writer.h"
+#include "Executor.h"
+#include "MemoryGovernor.h"
+#include "RateLimiter.h"
+#include "ThumbnailAccumulator.h"
+#include "Trace.h"
+#include "consts.h"
+#include "io.h"
+#include "exceptions.hpp"
+#include <cstring>
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#if !defined(_WIN32)
+	#include <cerrno>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+FSI_INLINE_HPP
+void fsi::convert(const std::filesystem::path& srcPath, const std::filesystem::path& dstPath,
+	FormatVersion targetVersion, const ConvertOptions& options)
+{
+	FSI_TRACE_ZONE("api", "convert");
+
+	if (targetVersion != FormatVersion::V1 && targetVersion != FormatVersion::V2)
+		throw ExceptionInvalidFormatVersion();
+
+	Reader reader;
+	reader.open(srcPath);
+	const Header srcHeader = reader.header();
+	const FormatVersion srcVersion = reader.formatVersion();
+
+	// A thumbnail of the source is reused, otherwise it's generated on request
+	const bool copyThumbnail = targetVersion == FormatVersion::V2 && srcVersion == FormatVersion::V2
+		&& srcHeader.hasThumb;
+
+	Header dstHeader;
+	dstHeader.width = srcHeader.width;
+	dstHeader.height = srcHeader.height;
+	dstHeader.channels = srcHeader.channels;
+	dstHeader.depth = srcHeader.depth;
+	dstHeader.hasThumb = targetVersion == FormatVersion::V2 && (copyThumbnail || options.thumbnail);
+
+	const bool generateThumbnail = dstHeader.hasThumb && !copyThumbnail;
+
+	const uint64_t rowSize = static_cast<uint64_t>(srcHeader.width) * srcHeader.channels * sizeOfDepth(srcHeader.depth);
+	const uint64_t dataSize = rowSize * srcHeader.height;
+
+#if !defined(_WIN32)
+	const uint64_t srcDataOffset = io::imageDataOffset(srcVersion);
+	const uint64_t dstDataOffset = io::imageDataOffset(targetVersion);
+
+	IoStats stats;
+	io::GlobalStatsScope globalStats(stats);
+
+	if (srcVersion == targetVersion && !generateThumbnail)
+	{
+		// The whole file stays the same
+		reader.close();
+
+		if (dstPath.extension() != expectedFileExtension)
+			throw ExceptionInvalidFileExtension();
+
+		io::FileDescriptor src(::open(srcPath.c_str(), O_RDONLY));
+		if (src.get() < 0)
+			throw ExceptionFailedToOpenFile(std::strerror(errno));
+		io::FileDescriptor dst(::open(dstPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644));
+		if (dst.get() < 0)
+			throw ExceptionFailedToCreateFile(std::strerror(errno));
+
+		if (io::cloneFile(src.get(), dst.get()))
+			return;
+
+		FSI_TRACE_ZONE("io", "copy file");
+
+		const uint64_t fileSize = srcDataOffset + dataSize;
+		stats.bytesRequested += fileSize;
+		if (!io::copyRange(src.get(), 0, dst.get(), 0, fileSize, stats))
+			throw std::runtime_error(std::string("Failed to copy FSI file: ") + std::strerror(errno));
+
+		return;
+	}
+
+	// The writer leaves the header. Everything after it is written through file descriptors.
+	Writer writer(targetVersion);
+	writer.open(dstPath, dstHeader);
+	dstHeader = writer.header();
+	writer.close();
+
+	io::FileDescriptor src(::open(srcPath.c_str(), O_RDONLY));
+	if (src.get() < 0)
+		throw ExceptionFailedToOpenFile(std::strerror(errno));
+	io::FileDescriptor dst(::open(dstPath.c_str(), O_WRONLY));
+	if (dst.get() < 0)
+		throw ExceptionFailedToCreateFile(std::strerror(errno));
+
+	// Sets the final size. A V2 thumbnail section without a thumbnail stays as zeros (a hole on most
+	// filesystems).
+	if (::ftruncate(dst.get(), static_cast<off_t>(dstDataOffset + dataSize)) != 0)
+		throw ExceptionFailedToCreateFile(std::strerror(errno));
+
+	// The data (and a thumbnail to keep, which sits right before it) is copied on the executor while
+	// this thread builds a new thumbnail, if any
+	RateLimiter* limiter = RateLimitScope::current();
+	auto copy = std::make_shared<std::packaged_task<void()>>([&]()
+	{
+		FSI_TRACE_ZONE("io", "copy data");
+		RateLimitScope rateLimit(limiter);
+
+		const uint64_t extra = copyThumbnail ? thumbSizeInBytes : 0;
+		stats.bytesRequested += extra + dataSize;
+		if (!io::copyRange(src.get(), srcDataOffset - extra, dst.get(), dstDataOffset - extra, extra + dataSize, stats))
+			throw std::runtime_error(std::string("Failed to copy FSI data: ") + std::strerror(errno));
+	});
+	std::future<void> copying = copy->get_future();
+	executor()->submit([copy]() { (*copy)(); });
+
+	try
+	{
+		if (generateThumbnail)
+		{
+			ThumbnailAccumulator thumbnail(dstHeader);
+
+			MemoryReservation memory;
+			const uint64_t bandHeight = memory.reserveRows(
+				std::clamp<uint64_t>(defaultBufferSize / rowSize, 1, srcHeader.height), 1, rowSize);
+			std::vector<uint8_t> band(bandHeight * rowSize);
+
+			for (uint64_t y = 0; y < srcHeader.height; y += bandHeight)
+			{
+				const uint64_t rows = std::min<uint64_t>(bandHeight, srcHeader.height - y);
+				reader.readRect(band.data(), 0, static_cast<uint32_t>(y), srcHeader.width, static_cast<uint32_t>(rows));
+
+				FSI_TRACE_ZONE("compute", "thumbnail rows");
+				thumbnail.addRows(band.data(), rows);
+			}
+
+			FSI_TRACE_ZONE("io", "write thumbnail");
+
+			const std::vector<uint8_t>& thumb = thumbnail.thumbnail();
+			const off_t thumbOffset = static_cast<off_t>(dstDataOffset - thumbSizeInBytes);
+			for (size_t written = 0; written < thumb.size();)
+			{
+				const ssize_t put = ::pwrite(dst.get(), thumb.data() + written, thumb.size() - written,
+					thumbOffset + static_cast<off_t>(written));
+				if (put < 0 && errno == EINTR)
+					continue;
+				if (put < 0)
+					throw std::runtime_error(std::string("Failed to write FSI thumbnail: ") + std::strerror(errno));
+				written += static_cast<size_t>(put);
+			}
+		}
+	}
+	catch (...)
+	{
+		// The copy task uses the file descriptors
+		copying.wait();
+		throw;
+	}
+
+	copying.get();
+#else
+	Writer writer(targetVersion);
+	writer.open(dstPath, dstHeader);
+
+	MemoryReservation memory;
+	const uint32_t bandHeight = static_cast<uint32_t>(memory.reserveRows(
+		std::clamp<uint64_t>(defaultBufferSize / rowSize, 1, srcHeader.height), 1, rowSize));
+	std::vector<uint8_t> band(bandHeight * rowSize);
+
+	for (uint32_t y = 0; y < srcHeader.height; y += bandHeight)
+	{
+		const uint32_t rows = std::min(bandHeight, srcHeader.height - y);
+		reader.readRect(band.data(), 0, y, srcHeader.width, rows);
+		writer.writeRows(band.data(), rows);
+	}
+#endif
+}
\ No newline at end of file
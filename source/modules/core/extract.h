@@ -0,0 +1,43 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include "fsi_core_exports.h"
+#include "../global.h"
+#include "FormatVersion.h"
+#include <cstdint>
+#include <filesystem>
+
+namespace fsi
+{
+	struct ExtractOptions
+	{
+		/** @brief Version of the output file.
+		*/
+		FormatVersion formatVersion = FormatVersion::Latest;
+
+		/** @brief Generates the thumbnail of the output (V2 only). The rows then have to pass through
+		* memory, so the copy isn't zero-copy anymore.
+		*/
+		bool thumbnail = false;
+	};
+
+	/** @brief Writes a rect of an FSI file to a new FSI file.
+	*
+	* Without a thumbnail the pixels never reach user memory: each row span of the rect (or the whole
+	* rect when it covers full rows) is copied file to file with io::copyRange(), which uses
+	* copy_file_range on Linux. Otherwise, and on Windows, the rect is streamed in row bands through
+	* readRect() and Writer::writeRows().
+	*/
+	FSI_CORE_API void extractRegion(const std::filesystem::path& srcPath, const std::filesystem::path& dstPath,
+		uint32_t x, uint32_t y, uint32_t width, uint32_t height, const ExtractOptions& options = ExtractOptions());
+}
+
+#if FSI_HEADERONLY
+#include "extract.hpp"
+#endif
\ No newline at end of file
@@ -0,0 +1,114 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include "extract.h"
+#include "Reader.h"
+#include "Writer.h"
+#include "MemoryGovernor.h"
+#include "Trace.h"
+#include "consts.h"
+#include "io.h"
+#include "exceptions.hpp"
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#if !defined(_WIN32)
+	#include <cerrno>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+FSI_INLINE_HPP
+void fsi::extractRegion(const std::filesystem::path& srcPath, const std::filesystem::path& dstPath,
+	uint32_t x, uint32_t y, uint32_t width, uint32_t height, const ExtractOptions& options)
+{
+	FSI_TRACE_ZONE("api", "extractRegion");
+
+	Reader reader;
+	reader.open(srcPath);
+	const Header srcHeader = reader.header();
+
+	if (width == 0 || height == 0)
+		throw std::runtime_error("Rectangle width and height must be greater than zero.");
+
+	if (static_cast<uint64_t>(x) + width > srcHeader.width || static_cast<uint64_t>(y) + height > srcHeader.height)
+		throw std::runtime_error("Requested rectangle is outside the image bounds.");
+
+	Header dstHeader;
+	dstHeader.width = width;
+	dstHeader.height = height;
+	dstHeader.channels = srcHeader.channels;
+	dstHeader.depth = srcHeader.depth;
+	dstHeader.hasThumb = options.thumbnail;
+
+	Writer writer(options.formatVersion);
+	writer.open(dstPath, dstHeader);
+
+	const uint64_t bytesPerPixel = static_cast<uint64_t>(srcHeader.channels) * sizeOfDepth(srcHeader.depth);
+	const uint64_t srcRowSize = srcHeader.width * bytesPerPixel;
+	const uint64_t dstRowSize = width * bytesPerPixel;
+
+#if !defined(_WIN32)
+	const bool withThumbnail = options.thumbnail && options.formatVersion != FormatVersion::V1;
+	if (!withThumbnail)
+	{
+		// The writer leaves the header. Everything after it is written through file descriptors.
+		writer.close();
+
+		const uint64_t srcDataOffset = io::imageDataOffset(reader.formatVersion());
+		const uint64_t dstDataOffset = io::imageDataOffset(options.formatVersion);
+		reader.close();
+
+		IoStats stats;
+		io::GlobalStatsScope globalStats(stats);
+
+		io::FileDescriptor src(::open(srcPath.c_str(), O_RDONLY));
+		io::FileDescriptor dst(::open(dstPath.c_str(), O_WRONLY));
+		if (src.get() < 0)
+			throw ExceptionFailedToOpenFile(std::strerror(errno));
+		if (dst.get() < 0)
+			throw ExceptionFailedToCreateFile(std::strerror(errno));
+
+		// Sets the final size. The V2 thumbnail section stays as zeros (a hole on most filesystems).
+		if (::ftruncate(dst.get(), static_cast<off_t>(dstDataOffset + dstRowSize * height)) != 0)
+			throw ExceptionFailedToCreateFile(std::strerror(errno));
+
+		FSI_TRACE_ZONE("io", "copy region");
+
+		// Full rows are one contiguous span
+		const uint64_t spans = dstRowSize == srcRowSize ? 1 : height;
+		const uint64_t spanSize = dstRowSize == srcRowSize ? dstRowSize * height : dstRowSize;
+
+		for (uint64_t span = 0; span < spans; span++)
+		{
+			const uint64_t srcOffset = srcDataOffset + (y + span) * srcRowSize + x * bytesPerPixel;
+			const uint64_t dstOffset = dstDataOffset + span * spanSize;
+
+			stats.bytesRequested += spanSize;
+			if (!io::copyRange(src.get(), srcOffset, dst.get(), dstOffset, spanSize, stats))
+				throw std::runtime_error(std::string("Failed to copy FSI rectangle: ") + std::strerror(errno));
+		}
+
+		return;
+	}
+#endif
+
+	MemoryReservation memory;
+	const uint32_t bandHeight = static_cast<uint32_t>(memory.reserveRows(
+		std::clamp<uint64_t>(defaultBufferSize / dstRowSize, 1, height), 1, dstRowSize));
+	std::vector<uint8_t> band(bandHeight * dstRowSize);
+
+	for (uint32_t row = 0; row < height; row += bandHeight)
+	{
+		const uint32_t rows = std::min(bandHeight, height - row);
+		reader.readRect(band.data(), x, y + row, width, rows);
+		writer.writeRows(band.data(), rows);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,208 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include "fsi_core_exports.h"
+#include "../global.h"
+#include "IoStats.h"
+#include "FormatVersion.h"
+#include "IoOptions.h"
+#include "ProgressThread.h"
+#include <cstdint>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+
+#if !defined(_WIN32)
+	#include <unistd.h>
+#endif
+
+namespace fsi
+{
+	namespace io
+	{
+		/** @brief File operations used by the readers and writers. They account the transferred bytes,
+		* the number of requests and the time blocked in IoStats.
+		*/
+		FSI_CORE_API void read(std::ifstream& file, uint8_t* dst, uint64_t size, IoStats& stats);
+
+		FSI_CORE_API void ignore(std::ifstream& file, uint64_t size, IoStats& stats);
+
+		FSI_CORE_API void seek(std::ifstream& file, uint64_t offset, IoStats& stats);
+
+		FSI_CORE_API void write(std::ofstream& file, const uint8_t* src, uint64_t size, IoStats& stats);
+
+		FSI_CORE_API void seek(std::ofstream& file, uint64_t offset, IoStats& stats);
+
+		/** @brief Offset of the image data in a file of the given version.
+		*/
+		FSI_CORE_API uint64_t imageDataOffset(FormatVersion formatVersion);
+
+#if !defined(_WIN32)
+		/** @brief Copies size bytes between two file descriptors at the given offsets without moving
+		* the file positions. On Linux the bytes stay in the kernel (copy_file_range), elsewhere or when
+		* the filesystems don't support it they go through a buffer with pread/pwrite.
+		*
+		* @return false if a read or write failed, with errno set.
+		*/
+		FSI_CORE_API bool copyRange(int srcFd, uint64_t srcOffset, int dstFd, uint64_t dstOffset,
+			uint64_t size, IoStats& stats);
+
+		/** @brief Makes dstFd share the blocks of the whole srcFd (a reflink) on filesystems that
+		* support it, like Btrfs or XFS, so nothing is copied.
+		*
+		* @return false if the filesystem or the platform can't, dstFd is unchanged then.
+		*/
+		FSI_CORE_API bool cloneFile(int srcFd, int dstFd);
+
+		/** @brief Alignment of offsets, sizes and buffers for O_DIRECT.
+		*/
+		const uint64_t directIoAlignment = 4096;
+
+		/** @brief Opens path for positional reads, or writes to an existing file. direct asks for
+		* O_DIRECT and is set to false when the filesystem doesn't support it.
+		*
+		* @return -1 with errno set on failure.
+		*/
+		FSI_CORE_API int openFile(const std::filesystem::path& path, bool write, bool& direct);
+
+		/** @brief pread/pwrite of a whole range, retrying interrupted and partial transfers. With
+		* O_DIRECT the data goes through an aligned buffer; reads may start and end anywhere, writes
+		* must be aligned to directIoAlignment. If the filesystem rejects O_DIRECT at transfer time it
+		* is turned off for fd and the transfer is retried. The limiter of a RateLimitScope on the
+		* calling thread throttles the transfer like read() and write().
+		*
+		* @return false with errno set on failure.
+		*/
+		FSI_CORE_API bool readAt(int fd, uint8_t* dst, uint64_t size, uint64_t offset, IoStats& stats);
+
+		FSI_CORE_API bool writeAt(int fd, const uint8_t* src, uint64_t size, uint64_t offset, IoStats& stats);
+
+		/** @brief Passes advice to posix_fadvise for the whole file. CacheAdvice::DontKeep is
+		* applied by finishFile() instead.
+		*/
+		FSI_CORE_API void adviseCache(int fd, CacheAdvice advice);
+
+		/** @brief Flushes a closed file to disk and/or drops its pages from the page cache.
+		*
+		* @return false with errno set if the flush failed.
+		*/
+		FSI_CORE_API bool finishFile(const std::filesystem::path& path, bool sync, bool dropCache);
+
+		/** @brief Sends size bytes over a stream socket, retrying partial sends. If fd isn't -1 it's
+		* passed to the peer along with the first byte (SCM_RIGHTS). A closed peer doesn't raise SIGPIPE.
+		*
+		* @return false with errno set on failure.
+		*/
+		FSI_CORE_API bool sendMessage(int socket, const void* data, uint64_t size, int fd = -1);
+
+		/** @brief Receives exactly size bytes from a stream socket. A file descriptor passed along with
+		* them is returned in fd, otherwise fd is -1.
+		*
+		* @return false if the peer closed the connection or on failure.
+		*/
+		FSI_CORE_API bool receiveMessage(int socket, void* data, uint64_t size, int& fd);
+
+		/** @brief Closes a file descriptor when it goes out of scope.
+		*/
+		class FileDescriptor
+		{
+		public:
+
+			FileDescriptor(int fd) : m_fd(fd) {}
+
+			~FileDescriptor()
+			{
+				if (m_fd >= 0)
+					::close(m_fd);
+			}
+
+			int get() const { return m_fd; }
+
+			FSI_DISABLE_COPY_MOVE(FileDescriptor);
+
+		private:
+
+			int m_fd;
+		};
+#endif
+
+		typedef std::function<void(uint64_t index, IoStats& stats)> ChunkTransfer;
+
+		/** @brief Calls transfer for the chunks [0, count), threads at a time on fsi::executor() (0 uses
+		* every worker). The progress is updated with the share of chunks done before each group, and
+		* the limiter of a RateLimitScope on the calling thread applies to the workers too.
+		*
+		* @param progress Optional.
+		* @param scratchPerChunk Memory a transfer allocates, e.g. the bounce buffer of direct I/O. Fewer
+		* chunks run at once when memoryGovernor() doesn't have room for all of them.
+		* @return false if the operation was canceled through progress.
+		*/
+		FSI_CORE_API bool forEachChunk(uint64_t count, uint32_t threads, ProgressThread* progress, IoStats& stats,
+			const ChunkTransfer& transfer, uint64_t scratchPerChunk = 0);
+
+		/** @brief Measures the time between its construction and destruction into a counter (e.g.
+		* IoStats::computeTimeUs).
+		*/
+		class ScopedTime
+		{
+		public:
+
+			ScopedTime(uint64_t& counterUs)
+				: m_counterUs(counterUs)
+				, m_start(std::chrono::steady_clock::now())
+			{
+			}
+
+			~ScopedTime()
+			{
+				m_counterUs += std::chrono::duration_cast<std::chrono::microseconds>(
+					std::chrono::steady_clock::now() - m_start).count();
+			}
+
+			FSI_DISABLE_COPY_MOVE(ScopedTime);
+
+		private:
+
+			uint64_t& m_counterUs;
+
+			std::chrono::steady_clock::time_point m_start;
+		};
+
+		/** @brief Adds the counters gathered during its lifetime to the process-wide stats.
+		*/
+		class GlobalStatsScope
+		{
+		public:
+
+			GlobalStatsScope(const IoStats& stats)
+				: m_stats(stats)
+				, m_before(stats)
+			{
+			}
+
+			~GlobalStatsScope()
+			{
+				addGlobalIoStats(m_stats - m_before);
+			}
+
+			FSI_DISABLE_COPY_MOVE(GlobalStatsScope);
+
+		private:
+
+			const IoStats& m_stats;
+
+			IoStats m_before;
+		};
+	}
+}
+
+#if FSI_HEADERONLY
+#include "io.hpp"
+#endif
\ No newline at end of file
@@ -0,0 +1,640 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include "io.h"
+#include "Depth.hpp"
+#include "consts.h"
+#include "exceptions.hpp"
+#include "RateLimiter.h"
+#include "Executor.h"
+#include "MemoryGovernor.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#if !defined(_WIN32)
+	#include <cerrno>
+	#include <fcntl.h>
+	#include <sys/socket.h>
+	#include <sys/uio.h>
+	#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+	#include <linux/fs.h>
+	#include <sys/ioctl.h>
+#endif
+
+namespace fsi
+{
+	namespace io
+	{
+		namespace detail
+		{
+			/** @brief Calls transfer(offset, size) over [0, size). With a limiter on the calling thread
+			* the range goes in chunks that wait for it, so a large request can't monopolize it. Stops
+			* when transfer returns false.
+			*/
+			template <typename Transfer>
+			inline void throttled(uint64_t size, Transfer transfer)
+			{
+				RateLimiter* limiter = RateLimitScope::current();
+				if (!limiter)
+				{
+					transfer(0, size);
+					return;
+				}
+
+				uint64_t offset = 0;
+				do
+				{
+					const uint64_t chunk = std::min(size - offset, defaultBufferSize);
+					limiter->acquire(chunk);
+					if (!transfer(offset, chunk))
+						return;
+					offset += chunk;
+				} while (offset < size);
+			}
+		}
+	}
+}
+
+FSI_INLINE_HPP
+void fsi::io::read(std::ifstream& file, uint8_t* dst, uint64_t size, IoStats& stats)
+{
+	detail::throttled(size, [&](uint64_t offset, uint64_t chunk)
+	{
+		ScopedTime time(stats.ioTimeUs);
+		file.read(reinterpret_cast<char*>(dst + offset), static_cast<std::streamsize>(chunk));
+		stats.bytesRead += static_cast<uint64_t>(file.gcount());
+		stats.readCalls++;
+		return static_cast<bool>(file);
+	});
+}
+
+FSI_INLINE_HPP
+void fsi::io::ignore(std::ifstream& file, uint64_t size, IoStats& stats)
+{
+	// The skipped bytes are still read through the stream buffer
+	detail::throttled(size, [&](uint64_t, uint64_t chunk)
+	{
+		ScopedTime time(stats.ioTimeUs);
+		file.ignore(static_cast<std::streamsize>(chunk));
+		stats.bytesRead += static_cast<uint64_t>(file.gcount());
+		stats.readCalls++;
+		return static_cast<bool>(file);
+	});
+}
+
+FSI_INLINE_HPP
+void fsi::io::seek(std::ifstream& file, uint64_t offset, IoStats& stats)
+{
+	ScopedTime time(stats.ioTimeUs);
+	file.seekg(static_cast<std::streamoff>(offset), std::ios::beg);
+	stats.seeks++;
+}
+
+FSI_INLINE_HPP
+void fsi::io::write(std::ofstream& file, const uint8_t* src, uint64_t size, IoStats& stats)
+{
+	detail::throttled(size, [&](uint64_t offset, uint64_t chunk)
+	{
+		ScopedTime time(stats.ioTimeUs);
+		file.write(reinterpret_cast<const char*>(src + offset), static_cast<std::streamsize>(chunk));
+		if (file)
+			stats.bytesWritten += chunk;
+		stats.writeCalls++;
+		return static_cast<bool>(file);
+	});
+}
+
+FSI_INLINE_HPP
+void fsi::io::seek(std::ofstream& file, uint64_t offset, IoStats& stats)
+{
+	ScopedTime time(stats.ioTimeUs);
+	file.seekp(static_cast<std::streamoff>(offset), std::ios::beg);
+	stats.seeks++;
+}
+
+FSI_INLINE_HPP
+uint64_t fsi::io::imageDataOffset(FormatVersion formatVersion)
+{
+	switch (formatVersion)
+	{
+	case FormatVersion::V1:
+		return
+			sizeof(expectedFormatSignature) +
+			sizeof(uint32_t) + // version
+			sizeof(uint32_t) + // width
+			sizeof(uint32_t) + // height
+			sizeof(uint32_t) + // channels
+			sizeof(uint32_t);  // depth
+
+	case FormatVersion::V2:
+		return
+			sizeof(expectedFormatSignature) +
+			sizeof(uint32_t) + // version
+			sizeof(uint32_t) + // width
+			sizeof(uint32_t) + // height
+			sizeof(uint32_t) + // channels
+			sizeof(uint8_t)  + // depth
+			sizeof(uint8_t)  + // hasThumb
+			sizeof(uint16_t) + // thumbWidth
+			sizeof(uint16_t) + // thumbHeight
+			thumbSizeInBytes;
+
+	default:
+		throw ExceptionInvalidFormatVersion();
+	}
+}
+
+#if !defined(_WIN32)
+namespace fsi
+{
+	namespace io
+	{
+		namespace detail
+		{
+			inline bool copyRange(int srcFd, uint64_t srcOffset, int dstFd, uint64_t dstOffset, uint64_t size,
+				IoStats& stats)
+			{
+				ScopedTime time(stats.ioTimeUs);
+
+#if defined(__linux__)
+				// Unsupported on this pair of files (e.g. another filesystem or an old kernel) shows up in the first
+				// call, before anything was copied
+				bool kernelCopy = true;
+				while (kernelCopy && size > 0)
+				{
+					off_t in = static_cast<off_t>(srcOffset);
+					off_t out = static_cast<off_t>(dstOffset);
+					const ssize_t copied = ::copy_file_range(srcFd, &in, dstFd, &out, static_cast<size_t>(size), 0);
+					stats.readCalls++;
+					stats.writeCalls++;
+
+					if (copied > 0)
+					{
+						srcOffset += static_cast<uint64_t>(copied);
+						dstOffset += static_cast<uint64_t>(copied);
+						size -= static_cast<uint64_t>(copied);
+						stats.bytesRead += static_cast<uint64_t>(copied);
+						stats.bytesWritten += static_cast<uint64_t>(copied);
+					}
+					else if (copied == 0)
+					{
+						errno = EIO; // Source shorter than expected
+						return false;
+					}
+					else if (errno == ENOSYS || errno == EXDEV || errno == EOPNOTSUPP || errno == EINVAL)
+						kernelCopy = false;
+					else if (errno != EINTR)
+						return false;
+				}
+#endif
+
+				// Smaller pieces when memory is tight
+				MemoryReservation memory(std::min(size, defaultBufferSize), std::min<uint64_t>(size, 64 * 1024));
+				std::vector<uint8_t> buffer(memory.size());
+				while (size > 0)
+				{
+					const size_t chunk = static_cast<size_t>(std::min<uint64_t>(size, buffer.size()));
+					const ssize_t got = ::pread(srcFd, buffer.data(), chunk, static_cast<off_t>(srcOffset));
+					stats.readCalls++;
+					if (got < 0 && errno == EINTR)
+						continue;
+					if (got <= 0)
+					{
+						if (got == 0)
+							errno = EIO;
+						return false;
+					}
+					stats.bytesRead += static_cast<uint64_t>(got);
+
+					for (ssize_t written = 0; written < got;)
+					{
+						const ssize_t put = ::pwrite(dstFd, buffer.data() + written, static_cast<size_t>(got - written),
+							static_cast<off_t>(dstOffset + written));
+						stats.writeCalls++;
+						if (put < 0 && errno == EINTR)
+							continue;
+						if (put < 0)
+							return false;
+						written += put;
+						stats.bytesWritten += static_cast<uint64_t>(put);
+					}
+
+					srcOffset += static_cast<uint64_t>(got);
+					dstOffset += static_cast<uint64_t>(got);
+					size -= static_cast<uint64_t>(got);
+				}
+
+				return true;
+			}
+		}
+	}
+}
+
+FSI_INLINE_HPP
+bool fsi::io::copyRange(int srcFd, uint64_t srcOffset, int dstFd, uint64_t dstOffset, uint64_t size,
+	IoStats& stats)
+{
+	bool copied = true;
+	detail::throttled(size, [&](uint64_t offset, uint64_t chunk)
+	{
+		copied = detail::copyRange(srcFd, srcOffset + offset, dstFd, dstOffset + offset, chunk, stats);
+		return copied;
+	});
+
+	return copied;
+}
+
+FSI_INLINE_HPP
+bool fsi::io::cloneFile(int srcFd, int dstFd)
+{
+#if defined(__linux__) && defined(FICLONE)
+	return ::ioctl(dstFd, FICLONE, srcFd) == 0;
+#else
+	(void)srcFd;
+	(void)dstFd;
+	return false;
+#endif
+}
+
+namespace fsi
+{
+	namespace io
+	{
+		namespace detail
+		{
+			inline bool isDirect(int fd)
+			{
+#if defined(O_DIRECT)
+				const int flags = ::fcntl(fd, F_GETFL);
+				return flags >= 0 && (flags & O_DIRECT) != 0;
+#else
+				(void)fd;
+				return false;
+#endif
+			}
+
+			// Filesystems that accept O_DIRECT at open() but not for the transfer report EINVAL
+			inline bool disableDirect(int fd)
+			{
+#if defined(O_DIRECT)
+				const int flags = ::fcntl(fd, F_GETFL);
+				return flags >= 0 && ::fcntl(fd, F_SETFL, flags & ~O_DIRECT) == 0;
+#else
+				(void)fd;
+				return false;
+#endif
+			}
+
+			struct FreeDeleter
+			{
+				void operator()(uint8_t* p) const { std::free(p); }
+			};
+
+			inline std::unique_ptr<uint8_t, FreeDeleter> alignedBuffer(uint64_t size)
+			{
+				return std::unique_ptr<uint8_t, FreeDeleter>(
+					static_cast<uint8_t*>(std::aligned_alloc(directIoAlignment, size)));
+			}
+
+			// Both go through throttled() in chunks of defaultBufferSize, a multiple of directIoAlignment,
+			// so the offsets of direct I/O stay aligned.
+			inline bool preadAll(int fd, uint8_t* dst, uint64_t size, uint64_t offset, bool allowShort,
+				uint64_t& got, IoStats& stats)
+			{
+				got = 0;
+				bool done = true;
+				throttled(size, [&](uint64_t chunkOffset, uint64_t chunk)
+				{
+					ScopedTime time(stats.ioTimeUs);
+					while (got < chunkOffset + chunk)
+					{
+						const ssize_t n = ::pread(fd, dst + got, static_cast<size_t>(chunkOffset + chunk - got),
+							static_cast<off_t>(offset + got));
+						stats.readCalls++;
+						if (n < 0 && errno == EINTR)
+							continue;
+						if (n < 0)
+							return done = false;
+						if (n == 0)
+						{
+							if (allowShort)
+								return false;
+							errno = EIO; // Shorter than expected
+							return done = false;
+						}
+						got += static_cast<uint64_t>(n);
+						stats.bytesRead += static_cast<uint64_t>(n);
+					}
+					return true;
+				});
+
+				return done;
+			}
+
+			inline bool pwriteAll(int fd, const uint8_t* src, uint64_t size, uint64_t offset, IoStats& stats)
+			{
+				uint64_t put = 0;
+				bool done = true;
+				throttled(size, [&](uint64_t chunkOffset, uint64_t chunk)
+				{
+					ScopedTime time(stats.ioTimeUs);
+					while (put < chunkOffset + chunk)
+					{
+						const ssize_t n = ::pwrite(fd, src + put, static_cast<size_t>(chunkOffset + chunk - put),
+							static_cast<off_t>(offset + put));
+						stats.writeCalls++;
+						if (n < 0 && errno == EINTR)
+							continue;
+						if (n < 0)
+							return done = false;
+						put += static_cast<uint64_t>(n);
+						stats.bytesWritten += static_cast<uint64_t>(n);
+					}
+					return true;
+				});
+
+				return done;
+			}
+		}
+	}
+}
+
+FSI_INLINE_HPP
+int fsi::io::openFile(const std::filesystem::path& path, bool write, bool& direct)
+{
+	const int flags = write ? O_WRONLY : O_RDONLY;
+
+#if defined(O_DIRECT)
+	if (direct)
+	{
+		const int fd = ::open(path.c_str(), flags | O_DIRECT);
+		if (fd >= 0)
+			return fd;
+	}
+#endif
+
+	direct = false;
+	return ::open(path.c_str(), flags);
+}
+
+FSI_INLINE_HPP
+bool fsi::io::readAt(int fd, uint8_t* dst, uint64_t size, uint64_t offset, IoStats& stats)
+{
+	uint64_t got = 0;
+	if (detail::isDirect(fd))
+	{
+		// The aligned range around the requested one. The end of the file may cut it short.
+		const uint64_t begin = offset / directIoAlignment * directIoAlignment;
+		const uint64_t end = (offset + size + directIoAlignment - 1) / directIoAlignment * directIoAlignment;
+
+		MemoryReservation memory(end - begin);
+		auto buffer = detail::alignedBuffer(end - begin);
+		stats.peakScratchBytes = std::max(stats.peakScratchBytes, end - begin);
+
+		if (buffer && detail::preadAll(fd, buffer.get(), end - begin, begin, true, got, stats))
+		{
+			if (got < offset + size - begin)
+			{
+				errno = EIO;
+				return false;
+			}
+
+			std::memcpy(dst, buffer.get() + (offset - begin), size);
+			return true;
+		}
+
+		if (buffer && (errno != EINVAL || !detail::disableDirect(fd)))
+			return false;
+	}
+
+	return detail::preadAll(fd, dst, size, offset, false, got, stats);
+}
+
+FSI_INLINE_HPP
+bool fsi::io::writeAt(int fd, const uint8_t* src, uint64_t size, uint64_t offset, IoStats& stats)
+{
+	if (detail::isDirect(fd))
+	{
+		MemoryReservation memory(size);
+		auto buffer = detail::alignedBuffer(size);
+		stats.peakScratchBytes = std::max(stats.peakScratchBytes, size);
+
+		if (buffer)
+		{
+			std::memcpy(buffer.get(), src, size);
+			if (detail::pwriteAll(fd, buffer.get(), size, offset, stats))
+				return true;
+
+			if (errno != EINVAL || !detail::disableDirect(fd))
+				return false;
+		}
+	}
+
+	return detail::pwriteAll(fd, src, size, offset, stats);
+}
+
+FSI_INLINE_HPP
+void fsi::io::adviseCache(int fd, CacheAdvice advice)
+{
+#if defined(POSIX_FADV_SEQUENTIAL)
+	switch (advice)
+	{
+	case CacheAdvice::Sequential:
+		::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+		break;
+	case CacheAdvice::Random:
+		::posix_fadvise(fd, 0, 0, POSIX_FADV_RANDOM);
+		break;
+	default:
+		break;
+	}
+#else
+	(void)fd;
+	(void)advice;
+#endif
+}
+
+FSI_INLINE_HPP
+bool fsi::io::finishFile(const std::filesystem::path& path, bool sync, bool dropCache)
+{
+	if (!sync && !dropCache)
+		return true;
+
+	FileDescriptor fd(::open(path.c_str(), sync ? O_WRONLY : O_RDONLY));
+	if (fd.get() < 0)
+		return false;
+
+	if (sync && ::fsync(fd.get()) != 0)
+		return false;
+
+#if defined(POSIX_FADV_DONTNEED)
+	// Dirty pages can't be dropped, so without a sync some of the file may stay cached
+	if (dropCache)
+		::posix_fadvise(fd.get(), 0, 0, POSIX_FADV_DONTNEED);
+#endif
+
+	return true;
+}
+
+FSI_INLINE_HPP
+bool fsi::io::sendMessage(int socket, const void* data, uint64_t size, int fd)
+{
+#if defined(MSG_NOSIGNAL)
+	const int flags = MSG_NOSIGNAL;
+#else
+	const int flags = 0;
+#endif
+
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	for (uint64_t sent = 0; sent < size;)
+	{
+		iovec vector;
+		vector.iov_base = const_cast<uint8_t*>(bytes + sent);
+		vector.iov_len = static_cast<size_t>(size - sent);
+
+		msghdr message{};
+		message.msg_iov = &vector;
+		message.msg_iovlen = 1;
+
+		alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+		if (fd >= 0 && sent == 0)
+		{
+			std::memset(control, 0, sizeof(control));
+			message.msg_control = control;
+			message.msg_controllen = sizeof(control);
+
+			cmsghdr* header = CMSG_FIRSTHDR(&message);
+			header->cmsg_level = SOL_SOCKET;
+			header->cmsg_type = SCM_RIGHTS;
+			header->cmsg_len = CMSG_LEN(sizeof(int));
+			std::memcpy(CMSG_DATA(header), &fd, sizeof(int));
+		}
+
+		const ssize_t put = ::sendmsg(socket, &message, flags);
+		if (put < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+
+		sent += static_cast<uint64_t>(put);
+	}
+
+	return true;
+}
+
+FSI_INLINE_HPP
+bool fsi::io::receiveMessage(int socket, void* data, uint64_t size, int& fd)
+{
+	fd = -1;
+
+	uint8_t* bytes = static_cast<uint8_t*>(data);
+	for (uint64_t received = 0; received < size;)
+	{
+		iovec vector;
+		vector.iov_base = bytes + received;
+		vector.iov_len = static_cast<size_t>(size - received);
+
+		alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+		msghdr message{};
+		message.msg_iov = &vector;
+		message.msg_iovlen = 1;
+		message.msg_control = control;
+		message.msg_controllen = sizeof(control);
+
+#if defined(MSG_CMSG_CLOEXEC)
+		const ssize_t got = ::recvmsg(socket, &message, MSG_CMSG_CLOEXEC);
+#else
+		const ssize_t got = ::recvmsg(socket, &message, 0);
+#endif
+		if (got < 0 && errno == EINTR)
+			continue;
+
+		for (cmsghdr* header = got > 0 ? CMSG_FIRSTHDR(&message) : nullptr; header;
+			header = CMSG_NXTHDR(&message, header))
+		{
+			if (header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS)
+				continue;
+
+			// Only one descriptor is expected, any other is closed
+			const size_t count = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+			for (size_t i = 0; i < count; i++)
+			{
+				int passed;
+				std::memcpy(&passed, CMSG_DATA(header) + i * sizeof(int), sizeof(int));
+				if (fd < 0)
+					fd = passed;
+				else
+					::close(passed);
+			}
+		}
+
+		if (got <= 0)
+		{
+			if (fd >= 0)
+				::close(fd);
+			fd = -1;
+			return false;
+		}
+
+		received += static_cast<uint64_t>(got);
+	}
+
+	return true;
+}
+#endif
+
+FSI_INLINE_HPP
+bool fsi::io::forEachChunk(uint64_t count, uint32_t threads, ProgressThread* progress, IoStats& stats,
+	const ChunkTransfer& transfer, uint64_t scratchPerChunk)
+{
+	uint64_t group = threads > 0 ? threads : static_cast<uint64_t>(executor()->concurrency()) + 1;
+	if (scratchPerChunk > 0)
+		group = std::clamp<uint64_t>(memoryGovernor().available() / scratchPerChunk, 1, group);
+
+	RateLimiter* limiter = RateLimitScope::current();
+	std::mutex mutex;
+
+	for (uint64_t first = 0; first < count; first += group)
+	{
+		if (progress && !progress->update(static_cast<float>(first) / static_cast<float>(count)))
+			return false;
+
+		const uint64_t last = std::min(count, first + group);
+		if (last - first == 1)
+		{
+			transfer(first, stats);
+			continue;
+		}
+
+		executor()->parallelFor(static_cast<int64_t>(first), static_cast<int64_t>(last), 1,
+			[&](int64_t begin, int64_t end)
+		{
+			RateLimitScope rateLimit(limiter);
+
+			// The workers count into their own stats
+			IoStats local;
+			for (int64_t i = begin; i < end; i++)
+				transfer(static_cast<uint64_t>(i), local);
+
+			std::lock_guard<std::mutex> lock(mutex);
+			stats += local;
+		});
+	}
+
+	return true;
+}
\ No newline at end of file
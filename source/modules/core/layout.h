@@ -0,0 +1,49 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include "fsi_core_exports.h"
+#include "../global.h"
+#include "IoOptions.h"
+#include <cstdint>
+
+namespace fsi
+{
+	/** @brief Whether read() and readRect() accept the layout and tile size. Tiled layouts need a tile
+	* size between 1 and 65536, Morton a power of two.
+	*/
+	FSI_CORE_API bool isValidLayout(PixelLayout layout, uint32_t tileSize);
+
+	/** @brief Bytes of a width x height rect in the layout, including the padding of the edge tiles.
+	*/
+	FSI_CORE_API uint64_t layoutSizeInBytes(uint32_t width, uint32_t height, uint64_t pixelBytes,
+		PixelLayout layout, uint32_t tileSize);
+
+	/** @brief Index of pixel (x, y) of a rect of the given width in the layout. Multiply by the pixel
+	* size for the byte offset.
+	*/
+	FSI_CORE_API uint64_t layoutPixelIndex(uint32_t x, uint32_t y, uint32_t width, PixelLayout layout,
+		uint32_t tileSize);
+
+	/** @brief Puts rows of a row-major image into a buffer of layoutSizeInBytes() in the layout.
+	*
+	* @param src The rows, srcStrideBytes apart.
+	* @param width The width of the image.
+	* @param firstRow Row of the image that src starts at. A multiple of tileSize.
+	* @param rows Rows in src. A multiple of tileSize, unless they end the image: the rest of the last
+	* tile row is then filled with zeros.
+	* @param dst The start of the whole layout buffer.
+	*/
+	FSI_CORE_API void swizzleRows(const uint8_t* src, uint64_t srcStrideBytes, uint32_t width,
+		uint32_t firstRow, uint32_t rows, uint64_t pixelBytes, PixelLayout layout, uint32_t tileSize,
+		uint8_t* dst);
+}
+
+#if FSI_HEADERONLY
+#include "layout.hpp"
+#endif
\ No newline at end of file
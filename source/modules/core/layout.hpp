@@ -0,0 +1,149 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include "layout.h"
+#include "layout.tcc"
+#include "Executor.h"
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+namespace fsi
+{
+	namespace detail
+	{
+		typedef void (*SwizzleTileRowKernel)(const uint8_t* src, uint64_t srcStride, uint64_t rows,
+			uint64_t width, uint64_t runtimePixelBytes, uint64_t tileSize, const uint64_t* mortonBits,
+			uint8_t* dst);
+
+		// The pixel sizes of 1-4 channels of every depth
+		inline SwizzleTileRowKernel swizzleTileRowKernel(uint64_t pixelBytes)
+		{
+			switch (pixelBytes)
+			{
+			case 1: return &swizzleTileRow<1>;
+			case 2: return &swizzleTileRow<2>;
+			case 3: return &swizzleTileRow<3>;
+			case 4: return &swizzleTileRow<4>;
+			case 6: return &swizzleTileRow<6>;
+			case 8: return &swizzleTileRow<8>;
+			case 12: return &swizzleTileRow<12>;
+			case 16: return &swizzleTileRow<16>;
+			case 24: return &swizzleTileRow<24>;
+			case 32: return &swizzleTileRow<32>;
+			default: return &swizzleTileRow<0>;
+			}
+		}
+
+		inline void checkLayout(PixelLayout layout, uint32_t tileSize)
+		{
+			if (!isValidLayout(layout, tileSize))
+				throw std::invalid_argument("Invalid pixel layout or layout tile size");
+		}
+	}
+}
+
+FSI_INLINE_HPP
+bool fsi::isValidLayout(PixelLayout layout, uint32_t tileSize)
+{
+	switch (layout)
+	{
+	case PixelLayout::Linear:
+		return true;
+	case PixelLayout::Tiled:
+		return tileSize > 0 && tileSize <= 65536;
+	case PixelLayout::Morton:
+		return tileSize > 0 && tileSize <= 65536 && (tileSize & (tileSize - 1)) == 0;
+	default:
+		return false;
+	}
+}
+
+FSI_INLINE_HPP
+uint64_t fsi::layoutSizeInBytes(uint32_t width, uint32_t height, uint64_t pixelBytes, PixelLayout layout,
+	uint32_t tileSize)
+{
+	detail::checkLayout(layout, tileSize);
+
+	if (layout == PixelLayout::Linear)
+		return static_cast<uint64_t>(width) * height * pixelBytes;
+
+	const uint64_t tilesX = (static_cast<uint64_t>(width) + tileSize - 1) / tileSize;
+	const uint64_t tilesY = (static_cast<uint64_t>(height) + tileSize - 1) / tileSize;
+	return tilesX * tilesY * tileSize * tileSize * pixelBytes;
+}
+
+FSI_INLINE_HPP
+uint64_t fsi::layoutPixelIndex(uint32_t x, uint32_t y, uint32_t width, PixelLayout layout, uint32_t tileSize)
+{
+	detail::checkLayout(layout, tileSize);
+
+	if (layout == PixelLayout::Linear)
+		return static_cast<uint64_t>(y) * width + x;
+
+	const uint64_t tilesX = (static_cast<uint64_t>(width) + tileSize - 1) / tileSize;
+	const uint64_t tile = (y / tileSize) * tilesX + x / tileSize;
+	const uint64_t tx = x % tileSize;
+	const uint64_t ty = y % tileSize;
+
+	const uint64_t inTile = layout == PixelLayout::Morton
+		? detail::spreadBits(tx) | (detail::spreadBits(ty) << 1)
+		: ty * tileSize + tx;
+
+	return tile * tileSize * tileSize + inTile;
+}
+
+FSI_INLINE_HPP
+void fsi::swizzleRows(const uint8_t* src, uint64_t srcStrideBytes, uint32_t width, uint32_t firstRow,
+	uint32_t rows, uint64_t pixelBytes, PixelLayout layout, uint32_t tileSize, uint8_t* dst)
+{
+	detail::checkLayout(layout, tileSize);
+
+	const uint64_t rowSize = static_cast<uint64_t>(width) * pixelBytes;
+
+	if (layout == PixelLayout::Linear)
+	{
+		for (uint64_t y = 0; y < rows; y++)
+			std::memcpy(dst + (firstRow + y) * rowSize, src + y * srcStrideBytes, rowSize);
+		return;
+	}
+
+	if (firstRow % tileSize != 0)
+		throw std::invalid_argument("Swizzled rows must start at a tile boundary");
+
+	std::vector<uint64_t> mortonBits;
+	if (layout == PixelLayout::Morton)
+	{
+		mortonBits.resize(tileSize);
+		for (uint64_t i = 0; i < tileSize; i++)
+			mortonBits[i] = detail::spreadBits(i);
+	}
+
+	const detail::SwizzleTileRowKernel kernel = detail::swizzleTileRowKernel(pixelBytes);
+	const uint64_t tilesX = (static_cast<uint64_t>(width) + tileSize - 1) / tileSize;
+	const uint64_t tileRowBytes = tilesX * tileSize * tileSize * pixelBytes;
+	const int64_t tileRows = static_cast<int64_t>((static_cast<uint64_t>(rows) + tileSize - 1) / tileSize);
+
+	// Tile rows don't share bytes of dst
+	auto swizzle = [&](int64_t begin, int64_t end)
+	{
+		for (int64_t tileRow = begin; tileRow < end; tileRow++)
+		{
+			const uint64_t y = static_cast<uint64_t>(tileRow) * tileSize;
+			kernel(src + y * srcStrideBytes, srcStrideBytes, std::min<uint64_t>(tileSize, rows - y), width,
+				pixelBytes, tileSize, mortonBits.empty() ? nullptr : mortonBits.data(),
+				dst + (firstRow / tileSize + static_cast<uint64_t>(tileRow)) * tileRowBytes);
+		}
+	};
+
+	if (tileRows > 1)
+		executor()->parallelFor(0, tileRows, 1, swizzle);
+	else
+		swizzle(0, tileRows);
+}
\ No newline at end of file
@@ -0,0 +1,108 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include "layout.h"
+#include <algorithm>
+#include <cstring>
+
+namespace fsi
+{
+	namespace detail
+	{
+		/** @brief Moves the low 32 bits of v to the even bits. The Morton index of (x, y) is
+		* spreadBits(x) | spreadBits(y) << 1.
+		*/
+		inline uint64_t spreadBits(uint64_t v)
+		{
+			v &= 0xFFFFFFFFull;
+			v = (v | (v << 16)) & 0x0000FFFF0000FFFFull;
+			v = (v | (v << 8)) & 0x00FF00FF00FF00FFull;
+			v = (v | (v << 4)) & 0x0F0F0F0F0F0F0F0Full;
+			v = (v | (v << 2)) & 0x3333333333333333ull;
+			v = (v | (v << 1)) & 0x5555555555555555ull;
+			return v;
+		}
+
+		/** @brief Swizzles up to tileSize rows of src into one row of tiles at dst. Tiles that the rows
+		* or the width don't fill are cleared first.
+		*
+		* mortonBits holds spreadBits() of 0 to tileSize - 1 for PixelLayout::Morton, and is null for
+		* PixelLayout::Tiled. On the Morton curve a 2x2 quad starting at an even row and column is four
+		* consecutive pixels, so pixels are moved in pairs of a row. PixelBytes is 0 when the pixel size is only known at runtime; with a
+		* fixed size each move is a register move.
+		*/
+		template <uint64_t PixelBytes>
+		void swizzleTileRow(const uint8_t* src, uint64_t srcStride, uint64_t rows, uint64_t width,
+			uint64_t runtimePixelBytes, uint64_t tileSize, const uint64_t* mortonBits, uint8_t* dst);
+	}
+}
+
+template <uint64_t PixelBytes>
+inline
+void fsi::detail::swizzleTileRow(const uint8_t* src, uint64_t srcStride, uint64_t rows, uint64_t width,
+	uint64_t runtimePixelBytes, uint64_t tileSize, const uint64_t* mortonBits, uint8_t* dst)
+{
+	const uint64_t pixelBytes = PixelBytes > 0 ? PixelBytes : runtimePixelBytes;
+	const uint64_t tileBytes = tileSize * tileSize * pixelBytes;
+	const uint64_t tilesX = (width + tileSize - 1) / tileSize;
+
+	for (uint64_t tx = 0; tx < tilesX; tx++)
+	{
+		uint8_t* tile = dst + tx * tileBytes;
+		const uint64_t x0 = tx * tileSize;
+		const uint64_t cols = std::min(tileSize, width - x0);
+
+		if (cols < tileSize || rows < tileSize)
+			std::memset(tile, 0, tileBytes);
+
+		if (!mortonBits)
+		{
+			for (uint64_t y = 0; y < rows; y++)
+				std::memcpy(tile + y * tileSize * pixelBytes, src + y * srcStride + x0 * pixelBytes, cols * pixelBytes);
+			continue;
+		}
+
+		// An even row and the next one make 2x2 quads, consecutive on the curve
+		uint64_t y = 0;
+		for (; y + 1 < rows; y += 2)
+		{
+			const uint8_t* in0 = src + y * srcStride + x0 * pixelBytes;
+			const uint8_t* in1 = in0 + srcStride;
+			const uint64_t rowBits = mortonBits[y] << 1;
+
+			uint64_t x = 0;
+			for (; x + 1 < cols; x += 2)
+			{
+				uint8_t* out = tile + (mortonBits[x] | rowBits) * pixelBytes;
+				std::memcpy(out, in0 + x * pixelBytes, 2 * pixelBytes);
+				std::memcpy(out + 2 * pixelBytes, in1 + x * pixelBytes, 2 * pixelBytes);
+			}
+
+			if (x < cols)
+			{
+				uint8_t* out = tile + (mortonBits[x] | rowBits) * pixelBytes;
+				std::memcpy(out, in0 + x * pixelBytes, pixelBytes);
+				std::memcpy(out + 2 * pixelBytes, in1 + x * pixelBytes, pixelBytes);
+			}
+		}
+
+		if (y < rows)
+		{
+			const uint8_t* in = src + y * srcStride + x0 * pixelBytes;
+			const uint64_t rowBits = mortonBits[y] << 1;
+
+			uint64_t x = 0;
+			for (; x + 1 < cols; x += 2)
+				std::memcpy(tile + (mortonBits[x] | rowBits) * pixelBytes, in + x * pixelBytes, 2 * pixelBytes);
+
+			if (x < cols)
+				std::memcpy(tile + (mortonBits[x] | rowBits) * pixelBytes, in + x * pixelBytes, pixelBytes);
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,77 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include "fsi_core_exports.h"
+#include "../global.h"
+#include "FormatVersion.h"
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+namespace fsi
+{
+	/** @brief An FSI file placed in the output with its top-left pixel at (x, y). Parts outside of the
+	* output are clipped.
+	*/
+	struct MosaicTile
+	{
+		std::filesystem::path path;
+		int64_t x = 0;
+		int64_t y = 0;
+	};
+
+	struct MosaicLayout
+	{
+		/** @brief Where tiles overlap, the later one wins.
+		*/
+		std::vector<MosaicTile> tiles;
+
+		/** @brief Size of the output. 0 uses the bounding box of the tiles.
+		*/
+		uint32_t width = 0;
+
+		uint32_t height = 0;
+	};
+
+	struct MosaicOptions
+	{
+		/** @brief Version of the output file.
+		*/
+		FormatVersion formatVersion = FormatVersion::Latest;
+
+		/** @brief Generates the thumbnail of the output (V2 only).
+		*/
+		bool thumbnail = true;
+
+		/** @brief Output rows per band. 0 picks about 16 * defaultBufferSize bytes per band.
+		*/
+		uint32_t bandHeight = 0;
+	};
+
+	/** @brief Lays out files in a grid of columns columns, row-major. Each grid column is as wide as
+	* its widest file and each grid row as tall as its tallest one.
+	*/
+	FSI_CORE_API MosaicLayout gridLayout(const std::vector<std::filesystem::path>& paths, uint32_t columns);
+
+	/** @brief Writes the tiles of a layout into one FSI file without allocating the output image.
+	*
+	* The output is produced in row bands appended with Writer::writeRows(). For each band, the rows of
+	* the tiles that intersect it are read with readRect() straight into the band buffer, in parallel on
+	* fsi::executor() unless tiles overlap. The next band is filled while the previous one is written,
+	* so memory is two bands. Pixels covered by no tile are zero.
+	*
+	* All tiles must have the same channels and depth.
+	*/
+	FSI_CORE_API void mosaic(const MosaicLayout& layout, const std::filesystem::path& dstPath,
+		const MosaicOptions& options = MosaicOptions());
+}
+
+#if FSI_HEADERONLY
+#include "mosaic.hpp"
+#endif
\ No newline at end of file
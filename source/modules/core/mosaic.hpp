@@ -0,0 +1,243 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include "mosaic.h"
+#include "Reader.h"
+#include "Writer.h"
+#include "Executor.h"
+#include "MemoryGovernor.h"
+#include "Trace.h"
+#include "consts.h"
+#include "exceptions.hpp"
+#include <algorithm>
+#include <cstring>
+#include <future>
+#include <memory>
+
+FSI_INLINE_HPP
+fsi::MosaicLayout fsi::gridLayout(const std::vector<std::filesystem::path>& paths, uint32_t columns)
+{
+	columns = std::max<uint32_t>(columns, 1);
+	const size_t rows = (paths.size() + columns - 1) / columns;
+
+	std::vector<uint32_t> columnWidths(columns, 0);
+	std::vector<uint32_t> rowHeights(rows, 0);
+	std::vector<Header> headers(paths.size());
+
+	for (size_t i = 0; i < paths.size(); i++)
+	{
+		Reader reader;
+		reader.open(paths[i]);
+		headers[i] = reader.header();
+
+		columnWidths[i % columns] = std::max(columnWidths[i % columns], headers[i].width);
+		rowHeights[i / columns] = std::max(rowHeights[i / columns], headers[i].height);
+	}
+
+	std::vector<int64_t> columnX(columns + 1, 0);
+	for (uint32_t c = 0; c < columns; c++)
+		columnX[c + 1] = columnX[c] + columnWidths[c];
+
+	std::vector<int64_t> rowY(rows + 1, 0);
+	for (size_t r = 0; r < rows; r++)
+		rowY[r + 1] = rowY[r] + rowHeights[r];
+
+	MosaicLayout layout;
+	layout.width = static_cast<uint32_t>(columnX.back());
+	layout.height = static_cast<uint32_t>(rowY.back());
+
+	for (size_t i = 0; i < paths.size(); i++)
+	{
+		MosaicTile tile;
+		tile.path = paths[i];
+		tile.x = columnX[i % columns];
+		tile.y = rowY[i / columns];
+		layout.tiles.push_back(tile);
+	}
+
+	return layout;
+}
+
+FSI_INLINE_HPP
+void fsi::mosaic(const MosaicLayout& layout, const std::filesystem::path& dstPath, const MosaicOptions& options)
+{
+	FSI_TRACE_ZONE("api", "mosaic");
+
+	if (layout.tiles.empty())
+		throw std::runtime_error("The mosaic has no tiles.");
+
+	// --- Tile headers and output size ---
+
+	std::vector<Header> headers(layout.tiles.size());
+	int64_t right = 0;
+	int64_t bottom = 0;
+
+	for (size_t i = 0; i < layout.tiles.size(); i++)
+	{
+		Reader reader;
+		reader.open(layout.tiles[i].path);
+		headers[i] = reader.header();
+
+		if (headers[i].channels != headers[0].channels)
+			throw ExceptionInvalidImageChannels("All the tiles of a mosaic must have the same channels");
+		if (headers[i].depth != headers[0].depth)
+			throw ExceptionInvalidImageDepth("All the tiles of a mosaic must have the same depth");
+
+		right = std::max(right, layout.tiles[i].x + headers[i].width);
+		bottom = std::max(bottom, layout.tiles[i].y + headers[i].height);
+	}
+
+	Header header;
+	header.width = layout.width > 0 ? layout.width : static_cast<uint32_t>(std::max<int64_t>(right, 0));
+	header.height = layout.height > 0 ? layout.height : static_cast<uint32_t>(std::max<int64_t>(bottom, 0));
+	header.channels = headers[0].channels;
+	header.depth = headers[0].depth;
+	header.hasThumb = options.thumbnail;
+
+	Writer writer(options.formatVersion);
+	writer.open(dstPath, header);
+
+	const int64_t width = header.width;
+	const int64_t height = header.height;
+	const uint64_t bytesPerPixel = static_cast<uint64_t>(header.channels) * sizeOfDepth(header.depth);
+	const uint64_t rowSize = width * bytesPerPixel;
+
+	// --- Clipped tile rects in output coordinates ---
+
+	struct Rect
+	{
+		int64_t x0, y0, x1, y1;
+	};
+
+	std::vector<Rect> rects;
+	std::vector<size_t> visible;
+	for (size_t i = 0; i < layout.tiles.size(); i++)
+	{
+		const MosaicTile& tile = layout.tiles[i];
+		const Rect rect = {
+			std::max<int64_t>(tile.x, 0),
+			std::max<int64_t>(tile.y, 0),
+			std::min<int64_t>(tile.x + headers[i].width, width),
+			std::min<int64_t>(tile.y + headers[i].height, height) };
+
+		if (rect.x0 < rect.x1 && rect.y0 < rect.y1)
+		{
+			rects.push_back(rect);
+			visible.push_back(i);
+		}
+	}
+
+	// Overlapping tiles must be copied in order, so they can't be read in parallel
+	bool overlapping = false;
+	{
+		std::vector<size_t> order(rects.size());
+		for (size_t i = 0; i < order.size(); i++)
+			order[i] = i;
+		std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return rects[a].y0 < rects[b].y0; });
+
+		for (size_t i = 0; i < order.size() && !overlapping; i++)
+		{
+			const Rect& a = rects[order[i]];
+			for (size_t j = i + 1; j < order.size() && rects[order[j]].y0 < a.y1; j++)
+			{
+				const Rect& b = rects[order[j]];
+				if (a.x0 < b.x1 && b.x0 < a.x1)
+				{
+					overlapping = true;
+					break;
+				}
+			}
+		}
+	}
+
+	// --- Bands ---
+
+	const int64_t desiredBandHeight = options.bandHeight > 0
+		? std::min<int64_t>(options.bandHeight, height)
+		: std::clamp<int64_t>(static_cast<int64_t>(16 * defaultBufferSize / rowSize), 1, height);
+
+	// Fewer rows per band under a tight memory budget, unless the band height was given
+	MemoryReservation memory;
+	const int64_t bandHeight = static_cast<int64_t>(memory.reserveRows(static_cast<uint64_t>(desiredBandHeight),
+		options.bandHeight > 0 ? static_cast<uint64_t>(desiredBandHeight) : 1, 2 * rowSize));
+
+	std::vector<uint8_t> bands[2];
+	std::future<void> writing;
+
+	for (int64_t bandY = 0; bandY < height; bandY += bandHeight)
+	{
+		const int64_t bandRows = std::min(bandHeight, height - bandY);
+		std::vector<uint8_t>& band = bands[(bandY / bandHeight) % 2];
+
+		std::vector<size_t> intersecting;
+		for (size_t i = 0; i < rects.size(); i++)
+		{
+			if (rects[i].y0 < bandY + bandRows && bandY < rects[i].y1)
+				intersecting.push_back(i);
+		}
+
+		auto readTile = [&](size_t i)
+		{
+			const Rect& rect = rects[i];
+			const MosaicTile& tile = layout.tiles[visible[i]];
+
+			const int64_t y0 = std::max(rect.y0, bandY);
+			const int64_t y1 = std::min(rect.y1, bandY + bandRows);
+
+			// Readers can't be shared between threads
+			Reader reader;
+			reader.open(tile.path);
+			reader.readRect(band.data() + (y0 - bandY) * rowSize + rect.x0 * bytesPerPixel,
+				static_cast<uint32_t>(rect.x0 - tile.x), static_cast<uint32_t>(y0 - tile.y),
+				static_cast<uint32_t>(rect.x1 - rect.x0), static_cast<uint32_t>(y1 - y0), rowSize);
+		};
+
+		try
+		{
+			FSI_TRACE_ZONE("io", "read mosaic band");
+
+			band.assign(bandRows * rowSize, 0);
+
+			if (overlapping)
+			{
+				for (size_t i : intersecting)
+					readTile(i);
+			}
+			else
+			{
+				executor()->parallelFor(0, static_cast<int64_t>(intersecting.size()), 1,
+					[&](int64_t begin, int64_t end)
+				{
+					for (int64_t i = begin; i < end; i++)
+						readTile(intersecting[i]);
+				});
+			}
+		}
+		catch (...)
+		{
+			// The write task uses the other band
+			if (writing.valid())
+				writing.wait();
+			throw;
+		}
+
+		if (writing.valid())
+			writing.get();
+
+		auto task = std::make_shared<std::packaged_task<void()>>([&writer, &band, bandRows]()
+		{
+			writer.writeRows(band.data(), static_cast<uint32_t>(bandRows));
+		});
+		writing = task->get_future();
+		executor()->submit([task]() { (*task)(); });
+	}
+
+	if (writing.valid())
+		writing.get();
+}
\ No newline at end of file
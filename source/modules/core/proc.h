@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include "fsi_core_exports.h"
 #include "Header.h"
 #include "../global.h"
 
@@ -19,7 +20,7 @@ namespace fsi
 			double r, g, b, a;
 
 			inline
-			constexpr double& operator[](typename size_t i)
+			constexpr double& operator[](size_t i)
 			{
 				assert(i < 4);
 
@@ -38,7 +39,7 @@ namespace fsi
 			}
 		};
 
-		void generateThumbnail(const uint8_t* srcData, uint64_t srcWidth, uint64_t srcHeight,
+		FSI_CORE_API void generateThumbnail(const uint8_t* srcData, uint64_t srcWidth, uint64_t srcHeight,
 			uint64_t srcChannels, Depth srcDepth, uint64_t srcStep, uint8_t* dstData, int64_t dstStep,
 			uint64_t targetWidth, uint64_t targetHeight);
 
@@ -47,6 +48,26 @@ namespace fsi
 			uint64_t srcChannels, uint64_t srcStep, uint8_t* dstData, int64_t dstStep,
 			uint64_t targetWidth, uint64_t targetHeight);
 
+		/** @brief Adds each factor pixels wide block of a row to its entry in sums, which holds
+		* channels values per output pixel. The last block may be narrower.
+		*/
+		FSI_CORE_API void boxAccumulateRow(const uint8_t* src, uint64_t width, uint64_t channels, Depth depth,
+			uint32_t factor, double* sums);
+
+		/** @brief Stores the averages of the blocks accumulated over rows rows with boxAccumulateRow() and
+		* clears sums. Integers are rounded to the nearest value.
+		*/
+		FSI_CORE_API void boxStoreRow(double* sums, uint64_t srcWidth, uint64_t channels, Depth depth,
+			uint32_t factor, uint64_t rows, uint8_t* dst);
+
+		template <typename T, uint64_t Channels>
+		void boxAccumulateRow(const uint8_t* src, uint64_t width, uint64_t runtimeChannels, uint32_t factor,
+			double* sums);
+
+		template <typename T>
+		void boxStoreRow(double* sums, uint64_t srcWidth, uint64_t channels, uint32_t factor, uint64_t rows,
+			uint8_t* dst);
+
 		template <typename T>
 		T remap(T src, T srcMin, T srcMax, T dstMin, T dstMax);
 
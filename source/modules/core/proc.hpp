@@ -66,4 +66,68 @@ void fsi::proc::generateThumbnail(const uint8_t* srcData, uint64_t srcWidth, uin
 		assert(false && "Invalid depth");
 		break;
 	}
+}
+
+namespace fsi
+{
+	namespace proc
+	{
+		template <typename T>
+		inline void boxAccumulateRowChannels(const uint8_t* src, uint64_t width, uint64_t channels,
+			uint32_t factor, double* sums)
+		{
+			switch (channels)
+			{
+			case 1: boxAccumulateRow<T, 1>(src, width, channels, factor, sums); break;
+			case 2: boxAccumulateRow<T, 2>(src, width, channels, factor, sums); break;
+			case 3: boxAccumulateRow<T, 3>(src, width, channels, factor, sums); break;
+			case 4: boxAccumulateRow<T, 4>(src, width, channels, factor, sums); break;
+			default: boxAccumulateRow<T, 0>(src, width, channels, factor, sums); break;
+			}
+		}
+	}
+}
+
+FSI_INLINE_HPP
+void fsi::proc::boxAccumulateRow(const uint8_t* src, uint64_t width, uint64_t channels, Depth depth,
+	uint32_t factor, double* sums)
+{
+	switch (depth)
+	{
+	case Depth::Int8: boxAccumulateRowChannels<int8_t>(src, width, channels, factor, sums); break;
+	case Depth::Int16: boxAccumulateRowChannels<int16_t>(src, width, channels, factor, sums); break;
+	case Depth::Int32: boxAccumulateRowChannels<int32_t>(src, width, channels, factor, sums); break;
+	case Depth::Int64: boxAccumulateRowChannels<int64_t>(src, width, channels, factor, sums); break;
+	case Depth::Uint8: boxAccumulateRowChannels<uint8_t>(src, width, channels, factor, sums); break;
+	case Depth::Uint16: boxAccumulateRowChannels<uint16_t>(src, width, channels, factor, sums); break;
+	case Depth::Uint32: boxAccumulateRowChannels<uint32_t>(src, width, channels, factor, sums); break;
+	case Depth::Uint64: boxAccumulateRowChannels<uint64_t>(src, width, channels, factor, sums); break;
+	case Depth::Float32: boxAccumulateRowChannels<float>(src, width, channels, factor, sums); break;
+	case Depth::Float64: boxAccumulateRowChannels<double>(src, width, channels, factor, sums); break;
+	default:
+		assert(false && "Invalid depth");
+		break;
+	}
+}
+
+FSI_INLINE_HPP
+void fsi::proc::boxStoreRow(double* sums, uint64_t srcWidth, uint64_t channels, Depth depth,
+	uint32_t factor, uint64_t rows, uint8_t* dst)
+{
+	switch (depth)
+	{
+	case Depth::Int8: boxStoreRow<int8_t>(sums, srcWidth, channels, factor, rows, dst); break;
+	case Depth::Int16: boxStoreRow<int16_t>(sums, srcWidth, channels, factor, rows, dst); break;
+	case Depth::Int32: boxStoreRow<int32_t>(sums, srcWidth, channels, factor, rows, dst); break;
+	case Depth::Int64: boxStoreRow<int64_t>(sums, srcWidth, channels, factor, rows, dst); break;
+	case Depth::Uint8: boxStoreRow<uint8_t>(sums, srcWidth, channels, factor, rows, dst); break;
+	case Depth::Uint16: boxStoreRow<uint16_t>(sums, srcWidth, channels, factor, rows, dst); break;
+	case Depth::Uint32: boxStoreRow<uint32_t>(sums, srcWidth, channels, factor, rows, dst); break;
+	case Depth::Uint64: boxStoreRow<uint64_t>(sums, srcWidth, channels, factor, rows, dst); break;
+	case Depth::Float32: boxStoreRow<float>(sums, srcWidth, channels, factor, rows, dst); break;
+	case Depth::Float64: boxStoreRow<double>(sums, srcWidth, channels, factor, rows, dst); break;
+	default:
+		assert(false && "Invalid depth");
+		break;
+	}
 }
\ No newline at end of file
@@ -9,8 +9,12 @@
 
 #include "proc.h"
 #include "consts.h"
+#include "Executor.h"
 #include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <limits>
+#include <type_traits>
 
 template <typename Src_T, size_t Dst_C>
 inline
@@ -70,101 +74,104 @@ void fsi::proc::generateThumbnail(const uint8_t* srcData, uint64_t srcWidth, uin
 	const int64_t kernel_height = round(height_factor);
 	const double kernel_size = static_cast<double>(kernel_width*kernel_height);
 
-#pragma omp parallel for
-	for (int64_t dst_y = 0; dst_y < dst_H; dst_y++)
+	executor()->parallelFor(0, dst_H, 1, [&](int64_t dst_y_begin, int64_t dst_y_end)
 	{
-		int64_t src_y = static_cast<int64_t>(floor(dst_y * height_factor));
-		src_y = min(src_y, src_H - 1);
-
-		for (int64_t dst_x = 0; dst_x < dst_W; dst_x++)
+		for (int64_t dst_y = dst_y_begin; dst_y < dst_y_end; dst_y++)
 		{
-			int64_t src_x = static_cast<int64_t>(floor(dst_x * width_factor));
-			src_x = min(src_x, src_W - 1);
-
-			const int64_t dst_idx = dst_y*dst_S + dst_x*Dst_C;
-
-			assert((dst_idx >= 0) && "dst out of range");
-			assert((dst_idx < dst_end) && "dst out of range");
-
-			Vec4 result;
-			result = sampleChannels<Src_T, Dst_C>(src_ptr, src_y, src_x, src_H, src_W, src_S, src_C,
-				src_end, kernel_width, kernel_height, kernel_size);
-
-			Dst_T result_cvt_r;
-			Dst_T result_cvt_g;
-			Dst_T result_cvt_b;
-			Dst_T result_cvt_a;
+			int64_t src_y = static_cast<int64_t>(floor(dst_y * height_factor));
+			src_y = min(src_y, src_H - 1);
 
-			switch (src_C)
+			for (int64_t dst_x = 0; dst_x < dst_W; dst_x++)
 			{
-				case 1:
-				{
-					result.r = clamp(remap(result.r, src_min, src_max, dst_min, dst_max),
-						dst_min, dst_max);
+				int64_t src_x = static_cast<int64_t>(floor(dst_x * width_factor));
+				src_x = min(src_x, src_W - 1);
 
-					result_cvt_r = static_cast<Dst_T>(result.r);
-					result_cvt_g = static_cast<Dst_T>(result.r);
-					result_cvt_b = static_cast<Dst_T>(result.r);
-					result_cvt_a = static_cast<Dst_T>(dst_max);
+				const int64_t dst_idx = dst_y*dst_S + dst_x*Dst_C;
 
-					break;
-				}
-				case 2:
-				{
-					result.r = clamp(remap(result.r, src_min, src_max, dst_min, dst_max),
-						dst_min, dst_max);
-					result.g = clamp(remap(result.g, src_min, src_max, dst_min, dst_max),
-						dst_min, dst_max);
+				assert((dst_idx >= 0) && "dst out of range");
+				assert((dst_idx < dst_end) && "dst out of range");
 
-					result_cvt_r = static_cast<Dst_T>(result.r);
-					result_cvt_g = static_cast<Dst_T>(result.g);
-					result_cvt_b = static_cast<Dst_T>(dst_min);
-					result_cvt_a = static_cast<Dst_T>(dst_max);
+				Vec4 result;
+				result = sampleChannels<Src_T, Dst_C>(src_ptr, src_y, src_x, src_H, src_W, src_S, src_C,
+					src_end, kernel_width, kernel_height, kernel_size);
 
-					break;
-				}
-				case 3:
-				{
-					result.r = clamp(remap(result.r, src_min, src_max, dst_min, dst_max),
-						dst_min, dst_max);
-					result.g = clamp(remap(result.g, src_min, src_max, dst_min, dst_max),
-						dst_min, dst_max);
-					result.b = clamp(remap(result.b, src_min, src_max, dst_min, dst_max),
-						dst_min, dst_max);
-
-					result_cvt_r = static_cast<Dst_T>(result.r);
-					result_cvt_g = static_cast<Dst_T>(result.g);
-					result_cvt_b = static_cast<Dst_T>(result.b);
-					result_cvt_a = static_cast<Dst_T>(dst_max);
-
-					break;
-				}
-				case 4:
+				Dst_T result_cvt_r;
+				Dst_T result_cvt_g;
+				Dst_T result_cvt_b;
+				Dst_T result_cvt_a;
+
+				switch (src_C)
 				{
-					result.r = clamp(remap(result.r, src_min, src_max, dst_min, dst_max),
-						dst_min, dst_max);
-					result.g = clamp(remap(result.g, src_min, src_max, dst_min, dst_max),
-						dst_min, dst_max);
-					result.b = clamp(remap(result.b, src_min, src_max, dst_min, dst_max),
-						dst_min, dst_max);
-					result.a = clamp(remap(result.a, src_min, src_max, dst_min, dst_max),
-						dst_min, dst_max);
-
-					result_cvt_r = static_cast<Dst_T>(result.r);
-					result_cvt_g = static_cast<Dst_T>(result.g);
-					result_cvt_b = static_cast<Dst_T>(result.b);
-					result_cvt_a = static_cast<Dst_T>(result.a);
-
-					break;
+					case 1:
+					{
+						result.r = clamp(remap(result.r, src_min, src_max, dst_min, dst_max),
+							dst_min, dst_max);
+
+						result_cvt_r = static_cast<Dst_T>(result.r);
+						result_cvt_g = static_cast<Dst_T>(result.r);
+						result_cvt_b = static_cast<Dst_T>(result.r);
+						result_cvt_a = static_cast<Dst_T>(dst_max);
+
+						break;
+					}
+					case 2:
+					{
+						result.r = clamp(remap(result.r, src_min, src_max, dst_min, dst_max),
+							dst_min, dst_max);
+						result.g = clamp(remap(result.g, src_min, src_max, dst_min, dst_max),
+							dst_min, dst_max);
+
+						result_cvt_r = static_cast<Dst_T>(result.r);
+						result_cvt_g = static_cast<Dst_T>(result.g);
+						result_cvt_b = static_cast<Dst_T>(dst_min);
+						result_cvt_a = static_cast<Dst_T>(dst_max);
+
+						break;
+					}
+					case 3:
+					{
+						result.r = clamp(remap(result.r, src_min, src_max, dst_min, dst_max),
+							dst_min, dst_max);
+						result.g = clamp(remap(result.g, src_min, src_max, dst_min, dst_max),
+							dst_min, dst_max);
+						result.b = clamp(remap(result.b, src_min, src_max, dst_min, dst_max),
+							dst_min, dst_max);
+
+						result_cvt_r = static_cast<Dst_T>(result.r);
+						result_cvt_g = static_cast<Dst_T>(result.g);
+						result_cvt_b = static_cast<Dst_T>(result.b);
+						result_cvt_a = static_cast<Dst_T>(dst_max);
+
+						break;
+					}
+					default: // The first 4 channels of images with more
+					case 4:
+					{
+						result.r = clamp(remap(result.r, src_min, src_max, dst_min, dst_max),
+							dst_min, dst_max);
+						result.g = clamp(remap(result.g, src_min, src_max, dst_min, dst_max),
+							dst_min, dst_max);
+						result.b = clamp(remap(result.b, src_min, src_max, dst_min, dst_max),
+							dst_min, dst_max);
+						result.a = clamp(remap(result.a, src_min, src_max, dst_min, dst_max),
+							dst_min, dst_max);
+
+						result_cvt_r = static_cast<Dst_T>(result.r);
+						result_cvt_g = static_cast<Dst_T>(result.g);
+						result_cvt_b = static_cast<Dst_T>(result.b);
+						result_cvt_a = static_cast<Dst_T>(result.a);
+
+						break;
+					}
 				}
-			}
 
-			dst_ptr[dst_idx    ] = result_cvt_r;
-			dst_ptr[dst_idx + 1] = result_cvt_g;
-			dst_ptr[dst_idx + 2] = result_cvt_b;
-			dst_ptr[dst_idx + 3] = result_cvt_a;
+				dst_ptr[dst_idx    ] = result_cvt_r;
+				dst_ptr[dst_idx + 1] = result_cvt_g;
+				dst_ptr[dst_idx + 2] = result_cvt_b;
+				dst_ptr[dst_idx + 3] = result_cvt_a;
+			}
 		}
-	}
+	});
 }
 
 /*inline
@@ -298,4 +305,62 @@ inline
 T fsi::proc::remap(T src, T srcMin, T srcMax, T dstMin, T dstMax)
 {
 	return ((src - srcMin) / (srcMax - srcMin)) * (dstMax - dstMin) + dstMin;
+}
+
+template <typename T, uint64_t Channels>
+inline
+void fsi::proc::boxAccumulateRow(const uint8_t* src, uint64_t width, uint64_t runtimeChannels,
+	uint32_t factor, double* sums)
+{
+	// With a fixed channel count the inner loop is unrolled and the block sums vectorize
+	const uint64_t channels = Channels > 0 ? Channels : runtimeChannels;
+	const T* values = reinterpret_cast<const T*>(src);
+
+	for (uint64_t x0 = 0; x0 < width; x0 += factor)
+	{
+		const uint64_t x1 = std::min<uint64_t>(x0 + factor, width);
+		double* sum = sums + (x0 / factor) * channels;
+
+		for (uint64_t x = x0; x < x1; x++)
+		{
+			for (uint64_t c = 0; c < channels; c++)
+				sum[c] += static_cast<double>(values[x*channels + c]);
+		}
+	}
+}
+
+template <typename T>
+inline
+void fsi::proc::boxStoreRow(double* sums, uint64_t srcWidth, uint64_t channels, uint32_t factor,
+	uint64_t rows, uint8_t* dst)
+{
+	T* values = reinterpret_cast<T*>(dst);
+
+	for (uint64_t x0 = 0; x0 < srcWidth; x0 += factor)
+	{
+		const uint64_t blockWidth = std::min<uint64_t>(factor, srcWidth - x0);
+		const double scale = 1.0 / static_cast<double>(blockWidth * rows);
+		const uint64_t i0 = (x0 / factor) * channels;
+
+		for (uint64_t i = i0; i < i0 + channels; i++)
+		{
+			const double average = sums[i] * scale;
+			sums[i] = 0.0;
+
+			if constexpr (std::is_floating_point_v<T>)
+				values[i] = static_cast<T>(average);
+			else
+			{
+				// The average is within the range of T, but rounding the extremes of 64-bit integers
+				// in double can step outside of it
+				const double rounded = std::round(average);
+				if (rounded >= static_cast<double>(std::numeric_limits<T>::max()))
+					values[i] = std::numeric_limits<T>::max();
+				else if (rounded <= static_cast<double>(std::numeric_limits<T>::lowest()))
+					values[i] = std::numeric_limits<T>::lowest();
+				else
+					values[i] = static_cast<T>(rounded);
+			}
+		}
+	}
 }
\ No newline at end of file
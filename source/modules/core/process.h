@@ -0,0 +1,120 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include "fsi_core_exports.h"
+#include "../global.h"
+#include <cstdint>
+#include <functional>
+
+namespace fsi
+{
+	class Reader;
+	class Writer;
+	class OperationControl;
+
+	/** @brief How the halo is filled outside of the image.
+	*/
+	enum class HaloBorder
+	{
+		Clamp, // Repeats the nearest edge pixel
+		Zero
+	};
+
+	/** @brief A tile of a band handed to a ProcessKernel.
+	*
+	* The input pixel at tile coordinates (c, r) is at src + r*srcStride + c*pixelBytes, for r in
+	* [-haloY, height + haloY) and c in [-haloX, width + haloX). The output pixel is at
+	* dst + r*dstStride + c*pixelBytes for r in [0, height) and c in [0, width), in the channels and
+	* depth of the Writer.
+	*/
+	struct ProcessTile
+	{
+		const uint8_t* src = nullptr;
+
+		int64_t srcStride = 0;
+
+		/** @brief nullptr when there is no Writer.
+		*/
+		uint8_t* dst = nullptr;
+
+		int64_t dstStride = 0;
+
+		/** @brief Position and size of the tile in the image, without the halo.
+		*/
+		uint32_t x = 0;
+
+		uint32_t y = 0;
+
+		uint32_t width = 0;
+
+		uint32_t height = 0;
+
+		uint32_t haloX = 0;
+
+		uint32_t haloY = 0;
+	};
+
+	/** @brief Called concurrently for disjoint tiles, so it must not write shared state without
+	* synchronization.
+	*/
+	typedef std::function<void(const ProcessTile& tile)> ProcessKernel;
+
+	struct ProcessOptions
+	{
+		/** @brief Columns and rows of neighbors around every tile, e.g. the radius of a blur.
+		*/
+		uint32_t haloX = 0;
+
+		uint32_t haloY = 0;
+
+		HaloBorder border = HaloBorder::Clamp;
+
+		/** @brief Image rows per band. 0 picks about 16 * defaultBufferSize bytes for the input and
+		* output buffers.
+		*/
+		uint32_t bandHeight = 0;
+
+		/** @brief Size of the tiles a band is split into. 0 uses the whole band width, and for the
+		* height an even share of the band rows per worker.
+		*/
+		uint32_t tileWidth = 0;
+
+		uint32_t tileHeight = 0;
+
+		/** @brief Optional. Pauses, resumes or cancels the operation between bands.
+		*/
+		OperationControl* control = nullptr;
+	};
+
+	/** @brief Runs kernel over an image that doesn't need to fit in memory.
+	*
+	* The image is read with readRect() in row bands extended by the halo rows, with the halo columns
+	* added on both sides, and every band is split into tiles that run in parallel on fsi::executor().
+	* The next band is read while the current one is processed, so memory is two input bands.
+	*
+	* @param reader An open reader. It's only used through readRect(), so it stays usable afterwards.
+	* The bands are read in PixelLayout::Linear whatever the layout of its options.
+	* @return false if the operation was completed or true if it was canceled.
+	*/
+	FSI_CORE_API bool processBands(Reader& reader, const ProcessKernel& kernel,
+		const ProcessOptions& options = ProcessOptions());
+
+	/** @brief Like processBands() above, but the kernel also fills the pixels of an output image, which
+	* are streamed into writer with Writer::writeRows() while the next band is processed.
+	*
+	* @param writer Opened with the width and height of the input. The channels and depth may differ.
+	* If the operation is canceled the output is left incomplete.
+	*/
+	FSI_CORE_API bool processBands(Reader& reader, Writer& writer, const ProcessKernel& kernel,
+		const ProcessOptions& options = ProcessOptions());
+}
+
+#if FSI_HEADERONLY
+#include "process.hpp"
+#endif
\ No newline at end of file
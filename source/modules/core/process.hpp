@@ -0,0 +1,251 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include "process.h"
+#include "Reader.h"
+#include "Writer.h"
+#include "Executor.h"
+#include "MemoryGovernor.h"
+#include "OperationControl.h"
+#include "Trace.h"
+#include "consts.h"
+#include "exceptions.hpp"
+#include <cstring>
+#include <future>
+#include <memory>
+
+namespace fsi
+{
+	namespace detail
+	{
+		/** @brief Fills the halo of a band whose rows [validFirst, validFirst + validCount) were read
+		* into the middle columns.
+		*/
+		inline void fillHalo(uint8_t* band, uint64_t rowBytes, uint64_t rows, uint64_t pixelBytes,
+			uint64_t haloX, uint64_t width, uint64_t validFirst, uint64_t validCount, HaloBorder border)
+		{
+			const uint64_t haloBytes = haloX * pixelBytes;
+			const uint64_t rightOffset = haloBytes + width * pixelBytes;
+
+			if (haloX > 0)
+			{
+				for (uint64_t r = validFirst; r < validFirst + validCount; r++)
+				{
+					uint8_t* row = band + r * rowBytes;
+
+					if (border == HaloBorder::Zero)
+					{
+						std::memset(row, 0, haloBytes);
+						std::memset(row + rightOffset, 0, haloBytes);
+						continue;
+					}
+
+					for (uint64_t c = 0; c < haloX; c++)
+					{
+						std::memcpy(row + c * pixelBytes, row + haloBytes, pixelBytes);
+						std::memcpy(row + rightOffset + c * pixelBytes, row + rightOffset - pixelBytes, pixelBytes);
+					}
+				}
+			}
+
+			for (uint64_t r = 0; r < rows; r++)
+			{
+				if (r >= validFirst && r < validFirst + validCount)
+					continue;
+
+				uint8_t* row = band + r * rowBytes;
+
+				if (border == HaloBorder::Zero)
+					std::memset(row, 0, rowBytes);
+				else
+					std::memcpy(row, band + (r < validFirst ? validFirst : validFirst + validCount - 1) * rowBytes,
+						rowBytes);
+			}
+		}
+
+		/** @brief Returns true if control was canceled, after waiting while it's paused.
+		*/
+		inline bool waitForControl(OperationControl* control)
+		{
+			if (!control)
+				return false;
+
+			while (control->isPaused() && control->waitWhilePaused(100)) {}
+
+			return control->isCanceled();
+		}
+
+		inline bool processBands(Reader& reader, Writer* writer, const ProcessKernel& kernel,
+			const ProcessOptions& options)
+		{
+			const Header header = reader.header();
+
+			const uint64_t width = header.width;
+			const uint64_t height = header.height;
+			const uint64_t pixelBytes = header.channels * sizeOfDepth(header.depth);
+			const uint64_t haloX = options.haloX;
+			const uint64_t haloY = options.haloY;
+			const uint64_t srcRowBytes = (width + 2 * haloX) * pixelBytes;
+
+			uint64_t dstRowBytes = 0;
+			if (writer)
+			{
+				const Header dstHeader = writer->header();
+				if (dstHeader.width != header.width)
+					throw ExceptionInvalidImageWidth("The output must have the width of the input");
+				if (dstHeader.height != header.height)
+					throw ExceptionInvalidImageHeight("The output must have the height of the input");
+
+				dstRowBytes = width * dstHeader.channels * sizeOfDepth(dstHeader.depth);
+			}
+
+			// Bands much taller than the halo, so that rereading the halo rows stays cheap
+			const uint64_t desiredBandHeight = options.bandHeight > 0
+				? std::min<uint64_t>(options.bandHeight, height)
+				: std::clamp<uint64_t>(std::max(16 * defaultBufferSize / (2 * (srcRowBytes + dstRowBytes)), 4 * haloY),
+					1, height);
+
+			// Under a tight memory budget the bands shrink, though not below the halo, unless the band
+			// height was given
+			MemoryReservation memory;
+			const uint64_t bandHeight = memory.reserveRows(desiredBandHeight,
+				options.bandHeight > 0 ? desiredBandHeight : std::max<uint64_t>(haloY, 1),
+				2 * (srcRowBytes + dstRowBytes));
+			const uint64_t bandCount = (height + bandHeight - 1) / bandHeight;
+			const uint64_t tileWidth = options.tileWidth > 0 ? std::min<uint64_t>(options.tileWidth, width) : width;
+
+			auto bandRows = [&](uint64_t band) { return std::min(bandHeight, height - band * bandHeight); };
+
+			std::vector<uint8_t> srcBands[2];
+			std::vector<uint8_t> dstBands[2];
+
+			auto readBand = [&](uint64_t band, std::vector<uint8_t>& buffer)
+			{
+				const uint64_t rows = bandRows(band) + 2 * haloY;
+				const int64_t firstY = static_cast<int64_t>(band * bandHeight) - static_cast<int64_t>(haloY);
+				const uint64_t validY = static_cast<uint64_t>(std::max<int64_t>(firstY, 0));
+				const uint64_t validEnd = std::min<uint64_t>(firstY + rows, height);
+
+				buffer.resize(rows * srcRowBytes);
+				reader.readRect(buffer.data() + (validY - firstY) * srcRowBytes + haloX * pixelBytes, 0,
+					static_cast<uint32_t>(validY), static_cast<uint32_t>(width),
+					static_cast<uint32_t>(validEnd - validY), srcRowBytes, PixelLayout::Linear);
+
+				fillHalo(buffer.data(), srcRowBytes, rows, pixelBytes, haloX, width, validY - firstY,
+					validEnd - validY, options.border);
+			};
+
+			readBand(0, srcBands[0]);
+
+			std::future<void> writing;
+
+			for (uint64_t band = 0; band < bandCount; band++)
+			{
+				if (waitForControl(options.control))
+				{
+					if (writing.valid())
+						writing.get();
+					return true;
+				}
+
+				std::future<void> next;
+				if (band + 1 < bandCount)
+				{
+					auto task = std::make_shared<std::packaged_task<void()>>(
+						[&readBand, &srcBands, band]() { readBand(band + 1, srcBands[(band + 1) % 2]); });
+					next = task->get_future();
+					executor()->submit([task]() { (*task)(); });
+				}
+
+				const uint64_t rows = bandRows(band);
+				const uint8_t* src = srcBands[band % 2].data() + haloY * srcRowBytes + haloX * pixelBytes;
+				std::vector<uint8_t>& dst = dstBands[band % 2];
+				dst.resize(rows * dstRowBytes);
+
+				try
+				{
+					FSI_TRACE_ZONE("compute", "process band");
+
+					const int64_t grainRows = options.tileHeight > 0 ? options.tileHeight : 1;
+
+					executor()->parallelFor(0, static_cast<int64_t>(rows), grainRows, [&](int64_t rowBegin, int64_t rowEnd)
+					{
+						const int64_t tileHeight = options.tileHeight > 0 ? options.tileHeight : rowEnd - rowBegin;
+
+						for (int64_t tileY = rowBegin; tileY < rowEnd; tileY += tileHeight)
+						{
+							for (uint64_t tileX = 0; tileX < width; tileX += tileWidth)
+							{
+								ProcessTile tile;
+								tile.src = src + tileY * srcRowBytes + tileX * pixelBytes;
+								tile.srcStride = static_cast<int64_t>(srcRowBytes);
+								tile.dst = writer
+									? dst.data() + tileY * dstRowBytes + tileX * (dstRowBytes / width)
+									: nullptr;
+								tile.dstStride = static_cast<int64_t>(dstRowBytes);
+								tile.x = static_cast<uint32_t>(tileX);
+								tile.y = static_cast<uint32_t>(band * bandHeight + tileY);
+								tile.width = static_cast<uint32_t>(std::min(tileWidth, width - tileX));
+								tile.height = static_cast<uint32_t>(std::min<int64_t>(tileHeight, rowEnd - tileY));
+								tile.haloX = static_cast<uint32_t>(haloX);
+								tile.haloY = static_cast<uint32_t>(haloY);
+
+								kernel(tile);
+							}
+						}
+					});
+				}
+				catch (...)
+				{
+					// The read and write tasks use the other buffers
+					if (next.valid())
+						next.wait();
+					if (writing.valid())
+						writing.wait();
+					throw;
+				}
+
+				if (next.valid())
+					next.get();
+
+				if (writer)
+				{
+					if (writing.valid())
+						writing.get();
+
+					auto task = std::make_shared<std::packaged_task<void()>>(
+						[writer, &dst, rows]() { writer->writeRows(dst.data(), static_cast<uint32_t>(rows)); });
+					writing = task->get_future();
+					executor()->submit([task]() { (*task)(); });
+				}
+			}
+
+			if (writing.valid())
+				writing.get();
+
+			return false;
+		}
+	}
+}
+
+FSI_INLINE_HPP
+bool fsi::processBands(Reader& reader, const ProcessKernel& kernel, const ProcessOptions& options)
+{
+	FSI_TRACE_ZONE("api", "processBands");
+
+	return detail::processBands(reader, nullptr, kernel, options);
+}
+
+FSI_INLINE_HPP
+bool fsi::processBands(Reader& reader, Writer& writer, const ProcessKernel& kernel, const ProcessOptions& options)
+{
+	FSI_TRACE_ZONE("api", "processBands");
+
+	return detail::processBands(reader, &writer, kernel, options);
+}
\ No newline at end of file
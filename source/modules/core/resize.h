@@ -0,0 +1,61 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include "fsi_core_exports.h"
+#include "../global.h"
+#include "FormatVersion.h"
+#include <cstdint>
+#include <filesystem>
+
+namespace fsi
+{
+	/** @brief Resampling kernel of fsi::resize(). When downscaling the kernel is widened by the scale
+	* factor, so every source pixel contributes (Box becomes an area average).
+	*/
+	enum class ResizeFilter : uint32_t
+	{
+		Box = 0,
+		Bilinear = 1,
+		Lanczos3 = 2,
+	};
+
+	struct ResizeOptions
+	{
+		/** @brief Version of the output file.
+		*/
+		FormatVersion formatVersion = FormatVersion::Latest;
+
+		/** @brief Generates the thumbnail of the output (V2 only).
+		*/
+		bool thumbnail = true;
+
+		/** @brief Output rows per band. 0 picks a band height that reads about 4 * defaultBufferSize
+		* source bytes per band.
+		*/
+		uint32_t bandHeight = 0;
+	};
+
+	/** @brief Resizes an FSI file into a new one without loading either image.
+	*
+	* The output is produced in row bands. Each band reads the source rows under its vertical kernel
+	* with readRect(), resamples them horizontally and then vertically (separable), and is appended
+	* with Writer::writeRows(). Bands are computed in parallel on fsi::executor() while the previous
+	* ones are written, so memory is a few bands per thread and doesn't depend on the image height.
+	*
+	* The output has the channels and depth of the source. Integers are rounded and clamped, since
+	* Lanczos can overshoot.
+	*/
+	FSI_CORE_API void resize(const std::filesystem::path& srcPath, const std::filesystem::path& dstPath,
+		uint32_t width, uint32_t height, ResizeFilter filter = ResizeFilter::Lanczos3,
+		const ResizeOptions& options = ResizeOptions());
+}
+
+#if FSI_HEADERONLY
+#include "resize.hpp"
+#endif
\ No newline at end of file
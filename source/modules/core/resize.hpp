@@ -0,0 +1,229 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include "resize.h"
+#include "resize.tcc"
+#include "Reader.h"
+#include "Writer.h"
+#include "Executor.h"
+#include "MemoryGovernor.h"
+#include "Trace.h"
+#include "consts.h"
+#include "exceptions.hpp"
+#include <future>
+#include <memory>
+
+namespace fsi
+{
+	namespace detail
+	{
+		inline double resizeFilterSupport(ResizeFilter filter)
+		{
+			switch (filter)
+			{
+			case ResizeFilter::Box: return 0.5;
+			case ResizeFilter::Bilinear: return 1.0;
+			default: return 3.0;
+			}
+		}
+
+		inline double resizeFilterWeight(ResizeFilter filter, double x)
+		{
+			constexpr double pi = 3.14159265358979323846;
+
+			switch (filter)
+			{
+			case ResizeFilter::Box:
+				return x >= -0.5 && x < 0.5 ? 1.0 : 0.0;
+			case ResizeFilter::Bilinear:
+				return std::max(0.0, 1.0 - std::abs(x));
+			default:
+				if (x == 0.0)
+					return 1.0;
+				if (x <= -3.0 || x >= 3.0)
+					return 0.0;
+				return 3.0 * std::sin(pi * x) * std::sin(pi * x / 3.0) / (pi * pi * x * x);
+			}
+		}
+
+		/** @brief Taps of a srcSize to dstSize resampling. Pixel centers are aligned (x + 0.5), taps
+		* outside of the image are dropped and the remaining weights normalized.
+		*/
+		inline ResampleAxis resampleAxis(uint64_t srcSize, uint64_t dstSize, ResizeFilter filter)
+		{
+			const double scale = static_cast<double>(srcSize) / static_cast<double>(dstSize);
+			const double filterScale = std::max(scale, 1.0);
+			const double support = resizeFilterSupport(filter) * filterScale;
+
+			ResampleAxis axis;
+			axis.taps.resize(dstSize);
+
+			for (uint64_t i = 0; i < dstSize; i++)
+			{
+				const double center = (static_cast<double>(i) + 0.5) * scale;
+				const int64_t first = std::max<int64_t>(static_cast<int64_t>(center - support + 0.5), 0);
+				const int64_t last = std::min<int64_t>(static_cast<int64_t>(center + support + 0.5),
+					static_cast<int64_t>(srcSize));
+
+				ResampleAxis::Taps& taps = axis.taps[i];
+				taps.first = first;
+				taps.count = std::max<int64_t>(last - first, 1);
+				taps.offset = axis.weights.size();
+
+				double sum = 0.0;
+				for (int64_t k = 0; k < taps.count; k++)
+				{
+					const double x = (static_cast<double>(first + k) + 0.5 - center) / filterScale;
+					axis.weights.push_back(resizeFilterWeight(filter, x));
+					sum += axis.weights.back();
+				}
+
+				for (int64_t k = 0; k < taps.count; k++)
+					axis.weights[taps.offset + k] = sum != 0.0 ? axis.weights[taps.offset + k] / sum : 1.0 / taps.count;
+			}
+
+			return axis;
+		}
+
+		typedef void (*ResampleBandKernel)(const uint8_t* src, uint64_t srcRowSize, int64_t srcFirstRow,
+			int64_t srcRowCount, uint64_t channels, const ResampleAxis& horizontal, const ResampleAxis& vertical,
+			int64_t dstFirstRow, int64_t dstRowCount, uint8_t* dst);
+
+		inline ResampleBandKernel resampleBandKernel(Depth depth)
+		{
+			switch (depth)
+			{
+			case Depth::Int8: return &resampleBand<int8_t>;
+			case Depth::Int16: return &resampleBand<int16_t>;
+			case Depth::Int32: return &resampleBand<int32_t>;
+			case Depth::Int64: return &resampleBand<int64_t>;
+			case Depth::Uint8: return &resampleBand<uint8_t>;
+			case Depth::Uint16: return &resampleBand<uint16_t>;
+			case Depth::Uint32: return &resampleBand<uint32_t>;
+			case Depth::Uint64: return &resampleBand<uint64_t>;
+			case Depth::Float32: return &resampleBand<float>;
+			case Depth::Float64: return &resampleBand<double>;
+			default:
+				throw ExceptionInvalidImageDepth("Must be an integer between 1 and 10");
+			}
+		}
+	}
+}
+
+FSI_INLINE_HPP
+void fsi::resize(const std::filesystem::path& srcPath, const std::filesystem::path& dstPath, uint32_t width,
+	uint32_t height, ResizeFilter filter, const ResizeOptions& options)
+{
+	FSI_TRACE_ZONE("api", "resize");
+
+	Header srcHeader;
+	{
+		Reader reader;
+		reader.open(srcPath);
+		srcHeader = reader.header();
+	}
+
+	Header dstHeader;
+	dstHeader.width = width;
+	dstHeader.height = height;
+	dstHeader.channels = srcHeader.channels;
+	dstHeader.depth = srcHeader.depth;
+	dstHeader.hasThumb = options.thumbnail;
+
+	// Validates the output header before any work
+	Writer writer(options.formatVersion);
+	writer.open(dstPath, dstHeader);
+
+	const detail::ResampleBandKernel kernel = detail::resampleBandKernel(srcHeader.depth);
+	const detail::ResampleAxis horizontal = detail::resampleAxis(srcHeader.width, width, filter);
+	const detail::ResampleAxis vertical = detail::resampleAxis(srcHeader.height, height, filter);
+
+	const uint64_t channels = srcHeader.channels;
+	const uint64_t srcRowSize = static_cast<uint64_t>(srcHeader.width) * channels * sizeOfDepth(srcHeader.depth);
+	const uint64_t dstRowSize = static_cast<uint64_t>(width) * channels * sizeOfDepth(srcHeader.depth);
+	const double scaleY = std::max(1.0, static_cast<double>(srcHeader.height) / static_cast<double>(height));
+
+	// A group of bands is computed in parallel while the previous group is written
+	const int64_t groupSize = static_cast<int64_t>(executor()->concurrency()) + 1;
+
+	const uint64_t desiredBandHeight = options.bandHeight > 0
+		? std::min<uint64_t>(options.bandHeight, height)
+		: std::clamp<uint64_t>(static_cast<uint64_t>(4 * defaultBufferSize / (srcRowSize * scaleY)), 1, height);
+
+	// Fewer rows per band under a tight memory budget, unless the band height was given. Every band
+	// of a group holds its source rows, and the outputs of two groups are alive.
+	MemoryReservation memory;
+	const uint64_t bandHeight = memory.reserveRows(desiredBandHeight, options.bandHeight > 0 ? desiredBandHeight : 1,
+		static_cast<uint64_t>(groupSize) * (static_cast<uint64_t>(srcRowSize * scaleY) + 2 * dstRowSize));
+	const int64_t bands = static_cast<int64_t>((height + bandHeight - 1) / bandHeight);
+	std::vector<std::vector<uint8_t>> groups[2];
+	std::future<void> writing;
+
+	for (int64_t groupBegin = 0; groupBegin < bands; groupBegin += groupSize)
+	{
+		const int64_t groupEnd = std::min(groupBegin + groupSize, bands);
+		std::vector<std::vector<uint8_t>>& outputs = groups[(groupBegin / groupSize) % 2];
+		outputs.resize(groupEnd - groupBegin);
+
+		try
+		{
+			executor()->parallelFor(groupBegin, groupEnd, 1, [&](int64_t bandBegin, int64_t bandEnd)
+			{
+				// Readers can't be shared between threads
+				Reader reader;
+				reader.open(srcPath);
+
+				std::vector<uint8_t> src;
+
+				for (int64_t band = bandBegin; band < bandEnd; band++)
+				{
+					const int64_t dstFirstRow = band * static_cast<int64_t>(bandHeight);
+					const int64_t dstRowCount = std::min<int64_t>(bandHeight, height - dstFirstRow);
+
+					const detail::ResampleAxis::Taps& firstTaps = vertical.taps[dstFirstRow];
+					const detail::ResampleAxis::Taps& lastTaps = vertical.taps[dstFirstRow + dstRowCount - 1];
+					const int64_t srcFirstRow = firstTaps.first;
+					const int64_t srcRowCount = lastTaps.first + lastTaps.count - srcFirstRow;
+
+					src.resize(srcRowCount * srcRowSize);
+					reader.readRect(src.data(), 0, static_cast<uint32_t>(srcFirstRow), srcHeader.width,
+						static_cast<uint32_t>(srcRowCount));
+
+					FSI_TRACE_ZONE("compute", "resize band");
+
+					std::vector<uint8_t>& dst = outputs[band - groupBegin];
+					dst.resize(dstRowCount * dstRowSize);
+					kernel(src.data(), srcRowSize, srcFirstRow, srcRowCount, channels, horizontal, vertical,
+						dstFirstRow, dstRowCount, dst.data());
+				}
+			});
+		}
+		catch (...)
+		{
+			// The write task uses the other group
+			if (writing.valid())
+				writing.wait();
+			throw;
+		}
+
+		if (writing.valid())
+			writing.get();
+
+		auto task = std::make_shared<std::packaged_task<void()>>([&writer, &outputs, dstRowSize]()
+		{
+			for (const std::vector<uint8_t>& band : outputs)
+				writer.writeRows(band.data(), static_cast<uint32_t>(band.size() / dstRowSize));
+		});
+		writing = task->get_future();
+		executor()->submit([task]() { (*task)(); });
+	}
+
+	if (writing.valid())
+		writing.get();
+}
\ No newline at end of file
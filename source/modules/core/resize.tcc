@@ -0,0 +1,172 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include "resize.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+namespace fsi
+{
+	namespace detail
+	{
+		/** @brief Source pixels and weights of every output pixel along one axis.
+		*/
+		struct ResampleAxis
+		{
+			struct Taps
+			{
+				int64_t first = 0;
+				int64_t count = 0;
+				size_t offset = 0; // Into weights
+			};
+
+			std::vector<Taps> taps;
+			std::vector<double> weights;
+		};
+
+		/** @brief 8 and 16-bit integers and floats are accumulated in float, which halves the
+		* scratch memory and doubles the vector width. Wider types need double.
+		*/
+		template <typename T>
+		using ResampleAccumulator = std::conditional_t<
+			(std::is_integral_v<T> && sizeof(T) <= 2) || std::is_same_v<T, float>, float, double>;
+
+		/** @brief Resamples one packed row horizontally into dst (axis.taps.size() pixels).
+		*
+		* Channels is 0 when the count is only known at runtime. With a fixed count the channel loop
+		* is unrolled.
+		*/
+		template <typename T, uint64_t Channels>
+		void resampleRow(const uint8_t* src, ResampleAccumulator<T>* dst, const ResampleAxis& axis,
+			uint64_t runtimeChannels);
+
+		/** @brief Resamples the horizontally resampled rows of a band vertically and stores them as T.
+		*
+		* @param rows The horizontally resampled rows, starting at source row rowsFirst.
+		* @param dst dstRowCount packed output rows starting at output row dstFirstRow.
+		*/
+		template <typename T>
+		void resampleColumns(const ResampleAccumulator<T>* rows, int64_t rowsFirst, uint64_t rowValues,
+			const ResampleAxis& axis, int64_t dstFirstRow, int64_t dstRowCount, uint8_t* dst);
+
+		/** @brief Resamples srcRowCount packed source rows, starting at source row srcFirstRow, into
+		* dstRowCount output rows starting at output row dstFirstRow.
+		*/
+		template <typename T>
+		void resampleBand(const uint8_t* src, uint64_t srcRowSize, int64_t srcFirstRow, int64_t srcRowCount,
+			uint64_t channels, const ResampleAxis& horizontal, const ResampleAxis& vertical,
+			int64_t dstFirstRow, int64_t dstRowCount, uint8_t* dst);
+	}
+}
+
+template <typename T, uint64_t Channels>
+inline
+void fsi::detail::resampleRow(const uint8_t* src, ResampleAccumulator<T>* dst, const ResampleAxis& axis,
+	uint64_t runtimeChannels)
+{
+	typedef ResampleAccumulator<T> Acc;
+
+	const uint64_t channels = Channels > 0 ? Channels : runtimeChannels;
+	const T* values = reinterpret_cast<const T*>(src);
+
+	for (size_t x = 0; x < axis.taps.size(); x++)
+	{
+		const ResampleAxis::Taps& taps = axis.taps[x];
+		const double* weights = axis.weights.data() + taps.offset;
+
+		Acc* out = dst + x * channels;
+		for (uint64_t c = 0; c < channels; c++)
+			out[c] = 0;
+
+		for (int64_t k = 0; k < taps.count; k++)
+		{
+			const Acc weight = static_cast<Acc>(weights[k]);
+			const T* pixel = values + (taps.first + k) * channels;
+
+			for (uint64_t c = 0; c < channels; c++)
+				out[c] += weight * static_cast<Acc>(pixel[c]);
+		}
+	}
+}
+
+template <typename T>
+inline
+void fsi::detail::resampleColumns(const ResampleAccumulator<T>* rows, int64_t rowsFirst,
+	uint64_t rowValues, const ResampleAxis& axis, int64_t dstFirstRow, int64_t dstRowCount, uint8_t* dst)
+{
+	typedef ResampleAccumulator<T> Acc;
+
+	std::vector<Acc> sums(rowValues);
+	T* out = reinterpret_cast<T*>(dst);
+
+	for (int64_t y = 0; y < dstRowCount; y++)
+	{
+		const ResampleAxis::Taps& taps = axis.taps[dstFirstRow + y];
+		const double* weights = axis.weights.data() + taps.offset;
+
+		std::fill(sums.begin(), sums.end(), Acc(0));
+
+		// Whole rows at a time, so the inner loop is a contiguous multiply-add
+		for (int64_t k = 0; k < taps.count; k++)
+		{
+			const Acc weight = static_cast<Acc>(weights[k]);
+			const Acc* row = rows + (taps.first + k - rowsFirst) * rowValues;
+
+			for (uint64_t i = 0; i < rowValues; i++)
+				sums[i] += weight * row[i];
+		}
+
+		T* outRow = out + y * rowValues;
+		for (uint64_t i = 0; i < rowValues; i++)
+		{
+			if constexpr (std::is_floating_point_v<T>)
+				outRow[i] = static_cast<T>(sums[i]);
+			else
+			{
+				const double value = std::round(static_cast<double>(sums[i]));
+				if (value >= static_cast<double>(std::numeric_limits<T>::max()))
+					outRow[i] = std::numeric_limits<T>::max();
+				else if (value <= static_cast<double>(std::numeric_limits<T>::lowest()))
+					outRow[i] = std::numeric_limits<T>::lowest();
+				else
+					outRow[i] = static_cast<T>(value);
+			}
+		}
+	}
+}
+
+template <typename T>
+inline
+void fsi::detail::resampleBand(const uint8_t* src, uint64_t srcRowSize, int64_t srcFirstRow,
+	int64_t srcRowCount, uint64_t channels, const ResampleAxis& horizontal, const ResampleAxis& vertical,
+	int64_t dstFirstRow, int64_t dstRowCount, uint8_t* dst)
+{
+	typedef ResampleAccumulator<T> Acc;
+
+	void (*rowKernel)(const uint8_t*, Acc*, const ResampleAxis&, uint64_t);
+	switch (channels)
+	{
+	case 1: rowKernel = &resampleRow<T, 1>; break;
+	case 2: rowKernel = &resampleRow<T, 2>; break;
+	case 3: rowKernel = &resampleRow<T, 3>; break;
+	case 4: rowKernel = &resampleRow<T, 4>; break;
+	default: rowKernel = &resampleRow<T, 0>; break;
+	}
+
+	const uint64_t rowValues = horizontal.taps.size() * channels;
+	std::vector<Acc> rows(static_cast<uint64_t>(srcRowCount) * rowValues);
+
+	for (int64_t y = 0; y < srcRowCount; y++)
+		rowKernel(src + y * srcRowSize, rows.data() + y * rowValues, horizontal, channels);
+
+	resampleColumns<T>(rows.data(), srcFirstRow, rowValues, vertical, dstFirstRow, dstRowCount, dst);
+}
\ No newline at end of file
@@ -0,0 +1,96 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include "fsi_core_exports.h"
+#include "../global.h"
+#include "Header.h"
+#include <cstdint>
+#include <vector>
+
+namespace fsi { class Reader; struct StatsOptions; struct ChannelStats; struct ImageStats; }
+
+struct fsi::StatsOptions
+{
+	/** @brief Number of histogram bins per channel. 0 disables the histograms.
+	*/
+	uint32_t histogramBins = 256;
+
+	/** @brief Range covered by the bins. When histogramMin >= histogramMax the range is the full range
+	* of the depth for 8 and 16-bit integers and [0, 1] otherwise.
+	*/
+	double histogramMin = 0.0;
+
+	double histogramMax = 0.0;
+
+	/** @brief Reads only one of every sampleEvery row bands, for a fast approximate answer. 1 reads
+	* every band.
+	*/
+	uint32_t sampleEvery = 1;
+
+	/** @brief Rows per band. 0 picks about defaultBufferSize bytes per band.
+	*/
+	uint32_t bandHeight = 0;
+};
+
+struct fsi::ChannelStats
+{
+	/** @brief Statistics of the finite values. NaN and Inf are only counted.
+	*/
+	double min = 0.0;
+
+	double max = 0.0;
+
+	double mean = 0.0;
+
+	double stddev = 0.0;
+
+	uint64_t finiteCount = 0;
+
+	uint64_t nanCount = 0;
+
+	uint64_t infCount = 0;
+
+	/** @brief Finite values per bin. Values outside the range go to underflow/overflow.
+	*/
+	std::vector<uint64_t> histogram;
+
+	uint64_t underflow = 0;
+
+	uint64_t overflow = 0;
+};
+
+struct fsi::ImageStats
+{
+	std::vector<ChannelStats> channels;
+
+	double histogramMin = 0.0;
+
+	double histogramMax = 0.0;
+
+	/** @brief Rows that were read. Less than the image height in sampled mode.
+	*/
+	uint64_t sampledRows = 0;
+};
+
+namespace fsi
+{
+	/** @brief Computes per-channel statistics and histograms of an open Reader.
+	*
+	* The data section is streamed in row bands with readRect(), so memory stays at two bands: the
+	* next band is read on fsi::executor() while the rows of the current one are reduced in parallel.
+	*
+	* @param reader An open reader. It's only used through readRect(), so it stays usable afterwards.
+	* The bands are read in PixelLayout::Linear whatever the layout of its options.
+	*/
+	FSI_CORE_API ImageStats computeStats(Reader& reader, const StatsOptions& options = StatsOptions());
+}
+
+#if FSI_HEADERONLY
+#include "stats.hpp"
+#endif
\ No newline at end of file
@@ -0,0 +1,198 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include "stats.h"
+#include "stats.tcc"
+#include "Reader.h"
+#include "Executor.h"
+#include "MemoryGovernor.h"
+#include "Trace.h"
+#include "consts.h"
+#include "exceptions.hpp"
+#include <cmath>
+#include <future>
+#include <memory>
+#include <mutex>
+
+namespace fsi
+{
+	namespace detail
+	{
+		typedef void (*StatsKernel)(const uint8_t* data, uint64_t pixelCount, uint64_t runtimeChannels,
+			double histogramMin, double histogramMax, StatsAccumulator& acc);
+
+		template <typename T>
+		inline StatsKernel statsKernel(uint64_t channels)
+		{
+			switch (channels)
+			{
+			case 1: return &accumulateStats<T, 1>;
+			case 2: return &accumulateStats<T, 2>;
+			case 3: return &accumulateStats<T, 3>;
+			case 4: return &accumulateStats<T, 4>;
+			default: return &accumulateStats<T, 0>;
+			}
+		}
+
+		inline StatsKernel statsKernel(Depth depth, uint64_t channels)
+		{
+			switch (depth)
+			{
+			case Depth::Int8: return statsKernel<int8_t>(channels);
+			case Depth::Int16: return statsKernel<int16_t>(channels);
+			case Depth::Int32: return statsKernel<int32_t>(channels);
+			case Depth::Int64: return statsKernel<int64_t>(channels);
+			case Depth::Uint8: return statsKernel<uint8_t>(channels);
+			case Depth::Uint16: return statsKernel<uint16_t>(channels);
+			case Depth::Uint32: return statsKernel<uint32_t>(channels);
+			case Depth::Uint64: return statsKernel<uint64_t>(channels);
+			case Depth::Float32: return statsKernel<float>(channels);
+			case Depth::Float64: return statsKernel<double>(channels);
+			default:
+				throw ExceptionInvalidImageDepth("Must be an integer between 1 and 10");
+			}
+		}
+
+		// One bin per value for 8 and 16-bit integers (the upper bound is exclusive there), [0, 1]
+		// otherwise
+		inline void defaultHistogramRange(Depth depth, double& min, double& max)
+		{
+			switch (depth)
+			{
+			case Depth::Int8: min = -128.0; max = 128.0; break;
+			case Depth::Uint8: min = 0.0; max = 256.0; break;
+			case Depth::Int16: min = -32768.0; max = 32768.0; break;
+			case Depth::Uint16: min = 0.0; max = 65536.0; break;
+			default: min = 0.0; max = 1.0; break;
+			}
+		}
+	}
+}
+
+FSI_INLINE_HPP
+fsi::ImageStats fsi::computeStats(Reader& reader, const StatsOptions& options)
+{
+	FSI_TRACE_ZONE("api", "computeStats");
+
+	const Header header = reader.header();
+
+	const uint64_t width = header.width;
+	const uint64_t height = header.height;
+	const uint64_t channels = header.channels;
+	const uint64_t rowSize = width * channels * sizeOfDepth(header.depth);
+
+	const detail::StatsKernel kernel = detail::statsKernel(header.depth, channels);
+
+	ImageStats stats;
+	stats.histogramMin = options.histogramMin;
+	stats.histogramMax = options.histogramMax;
+	if (stats.histogramMin >= stats.histogramMax)
+		detail::defaultHistogramRange(header.depth, stats.histogramMin, stats.histogramMax);
+
+	const uint64_t desiredBandHeight = options.bandHeight > 0
+		? std::min<uint64_t>(options.bandHeight, height)
+		: std::clamp<uint64_t>(defaultBufferSize / rowSize, 1, height);
+
+	// Fewer rows per band under a tight memory budget, unless the band height was given or the bands
+	// are sampled, which depends on their height
+	MemoryReservation memory;
+	const bool fixedBands = options.bandHeight > 0 || options.sampleEvery > 1;
+	const uint64_t bandHeight = memory.reserveRows(desiredBandHeight, fixedBands ? desiredBandHeight : 1, 2 * rowSize);
+	const uint64_t bandCount = (height + bandHeight - 1) / bandHeight;
+	const uint64_t sampleEvery = std::max<uint32_t>(options.sampleEvery, 1);
+
+	std::vector<uint64_t> bands;
+	for (uint64_t band = 0; band < bandCount; band += sampleEvery)
+		bands.push_back(band);
+
+	detail::StatsAccumulator total(channels, options.histogramBins);
+	std::mutex mutex;
+
+	// Double buffering: the next band is read on the executor while the current one is reduced
+	std::vector<uint8_t> buffers[2];
+	auto bandRows = [&](uint64_t band) { return std::min(bandHeight, height - band * bandHeight); };
+	auto readBand = [&](uint64_t band, std::vector<uint8_t>& buffer)
+	{
+		buffer.resize(bandRows(band) * rowSize);
+		reader.readRect(buffer.data(), 0, static_cast<uint32_t>(band * bandHeight),
+			static_cast<uint32_t>(width), static_cast<uint32_t>(bandRows(band)), rowSize, PixelLayout::Linear);
+	};
+
+	if (!bands.empty())
+		readBand(bands[0], buffers[0]);
+
+	// At least 64k values per task so the partial histograms stay cheap to merge
+	const int64_t grainRows = static_cast<int64_t>(std::max<uint64_t>(1, 65536 / (width * channels)));
+
+	for (size_t i = 0; i < bands.size(); i++)
+	{
+		std::future<void> next;
+		if (i + 1 < bands.size())
+		{
+			auto task = std::make_shared<std::packaged_task<void()>>(
+				[&readBand, &buffers, &bands, i]() { readBand(bands[i + 1], buffers[(i + 1) % 2]); });
+			next = task->get_future();
+			executor()->submit([task]() { (*task)(); });
+		}
+
+		try
+		{
+			FSI_TRACE_ZONE("compute", "stats band");
+
+			const uint8_t* band = buffers[i % 2].data();
+			const int64_t rows = static_cast<int64_t>(bandRows(bands[i]));
+
+			executor()->parallelFor(0, rows, grainRows, [&](int64_t rowBegin, int64_t rowEnd)
+			{
+				detail::StatsAccumulator partial(channels, options.histogramBins);
+				kernel(band + rowBegin * rowSize, (rowEnd - rowBegin) * width, channels,
+					stats.histogramMin, stats.histogramMax, partial);
+
+				std::lock_guard<std::mutex> lock(mutex);
+				total.merge(partial);
+			});
+
+			stats.sampledRows += rows;
+		}
+		catch (...)
+		{
+			// The read task uses the buffers
+			if (next.valid())
+				next.wait();
+			throw;
+		}
+
+		if (next.valid())
+			next.get();
+	}
+
+	stats.channels.resize(channels);
+	for (uint64_t c = 0; c < channels; c++)
+	{
+		const detail::StatsAccumulator::Channel& acc = total.channels[c];
+		ChannelStats& channel = stats.channels[c];
+
+		if (acc.finiteCount > 0)
+		{
+			channel.min = acc.min;
+			channel.max = acc.max;
+			channel.mean = acc.mean;
+			channel.stddev = std::sqrt(acc.m2 / static_cast<double>(acc.finiteCount));
+		}
+
+		channel.finiteCount = acc.finiteCount;
+		channel.nanCount = acc.nanCount;
+		channel.infCount = acc.infCount;
+		channel.histogram = acc.histogram;
+		channel.underflow = acc.underflow;
+		channel.overflow = acc.overflow;
+	}
+
+	return stats;
+}
\ No newline at end of file
@@ -0,0 +1,371 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include "stats.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+namespace fsi
+{
+	namespace detail
+	{
+		/** @brief Partial statistics of a set of pixels. Partials of disjoint sets are combined with
+		* merge() (Chan et al. for the variance), so bands and threads can be reduced in any order.
+		*/
+		struct StatsAccumulator
+		{
+			struct Channel
+			{
+				double min = std::numeric_limits<double>::infinity();
+				double max = -std::numeric_limits<double>::infinity();
+				double mean = 0.0;
+				double m2 = 0.0; // Sum of squared deviations from the mean
+				uint64_t finiteCount = 0;
+				uint64_t nanCount = 0;
+				uint64_t infCount = 0;
+				uint64_t underflow = 0;
+				uint64_t overflow = 0;
+				std::vector<uint64_t> histogram;
+			};
+
+			std::vector<Channel> channels;
+
+			StatsAccumulator(uint64_t channelCount, uint32_t bins)
+				: channels(channelCount)
+			{
+				for (Channel& channel : channels)
+					channel.histogram.assign(bins, 0);
+			}
+
+			void merge(const StatsAccumulator& other)
+			{
+				for (size_t c = 0; c < channels.size(); c++)
+					merge(channels[c], other.channels[c]);
+			}
+
+			static void merge(Channel& a, const Channel& b)
+			{
+				mergeMoments(a, b);
+
+				a.underflow += b.underflow;
+				a.overflow += b.overflow;
+				for (size_t i = 0; i < a.histogram.size(); i++)
+					a.histogram[i] += b.histogram[i];
+			}
+
+			/** @brief merge() without the histograms, for partials that count them elsewhere.
+			*/
+			static void mergeMoments(Channel& a, const Channel& b)
+			{
+				if (b.finiteCount > 0)
+				{
+					const double na = static_cast<double>(a.finiteCount);
+					const double nb = static_cast<double>(b.finiteCount);
+					const double n = na + nb;
+					const double delta = b.mean - a.mean;
+
+					a.mean += delta * nb / n;
+					a.m2 += b.m2 + delta * delta * na * nb / n;
+					a.min = std::min(a.min, b.min);
+					a.max = std::max(a.max, b.max);
+					a.finiteCount += b.finiteCount;
+				}
+
+				a.nanCount += b.nanCount;
+				a.infCount += b.infCount;
+			}
+		};
+
+		/** @brief Value helpers of the statistics kernels. Sum adds up values exactly for integers up to
+		* 32 bits, in double otherwise.
+		*
+		* Floating-point values are classified from their bit patterns and the results selected with
+		* masks of all ones: selects on comparisons stay branches in the compiler and keep the loops
+		* from vectorizing.
+		*/
+		template <typename T>
+		struct StatsTraits
+		{
+			typedef std::conditional_t<std::is_floating_point_v<T> || sizeof(T) == 8, double,
+				std::conditional_t<std::is_signed_v<T>, int64_t, uint64_t>> Sum;
+
+			typedef std::conditional_t<sizeof(T) == 8, uint64_t, uint32_t> Bits;
+
+			// All ones when the value is finite. Integers always are.
+			static Bits finiteMask(T value)
+			{
+				if constexpr (std::is_floating_point_v<T>)
+					return -static_cast<Bits>((bits(value) & ~sign) < infinity);
+				else
+					return ~Bits(0);
+			}
+
+			static Bits nan(T value) { return (bits(value) & ~sign) > infinity; }
+
+			static Bits inf(T value) { return (bits(value) & ~sign) == infinity; }
+
+			// value where mask is all ones, otherwise the value with the bits of otherwise
+			static T select(T value, Bits mask, Bits otherwise)
+			{
+				if constexpr (std::is_integral_v<T>)
+					return value;
+
+				const Bits result = (bits(value) & mask) | (otherwise & ~mask);
+				T out;
+				std::memcpy(&out, &result, sizeof(T));
+				return out;
+			}
+
+			static Bits bits(T value)
+			{
+				Bits result;
+				std::memcpy(&result, &value, sizeof(T));
+				return result;
+			}
+
+			static constexpr Bits sign = Bits(1) << (sizeof(T) * 8 - 1);
+			static constexpr Bits infinity = sizeof(T) == 4 ? Bits(0x7f800000) : Bits(0x7ff0000000000000);
+		};
+
+		/** @brief Adds packed pixels to acc. Channels is 0 when the count is only known at runtime.
+		*
+		* The pixels go in blocks that stay in the L1 cache. The range, sum and NaN/Inf counts, then the
+		* squared deviations around the mean of the block, are taken in loops without branches over
+		* per-lane accumulators, where lanes span whole pixels so they keep the channels apart. With -O3
+		* these vectorize for 8 to 32-bit integers and floats, and for Float64 on targets with 64-bit
+		* integer comparisons (SSE4.2 on x86-64); 64-bit integers stay scalar, as they only convert to
+		* double one at a time before AVX-512.
+		*
+		* The histogram is filled in a separate scalar pass, as a scatter doesn't vectorize. 8-bit
+		* values are counted as they are and binned once at the end.
+		*/
+		template <typename T, uint64_t Channels>
+		void accumulateStats(const uint8_t* data, uint64_t pixelCount, uint64_t runtimeChannels,
+			double histogramMin, double histogramMax, StatsAccumulator& acc);
+	}
+}
+
+template <typename T, uint64_t Channels>
+inline
+void fsi::detail::accumulateStats(const uint8_t* data, uint64_t pixelCount, uint64_t runtimeChannels,
+	double histogramMin, double histogramMax, StatsAccumulator& acc)
+{
+	typedef StatsTraits<T> Traits;
+	typedef typename Traits::Sum Sum;
+	typedef typename Traits::Bits Bits;
+
+	const uint64_t channels = Channels > 0 ? Channels : runtimeChannels;
+	const T* values = reinterpret_cast<const T*>(data);
+
+	// With a fixed channel count the lanes are 16 pixels, otherwise one pixel
+	constexpr uint64_t FixedLanes = Channels * 16;
+	const uint64_t lanes = Channels > 0 ? FixedLanes : channels;
+	const uint64_t blockPixels = Channels > 0 ? 256 : std::max<uint64_t>(1, 4096 / channels);
+
+	std::vector<T> laneMin(lanes);
+	std::vector<T> laneMax(lanes);
+	std::vector<Sum> laneSum(lanes);
+	std::vector<Bits> laneNaN(lanes);
+	std::vector<Bits> laneInf(lanes);
+	std::vector<double> laneMean(lanes);
+	std::vector<double> laneM2(lanes);
+
+	// Histogram counts per channel: underflow, the bins, then overflow
+	const uint64_t bins = acc.channels[0].histogram.size();
+	const uint64_t slots = bins + 2;
+	const double histogramScale = bins > 0
+		? static_cast<double>(bins) / (histogramMax - histogramMin)
+		: 0.0;
+	std::vector<uint64_t> histograms(channels * slots, 0);
+
+	auto addToHistogram = [&](uint64_t* counts, double v, uint64_t count)
+	{
+		const double position = (v - histogramMin) * histogramScale;
+		if (position < 0.0)
+			counts[0] += count;
+		else if (position < static_cast<double>(bins))
+			counts[static_cast<uint64_t>(position) + 1] += count;
+		else if (v <= histogramMax)
+			counts[bins] += count; // The range is closed at the top
+		else
+			counts[bins + 1] += count;
+	};
+
+	constexpr bool CountValues = sizeof(T) == 1;
+	std::vector<uint64_t> valueCounts(CountValues && bins > 0 ? channels * 256 : 0, 0);
+
+	std::vector<StatsAccumulator::Channel> blockChannels(channels);
+
+	for (uint64_t firstPixel = 0; firstPixel < pixelCount; firstPixel += blockPixels)
+	{
+		const T* block = values + firstPixel * channels;
+		const uint64_t count = std::min(blockPixels, pixelCount - firstPixel) * channels;
+
+		// --- Pass 1: range, sum and counts ---
+		std::fill(laneMin.begin(), laneMin.end(), std::numeric_limits<T>::has_infinity
+			? std::numeric_limits<T>::infinity() : std::numeric_limits<T>::max());
+		std::fill(laneMax.begin(), laneMax.end(), std::numeric_limits<T>::has_infinity
+			? -std::numeric_limits<T>::infinity() : std::numeric_limits<T>::lowest());
+		std::fill(laneSum.begin(), laneSum.end(), Sum(0));
+		std::fill(laneNaN.begin(), laneNaN.end(), Bits(0));
+		std::fill(laneInf.begin(), laneInf.end(), Bits(0));
+
+		T* minData = laneMin.data();
+		T* maxData = laneMax.data();
+		Sum* sumData = laneSum.data();
+		Bits* nanData = laneNaN.data();
+		Bits* infData = laneInf.data();
+		auto accumulate = [&](uint64_t i, uint64_t j)
+		{
+			const T value = block[i + j];
+			if constexpr (std::is_floating_point_v<T>)
+			{
+				// Non-finite values don't move the range and add 0
+				const Bits finite = Traits::finiteMask(value);
+				const T low = Traits::select(value, finite, Traits::infinity);
+				const T high = Traits::select(value, finite, Traits::infinity | Traits::sign);
+				minData[j] = low < minData[j] ? low : minData[j];
+				maxData[j] = high > maxData[j] ? high : maxData[j];
+				sumData[j] += static_cast<double>(Traits::select(value, finite, 0));
+				nanData[j] += Traits::nan(value);
+				infData[j] += Traits::inf(value);
+			}
+			else
+			{
+				minData[j] = value < minData[j] ? value : minData[j];
+				maxData[j] = value > maxData[j] ? value : maxData[j];
+				sumData[j] += static_cast<Sum>(value);
+			}
+		};
+
+		uint64_t i = 0;
+		for (; i + lanes <= count; i += lanes)
+		{
+			for (uint64_t j = 0; j < (Channels > 0 ? FixedLanes : lanes); j++)
+				accumulate(i, j);
+		}
+		for (uint64_t j = 0; i + j < count; j++)
+			accumulate(i, j);
+
+		for (StatsAccumulator::Channel& channel : blockChannels)
+			channel = StatsAccumulator::Channel();
+
+		std::vector<double> sums(channels, 0.0);
+		for (uint64_t j = 0; j < lanes; j++)
+		{
+			StatsAccumulator::Channel& channel = blockChannels[j % channels];
+			const uint64_t laneCount = count / lanes + (j < count % lanes ? 1 : 0);
+			const uint64_t finiteCount = laneCount - laneNaN[j] - laneInf[j];
+			if (finiteCount > 0)
+			{
+				channel.min = std::min(channel.min, static_cast<double>(laneMin[j]));
+				channel.max = std::max(channel.max, static_cast<double>(laneMax[j]));
+			}
+			channel.finiteCount += finiteCount;
+			channel.nanCount += laneNaN[j];
+			channel.infCount += laneInf[j];
+			sums[j % channels] += static_cast<double>(laneSum[j]);
+		}
+
+		// --- Pass 2: squared deviations around the mean of the block ---
+		for (uint64_t c = 0; c < channels; c++)
+		{
+			if (blockChannels[c].finiteCount > 0)
+				blockChannels[c].mean = sums[c] / static_cast<double>(blockChannels[c].finiteCount);
+		}
+		for (uint64_t j = 0; j < lanes; j++)
+			laneMean[j] = blockChannels[j % channels].mean;
+		std::fill(laneM2.begin(), laneM2.end(), 0.0);
+
+		const double* meanData = laneMean.data();
+		double* m2Data = laneM2.data();
+		auto deviate = [&](uint64_t i, uint64_t j)
+		{
+			const T value = block[i + j];
+			double deviation = static_cast<double>(value) - meanData[j];
+			if constexpr (std::is_floating_point_v<T>)
+			{
+				uint64_t bits;
+				std::memcpy(&bits, &deviation, sizeof(bits));
+				bits &= static_cast<uint64_t>(static_cast<int64_t>(
+					static_cast<std::make_signed_t<Bits>>(Traits::finiteMask(value))));
+				std::memcpy(&deviation, &bits, sizeof(bits));
+			}
+			m2Data[j] += deviation * deviation;
+		};
+
+		for (i = 0; i + lanes <= count; i += lanes)
+		{
+			for (uint64_t j = 0; j < (Channels > 0 ? FixedLanes : lanes); j++)
+				deviate(i, j);
+		}
+		for (uint64_t j = 0; i + j < count; j++)
+			deviate(i, j);
+
+		for (uint64_t j = 0; j < lanes; j++)
+			blockChannels[j % channels].m2 += laneM2[j];
+
+		for (uint64_t c = 0; c < channels; c++)
+			StatsAccumulator::mergeMoments(acc.channels[c], blockChannels[c]);
+
+		if (bins == 0)
+			continue;
+
+		// --- Pass 3: histogram ---
+		for (uint64_t k = 0; k < count; k += channels)
+		{
+			for (uint64_t c = 0; c < (Channels > 0 ? Channels : channels); c++)
+			{
+				const T value = block[k + c];
+
+				if constexpr (CountValues)
+				{
+					valueCounts[c * 256 + static_cast<uint8_t>(value)]++;
+				}
+				else
+				{
+					if constexpr (std::is_floating_point_v<T>)
+					{
+						if (!std::isfinite(value))
+							continue;
+					}
+
+					addToHistogram(histograms.data() + c * slots, static_cast<double>(value), 1);
+				}
+			}
+		}
+	}
+
+	if constexpr (CountValues)
+	{
+		for (uint64_t c = 0; c < channels && bins > 0; c++)
+		{
+			for (uint64_t value = 0; value < 256; value++)
+			{
+				addToHistogram(histograms.data() + c * slots, static_cast<double>(static_cast<T>(value)),
+					valueCounts[c * 256 + value]);
+			}
+		}
+	}
+
+	for (uint64_t c = 0; c < channels && bins > 0; c++)
+	{
+		StatsAccumulator::Channel& channel = acc.channels[c];
+		const uint64_t* counts = histograms.data() + c * slots;
+
+		channel.underflow += counts[0];
+		for (uint64_t bin = 0; bin < bins; bin++)
+			channel.histogram[bin] += counts[bin + 1];
+		channel.overflow += counts[bins + 1];
+	}
+}
@@ -0,0 +1,61 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include "fsi_core_exports.h"
+#include "../global.h"
+#include "FormatVersion.h"
+#include <cstdint>
+#include <filesystem>
+
+namespace fsi
+{
+	/** @brief Orientation changes of fsi::transform(). Rotations are clockwise.
+	*/
+	enum class Transform : uint32_t
+	{
+		Rotate90 = 0,
+		Rotate180 = 1,
+		Rotate270 = 2,
+		FlipHorizontal = 3, // Mirrors left and right
+		FlipVertical = 4, // Mirrors top and bottom
+		Transpose = 5, // Mirrors along the main diagonal
+		Transverse = 6, // Mirrors along the anti-diagonal
+	};
+
+	struct TransformOptions
+	{
+		/** @brief Version of the output file.
+		*/
+		FormatVersion formatVersion = FormatVersion::Latest;
+
+		/** @brief Generates the thumbnail of the output (V2 only).
+		*/
+		bool thumbnail = true;
+
+		/** @brief Output rows per band. 0 picks about 64 * defaultBufferSize bytes per band, and at least
+		* a page of every source row for the transforms that swap the axes.
+		*/
+		uint32_t bandHeight = 0;
+	};
+
+	/** @brief Rotates, flips or transposes an FSI file into a new one without loading the image.
+	*
+	* The output is written sequentially in row bands with Writer::writeRows(). For the transforms that
+	* swap the axes, an output band is a strip of source columns: it's read in tiles of source rows, in
+	* parallel, and each tile is transposed into the band in small blocks that stay in cache. The other
+	* transforms read the source rows of the band, in reverse order for vertical flips. The next band is
+	* built while the previous one is written, so memory is two bands.
+	*/
+	FSI_CORE_API void transform(const std::filesystem::path& srcPath, const std::filesystem::path& dstPath,
+		Transform op, const TransformOptions& options = TransformOptions());
+}
+
+#if FSI_HEADERONLY
+#include "transform.hpp"
+#endif
\ No newline at end of file
@@ -0,0 +1,234 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include "transform.h"
+#include "transform.tcc"
+#include "Reader.h"
+#include "Writer.h"
+#include "Executor.h"
+#include "MemoryGovernor.h"
+#include "Trace.h"
+#include "consts.h"
+#include "exceptions.hpp"
+#include <future>
+#include <memory>
+#include <vector>
+
+namespace fsi
+{
+	namespace detail
+	{
+		typedef void (*CopyTransposedKernel)(const uint8_t* src, uint64_t srcStride, uint64_t rows,
+			uint64_t cols, uint64_t runtimePixelBytes, uint8_t* dst, int64_t dstColumnStep, int64_t dstRowStep);
+
+		typedef void (*CopyReversedKernel)(const uint8_t* src, uint64_t count, uint64_t runtimePixelBytes,
+			uint8_t* dst);
+
+		// The pixel sizes of 1-4 channels of every depth
+		inline CopyTransposedKernel copyTransposedKernel(uint64_t pixelBytes)
+		{
+			switch (pixelBytes)
+			{
+			case 1: return &copyTransposed<1>;
+			case 2: return &copyTransposed<2>;
+			case 3: return &copyTransposed<3>;
+			case 4: return &copyTransposed<4>;
+			case 6: return &copyTransposed<6>;
+			case 8: return &copyTransposed<8>;
+			case 12: return &copyTransposed<12>;
+			case 16: return &copyTransposed<16>;
+			case 24: return &copyTransposed<24>;
+			case 32: return &copyTransposed<32>;
+			default: return &copyTransposed<0>;
+			}
+		}
+
+		inline CopyReversedKernel copyReversedKernel(uint64_t pixelBytes)
+		{
+			switch (pixelBytes)
+			{
+			case 1: return &copyReversed<1>;
+			case 2: return &copyReversed<2>;
+			case 3: return &copyReversed<3>;
+			case 4: return &copyReversed<4>;
+			case 6: return &copyReversed<6>;
+			case 8: return &copyReversed<8>;
+			case 12: return &copyReversed<12>;
+			case 16: return &copyReversed<16>;
+			case 24: return &copyReversed<24>;
+			case 32: return &copyReversed<32>;
+			default: return &copyReversed<0>;
+			}
+		}
+	}
+}
+
+FSI_INLINE_HPP
+void fsi::transform(const std::filesystem::path& srcPath, const std::filesystem::path& dstPath, Transform op,
+	const TransformOptions& options)
+{
+	FSI_TRACE_ZONE("api", "transform");
+
+	Header srcHeader;
+	{
+		Reader reader;
+		reader.open(srcPath);
+		srcHeader = reader.header();
+	}
+
+	// Output pixel (ox, oy) comes from source pixel
+	//   swapAxes:  sx = flipX ? W-1-oy : oy,  sy = flipY ? H-1-ox : ox
+	//   otherwise: sx = flipX ? W-1-ox : ox,  sy = flipY ? H-1-oy : oy
+	const bool swapAxes = op == Transform::Rotate90 || op == Transform::Rotate270
+		|| op == Transform::Transpose || op == Transform::Transverse;
+	const bool flipX = op == Transform::Rotate270 || op == Transform::Transverse
+		|| op == Transform::Rotate180 || op == Transform::FlipHorizontal;
+	const bool flipY = op == Transform::Rotate90 || op == Transform::Transverse
+		|| op == Transform::Rotate180 || op == Transform::FlipVertical;
+
+	Header header = srcHeader;
+	header.width = swapAxes ? srcHeader.height : srcHeader.width;
+	header.height = swapAxes ? srcHeader.width : srcHeader.height;
+	header.hasThumb = options.thumbnail;
+
+	Writer writer(options.formatVersion);
+	writer.open(dstPath, header);
+
+	const int64_t srcWidth = srcHeader.width;
+	const int64_t srcHeight = srcHeader.height;
+	const int64_t height = header.height;
+	const uint64_t bytesPerPixel = static_cast<uint64_t>(header.channels) * sizeOfDepth(header.depth);
+	const uint64_t srcRowSize = srcWidth * bytesPerPixel;
+	const uint64_t rowSize = header.width * bytesPerPixel;
+
+	const detail::CopyTransposedKernel transposed = detail::copyTransposedKernel(bytesPerPixel);
+	const detail::CopyReversedKernel reversed = detail::copyReversedKernel(bytesPerPixel);
+
+	// Swapping the axes reads bandHeight pixels of every source row, which should be at least a page
+	const int64_t minBandHeight = swapAxes ? static_cast<int64_t>((4096 + bytesPerPixel - 1) / bytesPerPixel) : 1;
+	const int64_t desiredBandHeight = options.bandHeight > 0
+		? std::min<int64_t>(options.bandHeight, height)
+		: std::clamp<int64_t>(std::max<int64_t>(64 * defaultBufferSize / rowSize, minBandHeight), 1, height);
+
+	// Fewer rows per band under a tight memory budget, unless the band height was given
+	MemoryReservation memory;
+	const int64_t bandHeight = static_cast<int64_t>(memory.reserveRows(static_cast<uint64_t>(desiredBandHeight),
+		static_cast<uint64_t>(options.bandHeight > 0 ? desiredBandHeight : minBandHeight), 2 * rowSize));
+
+	std::vector<uint8_t> bands[2];
+	std::future<void> writing;
+
+	for (int64_t bandY = 0; bandY < height; bandY += bandHeight)
+	{
+		const int64_t bandRows = std::min(bandHeight, height - bandY);
+		std::vector<uint8_t>& band = bands[(bandY / bandHeight) % 2];
+
+		try
+		{
+			band.resize(bandRows * rowSize);
+
+			if (swapAxes)
+			{
+				// The band is the strip of source columns [firstColumn, firstColumn + bandRows), read in
+				// tiles of about defaultBufferSize
+				const int64_t firstColumn = flipX ? srcWidth - bandY - bandRows : bandY;
+				const uint64_t tileRowSize = bandRows * bytesPerPixel;
+				const int64_t tileRows = std::clamp<int64_t>(defaultBufferSize / tileRowSize, 1, srcHeight);
+				const int64_t tiles = (srcHeight + tileRows - 1) / tileRows;
+
+				executor()->parallelFor(0, tiles, 1, [&](int64_t tileBegin, int64_t tileEnd)
+				{
+					// Readers can't be shared between threads
+					Reader reader;
+					reader.open(srcPath);
+
+					std::vector<uint8_t> tile(tileRows * tileRowSize);
+
+					for (int64_t t = tileBegin; t < tileEnd; t++)
+					{
+						const int64_t tileY = t * tileRows;
+						const int64_t rows = std::min(tileRows, srcHeight - tileY);
+
+						reader.readRect(tile.data(), static_cast<uint32_t>(firstColumn), static_cast<uint32_t>(tileY),
+							static_cast<uint32_t>(bandRows), static_cast<uint32_t>(rows));
+
+						FSI_TRACE_ZONE("compute", "transpose tile");
+
+						// Tile column j is band row (flipX ? bandRows-1-j : j), tile row i is band column
+						// (flipY ? H-1-(tileY+i) : tileY+i)
+						const int64_t firstRow = flipX ? bandRows - 1 : 0;
+						const int64_t firstX = flipY ? srcHeight - 1 - tileY : tileY;
+
+						transposed(tile.data(), tileRowSize, rows, bandRows, bytesPerPixel,
+							band.data() + firstRow * rowSize + firstX * bytesPerPixel,
+							flipX ? -static_cast<int64_t>(rowSize) : static_cast<int64_t>(rowSize),
+							flipY ? -static_cast<int64_t>(bytesPerPixel) : static_cast<int64_t>(bytesPerPixel));
+					}
+				});
+			}
+			else
+			{
+				// The band is the source rows [firstRow, firstRow + bandRows), in reverse order with flipY
+				const int64_t firstRow = flipY ? srcHeight - bandY - bandRows : bandY;
+				const int64_t chunkRows = std::clamp<int64_t>(defaultBufferSize / srcRowSize, 1, bandRows);
+				const int64_t chunks = (bandRows + chunkRows - 1) / chunkRows;
+
+				executor()->parallelFor(0, chunks, 1, [&](int64_t chunkBegin, int64_t chunkEnd)
+				{
+					Reader reader;
+					reader.open(srcPath);
+
+					std::vector<uint8_t> chunk(chunkRows * srcRowSize);
+
+					for (int64_t c = chunkBegin; c < chunkEnd; c++)
+					{
+						const int64_t chunkY = c * chunkRows;
+						const int64_t rows = std::min(chunkRows, bandRows - chunkY);
+
+						reader.readRect(chunk.data(), 0, static_cast<uint32_t>(firstRow + chunkY),
+							static_cast<uint32_t>(srcWidth), static_cast<uint32_t>(rows));
+
+						FSI_TRACE_ZONE("compute", "flip rows");
+
+						for (int64_t i = 0; i < rows; i++)
+						{
+							const int64_t bandRow = flipY ? bandRows - 1 - (chunkY + i) : chunkY + i;
+							uint8_t* dst = band.data() + bandRow * rowSize;
+
+							if (flipX)
+								reversed(chunk.data() + i * srcRowSize, srcWidth, bytesPerPixel, dst);
+							else
+								std::memcpy(dst, chunk.data() + i * srcRowSize, srcRowSize);
+						}
+					}
+				});
+			}
+		}
+		catch (...)
+		{
+			// The write task uses the other band
+			if (writing.valid())
+				writing.wait();
+			throw;
+		}
+
+		if (writing.valid())
+			writing.get();
+
+		auto task = std::make_shared<std::packaged_task<void()>>([&writer, &band, bandRows]()
+		{
+			writer.writeRows(band.data(), static_cast<uint32_t>(bandRows));
+		});
+		writing = task->get_future();
+		executor()->submit([task]() { (*task)(); });
+	}
+
+	if (writing.valid())
+		writing.get();
+}
\ No newline at end of file
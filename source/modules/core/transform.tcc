@@ -0,0 +1,73 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include "transform.h"
+#include <algorithm>
+#include <cstring>
+
+namespace fsi
+{
+	namespace detail
+	{
+		/** @brief Copies a rows x cols tile of pixels so that source column c, row r lands at
+		* dst + c*dstColumnStep + r*dstRowStep. The steps are signed, so the same kernel transposes,
+		* rotates and mirrors.
+		*
+		* The tile is walked in blockSize x blockSize blocks so the source and destination lines of a
+		* block stay in L1. PixelBytes is 0 when the pixel size is only known at runtime; with a fixed
+		* size each pixel is a register move.
+		*/
+		template <uint64_t PixelBytes>
+		void copyTransposed(const uint8_t* src, uint64_t srcStride, uint64_t rows, uint64_t cols,
+			uint64_t runtimePixelBytes, uint8_t* dst, int64_t dstColumnStep, int64_t dstRowStep);
+
+		/** @brief Copies count pixels in reverse order.
+		*/
+		template <uint64_t PixelBytes>
+		void copyReversed(const uint8_t* src, uint64_t count, uint64_t runtimePixelBytes, uint8_t* dst);
+	}
+}
+
+template <uint64_t PixelBytes>
+inline
+void fsi::detail::copyTransposed(const uint8_t* src, uint64_t srcStride, uint64_t rows, uint64_t cols,
+	uint64_t runtimePixelBytes, uint8_t* dst, int64_t dstColumnStep, int64_t dstRowStep)
+{
+	const uint64_t pixelBytes = PixelBytes > 0 ? PixelBytes : runtimePixelBytes;
+	const uint64_t blockSize = 16;
+
+	for (uint64_t r0 = 0; r0 < rows; r0 += blockSize)
+	{
+		const uint64_t r1 = std::min(r0 + blockSize, rows);
+
+		for (uint64_t c0 = 0; c0 < cols; c0 += blockSize)
+		{
+			const uint64_t c1 = std::min(c0 + blockSize, cols);
+
+			for (uint64_t c = c0; c < c1; c++)
+			{
+				uint8_t* out = dst + static_cast<int64_t>(c) * dstColumnStep;
+
+				for (uint64_t r = r0; r < r1; r++)
+					std::memcpy(out + static_cast<int64_t>(r) * dstRowStep, src + r * srcStride + c * pixelBytes,
+						pixelBytes);
+			}
+		}
+	}
+}
+
+template <uint64_t PixelBytes>
+inline
+void fsi::detail::copyReversed(const uint8_t* src, uint64_t count, uint64_t runtimePixelBytes, uint8_t* dst)
+{
+	const uint64_t pixelBytes = PixelBytes > 0 ? PixelBytes : runtimePixelBytes;
+
+	for (uint64_t i = 0; i < count; i++)
+		std::memcpy(dst + (count - 1 - i) * pixelBytes, src + i * pixelBytes, pixelBytes);
+}
\ No newline at end of file
@@ -0,0 +1,119 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include "fsi_core_exports.h"
+#include "../global.h"
+#include "IoOptions.h"
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace fsi
+{
+	/** @brief Name of the profile files written by probeStorage() users like the fsi_tune tool.
+	*/
+	const std::string ioProfileFileName = ".fsi-io-profile";
+
+	/** @brief Throughput of one configuration measured by probeStorage().
+	*/
+	struct IoMeasurement
+	{
+		bool write = false;
+
+		IoBackend backend = IoBackend::Stream;
+
+		uint64_t chunkSize = 0;
+
+		uint32_t threads = 1;
+
+		bool directIo = false;
+
+		double bytesPerSecond = 0.0;
+	};
+
+	/** @brief The fastest read and write settings of a storage.
+	*/
+	struct IoProfile
+	{
+		ReadOptions read;
+
+		WriteOptions write;
+
+		double readBytesPerSecond = 0.0;
+
+		double writeBytesPerSecond = 0.0;
+
+		/** @brief Every configuration that was measured. Not saved.
+		*/
+		std::vector<IoMeasurement> measurements;
+	};
+
+	struct ProbeOptions
+	{
+		/** @brief Size of the image written and read by each measurement.
+		*/
+		uint64_t fileSize = 256ull * 1024 * 1024;
+
+		std::vector<uint64_t> chunkSizes = { 256ull * 1024, 1024ull * 1024, 4ull * 1024 * 1024, 16ull * 1024 * 1024 };
+
+		std::vector<uint32_t> threads = { 1, 2, 4, 8, 16 };
+
+		bool testDirectIo = true;
+
+		/** @brief Called after each measurement, e.g. to print progress.
+		*/
+		std::function<void(const IoMeasurement&)> onMeasurement;
+	};
+
+	/** @brief Measures the storage of directory with FSI files written and read through Writer and
+	* Reader, and returns the fastest settings.
+	*
+	* The search is greedy to keep it short: the stream backend sets a baseline, then the chunk size
+	* is picked with one thread of the positional backend, then the number of chunks in flight
+	* (threads) with that chunk size, and finally direct I/O is tried with the winner. Every write is
+	* flushed with fsync and every read starts with the file dropped from the page cache, so the
+	* numbers are the ones of the device, not of memory. The probe file is deleted afterwards.
+	*/
+	FSI_CORE_API IoProfile probeStorage(const std::filesystem::path& directory,
+		const ProbeOptions& options = ProbeOptions());
+
+	/** @brief Writes the settings of a profile as a text file of key=value lines.
+	*/
+	FSI_CORE_API void saveIoProfile(const IoProfile& profile, const std::filesystem::path& path);
+
+	/** @brief Reads a file written by saveIoProfile(). Unknown keys are ignored.
+	*
+	* @return false if the file can't be read.
+	*/
+	FSI_CORE_API bool loadIoProfile(const std::filesystem::path& path, IoProfile& profile);
+
+	/** @brief The profile that applies to a file: the one named by the FSI_IO_PROFILE environment
+	* variable, or else the first ioProfileFileName found in the directory of the file or one of its
+	* parents. Empty if there is none.
+	*/
+	FSI_CORE_API std::filesystem::path findIoProfile(const std::filesystem::path& path);
+
+	/** @brief Options with the settings of the profile for path, when options.useStorageProfile is
+	* set and there is one. The profile only replaces chunkSize, threads, backend and directIo where
+	* they still have their default values. Profiles are looked up once per directory and cached.
+	*/
+	FSI_CORE_API ReadOptions applyIoProfile(const std::filesystem::path& path, const ReadOptions& options);
+
+	FSI_CORE_API WriteOptions applyIoProfile(const std::filesystem::path& path, const WriteOptions& options);
+
+	/** @brief Forgets the cached profiles, e.g. after writing a new one.
+	*/
+	FSI_CORE_API void clearIoProfileCache();
+}
+
+#if FSI_HEADERONLY
+#include "tuning.hpp"
+#endif
\ No newline at end of file
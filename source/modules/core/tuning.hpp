@@ -0,0 +1,403 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+#pragma once
+
+#include "tuning.h"
+#include "Reader.h"
+#include "Writer.h"
+#include "Trace.h"
+#include "io.h"
+#include "exceptions.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+
+namespace fsi
+{
+	namespace detail
+	{
+		/** @brief Deletes the probe file when the probe ends, also after an exception.
+		*/
+		struct ProbeFile
+		{
+			std::filesystem::path path;
+
+			~ProbeFile()
+			{
+				std::error_code error;
+				std::filesystem::remove(path, error);
+			}
+		};
+
+		inline double secondsSince(std::chrono::steady_clock::time_point start)
+		{
+			return std::max(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(), 1e-9);
+		}
+
+		inline const char* backendName(IoBackend backend)
+		{
+			return backend == IoBackend::Positional ? "positional" : "stream";
+		}
+
+		struct IoProfileCache
+		{
+			std::mutex mutex;
+
+			// By profile path. nullptr when it couldn't be loaded.
+			std::map<std::filesystem::path, std::shared_ptr<const IoProfile>> profiles;
+
+			// By directory. Empty when there is no profile.
+			std::map<std::filesystem::path, std::filesystem::path> directories;
+		};
+
+		inline IoProfileCache& ioProfileCache()
+		{
+			static IoProfileCache cache;
+			return cache;
+		}
+
+		inline std::shared_ptr<const IoProfile> cachedIoProfile(const std::filesystem::path& path)
+		{
+			IoProfileCache& cache = ioProfileCache();
+			std::lock_guard<std::mutex> lock(cache.mutex);
+
+			std::filesystem::path profilePath;
+			if (const char* environment = std::getenv("FSI_IO_PROFILE"); environment && *environment)
+			{
+				profilePath = environment;
+			}
+			else
+			{
+				const std::filesystem::path directory = path.parent_path();
+				auto found = cache.directories.find(directory);
+				if (found == cache.directories.end())
+					found = cache.directories.emplace(directory, findIoProfile(path)).first;
+				profilePath = found->second;
+			}
+
+			if (profilePath.empty())
+				return nullptr;
+
+			auto found = cache.profiles.find(profilePath);
+			if (found == cache.profiles.end())
+			{
+				auto profile = std::make_shared<IoProfile>();
+				found = cache.profiles.emplace(profilePath,
+					loadIoProfile(profilePath, *profile) ? profile : nullptr).first;
+			}
+
+			return found->second;
+		}
+	}
+}
+
+FSI_INLINE_HPP
+fsi::IoProfile fsi::probeStorage(const std::filesystem::path& directory, const ProbeOptions& options)
+{
+	FSI_TRACE_ZONE("api", "probeStorage");
+
+	// An FSI-shaped workload: 16 KB rows of RGBA8
+	Header header;
+	header.width = 4096;
+	header.channels = 4;
+	header.depth = Depth::Uint8;
+	header.height = static_cast<uint32_t>(std::clamp<uint64_t>(options.fileSize / (header.width * header.channels),
+		1, 1048575));
+	header.hasThumb = false;
+
+	const uint64_t size = static_cast<uint64_t>(header.width) * header.height * header.channels;
+	std::vector<uint8_t> image(size);
+	for (uint64_t i = 0; i < size; i++)
+		image[i] = static_cast<uint8_t>(i * 2654435761u >> 24);
+
+	detail::ProbeFile file;
+	file.path = directory / ".fsi-probe.fsi";
+
+	IoProfile profile;
+	profile.read.useStorageProfile = false;
+	profile.write.useStorageProfile = false;
+
+	// Writes and then reads the probe file with one configuration. Returns true if it beat the best
+	// write or read so far, which then becomes the profile.
+	auto measure = [&](IoBackend backend, uint64_t chunkSize, uint32_t threads, bool directIo)
+	{
+		WriteOptions writeOptions;
+		writeOptions.backend = backend;
+		writeOptions.chunkSize = chunkSize;
+		writeOptions.threads = threads;
+		writeOptions.directIo = directIo;
+		writeOptions.sync = SyncPolicy::OnClose;
+		writeOptions.cacheAdvice = CacheAdvice::DontKeep;
+		writeOptions.useStorageProfile = false;
+
+		IoMeasurement write;
+		write.write = true;
+		write.backend = backend;
+		write.chunkSize = chunkSize;
+		write.threads = threads;
+		write.directIo = directIo;
+		{
+			const auto start = std::chrono::steady_clock::now();
+			Writer writer(FormatVersion::V2);
+			writer.open(file.path, header, writeOptions);
+			writer.write(image.data());
+			write.bytesPerSecond = static_cast<double>(size) / detail::secondsSince(start);
+		}
+
+		ReadOptions readOptions;
+		readOptions.backend = backend;
+		readOptions.chunkSize = chunkSize;
+		readOptions.threads = threads;
+		readOptions.directIo = directIo;
+		readOptions.cacheAdvice = CacheAdvice::Sequential;
+		readOptions.useStorageProfile = false;
+
+		IoMeasurement read = write;
+		read.write = false;
+		{
+#if !defined(_WIN32)
+			io::finishFile(file.path, false, true);
+#endif
+			const auto start = std::chrono::steady_clock::now();
+			Reader reader;
+			reader.open(file.path, readOptions);
+			reader.read(image.data());
+			read.bytesPerSecond = static_cast<double>(size) / detail::secondsSince(start);
+		}
+
+		for (const IoMeasurement& measurement : { write, read })
+		{
+			profile.measurements.push_back(measurement);
+			if (options.onMeasurement)
+				options.onMeasurement(measurement);
+		}
+
+		bool improved = false;
+		if (write.bytesPerSecond > profile.writeBytesPerSecond)
+		{
+			profile.write.backend = backend;
+			profile.write.chunkSize = chunkSize;
+			profile.write.threads = threads;
+			profile.write.directIo = directIo;
+			profile.writeBytesPerSecond = write.bytesPerSecond;
+			improved = true;
+		}
+		if (read.bytesPerSecond > profile.readBytesPerSecond)
+		{
+			profile.read.backend = backend;
+			profile.read.chunkSize = chunkSize;
+			profile.read.threads = threads;
+			profile.read.directIo = directIo;
+			profile.readBytesPerSecond = read.bytesPerSecond;
+			improved = true;
+		}
+		return improved;
+	};
+
+	// --- Baseline: the default stream loop ---
+	measure(IoBackend::Stream, defaultBufferSize, 1, false);
+
+#if !defined(_WIN32)
+	// --- Chunk size, one chunk in flight ---
+	uint64_t bestChunk = defaultBufferSize;
+	double bestChunkSpeed = 0.0;
+	for (uint64_t chunkSize : options.chunkSizes)
+	{
+		measure(IoBackend::Positional, chunkSize, 1, false);
+
+		// Reads and writes count the same here
+		const double speed = profile.measurements.end()[-2].bytesPerSecond + profile.measurements.back().bytesPerSecond;
+		if (speed > bestChunkSpeed)
+		{
+			bestChunkSpeed = speed;
+			bestChunk = chunkSize;
+		}
+	}
+
+	// --- Chunks in flight ---
+	uint32_t bestThreads = 1;
+	double bestThreadsSpeed = bestChunkSpeed;
+	for (uint32_t threads : options.threads)
+	{
+		if (threads <= 1)
+			continue;
+
+		measure(IoBackend::Positional, bestChunk, threads, false);
+
+		const double speed = profile.measurements.end()[-2].bytesPerSecond + profile.measurements.back().bytesPerSecond;
+		if (speed > bestThreadsSpeed)
+		{
+			bestThreadsSpeed = speed;
+			bestThreads = threads;
+		}
+	}
+
+	// --- Direct I/O with the winner ---
+	if (options.testDirectIo)
+		measure(IoBackend::Positional, bestChunk, bestThreads, true);
+#endif
+
+	return profile;
+}
+
+FSI_INLINE_HPP
+void fsi::saveIoProfile(const IoProfile& profile, const std::filesystem::path& path)
+{
+	std::ofstream file(path);
+	if (!file)
+		throw ExceptionFailedToCreateFile(path.string());
+
+	file << "# FSI I/O profile\n";
+	file << "read.backend=" << detail::backendName(profile.read.backend) << "\n";
+	file << "read.chunkSize=" << profile.read.chunkSize << "\n";
+	file << "read.threads=" << profile.read.threads << "\n";
+	file << "read.directIo=" << (profile.read.directIo ? 1 : 0) << "\n";
+	file << "read.bytesPerSecond=" << static_cast<uint64_t>(profile.readBytesPerSecond) << "\n";
+	file << "write.backend=" << detail::backendName(profile.write.backend) << "\n";
+	file << "write.chunkSize=" << profile.write.chunkSize << "\n";
+	file << "write.threads=" << profile.write.threads << "\n";
+	file << "write.directIo=" << (profile.write.directIo ? 1 : 0) << "\n";
+	file << "write.bytesPerSecond=" << static_cast<uint64_t>(profile.writeBytesPerSecond) << "\n";
+
+	if (!file)
+		throw ExceptionFailedToCreateFile(path.string());
+}
+
+FSI_INLINE_HPP
+bool fsi::loadIoProfile(const std::filesystem::path& path, IoProfile& profile)
+{
+	std::ifstream file(path);
+	if (!file)
+		return false;
+
+	profile = IoProfile();
+
+	std::string line;
+	while (std::getline(file, line))
+	{
+		const size_t equals = line.find('=');
+		if (line.empty() || line[0] == '#' || equals == std::string::npos)
+			continue;
+
+		const std::string key = line.substr(0, equals);
+		const std::string value = line.substr(equals + 1);
+
+		try
+		{
+			if (key == "read.backend")
+				profile.read.backend = value == "positional" ? IoBackend::Positional : IoBackend::Stream;
+			else if (key == "read.chunkSize")
+				profile.read.chunkSize = std::max<uint64_t>(std::stoull(value), 1);
+			else if (key == "read.threads")
+				profile.read.threads = static_cast<uint32_t>(std::stoul(value));
+			else if (key == "read.directIo")
+				profile.read.directIo = value == "1";
+			else if (key == "read.bytesPerSecond")
+				profile.readBytesPerSecond = std::stod(value);
+			else if (key == "write.backend")
+				profile.write.backend = value == "positional" ? IoBackend::Positional : IoBackend::Stream;
+			else if (key == "write.chunkSize")
+				profile.write.chunkSize = std::max<uint64_t>(std::stoull(value), 1);
+			else if (key == "write.threads")
+				profile.write.threads = static_cast<uint32_t>(std::stoul(value));
+			else if (key == "write.directIo")
+				profile.write.directIo = value == "1";
+			else if (key == "write.bytesPerSecond")
+				profile.writeBytesPerSecond = std::stod(value);
+		}
+		catch (const std::exception&)
+		{
+			// A malformed value keeps the default
+		}
+	}
+
+	return true;
+}
+
+FSI_INLINE_HPP
+std::filesystem::path fsi::findIoProfile(const std::filesystem::path& path)
+{
+	if (const char* environment = std::getenv("FSI_IO_PROFILE"); environment && *environment)
+		return environment;
+
+	std::error_code error;
+	std::filesystem::path directory = std::filesystem::absolute(path, error).parent_path();
+	if (error)
+		return {};
+
+	for (;;)
+	{
+		const std::filesystem::path candidate = directory / ioProfileFileName;
+		if (std::filesystem::is_regular_file(candidate, error))
+			return candidate;
+
+		if (directory == directory.parent_path())
+			return {};
+		directory = directory.parent_path();
+	}
+}
+
+FSI_INLINE_HPP
+fsi::ReadOptions fsi::applyIoProfile(const std::filesystem::path& path, const ReadOptions& options)
+{
+	if (!options.useStorageProfile)
+		return options;
+
+	const std::shared_ptr<const IoProfile> profile = detail::cachedIoProfile(path);
+	if (!profile)
+		return options;
+
+	// Only the settings the caller left at their defaults
+	const ReadOptions defaults;
+	ReadOptions result = options;
+	if (options.chunkSize == defaults.chunkSize)
+		result.chunkSize = profile->read.chunkSize;
+	if (options.threads == defaults.threads)
+		result.threads = profile->read.threads;
+	if (options.backend == defaults.backend)
+		result.backend = profile->read.backend;
+	if (options.directIo == defaults.directIo)
+		result.directIo = profile->read.directIo;
+	return result;
+}
+
+FSI_INLINE_HPP
+fsi::WriteOptions fsi::applyIoProfile(const std::filesystem::path& path, const WriteOptions& options)
+{
+	if (!options.useStorageProfile)
+		return options;
+
+	const std::shared_ptr<const IoProfile> profile = detail::cachedIoProfile(path);
+	if (!profile)
+		return options;
+
+	const WriteOptions defaults;
+	WriteOptions result = options;
+	if (options.chunkSize == defaults.chunkSize)
+		result.chunkSize = profile->write.chunkSize;
+	if (options.threads == defaults.threads)
+		result.threads = profile->write.threads;
+	if (options.backend == defaults.backend)
+		result.backend = profile->write.backend;
+	if (options.directIo == defaults.directIo)
+		result.directIo = profile->write.directIo;
+	return result;
+}
+
+FSI_INLINE_HPP
+void fsi::clearIoProfileCache()
+{
+	detail::IoProfileCache& cache = detail::ioProfileCache();
+	std::lock_guard<std::mutex> lock(cache.mutex);
+	cache.profiles.clear();
+	cache.directories.clear();
+}
\ No newline at end of file
@@ -8,6 +8,7 @@
 #include "../../modules/core/Depth.hpp"
 #include "../../modules/core/ProgressThread.h"
 #include "../../modules/core/Exception.h"
+#include "../../modules/core/ImageBuffer.h"
 #include "../../modules/core/Reader.h"
 #include "../../modules/core/Writer.h"
 #include "../../modules/core/Timer.h"
@@ -18,46 +19,6 @@
 #include <utility>
 #include <assert.h>
 
-class Image
-{
-public:
-
-	Image()
-	{
-		data = nullptr;
-		this->width = 0;
-		this->height = 0;
-		this->channels = 0;
-		this->depth = fsi::Depth::Invalid;
-	}
-
-	Image(uint64_t width, uint64_t height, uint64_t channels, fsi::Depth depth)
-	{
-		data = new uint8_t[width*height*channels*fsi::sizeOfDepth(depth)];
-		this->width = width;
-		this->height = height;
-		this->channels = channels;
-		this->depth = depth;
-	}
-
-	~Image()
-	{
-		delete[] data;
-	}
-
-	FSI_DISABLE_COPY_MOVE(Image); // Just to keep memory management simple
-
-	uint8_t* data;
-
-	uint64_t width;
-
-	uint64_t height;
-
-	uint64_t channels;
-
-	fsi::Depth depth;
-};
-
 void updateProgressBar(
 	int tick,
 	int total,
@@ -159,14 +120,14 @@ int main()
 
 		Header headerReader = reader.header();
 
-		Image image(headerReader.width, headerReader.height, headerReader.channels, headerReader.depth);
+		fsi::ImageBuffer image(headerReader);
 		std::vector<uint8_t> thumb;
 		if (headerReader.hasThumb)
 			thumb = std::vector<uint8_t>(headerReader.thumbWidth * headerReader.thumbHeight * 4);
 
 		try
 		{
-			reader.read(image.data, headerReader.hasThumb ? thumb.data() : nullptr, progressCallback);
+			reader.read(image.data(), headerReader.hasThumb ? thumb.data() : nullptr, progressCallback);
 		}
 		catch (Exception& e)
 		{
@@ -176,8 +137,8 @@ int main()
 
 		reader.close();
 
-		cout << "Input read successfully (w: " << image.width << ", h: " << image.height << ", c: "
-			<< image.channels << ", d: " << image.depth << ")\n";
+		cout << "Input read successfully (w: " << image.width() << ", h: " << image.height() << ", c: "
+			<< image.channels() << ", d: " << image.depth() << ")\n";
 
 		// --- Write ---
 
@@ -193,10 +154,10 @@ int main()
 		}
 
 		Header headerWriter;
-		headerWriter.width = image.width;
-		headerWriter.height = image.height;
-		headerWriter.channels = image.channels;
-		headerWriter.depth = image.depth;
+		headerWriter.width = image.width();
+		headerWriter.height = image.height();
+		headerWriter.channels = image.channels();
+		headerWriter.depth = image.depth();
 		headerWriter.hasThumb = true;
 
 		Writer writer(FormatVersion::V2);
@@ -214,7 +175,7 @@ int main()
 		Timer timer; timer.start();
 		try
 		{
-			writer.write(image.data, progressCallback);
+			writer.write(image.data(), progressCallback);
 		}
 		catch (Exception& e)
 		{
@@ -8,6 +8,7 @@
 #include "../../modules/core/Depth.hpp"
 #include "../../modules/core/ProgressThread.h"
 #include "../../modules/core/Exception.h"
+#include "../../modules/core/ImageBuffer.h"
 #include "../../modules/core/Reader.h"
 #include "../../modules/core/Writer.h"
 #include "../../modules/core/Timer.h"
@@ -17,31 +18,6 @@
 #include <algorithm>
 #include <filesystem>
 
-struct Image
-{
-	Image(uint64_t width, uint64_t height, uint64_t channels, fsi::Depth depth)
-	{
-		data = new uint8_t[width*height*channels*fsi::sizeOfDepth(depth)];
-		this->width = width;
-		this->height = height;
-		this->channels = channels;
-		this->depth = depth;
-	}
-
-	~Image()
-	{
-		delete[] data;
-	}
-
-	uint8_t* data;
-	uint64_t width;
-	uint64_t height;
-	uint64_t channels;
-	fsi::Depth depth;
-
-	FSI_DISABLE_COPY_MOVE(Image); // Just to keep memory management simple
-};
-
 int64_t positiveMod(int64_t value, int64_t size)
 {
 	const int64_t result = value % size;
@@ -116,19 +92,19 @@ void readRectRepeat(
 	}
 }
 
-void writeImage(const Image& image, const std::filesystem::path& path)
+void writeImage(const fsi::ImageBuffer& image, const std::filesystem::path& path)
 {
 	fsi::Header headerWriter;
-	headerWriter.width = image.width;
-	headerWriter.height = image.height;
-	headerWriter.channels = image.channels;
-	headerWriter.depth = image.depth;
+	headerWriter.width = image.width();
+	headerWriter.height = image.height();
+	headerWriter.channels = image.channels();
+	headerWriter.depth = image.depth();
 	headerWriter.hasThumb = true;
 
 	fsi::Writer writer(fsi::FormatVersion::V2);
 
 	writer.open(path, headerWriter);
-	writer.write(image.data);
+	writer.write(image.data());
 
 	writer.close();
 }
@@ -164,12 +140,12 @@ int main()
 	const uint64_t cropWidth = 355;
 	const uint64_t cropHeight = 801;
 
-	Image image(cropWidth, cropHeight, header.channels, header.depth);
+	fsi::ImageBuffer image(cropWidth, cropHeight, header.channels, header.depth);
 
 	try
 	{
 		reader.readRect(
-			image.data,
+			image.data(),
 			cropX,
 			cropY,
 			cropWidth,
@@ -185,10 +161,10 @@ int main()
 	cout << "Crop read successfully in " << timer.elapsedMs() << " ms\n";
 
 	cout << " ---- Image information ----\n";
-	cout << "   Width: " << image.width << "\n";
-	cout << "   Height: " << image.height << "\n";
-	cout << "   Channels: " << image.channels << "\n";
-	cout << "   Depth: " << image.depth << "\n";
+	cout << "   Width: " << image.width() << "\n";
+	cout << "   Height: " << image.height() << "\n";
+	cout << "   Channels: " << image.channels() << "\n";
+	cout << "   Depth: " << image.depth() << "\n";
 	cout << " ---------------------------\n";
 
 	cout << "Reading repeated corner crop...\n";
@@ -202,7 +178,7 @@ int main()
 	const int64_t repeatCropY =
 		static_cast<int64_t>(header.height) - 400;
 
-	Image repeatImage(
+	fsi::ImageBuffer repeatImage(
 		repeatCropWidth,
 		repeatCropHeight,
 		header.channels,
@@ -215,7 +191,7 @@ int main()
 	{
 		readRectRepeat(
 			reader,
-			repeatImage.data,
+			repeatImage.data(),
 			repeatCropX,
 			repeatCropY,
 			repeatCropWidth,
@@ -8,6 +8,7 @@
 #include "../../modules/core/Depth.hpp"
 #include "../../modules/core/ProgressThread.h"
 #include "../../modules/core/Exception.h"
+#include "../../modules/core/ImageBuffer.h"
 #include "../../modules/core/Reader.h"
 #include "../../modules/core/Writer.h"
 #include "../../modules/core/Timer.h"
@@ -17,37 +18,6 @@
 #include <vector>
 #include <assert.h>
 
-class Image
-{
-public:
-
-	Image(uint64_t width, uint64_t height, uint64_t channels, fsi::Depth depth)
-	{
-		data = new uint8_t[width*height*channels*fsi::sizeOfDepth(depth)];
-		this->width = width;
-		this->height = height;
-		this->channels = channels;
-		this->depth = depth;
-	}
-
-	~Image()
-	{
-		delete[] data;
-	}
-
-	FSI_DISABLE_COPY_MOVE(Image); // Just to keep memory management simple
-
-	uint8_t* data;
-
-	uint64_t width;
-
-	uint64_t height;
-
-	uint64_t channels;
-
-	fsi::Depth depth;
-};
-
 void invertColor(uint64_t width, uint64_t height, uint64_t channels, fsi::Depth depth, uint8_t* data)
 {
 	assert(depth == fsi::Depth::Uint16 && "Data must be Uint16");
@@ -143,11 +113,16 @@ int main()
 
 	fsi::Header headerReader = reader.header();
 
-	Image image(headerReader.width, headerReader.height, headerReader.channels, headerReader.depth);
+	// Large images benefit from huge pages and from faulting the pages in parallel before reading
+	fsi::ImageBufferOptions imageOptions;
+	imageOptions.hugePages = fsi::ImageBufferOptions::HugePages::Transparent;
+	imageOptions.parallelFirstTouch = true;
+
+	fsi::ImageBuffer image(headerReader, imageOptions);
 
 	try
 	{
-		reader.read(image.data, nullptr, progressCallback);
+		reader.read(image.data(), nullptr, progressCallback);
 	}
 	catch (fsi::Exception& e)
 	{
@@ -160,21 +135,21 @@ int main()
 	cout << "Input read successfully\n";
 
 	cout << " ---- Image information ----\n";
-	cout << "   Width: " << image.width << "\n";
-	cout << "   Height: " << image.height << "\n";
-	cout << "   Channels: " << image.channels << "\n";
-	cout << "   Depth: " << image.depth << "\n";
+	cout << "   Width: " << image.width() << "\n";
+	cout << "   Height: " << image.height() << "\n";
+	cout << "   Channels: " << image.channels() << "\n";
+	cout << "   Depth: " << image.depth() << "\n";
 	cout << " ---------------------------\n";
 
 	// Invert color
 	// ------------
 
 	cout << "Inverting image colors...\n";
-	invertColor(image.width, image.height, image.channels, image.depth, image.data);
+	invertColor(image.width(), image.height(), image.channels(), image.depth(), image.data());
 	cout << "Image colors inverted\n";
 
-	// Image rgImage(image.width, image.height, 2, image.depth);
-	// RGBtoRG(image.width, image.height, image.depth, image.data, rgImage.data);
+	// fsi::ImageBuffer rgImage(image.width(), image.height(), 2, image.depth());
+	// RGBtoRG(image.width(), image.height(), image.depth(), image.data(), rgImage.data);
 
 	// Write
 	// -----
@@ -193,10 +168,10 @@ int main()
 		}
 
 		fsi::Header headerWriter;
-		headerWriter.width = image.width;
-		headerWriter.height = image.height;
-		headerWriter.channels = image.channels;
-		headerWriter.depth = image.depth;
+		headerWriter.width = image.width();
+		headerWriter.height = image.height();
+		headerWriter.channels = image.channels();
+		headerWriter.depth = image.depth();
 
 		fsi::Writer writer(fsi::FormatVersion::V1);
 
@@ -214,7 +189,7 @@ int main()
 
 		try
 		{
-			writer.write(image.data, progressCallback);
+			writer.write(image.data(), progressCallback);
 		}
 		catch (fsi::Exception& e)
 		{
@@ -239,10 +214,10 @@ int main()
 		}
 
 		fsi::Header headerWriter;
-		headerWriter.width = image.width;
-		headerWriter.height = image.height;
-		headerWriter.channels = image.channels;
-		headerWriter.depth = image.depth;
+		headerWriter.width = image.width();
+		headerWriter.height = image.height();
+		headerWriter.channels = image.channels();
+		headerWriter.depth = image.depth();
 		headerWriter.hasThumb = false;
 
 		fsi::Writer writer(fsi::FormatVersion::V2);
@@ -261,7 +236,7 @@ int main()
 
 		try
 		{
-			writer.write(image.data, progressCallback);
+			writer.write(image.data(), progressCallback);
 		}
 		catch (fsi::Exception& e)
 		{
@@ -0,0 +1,142 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+// Compares the image data of two FSI files. Exit code 0 when identical, 1 when they differ and 2 on
+// errors, so it can be used from scripts like cmp.
+
+#include "../../modules/core/compare.h"
+#include "../../modules/core/Exception.h"
+#include "../../modules/global.h"
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+void printUsage()
+{
+	std::cout <<
+		"Usage: fsi_compare <a.fsi> <b.fsi> [options]\n"
+		"  --exact             Only check whether the data is identical (stops at the first difference)\n"
+		"  --tolerance <v>     Differences up to v don't count as differing pixels (default: 0)\n"
+		"  --tile-size <n>     Build a map of differing tiles of n x n pixels\n"
+		"  --tile-map <file>   Write the tile map as a PGM image (requires --tile-size)\n"
+		"  --quiet             Print nothing, only set the exit code\n";
+}
+
+bool writeTileMap(const std::string& path, const fsi::CompareResult& result)
+{
+	std::ofstream file(path, std::ios::binary);
+	file << "P5\n" << result.tilesX << " " << result.tilesY << "\n255\n";
+
+	std::vector<uint8_t> pixels(result.differingTiles.size());
+	std::transform(result.differingTiles.begin(), result.differingTiles.end(), pixels.begin(),
+		[](uint8_t differs) { return static_cast<uint8_t>(differs ? 255 : 0); });
+	file.write(reinterpret_cast<const char*>(pixels.data()), static_cast<std::streamsize>(pixels.size()));
+
+	return static_cast<bool>(file);
+}
+
+int main(int argc, char** argv)
+{
+	fsi::CompareOptions options;
+	std::vector<std::string> paths;
+	std::string tileMapPath;
+	bool quiet = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		const std::string arg = argv[i];
+		const bool hasValue = i + 1 < argc;
+
+		if (arg == "--help" || arg == "-h")
+		{
+			printUsage();
+			return 0;
+		}
+		else if (arg == "--exact")
+			options.exactOnly = true;
+		else if (arg == "--quiet")
+			quiet = true;
+		else if (arg == "--tolerance" && hasValue)
+			options.tolerance = std::stod(argv[++i]);
+		else if (arg == "--tile-size" && hasValue)
+			options.tileSize = static_cast<uint32_t>(std::stoul(argv[++i]));
+		else if (arg == "--tile-map" && hasValue)
+			tileMapPath = argv[++i];
+		else if (arg.rfind("--", 0) == 0)
+		{
+			std::cerr << "Unknown option or missing value: " << arg << "\n";
+			printUsage();
+			return 2;
+		}
+		else
+			paths.push_back(arg);
+	}
+
+	if (paths.size() != 2)
+	{
+		printUsage();
+		return 2;
+	}
+
+	fsi::CompareResult result;
+	try
+	{
+		result = fsi::compare(paths[0], paths[1], options);
+	}
+	catch (const fsi::Exception& e)
+	{
+		std::cerr << e << "\n";
+		return 2;
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << "\n";
+		return 2;
+	}
+
+	if (!result.headersMatch)
+	{
+		if (!quiet)
+			std::cout << "Different: the dimensions, channels or depth don't match\n";
+		return 1;
+	}
+
+	if (!quiet)
+	{
+		std::cout << (result.identical ? "Identical" : "Different") << "\n";
+
+		if (!options.exactOnly && !result.identical)
+		{
+			std::cout << "Differing pixels: " << result.differingPixels << "\n";
+			for (size_t c = 0; c < result.channels.size(); c++)
+			{
+				const fsi::CompareResult::Channel& channel = result.channels[c];
+				std::cout << "Channel " << c << ": max abs diff " << channel.maxAbsDiff
+					<< ", RMSE " << channel.rmse << ", PSNR " << channel.psnr << " dB\n";
+			}
+
+			if (result.tileSize > 0)
+			{
+				const uint64_t differingTiles = std::count(result.differingTiles.begin(),
+					result.differingTiles.end(), 1);
+				std::cout << "Differing tiles: " << differingTiles << " of " << result.differingTiles.size()
+					<< " (" << result.tileSize << " px)\n";
+			}
+		}
+	}
+
+	if (!tileMapPath.empty() && result.tileSize > 0 && !writeTileMap(tileMapPath, result))
+	{
+		std::cerr << "Could not write " << tileMapPath << "\n";
+		return 2;
+	}
+
+	return result.identical ? 0 : 1;
+}
\ No newline at end of file
@@ -0,0 +1,164 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+// Assembles many FSI files into one, either as a grid or from a placement list, without holding the
+// output image in memory.
+
+#include "../../modules/core/mosaic.h"
+#include "../../modules/core/Exception.h"
+#include "../../modules/global.h"
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+
+void printUsage()
+{
+	std::cout <<
+		"Usage: fsi_mosaic <out.fsi> --grid <columns> <tile.fsi>...\n"
+		"       fsi_mosaic <out.fsi> --placements <list.txt>\n"
+		"  --grid <columns>      Lay out the tiles row-major in a grid of <columns> columns\n"
+		"  --placements <file>   One tile per line: <path> <x> <y>. Later tiles are drawn on top\n"
+		"  --size <w> <h>        Output size (default: bounding box of the tiles)\n"
+		"  --band-height <n>     Output rows per band\n"
+		"  --v1                  Write a V1 file\n"
+		"  --no-thumbnail        Don't generate the thumbnail\n";
+}
+
+// Removes and returns the last whitespace separated word of line
+std::string popWord(std::string& line)
+{
+	line.erase(line.find_last_not_of(" \t\r") + 1);
+	const size_t space = line.find_last_of(" \t");
+	const std::string word = line.substr(space == std::string::npos ? 0 : space + 1);
+	line.erase(space == std::string::npos ? 0 : space);
+	return word;
+}
+
+bool readPlacements(const std::string& path, fsi::MosaicLayout& layout)
+{
+	std::ifstream file(path);
+	if (!file)
+		return false;
+
+	std::string line;
+	while (std::getline(file, line))
+	{
+		if (line.find_first_not_of(" \t\r") == std::string::npos || line[0] == '#')
+			continue;
+
+		// x and y are taken from the end, so the path may contain spaces
+		fsi::MosaicTile tile;
+		try
+		{
+			tile.y = std::stoll(popWord(line));
+			tile.x = std::stoll(popWord(line));
+		}
+		catch (const std::exception&)
+		{
+			return false;
+		}
+
+		line.erase(line.find_last_not_of(" \t") + 1);
+		line.erase(0, line.find_first_not_of(" \t"));
+		if (line.empty())
+			return false;
+
+		tile.path = line;
+		layout.tiles.push_back(tile);
+	}
+
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	fsi::MosaicOptions options;
+	fsi::MosaicLayout layout;
+	std::string outPath;
+	std::string placementsPath;
+	std::vector<std::filesystem::path> gridPaths;
+	uint32_t columns = 0;
+	uint32_t width = 0;
+	uint32_t height = 0;
+
+	for (int i = 1; i < argc; i++)
+	{
+		const std::string arg = argv[i];
+		const bool hasValue = i + 1 < argc;
+
+		if (arg == "--help" || arg == "-h")
+		{
+			printUsage();
+			return 0;
+		}
+		else if (arg == "--grid" && hasValue)
+			columns = static_cast<uint32_t>(std::stoul(argv[++i]));
+		else if (arg == "--placements" && hasValue)
+			placementsPath = argv[++i];
+		else if (arg == "--size" && i + 2 < argc)
+		{
+			width = static_cast<uint32_t>(std::stoul(argv[++i]));
+			height = static_cast<uint32_t>(std::stoul(argv[++i]));
+		}
+		else if (arg == "--band-height" && hasValue)
+			options.bandHeight = static_cast<uint32_t>(std::stoul(argv[++i]));
+		else if (arg == "--v1")
+			options.formatVersion = fsi::FormatVersion::V1;
+		else if (arg == "--no-thumbnail")
+			options.thumbnail = false;
+		else if (arg.rfind("--", 0) == 0)
+		{
+			std::cerr << "Unknown option or missing value: " << arg << "\n";
+			printUsage();
+			return 1;
+		}
+		else if (outPath.empty())
+			outPath = arg;
+		else
+			gridPaths.push_back(arg);
+	}
+
+	if (outPath.empty() || (columns == 0) == placementsPath.empty())
+	{
+		printUsage();
+		return 1;
+	}
+
+	try
+	{
+		if (columns > 0)
+			layout = fsi::gridLayout(gridPaths, columns);
+		else if (!readPlacements(placementsPath, layout))
+		{
+			std::cerr << "Could not read the placements in " << placementsPath << "\n";
+			return 1;
+		}
+
+		if (width > 0 && height > 0)
+		{
+			layout.width = width;
+			layout.height = height;
+		}
+
+		fsi::mosaic(layout, outPath, options);
+	}
+	catch (const fsi::Exception& e)
+	{
+		std::cerr << e << "\n";
+		return 1;
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << "\n";
+		return 1;
+	}
+
+	std::cout << "Wrote " << layout.tiles.size() << " tiles to " << outPath << "\n";
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,99 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+// Keeps FSI files open and serves their headers, rects and thumbnails to local processes through
+// fsi::TileClient, until interrupted.
+
+#include "../../modules/core/TileServer.h"
+#include "../../modules/core/Exception.h"
+#include "../../modules/global.h"
+
+#include <csignal>
+#include <iostream>
+#include <string>
+
+fsi::TileServer* server = nullptr;
+
+void printUsage()
+{
+	std::cout <<
+		"Usage: fsi-served <socket> [options]\n"
+		"  --workers <n>           Requests served at the same time (default: hardware threads)\n"
+		"  --max-files <n>         Files kept open (default: 64)\n"
+		"  --readers-per-file <n>  Parallel readers kept open per file (default: 4)\n";
+}
+
+extern "C" void onSignal(int)
+{
+	if (server)
+		server->stop();
+}
+
+int main(int argc, char** argv)
+{
+	fsi::TileServerOptions options;
+	std::string socketPath;
+
+	for (int i = 1; i < argc; i++)
+	{
+		const std::string arg = argv[i];
+		const bool hasValue = i + 1 < argc;
+
+		if (arg == "--help" || arg == "-h")
+		{
+			printUsage();
+			return 0;
+		}
+		else if (arg == "--workers" && hasValue)
+			options.workers = static_cast<uint32_t>(std::stoul(argv[++i]));
+		else if (arg == "--max-files" && hasValue)
+			options.maxOpenFiles = static_cast<uint32_t>(std::stoul(argv[++i]));
+		else if (arg == "--readers-per-file" && hasValue)
+			options.readersPerFile = static_cast<uint32_t>(std::stoul(argv[++i]));
+		else if (arg.rfind("--", 0) == 0)
+		{
+			std::cerr << "Unknown option or missing value: " << arg << "\n";
+			printUsage();
+			return 1;
+		}
+		else if (socketPath.empty())
+			socketPath = arg;
+	}
+
+	if (socketPath.empty())
+	{
+		printUsage();
+		return 1;
+	}
+
+	try
+	{
+		fsi::TileServer tileServer(socketPath, options);
+		server = &tileServer;
+		std::signal(SIGINT, onSignal);
+		std::signal(SIGTERM, onSignal);
+
+		std::cout << "Serving on " << socketPath << "\n";
+		tileServer.run();
+
+		std::signal(SIGINT, SIG_DFL);
+		std::signal(SIGTERM, SIG_DFL);
+		server = nullptr;
+	}
+	catch (const fsi::Exception& e)
+	{
+		std::cerr << e << "\n";
+		return 1;
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << "\n";
+		return 1;
+	}
+
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,428 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+// Replays an access trace written by fsi::AccessTraceRecorder against an FSI file. The file doesn't
+// need to be the one the trace was recorded on; events that fall outside of it are skipped.
+
+#include "../../modules/core/AccessTrace.h"
+#include "../../modules/core/Depth.hpp"
+#include "../../modules/core/Exception.h"
+#include "../../modules/core/Reader.h"
+#include "../../modules/core/Timer.h"
+#include "../../modules/global.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <algorithm>
+#include <exception>
+
+struct Options
+{
+	std::filesystem::path tracePath;
+	std::filesystem::path imagePath;
+	uint32_t threads = 1;
+	bool originalTiming = false;
+	double speed = 1.0;
+	bool dump = false;
+	std::string sharedCache;
+	fsi::ReadOptions readOptions;
+};
+
+struct Stats
+{
+	std::vector<uint64_t> latenciesUs;
+	uint64_t bytes = 0;
+	uint64_t failed = 0;
+	uint64_t skipped = 0;
+	uint64_t cacheHits = 0;
+	uint64_t cacheMisses = 0;
+};
+
+uint64_t percentile(const std::vector<uint64_t>& sorted, double p)
+{
+	if (sorted.empty())
+		return 0;
+
+	const size_t index = static_cast<size_t>(p * static_cast<double>(sorted.size() - 1) + 0.5);
+	return sorted[std::min(index, sorted.size() - 1)];
+}
+
+void printLatencies(const std::string& label, std::vector<uint64_t> latencies)
+{
+	std::sort(latencies.begin(), latencies.end());
+	std::cout << label << " latency (us): "
+		<< "min " << (latencies.empty() ? 0 : latencies.front())
+		<< ", p50 " << percentile(latencies, 0.50)
+		<< ", p90 " << percentile(latencies, 0.90)
+		<< ", p99 " << percentile(latencies, 0.99)
+		<< ", max " << (latencies.empty() ? 0 : latencies.back()) << "\n";
+}
+
+uint32_t blockFormatNumber(fsi::BlockFormat format)
+{
+	switch (format)
+	{
+	case fsi::BlockFormat::BC1: return 1;
+	case fsi::BlockFormat::BC4: return 4;
+	case fsi::BlockFormat::BC5: return 5;
+	case fsi::BlockFormat::BC7: return 7;
+	}
+	return 0;
+}
+
+std::string opName(fsi::AccessTraceEvent::Op op)
+{
+	switch (op)
+	{
+	case fsi::AccessTraceEvent::Op::Read: return "read";
+	case fsi::AccessTraceEvent::Op::ReadRect: return "readRect";
+	case fsi::AccessTraceEvent::Op::ReadRectScaled: return "readRectScaled";
+	case fsi::AccessTraceEvent::Op::ReadCompressed: return "readCompressed";
+	}
+	return "unknown";
+}
+
+void dumpTrace(const fsi::AccessTrace& trace)
+{
+	std::cout << "# image " << trace.header.width << "x" << trace.header.height << "x"
+		<< trace.header.channels << " " << trace.header.depth << "\n";
+	std::cout << "# op timestamp_us latency_us bytes x y width height success [factor filter | format]\n";
+
+	for (const fsi::AccessTraceEvent& event : trace.events)
+	{
+		std::cout << opName(event.op) << " "
+			<< event.timestampUs << " " << event.latencyUs << " " << event.bytes << " "
+			<< event.x << " " << event.y << " " << event.width << " " << event.height << " "
+			<< event.success;
+		if (event.op == fsi::AccessTraceEvent::Op::ReadRectScaled)
+			std::cout << " " << event.factor << " "
+				<< (event.filter == fsi::ScaleFilter::Nearest ? "nearest" : "box");
+		else if (event.op == fsi::AccessTraceEvent::Op::ReadCompressed)
+			std::cout << " bc" << blockFormatNumber(event.format);
+		std::cout << "\n";
+	}
+}
+
+// Each worker owns a Reader, since a Reader must not be used from several threads. The events are
+// taken in trace order from a shared counter. Events that throw count as failed; a worker that can't
+// start stops the others and its exception is rethrown once they have all been joined.
+void replay(const Options& options, const fsi::AccessTrace& trace, Stats& total)
+{
+	fsi::Header header;
+	{
+		fsi::Reader reader;
+		reader.open(options.imagePath, options.readOptions);
+		header = reader.header();
+	}
+
+	const uint64_t pixelBytes = static_cast<uint64_t>(header.channels) * fsi::sizeOfDepth(header.depth);
+	const uint64_t imageBytes = static_cast<uint64_t>(header.width) * header.height * pixelBytes;
+
+	// Rects are read into a buffer of the largest one, read() into a whole image allocated on demand.
+	// A scaled rect is smaller than its source rect, the blocks of a small rect can be larger.
+	uint64_t rectBytes = 0;
+	for (const fsi::AccessTraceEvent& event : trace.events)
+	{
+		if (event.op == fsi::AccessTraceEvent::Op::ReadCompressed)
+			rectBytes = std::max(rectBytes, fsi::compressedSizeInBytes(event.width, event.height, event.format));
+		else if (event.op != fsi::AccessTraceEvent::Op::Read)
+			rectBytes = std::max(rectBytes, static_cast<uint64_t>(event.width) * event.height * pixelBytes);
+	}
+
+	// One cache for the workers, and for other replays with the same name
+	std::shared_ptr<fsi::SharedBlockCache> cache;
+	if (!options.sharedCache.empty())
+		cache = std::make_shared<fsi::SharedBlockCache>(options.sharedCache);
+
+	std::atomic<size_t> next = 0;
+	std::mutex statsMutex;
+	std::exception_ptr error;
+	const auto start = std::chrono::steady_clock::now();
+
+	auto run = [&]()
+	{
+		Stats stats;
+		std::vector<uint8_t> buffer(std::min(rectBytes,
+			std::max(imageBytes, fsi::compressedSizeInBytes(header.width, header.height, fsi::BlockFormat::BC7))));
+		std::vector<uint8_t> imageBuffer;
+
+		fsi::Reader reader;
+		reader.setBlockCache(cache);
+		reader.open(options.imagePath, options.readOptions);
+
+		fsi::Timer timer;
+
+		for (;;)
+		{
+			const size_t index = next.fetch_add(1);
+			if (index >= trace.events.size())
+				break;
+
+			const fsi::AccessTraceEvent& event = trace.events[index];
+
+			const bool fits = event.width > 0 && event.height > 0
+				&& static_cast<uint64_t>(event.x) + event.width <= header.width
+				&& static_cast<uint64_t>(event.y) + event.height <= header.height;
+			const bool unknown = event.op > fsi::AccessTraceEvent::Op::ReadCompressed
+				|| (event.op == fsi::AccessTraceEvent::Op::ReadRectScaled && event.factor == 0);
+			if (unknown || (event.op != fsi::AccessTraceEvent::Op::Read && !fits))
+			{
+				stats.skipped++;
+				continue;
+			}
+
+			if (options.originalTiming)
+			{
+				const auto due = start + std::chrono::microseconds(
+					static_cast<uint64_t>(static_cast<double>(event.timestampUs) / options.speed));
+				std::this_thread::sleep_until(due);
+			}
+
+			timer.start();
+
+			bool success = false;
+			uint64_t bytes = 0;
+			try
+			{
+				if (event.op == fsi::AccessTraceEvent::Op::Read)
+				{
+					imageBuffer.resize(imageBytes);
+
+					// read() is one-shot, so it gets a fresh Reader
+					fsi::Reader fullReader;
+					fullReader.open(options.imagePath, options.readOptions);
+					success = !fullReader.read(imageBuffer.data()); // Returns true when canceled
+					bytes = imageBytes;
+				}
+				else if (event.op == fsi::AccessTraceEvent::Op::ReadRectScaled)
+				{
+					success = reader.readRectScaled(buffer.data(), event.x, event.y, event.width, event.height,
+						event.factor, event.filter);
+					bytes = static_cast<uint64_t>(fsi::scaledExtent(event.width, event.factor))
+						* fsi::scaledExtent(event.height, event.factor) * pixelBytes;
+				}
+				else if (event.op == fsi::AccessTraceEvent::Op::ReadCompressed)
+				{
+					success = reader.readCompressed(buffer.data(), event.x, event.y, event.width, event.height,
+						event.format);
+					bytes = fsi::compressedSizeInBytes(event.width, event.height, event.format);
+				}
+				else
+				{
+					success = reader.readRect(buffer.data(), event.x, event.y, event.width, event.height);
+					bytes = static_cast<uint64_t>(event.width) * event.height * pixelBytes;
+				}
+			}
+			catch (...)
+			{
+				success = false;
+			}
+
+			stats.latenciesUs.push_back(timer.elapsedUs());
+			if (success)
+				stats.bytes += bytes;
+			else
+				stats.failed++;
+		}
+
+		std::lock_guard<std::mutex> lock(statsMutex);
+		total.cacheHits += reader.ioStats().cacheHits;
+		total.cacheMisses += reader.ioStats().cacheMisses;
+		total.latenciesUs.insert(total.latenciesUs.end(), stats.latenciesUs.begin(), stats.latenciesUs.end());
+		total.bytes += stats.bytes;
+		total.failed += stats.failed;
+		total.skipped += stats.skipped;
+	};
+
+	auto work = [&]()
+	{
+		try
+		{
+			run();
+		}
+		catch (...)
+		{
+			next = trace.events.size();
+
+			std::lock_guard<std::mutex> lock(statsMutex);
+			if (!error)
+				error = std::current_exception();
+		}
+	};
+
+	std::vector<std::thread> workers;
+	bool started = true;
+	try
+	{
+		for (uint32_t i = 1; i < options.threads; i++)
+			workers.emplace_back(work);
+	}
+	catch (...)
+	{
+		next = trace.events.size();
+		started = false;
+
+		std::lock_guard<std::mutex> lock(statsMutex);
+		error = std::current_exception();
+	}
+
+	if (started)
+		work();
+
+	for (std::thread& worker : workers)
+		worker.join();
+
+	if (error)
+		std::rethrow_exception(error);
+}
+
+void printUsage()
+{
+	std::cout <<
+		"Usage: fsi_trace_replay <trace> [image.fsi] [options]\n"
+		"  --threads <n>      Concurrent readers (default: 1)\n"
+		"  --timing <mode>    fast: issue the events back to back (default)\n"
+		"                     original: keep the recorded inter-arrival times\n"
+		"  --speed <factor>   Speeds up the original timing (default: 1.0)\n"
+		"  --shared-cache <name>\n"
+		"                     Read through the shared block cache <name>\n"
+		"  --backend <name>   stream (default) or positional\n"
+		"  --direct           Bypass the page cache (O_DIRECT), positional backend only\n"
+		"  --chunk-size <n>   Bytes per read request (default: " << fsi::defaultBufferSize << ")\n"
+		"  --io-threads <n>   Chunks read at the same time by the positional backend, 0 for every\n"
+		"                     worker (default: 1)\n"
+		"  --storage-profile  Take the I/O settings not given above from the storage profile of the\n"
+		"                     image (.fsi-io-profile) instead of the defaults\n"
+		"  --dump             Print the events of the trace instead of replaying it\n";
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	std::vector<std::string> positional;
+
+	// The replay measures the settings given on the command line, not the ones of a profile
+	options.readOptions.useStorageProfile = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		const std::string arg = argv[i];
+		const bool hasValue = i + 1 < argc;
+
+		if (arg == "--help" || arg == "-h")
+		{
+			printUsage();
+			return 0;
+		}
+		else if (arg == "--dump")
+			options.dump = true;
+		else if (arg == "--threads" && hasValue)
+			options.threads = std::max(1u, static_cast<uint32_t>(std::stoul(argv[++i])));
+		else if (arg == "--timing" && hasValue)
+			options.originalTiming = std::string(argv[++i]) == "original";
+		else if (arg == "--shared-cache" && hasValue)
+			options.sharedCache = argv[++i];
+		else if (arg == "--speed" && hasValue)
+			options.speed = std::max(0.001, std::stod(argv[++i]));
+		else if (arg == "--backend" && hasValue)
+		{
+			const std::string backend = argv[++i];
+			if (backend == "stream")
+				options.readOptions.backend = fsi::IoBackend::Stream;
+			else if (backend == "positional")
+				options.readOptions.backend = fsi::IoBackend::Positional;
+			else
+			{
+				std::cerr << "Unknown backend: " << backend << "\n";
+				printUsage();
+				return 1;
+			}
+		}
+		else if (arg == "--direct")
+			options.readOptions.directIo = true;
+		else if (arg == "--chunk-size" && hasValue)
+			options.readOptions.chunkSize = std::max<uint64_t>(1, std::stoull(argv[++i]));
+		else if (arg == "--io-threads" && hasValue)
+			options.readOptions.threads = static_cast<uint32_t>(std::stoul(argv[++i]));
+		else if (arg == "--storage-profile")
+			options.readOptions.useStorageProfile = true;
+		else if (arg.rfind("--", 0) == 0)
+		{
+			std::cerr << "Unknown option or missing value: " << arg << "\n";
+			printUsage();
+			return 1;
+		}
+		else
+			positional.push_back(arg);
+	}
+
+	if (positional.empty() || (!options.dump && positional.size() < 2))
+	{
+		printUsage();
+		return 1;
+	}
+
+	options.tracePath = positional[0];
+	if (positional.size() > 1)
+		options.imagePath = positional[1];
+
+	try
+	{
+		const fsi::AccessTrace trace = fsi::AccessTrace::load(options.tracePath);
+
+		if (options.dump)
+		{
+			dumpTrace(trace);
+			return 0;
+		}
+
+		Stats stats;
+		fsi::Timer timer;
+		timer.start();
+		replay(options, trace, stats);
+		const uint64_t elapsedUs = timer.elapsedUs();
+
+		std::vector<uint64_t> recorded;
+		for (const fsi::AccessTraceEvent& event : trace.events)
+			recorded.push_back(event.latencyUs);
+
+		const double seconds = static_cast<double>(elapsedUs) / 1e6;
+		std::cout << "Events: " << trace.events.size() << " (skipped " << stats.skipped
+			<< ", failed " << stats.failed << ")\n";
+		std::cout << "Threads: " << options.threads << ", timing: "
+			<< (options.originalTiming ? "original" : "fast") << "\n";
+		std::cout << "I/O: "
+			<< (options.readOptions.backend == fsi::IoBackend::Positional ? "positional" : "stream")
+			<< ", chunk " << options.readOptions.chunkSize << " bytes, io threads " << options.readOptions.threads
+			<< (options.readOptions.directIo ? ", direct" : "")
+			<< (options.readOptions.useStorageProfile ? ", storage profile" : "") << "\n";
+		std::cout << "Elapsed: " << seconds << " s, "
+			<< (seconds > 0 ? static_cast<double>(stats.bytes) / (1024.0*1024.0) / seconds : 0.0)
+			<< " MB/s\n";
+		if (!options.sharedCache.empty())
+			std::cout << "Cache: " << stats.cacheHits << " block hits, " << stats.cacheMisses << " misses\n";
+		printLatencies("Recorded", recorded);
+		printLatencies("Replayed", stats.latenciesUs);
+	}
+	catch (const fsi::Exception& e)
+	{
+		std::cerr << e << "\n";
+		return 1;
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << "\n";
+		return 1;
+	}
+
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,111 @@
+// © 2023 Friendly Shade, Inc.
+// © 2023 Sebastian Zapata
+//
+// This file is part of FSI.
+// FSI is licensed under The MIT License. If a copy of The MIT License was not distributed with this
+// file, you can obtain one at https://opensource.org/license/mit.
+
+// Measures the storage of a directory and writes the I/O profile that Reader and Writer pick up for
+// the files below it.
+
+#include "../../modules/core/tuning.h"
+#include "../../modules/core/Exception.h"
+#include "../../modules/global.h"
+
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+void printUsage()
+{
+	std::cout <<
+		"Usage: fsi_tune <directory> [options]\n"
+		"  --size <MB>      Size of the probe file (default: 256)\n"
+		"  --no-direct      Don't try direct I/O\n"
+		"  --dry-run        Print the results without writing " << fsi::ioProfileFileName << "\n";
+}
+
+void printOptions(const char* name, fsi::IoBackend backend, uint64_t chunkSize, uint32_t threads,
+	bool directIo, double bytesPerSecond)
+{
+	std::cout << std::left << std::setw(6) << name
+		<< std::setw(11) << (backend == fsi::IoBackend::Positional ? "positional" : "stream")
+		<< std::right << std::setw(6) << chunkSize / 1024 << " KB"
+		<< std::setw(4) << threads << " threads"
+		<< (directIo ? "  direct" : "        ")
+		<< std::setw(10) << std::fixed << std::setprecision(1) << bytesPerSecond / (1024.0 * 1024.0) << " MB/s\n";
+}
+
+int main(int argc, char** argv)
+{
+	fsi::ProbeOptions options;
+	std::string directory;
+	bool dryRun = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		const std::string arg = argv[i];
+		const bool hasValue = i + 1 < argc;
+
+		if (arg == "--help" || arg == "-h")
+		{
+			printUsage();
+			return 0;
+		}
+		else if (arg == "--size" && hasValue)
+			options.fileSize = std::stoull(argv[++i]) * 1024 * 1024;
+		else if (arg == "--no-direct")
+			options.testDirectIo = false;
+		else if (arg == "--dry-run")
+			dryRun = true;
+		else if (arg.rfind("--", 0) == 0)
+		{
+			std::cerr << "Unknown option or missing value: " << arg << "\n";
+			printUsage();
+			return 1;
+		}
+		else if (directory.empty())
+			directory = arg;
+	}
+
+	if (directory.empty())
+	{
+		printUsage();
+		return 1;
+	}
+
+	try
+	{
+		options.onMeasurement = [](const fsi::IoMeasurement& m)
+		{
+			printOptions(m.write ? "write" : "read", m.backend, m.chunkSize, m.threads, m.directIo, m.bytesPerSecond);
+		};
+
+		const fsi::IoProfile profile = fsi::probeStorage(directory, options);
+
+		std::cout << "\nBest:\n";
+		printOptions("read", profile.read.backend, profile.read.chunkSize, profile.read.threads,
+			profile.read.directIo, profile.readBytesPerSecond);
+		printOptions("write", profile.write.backend, profile.write.chunkSize, profile.write.threads,
+			profile.write.directIo, profile.writeBytesPerSecond);
+
+		if (!dryRun)
+		{
+			const std::filesystem::path path = std::filesystem::path(directory) / fsi::ioProfileFileName;
+			fsi::saveIoProfile(profile, path);
+			std::cout << "\nWrote " << path.string() << "\n";
+		}
+	}
+	catch (const fsi::Exception& e)
+	{
+		std::cerr << e << "\n";
+		return 1;
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << "\n";
+		return 1;
+	}
+
+	return 0;
+}
\ No newline at end of file